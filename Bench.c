@@ -0,0 +1,1074 @@
+/** @file Bench.c
+* @author  Yair Escott <yair.95@gmail.com>
+*
+* @brief measuring the throughput and the latency of the tree's operations. for every key type,
+* access pattern and size, the items are inserted, looked up, visited, visited by ranges and
+* deleted, and every operation gets a row of ops/sec and p50/p99/p999 latency, as CSV or JSON.
+* built with RB_BENCH_BASELINE it uses only the API of the school solution, so it can be linked
+* with RBTreeSchool.a to compare against it.
+*/
+
+// ------------------------------ includes ------------------------------
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "RBTree.h"
+#ifndef RB_BENCH_BASELINE
+#include "Structs.h"
+#include "TypedRBTree.h"
+#endif
+
+// -------------------------- const definitions -------------------------
+
+#ifdef RB_BENCH_BASELINE
+#define BENCH_IMPL "school"
+#else
+#define BENCH_IMPL "RBTree"
+#endif
+
+// the sizes, key types and patterns measured when none are given
+#define DEFAULT_SIZES "1000,10000,100000,1000000"
+#define DEFAULT_KEYS "int,string,vector,typed"
+#define DEFAULT_PATTERNS "sequential,random,zipf"
+#define DEFAULT_OPS "insert,lookup,forEach,range,delete"
+#define DEFAULT_SEED 1
+
+// the number of items a range query visits
+#define RANGE_WIDTH 100
+
+// the least number of range queries and of full traversals measured per size
+#define MIN_RANGE_QUERIES 100
+#define MIN_TRAVERSALS 5
+
+// traversals are repeated until about this many items were visited
+#define TRAVERSAL_ITEMS 1000000
+
+// the skew of the Zipfian pattern (as in YCSB)
+#define ZIPF_THETA 0.99
+
+// the digits of a string key, zero padded so that the strings sort like the numbers
+#define STRING_KEY_DIGITS 20
+
+// the elements of a Vector key: all but the last are equal, so comparisons scan the vectors
+#define VECTOR_KEY_LENGTH 8
+
+// latencies are counted in buckets of 16 per power of 2 (within 6.25% of the real value)
+#define LATENCY_SUB_BITS 4
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS (64 * LATENCY_SUB_BUCKETS)
+
+// the key types. typed keys are ints in a tree of TypedRBTree.h, which compares them inline
+typedef enum KeyType
+{
+    INT_KEYS,
+    STRING_KEYS,
+    VECTOR_KEYS,
+    TYPED_KEYS,
+    KEY_TYPES
+} KeyType;
+
+// the orders the items are accessed in
+typedef enum Pattern
+{
+    SEQUENTIAL,
+    RANDOM,
+    ZIPF,
+    PATTERNS
+} Pattern;
+
+static const char *const KEY_NAMES[KEY_TYPES] = {"int", "string", "vector", "typed"};
+// the operations. the items are always inserted first, to build the tree
+typedef enum Operation
+{
+    INSERT_OP,
+    LOOKUP_OP,
+    FOREACH_OP,
+    RANGE_OP,
+    DELETE_OP,
+    OPERATIONS
+} Operation;
+
+static const char *const PATTERN_NAMES[PATTERNS] = {"sequential", "random", "zipf"};
+static const char *const OP_NAMES[OPERATIONS] = {"insert", "lookup", "forEach", "range", "delete"};
+
+/*
+ * a histogram of latencies in nanoseconds, with log-linear buckets.
+ */
+typedef struct Histogram
+{
+    long unsigned counts[LATENCY_BUCKETS];
+    long unsigned total;
+} Histogram;
+
+/*
+ * the measurements of one operation: the number of ops, their wall time and their latencies.
+ */
+typedef struct Measure
+{
+    long unsigned ops;
+    uint64_t start;
+    uint64_t nanos;
+    Histogram latency;
+} Measure;
+
+/*
+ * a generator of Zipfian ranks in [0, n), by the method of Gray et al. (as in YCSB), which needs
+ * no table.
+ */
+typedef struct Zipf
+{
+    long unsigned n;
+    double alpha;
+    double zetan;
+    double eta;
+    double half;
+} Zipf;
+
+/*
+ * what to measure, and how to print it.
+ */
+typedef struct Options
+{
+    long unsigned *sizes;
+    int nsizes;
+    int keys[KEY_TYPES];
+    int patterns[PATTERNS];
+    int ops[OPERATIONS];
+    int json;
+    uint64_t seed;
+} Options;
+
+/*
+ * the state of one benchmark: its items (items[i] is the i'th smallest), the order they are
+ * inserted and deleted in, and the generators of its access pattern. lookups, ranges and deletes
+ * are given probes, items of their own set to the keys to look for, as callers would.
+ */
+typedef struct Bench
+{
+    const Options *options;
+    KeyType key;
+    Pattern pattern;
+    long unsigned n;
+    void **items;
+    long unsigned *order;
+    void *probe;
+    void *probeHigh;
+    uint64_t rng;
+    Zipf zipf;
+    int *rows;
+} Bench;
+
+// the next number of a xorshift64* generator
+uint64_t nextRandom(uint64_t *state);
+
+// a uniform number in [0, 1)
+double nextUniform(uint64_t *state);
+
+// the current time of the monotonic clock
+uint64_t nowNanos(void);
+
+// counts a latency
+void recordLatency(Histogram *histogram, uint64_t nanos);
+
+// the latency at a percentile
+uint64_t percentile(const Histogram *histogram, double p);
+
+// prepares a Zipfian generator over n ranks
+void initZipf(Zipf *zipf, long unsigned n);
+
+// the next Zipfian rank
+long unsigned nextZipf(Zipf *zipf, uint64_t *rng);
+
+// the index of the item accessed next by the pattern
+long unsigned nextIndex(Bench *bench, long unsigned i);
+
+// CompFunc for int keys
+int compareInts(const void *a, const void *b);
+
+// CompFunc for string keys
+int compareStrings(const void *a, const void *b);
+
+// allocates an item of a key type
+void *newBenchItem(KeyType key);
+
+// sets the key of an item to the i'th smallest key
+void setBenchItem(KeyType key, void *item, long unsigned i);
+
+// frees an item of a key type
+void freeBenchItem(KeyType key, void *item);
+
+// allocates the items of a benchmark
+int makeItems(Bench *bench);
+
+// frees the items of a benchmark that are not in a tree
+void freeItems(Bench *bench, long unsigned from);
+
+// shuffles the insertion order of a benchmark
+void shuffleOrder(Bench *bench);
+
+// forEach function that counts the items
+int countItem(const void *item, void *count);
+
+// starts measuring an operation
+void startMeasure(Measure *measure);
+
+// prints the row of an operation
+void printMeasure(Bench *bench, const char *op, Measure *measure);
+
+// looks items up by the pattern
+int measureLookups(Bench *bench, const RBTree *tree);
+
+// traverses the tree
+int measureTraversals(Bench *bench, const RBTree *tree);
+
+#ifndef RB_BENCH_BASELINE
+// visits ranges of items
+int measureRanges(Bench *bench, const RBTree *tree);
+#endif
+
+// deletes all the items
+int measureDeletes(Bench *bench, RBTree *tree);
+
+#ifndef RB_BENCH_BASELINE
+// runs the operations of a benchmark on a typed tree of ints
+int runTypedBench(Bench *bench);
+#endif
+
+// runs one benchmark: the operations on one key type, pattern and size
+int runBench(const Options *options, KeyType key, Pattern pattern, long unsigned n, int *rows);
+
+// parses a list of names into flags
+int parseNames(const char *list, const char *const *names, int count, int *flags);
+
+// parses a list of sizes
+int parseSizes(const char *list, Options *options);
+
+// parses the command line
+int parseOptions(int argc, char *argv[], Options *options);
+
+// ------------------------------ functions -----------------------------
+
+/**
+ * @brief the next number of a xorshift64* generator
+ * @param state the state of the generator, not 0
+ * @return the number
+ */
+uint64_t nextRandom(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+/**
+ * @brief a uniform number in [0, 1)
+ * @param state the state of the generator
+ * @return the number
+ */
+double nextUniform(uint64_t *state)
+{
+    return (double)(nextRandom(state) >> 11) / (double)(1ULL << 53);
+}
+
+/**
+ * @brief the current time of the monotonic clock
+ * @return the time in nanoseconds
+ */
+uint64_t nowNanos(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * @brief counts a latency in its bucket. latencies below 16ns have a bucket each, larger ones
+ * share 16 buckets per power of 2
+ * @param histogram the histogram
+ * @param nanos the latency
+ */
+void recordLatency(Histogram *histogram, uint64_t nanos)
+{
+    long unsigned bucket = (long unsigned)nanos;
+    if(nanos >= LATENCY_SUB_BUCKETS)
+    {
+        int exponent = LATENCY_SUB_BITS;
+        while((nanos >> (exponent + 1)) != 0)
+        {
+            exponent++;
+        }
+        bucket = (long unsigned)(exponent - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS +
+                 (long unsigned)((nanos >> (exponent - LATENCY_SUB_BITS)) &
+                                 (LATENCY_SUB_BUCKETS - 1));
+    }
+    histogram->counts[bucket]++;
+    histogram->total++;
+}
+
+/**
+ * @brief the latency at a percentile: the smallest latency of the bucket it falls in
+ * @param histogram the histogram
+ * @param p the percentile, in [0, 1]
+ * @return the latency in nanoseconds, 0 if nothing was counted
+ */
+uint64_t percentile(const Histogram *histogram, double p)
+{
+    long unsigned rank = (long unsigned)ceil(p * (double)histogram->total);
+    long unsigned seen = 0;
+    for(long unsigned bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+    {
+        seen += histogram->counts[bucket];
+        if(seen >= rank && seen > 0)
+        {
+            if(bucket < LATENCY_SUB_BUCKETS)
+            {
+                return bucket;
+            }
+            int exponent = (int)(bucket / LATENCY_SUB_BUCKETS) + LATENCY_SUB_BITS - 1;
+            return (uint64_t)(LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS)
+                   << (exponent - LATENCY_SUB_BITS);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief prepares a Zipfian generator over n ranks. the zeta constant takes O(n) to compute,
+ * once per benchmark
+ * @param zipf the generator
+ * @param n the number of ranks
+ */
+void initZipf(Zipf *zipf, long unsigned n)
+{
+    zipf->n = n;
+    zipf->zetan = 0;
+    for(long unsigned i = 1; i <= n; i++)
+    {
+        zipf->zetan += 1.0 / pow((double)i, ZIPF_THETA);
+    }
+    double zeta2 = 1.0 + 1.0 / pow(2.0, ZIPF_THETA);
+    zipf->alpha = 1.0 / (1.0 - ZIPF_THETA);
+    zipf->eta = (1.0 - pow(2.0 / (double)n, 1.0 - ZIPF_THETA)) / (1.0 - zeta2 / zipf->zetan);
+    zipf->half = 1.0 + pow(0.5, ZIPF_THETA);
+}
+
+/**
+ * @brief the next Zipfian rank: rank 0 is the most likely
+ * @param zipf the generator
+ * @param rng the state of the uniform generator
+ * @return the rank, in [0, n)
+ */
+long unsigned nextZipf(Zipf *zipf, uint64_t *rng)
+{
+    double u = nextUniform(rng);
+    double uz = u * zipf->zetan;
+    if(uz < 1.0 || zipf->n < 2)
+    {
+        return 0;
+    }
+    if(uz < zipf->half)
+    {
+        return 1;
+    }
+    long unsigned rank = (long unsigned)((double)zipf->n *
+                                         pow(zipf->eta * u - zipf->eta + 1.0, zipf->alpha));
+    return (rank < zipf->n) ? rank : zipf->n - 1;
+}
+
+/**
+ * @brief the index of the item accessed next: in ascending order, uniformly at random, or by a
+ * Zipfian rank (the hot ranks are spread over the keys by the shuffled insertion order)
+ * @param bench the benchmark
+ * @param i the number of accesses so far
+ * @return the index of the item
+ */
+long unsigned nextIndex(Bench *bench, long unsigned i)
+{
+    switch(bench->pattern)
+    {
+        case SEQUENTIAL:
+            return i % bench->n;
+        case RANDOM:
+            return (long unsigned)(nextRandom(&bench->rng) % bench->n);
+        default:
+            return bench->order[nextZipf(&bench->zipf, &bench->rng)];
+    }
+}
+
+/**
+ * @brief CompFunc for int keys
+ * @param a pointer to int
+ * @param b pointer to int
+ * @return the order of the ints
+ */
+int compareInts(const void *a, const void *b)
+{
+    int first = *(const int *)a;
+    int second = *(const int *)b;
+    return (first > second) - (first < second);
+}
+
+/**
+ * @brief CompFunc for string keys
+ * @param a char* pointer
+ * @param b char* pointer
+ * @return the lexicographic order of the strings
+ */
+int compareStrings(const void *a, const void *b)
+{
+    return strcmp((const char *)a, (const char *)b);
+}
+
+/**
+ * @brief allocates an item of a key type, with key 0
+ * @param key the key type
+ * @return the item, NULL on failure
+ */
+void *newBenchItem(KeyType key)
+{
+    void *item;
+    if(key == INT_KEYS || key == TYPED_KEYS)
+    {
+        item = malloc(sizeof(int));
+    }
+    else if(key == STRING_KEYS)
+    {
+        item = malloc(STRING_KEY_DIGITS + 1);
+    }
+#ifndef RB_BENCH_BASELINE
+    else
+    {
+        item = newVector(VECTOR_KEY_LENGTH);
+    }
+#else
+    else
+    {
+        item = NULL;
+    }
+#endif
+    if(item != NULL)
+    {
+        setBenchItem(key, item, 0);
+    }
+    return item;
+}
+
+/**
+ * @brief sets the key of an item to the i'th smallest key
+ * @param key the key type
+ * @param item the item
+ * @param i the index of the key
+ */
+void setBenchItem(KeyType key, void *item, long unsigned i)
+{
+    if(key == INT_KEYS || key == TYPED_KEYS)
+    {
+        *(int *)item = (int)i;
+    }
+    else if(key == STRING_KEYS)
+    {
+        snprintf((char *)item, STRING_KEY_DIGITS + 1, "%0*lu", STRING_KEY_DIGITS, i);
+    }
+#ifndef RB_BENCH_BASELINE
+    else
+    {
+        for(int j = 0; j < VECTOR_KEY_LENGTH - 1; j++)
+        {
+            vectorSet((Vector *)item, j, 1.0);
+        }
+        vectorSet((Vector *)item, VECTOR_KEY_LENGTH - 1, (double)i);
+    }
+#endif
+}
+
+/**
+ * @brief frees an item of a key type
+ * @param key the key type
+ * @param item the item (may be NULL)
+ */
+void freeBenchItem(KeyType key, void *item)
+{
+#ifndef RB_BENCH_BASELINE
+    if(key == VECTOR_KEYS && item != NULL)
+    {
+        freeVector(item);
+        return;
+    }
+#endif
+    (void)key;
+    free(item);
+}
+
+/**
+ * @brief allocates the items of a benchmark, items[i] being the i'th smallest, the probes and the
+ * insertion order (ascending for the sequential pattern)
+ * @param bench the benchmark
+ * @return 1 on success, 0 on failure
+ */
+int makeItems(Bench *bench)
+{
+    bench->items = (void **)calloc(bench->n, sizeof(void *));
+    bench->order = (long unsigned *)malloc(bench->n * sizeof(long unsigned));
+    bench->probe = newBenchItem(bench->key);
+    bench->probeHigh = newBenchItem(bench->key);
+    if(bench->items == NULL || bench->order == NULL || bench->probe == NULL ||
+       bench->probeHigh == NULL)
+    {
+        return 0;
+    }
+    for(long unsigned i = 0; i < bench->n; i++)
+    {
+        bench->order[i] = i;
+    }
+    for(long unsigned i = 0; i < bench->n; i++)
+    {
+        bench->items[i] = newBenchItem(bench->key);
+        if(bench->items[i] == NULL)
+        {
+            return 0;
+        }
+        setBenchItem(bench->key, bench->items[i], i);
+    }
+    return 1;
+}
+
+/**
+ * @brief frees the items of a benchmark from an index of the order on (those that are not in the
+ * tree), its probes and its arrays
+ * @param bench the benchmark
+ * @param from the first item to free
+ */
+void freeItems(Bench *bench, long unsigned from)
+{
+    for(long unsigned i = from; bench->items != NULL && bench->order != NULL && i < bench->n; i++)
+    {
+        freeBenchItem(bench->key, bench->items[bench->order[i]]);
+    }
+    freeBenchItem(bench->key, bench->probe);
+    freeBenchItem(bench->key, bench->probeHigh);
+    free(bench->items);
+    free(bench->order);
+}
+
+/**
+ * @brief shuffles the insertion order of a benchmark, unless it is sequential
+ * @param bench the benchmark
+ */
+void shuffleOrder(Bench *bench)
+{
+    if(bench->pattern == SEQUENTIAL)
+    {
+        return;
+    }
+    for(long unsigned i = bench->n - 1; i > 0; i--)
+    {
+        long unsigned j = (long unsigned)(nextRandom(&bench->rng) % (i + 1));
+        long unsigned swap = bench->order[i];
+        bench->order[i] = bench->order[j];
+        bench->order[j] = swap;
+    }
+}
+
+/**
+ * @brief forEach function that counts the items
+ * @param item an item
+ * @param count pointer to the long unsigned count
+ * @return 1
+ */
+int countItem(const void *item, void *count)
+{
+    (void)item;
+    (*(long unsigned *)count)++;
+    return 1;
+}
+
+/**
+ * @brief starts measuring an operation
+ * @param measure the measurements
+ */
+void startMeasure(Measure *measure)
+{
+    memset(measure, 0, sizeof(Measure));
+    measure->start = nowNanos();
+}
+
+/**
+ * @brief prints the row of an operation, as CSV or as an element of a JSON array
+ * @param bench the benchmark
+ * @param op the name of the operation
+ * @param measure its measurements
+ */
+void printMeasure(Bench *bench, const char *op, Measure *measure)
+{
+    measure->nanos = nowNanos() - measure->start;
+    double seconds = (double)measure->nanos / 1e9;
+    double opsPerSec = (seconds > 0) ? (double)measure->ops / seconds : 0;
+    const char *format = bench->options->json ?
+        "%s    {\"impl\": \"%s\", \"key\": \"%s\", \"pattern\": \"%s\", \"n\": %lu, "
+        "\"op\": \"%s\", \"ops\": %lu, \"seconds\": %.6f, \"ops_per_sec\": %.0f, "
+        "\"p50_ns\": %lu, \"p99_ns\": %lu, \"p999_ns\": %lu}" :
+        "%s%s,%s,%s,%lu,%s,%lu,%.6f,%.0f,%lu,%lu,%lu";
+    printf(format, (bench->options->json && *bench->rows > 0) ? ",\n" : "", BENCH_IMPL,
+           KEY_NAMES[bench->key], PATTERN_NAMES[bench->pattern], bench->n, op, measure->ops,
+           seconds, opsPerSec, (long unsigned)percentile(&measure->latency, 0.5),
+           (long unsigned)percentile(&measure->latency, 0.99),
+           (long unsigned)percentile(&measure->latency, 0.999));
+    if(!bench->options->json)
+    {
+        printf("\n");
+    }
+    (*bench->rows)++;
+    fflush(stdout);
+}
+
+/**
+ * @brief looks n items up, picked by the pattern
+ * @param bench the benchmark
+ * @param tree the tree with all the items
+ * @return 1 if all were found, 0 otherwise
+ */
+int measureLookups(Bench *bench, const RBTree *tree)
+{
+    Measure measure;
+    long unsigned found = 0;
+    startMeasure(&measure);
+    for(; measure.ops < bench->n; measure.ops++)
+    {
+        setBenchItem(bench->key, bench->probe, nextIndex(bench, measure.ops));
+        uint64_t before = nowNanos();
+        found += (RBTreeContains(tree, bench->probe) != 0);
+        recordLatency(&measure.latency, nowNanos() - before);
+    }
+    printMeasure(bench, "lookup", &measure);
+    return found == bench->n;
+}
+
+/**
+ * @brief traverses the tree, at least MIN_TRAVERSALS times and about TRAVERSAL_ITEMS items.
+ * throughput is in items visited, latency is per traversal
+ * @param bench the benchmark
+ * @param tree the tree with all the items
+ * @return 1 if all the items were visited, 0 otherwise
+ */
+int measureTraversals(Bench *bench, const RBTree *tree)
+{
+    long unsigned traversals = TRAVERSAL_ITEMS / bench->n;
+    traversals = (traversals < MIN_TRAVERSALS) ? MIN_TRAVERSALS : traversals;
+    Measure measure;
+    startMeasure(&measure);
+    for(long unsigned i = 0; i < traversals; i++)
+    {
+        uint64_t before = nowNanos();
+        forEachRBTree(tree, countItem, &measure.ops);
+        recordLatency(&measure.latency, nowNanos() - before);
+    }
+    printMeasure(bench, "forEach", &measure);
+    return measure.ops == traversals * bench->n;
+}
+
+#ifndef RB_BENCH_BASELINE
+/**
+ * @brief visits ranges of RANGE_WIDTH items that start where the pattern picks
+ * @param bench the benchmark
+ * @param tree the tree with all the items
+ * @return 1
+ */
+int measureRanges(Bench *bench, const RBTree *tree)
+{
+    long unsigned queries = bench->n / RANGE_WIDTH;
+    queries = (queries < MIN_RANGE_QUERIES) ? MIN_RANGE_QUERIES : queries;
+    long unsigned visited = 0;
+    Measure measure;
+    startMeasure(&measure);
+    for(; measure.ops < queries; measure.ops++)
+    {
+        long unsigned lo = nextIndex(bench, measure.ops * RANGE_WIDTH);
+        long unsigned hi = (lo + RANGE_WIDTH <= bench->n) ? lo + RANGE_WIDTH - 1 : bench->n - 1;
+        setBenchItem(bench->key, bench->probe, lo);
+        setBenchItem(bench->key, bench->probeHigh, hi);
+        uint64_t before = nowNanos();
+        forEachRangeRBTree(tree, bench->probe, bench->probeHigh, countItem, &visited);
+        recordLatency(&measure.latency, nowNanos() - before);
+    }
+    printMeasure(bench, "range", &measure);
+    return 1;
+}
+#endif
+
+/**
+ * @brief deletes all the items, in a new random order (in ascending order for the sequential
+ * pattern)
+ * @param bench the benchmark
+ * @param tree the tree with all the items
+ * @return 1 if all were deleted, 0 otherwise
+ */
+int measureDeletes(Bench *bench, RBTree *tree)
+{
+    shuffleOrder(bench);
+    Measure measure;
+    startMeasure(&measure);
+    for(; measure.ops < bench->n; measure.ops++)
+    {
+        setBenchItem(bench->key, bench->probe, bench->order[measure.ops]);
+        uint64_t before = nowNanos();
+        int deleted = deleteFromRBTree(tree, bench->probe);
+        recordLatency(&measure.latency, nowNanos() - before);
+        if(!deleted)
+        {
+            return 0;
+        }
+    }
+    printMeasure(bench, "delete", &measure);
+    return 1;
+}
+
+#ifndef RB_BENCH_BASELINE
+RB_DEFINE_TREE(BenchInts, int, RB_COMPARE_NUMBERS, RB_KEEP_KEY)
+
+/**
+ * @brief runs the operations of a benchmark on a typed tree of ints, in the orders runBench and
+ * its measures use, so the rows compare with those of int keys. a typed tree has no range queries
+ * @param bench the benchmark, with its items made and its order shuffled
+ * @return 1 on success, 0 on failure
+ */
+int runTypedBench(Bench *bench)
+{
+    BenchInts tree;
+    BenchIntsInit(&tree);
+    Measure measure;
+    startMeasure(&measure);
+    for(; measure.ops < bench->n; measure.ops++)
+    {
+        int key = *(int *)bench->items[bench->order[measure.ops]];
+        uint64_t before = nowNanos();
+        int inserted = BenchIntsInsert(&tree, key);
+        recordLatency(&measure.latency, nowNanos() - before);
+        if(!inserted)
+        {
+            BenchIntsClear(&tree);
+            return 0;
+        }
+    }
+    printMeasure(bench, "insert", &measure);
+
+    int result = 1;
+    if(bench->options->ops[LOOKUP_OP])
+    {
+        long unsigned found = 0;
+        startMeasure(&measure);
+        for(; measure.ops < bench->n; measure.ops++)
+        {
+            int key = (int)nextIndex(bench, measure.ops);
+            uint64_t before = nowNanos();
+            found += (BenchIntsContains(&tree, key) != 0);
+            recordLatency(&measure.latency, nowNanos() - before);
+        }
+        printMeasure(bench, "lookup", &measure);
+        result = (found == bench->n);
+    }
+    if(result && bench->options->ops[FOREACH_OP])
+    {
+        long unsigned traversals = TRAVERSAL_ITEMS / bench->n;
+        traversals = (traversals < MIN_TRAVERSALS) ? MIN_TRAVERSALS : traversals;
+        startMeasure(&measure);
+        for(long unsigned i = 0; i < traversals; i++)
+        {
+            uint64_t before = nowNanos();
+            for(BenchIntsNode *node = BenchIntsBegin(&tree); node != NULL;
+                node = BenchIntsNext(node))
+            {
+                measure.ops++;
+            }
+            recordLatency(&measure.latency, nowNanos() - before);
+        }
+        printMeasure(bench, "forEach", &measure);
+        result = (measure.ops == traversals * bench->n);
+    }
+    if(result && bench->options->ops[DELETE_OP])
+    {
+        shuffleOrder(bench);
+        startMeasure(&measure);
+        for(; result && measure.ops < bench->n; measure.ops++)
+        {
+            int key = (int)bench->order[measure.ops];
+            uint64_t before = nowNanos();
+            result = BenchIntsDelete(&tree, key);
+            recordLatency(&measure.latency, nowNanos() - before);
+        }
+        if(result)
+        {
+            printMeasure(bench, "delete", &measure);
+        }
+    }
+    BenchIntsClear(&tree);
+    return result;
+}
+#endif
+
+/**
+ * @brief runs one benchmark: inserts n items in the pattern's order, and then runs the other
+ * operations that were asked for, printing a row per operation. every operation is timed on its
+ * own, so the wall time includes the clock reads
+ * @param options the options
+ * @param key the key type
+ * @param pattern the access pattern
+ * @param n the number of items
+ * @param rows the number of rows printed so far
+ * @return 1 on success, 0 on failure
+ */
+int runBench(const Options *options, KeyType key, Pattern pattern, long unsigned n, int *rows)
+{
+    Bench bench = {options, key, pattern, n, NULL, NULL, NULL, NULL,
+                   (options->seed * 0x9E3779B97F4A7C15ULL) ^ n, {0, 0, 0, 0, 0}, rows};
+    bench.rng |= 1;
+    CompareFunc compare = (key == STRING_KEYS) ? compareStrings : compareInts;
+    FreeFunc freeFunc = free;
+#ifndef RB_BENCH_BASELINE
+    if(key == VECTOR_KEYS)
+    {
+        compare = vectorCompare1By1;
+        freeFunc = freeVector;
+    }
+#endif
+    RBTree *tree = makeItems(&bench) ? newRBTree(compare, freeFunc) : NULL;
+    if(tree == NULL)
+    {
+        fprintf(stderr, "rbtree_bench: out of memory for %lu items\n", n);
+        freeItems(&bench, 0);
+        return 0;
+    }
+    shuffleOrder(&bench);
+    if(pattern == ZIPF)
+    {
+        initZipf(&bench.zipf, n);
+    }
+#ifndef RB_BENCH_BASELINE
+    if(key == TYPED_KEYS)
+    {
+        // the typed tree keeps copies of the keys, so all the items stay with the benchmark
+        freeRBTree(&tree);
+        int result = runTypedBench(&bench);
+        freeItems(&bench, 0);
+        if(!result)
+        {
+            fprintf(stderr, "rbtree_bench: the typed tree lost items (%s, n = %lu)\n",
+                    PATTERN_NAMES[pattern], n);
+        }
+        return result;
+    }
+#endif
+
+    Measure measure;
+    startMeasure(&measure);
+    for(; measure.ops < n; measure.ops++)
+    {
+        uint64_t before = nowNanos();
+        int inserted = insertToRBTree(tree, bench.items[bench.order[measure.ops]]);
+        recordLatency(&measure.latency, nowNanos() - before);
+        if(!inserted)
+        {
+            fprintf(stderr, "rbtree_bench: insert failed\n");
+            freeRBTree(&tree);
+            freeItems(&bench, measure.ops);
+            return 0;
+        }
+    }
+    printMeasure(&bench, "insert", &measure);
+
+    int result = 1;
+    result = result && (!options->ops[LOOKUP_OP] || measureLookups(&bench, tree));
+    result = result && (!options->ops[FOREACH_OP] || measureTraversals(&bench, tree));
+#ifndef RB_BENCH_BASELINE
+    result = result && (!options->ops[RANGE_OP] || measureRanges(&bench, tree));
+#endif
+    result = result && (!options->ops[DELETE_OP] || measureDeletes(&bench, tree));
+    freeRBTree(&tree);
+    freeItems(&bench, n);
+    if(!result)
+    {
+        fprintf(stderr, "rbtree_bench: the tree lost items (%s keys, %s, n = %lu)\n",
+                KEY_NAMES[key], PATTERN_NAMES[pattern], n);
+    }
+    return result;
+}
+
+/**
+ * @brief parses a comma separated list of names into flags
+ * @param list the list
+ * @param names the known names
+ * @param count the number of known names
+ * @param flags set to 1 for the names in the list, 0 for the others
+ * @return 1 on success, 0 if a name is unknown
+ */
+int parseNames(const char *list, const char *const *names, int count, int *flags)
+{
+    memset(flags, 0, count * sizeof(int));
+    while(*list != '\0')
+    {
+        size_t len = strcspn(list, ",");
+        int known = 0;
+        for(int i = 0; i < count; i++)
+        {
+            if(strlen(names[i]) == len && strncmp(list, names[i], len) == 0)
+            {
+                flags[i] = known = 1;
+            }
+        }
+        if(!known)
+        {
+            return 0;
+        }
+        list += len + (list[len] == ',');
+    }
+    return 1;
+}
+
+/**
+ * @brief parses a comma separated list of sizes (a size may end with K or M)
+ * @param list the list
+ * @param options the options to set the sizes of
+ * @return 1 on success, 0 on failure
+ */
+int parseSizes(const char *list, Options *options)
+{
+    free(options->sizes);
+    options->sizes = (long unsigned *)malloc((strlen(list) / 2 + 1) * sizeof(long unsigned));
+    options->nsizes = 0;
+    if(options->sizes == NULL)
+    {
+        return 0;
+    }
+    while(*list != '\0')
+    {
+        char *end;
+        long unsigned size = strtoul(list, &end, 10);
+        if(*end == 'K' || *end == 'M')
+        {
+            size *= (*end == 'K') ? 1000 : 1000000;
+            end++;
+        }
+        if(end == list || size == 0 || (*end != ',' && *end != '\0'))
+        {
+            return 0;
+        }
+        options->sizes[options->nsizes++] = size;
+        list = end + (*end == ',');
+    }
+    return options->nsizes > 0;
+}
+
+/**
+ * @brief parses the command line: --sizes, --keys, --patterns, --ops, --format and --seed
+ * @param argc the number of arguments
+ * @param argv the arguments
+ * @param options the options, set to the defaults first
+ * @return 1 on success, 0 on bad arguments
+ */
+int parseOptions(int argc, char *argv[], Options *options)
+{
+    options->sizes = NULL;
+    options->json = 0;
+    options->seed = DEFAULT_SEED;
+    if(!parseSizes(DEFAULT_SIZES, options) ||
+       !parseNames(DEFAULT_KEYS, KEY_NAMES, KEY_TYPES, options->keys) ||
+       !parseNames(DEFAULT_PATTERNS, PATTERN_NAMES, PATTERNS, options->patterns) ||
+       !parseNames(DEFAULT_OPS, OP_NAMES, OPERATIONS, options->ops))
+    {
+        return 0;
+    }
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        const char *value = argv[i + 1];
+        int parsed = 0;
+        if(strcmp(argv[i], "--sizes") == 0)
+        {
+            parsed = parseSizes(value, options);
+        }
+        else if(strcmp(argv[i], "--keys") == 0)
+        {
+            parsed = parseNames(value, KEY_NAMES, KEY_TYPES, options->keys);
+        }
+        else if(strcmp(argv[i], "--patterns") == 0)
+        {
+            parsed = parseNames(value, PATTERN_NAMES, PATTERNS, options->patterns);
+        }
+        else if(strcmp(argv[i], "--ops") == 0)
+        {
+            parsed = parseNames(value, OP_NAMES, OPERATIONS, options->ops);
+        }
+        else if(strcmp(argv[i], "--format") == 0)
+        {
+            options->json = (strcmp(value, "json") == 0);
+            parsed = options->json || strcmp(value, "csv") == 0;
+        }
+        else if(strcmp(argv[i], "--seed") == 0)
+        {
+            options->seed = strtoull(value, NULL, 10);
+            parsed = 1;
+        }
+        if(!parsed)
+        {
+            return 0;
+        }
+    }
+#ifdef RB_BENCH_BASELINE
+    if(options->keys[VECTOR_KEYS] || options->keys[TYPED_KEYS])
+    {
+        // Vector keys need Structs.c, and typed trees TypedRBTree.h, of this repository's tree
+        fprintf(stderr, "rbtree_bench: vector and typed keys are skipped against the baseline\n");
+        options->keys[VECTOR_KEYS] = options->keys[TYPED_KEYS] = 0;
+    }
+    // the baseline's deleteFromRBTree frees nodes twice, and it has no range queries
+    if(options->ops[DELETE_OP] || options->ops[RANGE_OP])
+    {
+        fprintf(stderr, "rbtree_bench: range and delete are skipped against the baseline\n");
+        options->ops[DELETE_OP] = options->ops[RANGE_OP] = 0;
+    }
+#endif
+    return argc % 2 == 1;
+}
+
+/**
+ * runs the benchmarks the command line asks for, and prints their rows to stdout.
+ * @return EXIT_SUCCESS, or EXIT_FAILURE on bad arguments or a failed benchmark
+ */
+int main(int argc, char *argv[])
+{
+    Options options;
+    if(parseOptions(argc, argv, &options) == 0)
+    {
+        fprintf(stderr, "usage: %s [--sizes 1K,10K,100K,1M,10M,100M] [--keys %s] [--patterns %s] "
+                        "[--ops %s] [--format csv|json] [--seed N]\n", argv[0], DEFAULT_KEYS,
+                DEFAULT_PATTERNS, DEFAULT_OPS);
+        free(options.sizes);
+        return EXIT_FAILURE;
+    }
+    int rows = 0;
+    int result = 1;
+    printf(options.json ? "[\n" :
+           "impl,key,pattern,n,op,ops,seconds,ops_per_sec,p50_ns,p99_ns,p999_ns\n");
+    for(int k = 0; result && k < KEY_TYPES; k++)
+    {
+        for(int p = 0; result && p < PATTERNS; p++)
+        {
+            for(int s = 0; result && s < options.nsizes; s++)
+            {
+                if(options.keys[k] && options.patterns[p])
+                {
+                    result = runBench(&options, (KeyType)k, (Pattern)p, options.sizes[s], &rows);
+                }
+            }
+        }
+    }
+    if(options.json)
+    {
+        printf("\n]\n");
+    }
+    free(options.sizes);
+    return result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,556 @@
+/** @file ConcurrentRBTree.c
+* @author  Yair Escott <yair.95@gmail.com>
+*
+* @brief a red black tree shared between threads, with readers that take no lock
+*/
+
+// ------------------------------ includes ------------------------------
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <sched.h>
+#include "ConcurrentRBTree.h"
+
+// -------------------------- const definitions -------------------------
+
+// a lookup that takes more steps than this is walking through a rotation - it is retried
+#define MAX_READ_STEPS 256
+
+// the number of failed attempts a reader spins for before it yields the processor
+#define SPINS_BEFORE_YIELD 64
+
+/*
+ * the place of a scan in a consistent state of the tree: the nodes of the path from the root at
+ * which the scan went left, so the items that follow the current one (the last of them holds the
+ * next item, next). it is valid as long as the sequence is still the one it was read at.
+ */
+typedef struct ScanPath
+{
+    Node *nodes[MAX_READ_STEPS];
+    int depth;
+    void *next;
+    unsigned long sequence;
+} ScanPath;
+
+// constructs a new concurrent tree
+ConcurrentRBTree *newConcurrentRBTree(CompareFunc compFunc, FreeFunc freeFunc);
+
+// registers a reader
+RBReader *concurrentRBTreeRegisterReader(ConcurrentRBTree *tree);
+
+// gives back a reader
+void concurrentRBTreeUnregisterReader(ConcurrentRBTree *tree, RBReader *reader);
+
+// adds an item to the tree
+int concurrentInsertToRBTree(ConcurrentRBTree *tree, void *data);
+
+// removes an item from the tree
+int concurrentDeleteFromRBTree(ConcurrentRBTree *tree, void *data);
+
+// checks whether the tree contains this item
+int concurrentRBTreeContains(ConcurrentRBTree *tree, RBReader *reader, const void *data);
+
+// activates a function on each item of the tree
+int concurrentForEachRBTree(ConcurrentRBTree *tree, RBReader *reader, forEachFunc func,
+                            void *args);
+
+// gets the statistics of the tree
+int concurrentRBTreeGetStats(ConcurrentRBTree *tree, RBTreeStats *stats);
+
+// frees all memory of the tree
+void freeConcurrentRBTree(ConcurrentRBTree **tree);
+
+// the tree's retireFunc: queues a removed node until no reader can see it
+void retireNode(RBTree *rbTree, Node *node, void *args);
+
+// frees the retired nodes that no reader can see anymore
+void reclaimNodes(ConcurrentRBTree *tree);
+
+// marks the reader as reading
+void enterRead(ConcurrentRBTree *tree, RBReader *reader);
+
+// marks the reader as not reading
+void leaveRead(RBReader *reader);
+
+// starts a write
+void beginWrite(ConcurrentRBTree *tree);
+
+// ends a write
+void endWrite(ConcurrentRBTree *tree);
+
+// finds the item equal to data in a consistent state of the tree
+void *validatedSearch(ConcurrentRBTree *tree, const void *data);
+
+// finds the path to the first item greater than data in a consistent state of the tree
+void findScanPath(ConcurrentRBTree *tree, const void *data, ScanPath *path);
+
+// moves a scan path to the next item, if no writer changed the tree since it was found
+int stepScanPath(ConcurrentRBTree *tree, ScanPath *path);
+
+// ------------------------------ functions -----------------------------
+
+/**
+ * constructs a new concurrent tree.
+ * @param compFunc: a function two compare two items. it is called by readers concurrently.
+ * @param freeFunc: a function to free an item.
+ * @return: the new tree, NULL on failure.
+ */
+ConcurrentRBTree *newConcurrentRBTree(CompareFunc compFunc, FreeFunc freeFunc)
+{
+    ConcurrentRBTree *tree = (ConcurrentRBTree *)malloc(sizeof(ConcurrentRBTree));
+    if(tree == NULL)
+    {
+        return NULL;
+    }
+    tree->tree = newRBTree(compFunc, freeFunc);
+    if(tree->tree == NULL)
+    {
+        free(tree);
+        return NULL;
+    }
+    if(pthread_mutex_init(&tree->writeLock, NULL) != 0)
+    {
+        freeRBTree(&tree->tree);
+        free(tree);
+        return NULL;
+    }
+    tree->tree->retireFunc = retireNode;
+    tree->tree->retireArgs = tree;
+    tree->sequence = 0;
+    // epoch 0 means "not reading"
+    tree->epoch = 1;
+    tree->readers = NULL;
+    tree->retired = NULL;
+    return tree;
+}
+
+/**
+ * register the calling thread as a reader of the tree.
+ * @param tree: the tree.
+ * @return: the reader, NULL on failure.
+ */
+RBReader *concurrentRBTreeRegisterReader(ConcurrentRBTree *tree)
+{
+    if(tree == NULL)
+    {
+        return NULL;
+    }
+    pthread_mutex_lock(&tree->writeLock);
+    RBReader *reader = tree->readers;
+    while(reader != NULL && reader->inUse)
+    {
+        reader = reader->next;
+    }
+    if(reader == NULL)
+    {
+        reader = (RBReader *)malloc(sizeof(RBReader));
+        if(reader == NULL)
+        {
+            pthread_mutex_unlock(&tree->writeLock);
+            return NULL;
+        }
+        reader->epoch = 0;
+        reader->next = tree->readers;
+        tree->readers = reader;
+    }
+    reader->inUse = 1;
+    pthread_mutex_unlock(&tree->writeLock);
+    return reader;
+}
+
+/**
+ * give back a reader, once its thread is done reading.
+ * @param tree: the tree.
+ * @param reader: a reader of the tree that is not inside a read.
+ */
+void concurrentRBTreeUnregisterReader(ConcurrentRBTree *tree, RBReader *reader)
+{
+    if(tree == NULL || reader == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&tree->writeLock);
+    __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+    reader->inUse = 0;
+    pthread_mutex_unlock(&tree->writeLock);
+}
+
+/**
+ * @brief marks the reader as reading. nodes retired from now on are kept until it leaves
+ * @param tree the tree
+ * @param reader the reader
+ */
+void enterRead(ConcurrentRBTree *tree, RBReader *reader)
+{
+    __atomic_store_n(&reader->epoch, __atomic_load_n(&tree->epoch, __ATOMIC_ACQUIRE),
+                     __ATOMIC_RELAXED);
+    // the announcement must be visible before the reader loads any node
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief marks the reader as not reading
+ * @param reader the reader
+ */
+void leaveRead(RBReader *reader)
+{
+    __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief starts a write: takes the write lock and makes the sequence odd
+ * @param tree the tree
+ */
+void beginWrite(ConcurrentRBTree *tree)
+{
+    pthread_mutex_lock(&tree->writeLock);
+    __atomic_store_n(&tree->sequence, tree->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * @brief ends a write: makes the sequence even again, advances the epoch, frees what it can and
+ * releases the write lock
+ * @param tree the tree
+ */
+void endWrite(ConcurrentRBTree *tree)
+{
+    __atomic_store_n(&tree->sequence, tree->sequence + 1, __ATOMIC_RELEASE);
+    if(tree->retired != NULL)
+    {
+        __atomic_store_n(&tree->epoch, tree->epoch + 1, __ATOMIC_RELEASE);
+        reclaimNodes(tree);
+    }
+    pthread_mutex_unlock(&tree->writeLock);
+}
+
+/**
+ * @brief the tree's retireFunc: queues a removed node until no reader can see it. called with the
+ * write lock held
+ * @param rbTree the inner tree
+ * @param node the removed node
+ * @param args the concurrent tree
+ */
+void retireNode(RBTree *rbTree, Node *node, void *args)
+{
+    ConcurrentRBTree *tree = (ConcurrentRBTree *)args;
+    RetiredNode *retired = (RetiredNode *)malloc(sizeof(RetiredNode));
+    if(retired == NULL)
+    {
+        // no room to queue it - wait until every reader that is inside a read has left
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        for(RBReader *reader = tree->readers; reader != NULL; reader = reader->next)
+        {
+            while(__atomic_load_n(&reader->epoch, __ATOMIC_ACQUIRE) != 0)
+            {
+                sched_yield();
+            }
+        }
+        freeRBTreeNode(rbTree, node);
+        return;
+    }
+    retired->node = node;
+    retired->epoch = tree->epoch;
+    retired->next = tree->retired;
+    tree->retired = retired;
+}
+
+/**
+ * @brief frees the retired nodes that no reader can see anymore: those retired before the oldest
+ * epoch a reader is still reading in. called with the write lock held
+ * @param tree the tree
+ */
+void reclaimNodes(ConcurrentRBTree *tree)
+{
+    // the removals must be visible before the readers' epochs are checked
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    unsigned long oldest = tree->epoch;
+    for(RBReader *reader = tree->readers; reader != NULL; reader = reader->next)
+    {
+        unsigned long epoch = __atomic_load_n(&reader->epoch, __ATOMIC_ACQUIRE);
+        if(epoch != 0 && epoch < oldest)
+        {
+            oldest = epoch;
+        }
+    }
+    RetiredNode **link = &tree->retired;
+    while(*link != NULL)
+    {
+        RetiredNode *retired = *link;
+        if(retired->epoch < oldest)
+        {
+            *link = retired->next;
+            freeRBTreeNode(tree->tree, retired->node);
+            free(retired);
+        }
+        else
+        {
+            link = &retired->next;
+        }
+    }
+}
+
+/**
+ * add an item to the tree. writers are serialized.
+ * @param tree: the tree to add an item to.
+ * @param data: item to add to the tree.
+ * @return: 0 on failure, other on success. (if the item is already in the tree - failure).
+ */
+int concurrentInsertToRBTree(ConcurrentRBTree *tree, void *data)
+{
+    if(tree == NULL)
+    {
+        return 0;
+    }
+    beginWrite(tree);
+    int result = insertToRBTree(tree->tree, data);
+    endWrite(tree);
+    return result;
+}
+
+/**
+ * remove an item from the tree. the item is freed once no reader can see it anymore.
+ * @param tree: the tree to remove an item from.
+ * @param data: item to remove from the tree.
+ * @return: 0 on failure, other on success. (if data is not in the tree - failure).
+ */
+int concurrentDeleteFromRBTree(ConcurrentRBTree *tree, void *data)
+{
+    if(tree == NULL)
+    {
+        return 0;
+    }
+    beginWrite(tree);
+    int result = deleteFromRBTree(tree->tree, data);
+    endWrite(tree);
+    return result;
+}
+
+/**
+ * @brief looks data up in a consistent state of the tree, retrying whenever a writer changed the
+ * tree in the middle. the caller must be inside a read
+ * @param tree the tree
+ * @param data the data to look for
+ * @return the item equal to data, NULL if there is none
+ */
+void *validatedSearch(ConcurrentRBTree *tree, const void *data)
+{
+    CompareFunc compFunc = tree->tree->compFunc;
+    for(int attempt = 1; ; attempt++)
+    {
+        if(attempt % SPINS_BEFORE_YIELD == 0)
+        {
+            sched_yield();
+        }
+        unsigned long sequence = __atomic_load_n(&tree->sequence, __ATOMIC_ACQUIRE);
+        if(sequence % 2 == 1)
+        {
+            continue;
+        }
+        void *found = NULL;
+        int steps = 0;
+        Node *node = __atomic_load_n(&tree->tree->root, __ATOMIC_ACQUIRE);
+        while(node != NULL && steps < MAX_READ_STEPS)
+        {
+            steps++;
+            int comp = compFunc(node->data, data);
+            if(comp == 0)
+            {
+                found = node->data;
+                break;
+            }
+            node = (comp > 0) ? __atomic_load_n(&node->left, __ATOMIC_ACQUIRE) :
+                                __atomic_load_n(&node->right, __ATOMIC_ACQUIRE);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(steps < MAX_READ_STEPS &&
+           __atomic_load_n(&tree->sequence, __ATOMIC_RELAXED) == sequence)
+        {
+            return found;
+        }
+    }
+}
+
+/**
+ * @brief finds the path to the first item greater than data in a consistent state of the tree,
+ * retrying whenever a writer changed the tree in the middle. the caller must be inside a read
+ * @param tree the tree
+ * @param data the bound (NULL to find the smallest item)
+ * @param path set to the path, with a depth of 0 if there is no such item
+ */
+void findScanPath(ConcurrentRBTree *tree, const void *data, ScanPath *path)
+{
+    CompareFunc compFunc = tree->tree->compFunc;
+    for(int attempt = 1; ; attempt++)
+    {
+        if(attempt % SPINS_BEFORE_YIELD == 0)
+        {
+            sched_yield();
+        }
+        path->sequence = __atomic_load_n(&tree->sequence, __ATOMIC_ACQUIRE);
+        if(path->sequence % 2 == 1)
+        {
+            continue;
+        }
+        path->depth = 0;
+        int steps = 0;
+        Node *node = __atomic_load_n(&tree->tree->root, __ATOMIC_ACQUIRE);
+        while(node != NULL && steps < MAX_READ_STEPS)
+        {
+            steps++;
+            if(data == NULL || compFunc(node->data, data) > 0)
+            {
+                path->nodes[path->depth++] = node;
+                node = __atomic_load_n(&node->left, __ATOMIC_ACQUIRE);
+            }
+            else
+            {
+                node = __atomic_load_n(&node->right, __ATOMIC_ACQUIRE);
+            }
+        }
+        path->next = (path->depth > 0) ? path->nodes[path->depth - 1]->data : NULL;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(steps < MAX_READ_STEPS &&
+           __atomic_load_n(&tree->sequence, __ATOMIC_RELAXED) == path->sequence)
+        {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief moves a scan path from its item to the next one: the smallest item of the right subtree
+ * of its node, or else the item of the node below it on the path. the caller must be inside a read
+ * @param tree the tree
+ * @param path the path, with a depth above 0
+ * @return 1 on success, 0 if a writer changed the tree since the path was found (the path is then
+ * useless, and must be found again)
+ */
+int stepScanPath(ConcurrentRBTree *tree, ScanPath *path)
+{
+    if(__atomic_load_n(&tree->sequence, __ATOMIC_ACQUIRE) != path->sequence)
+    {
+        return 0;
+    }
+    path->depth--;
+    Node *node = __atomic_load_n(&path->nodes[path->depth]->right, __ATOMIC_ACQUIRE);
+    while(node != NULL)
+    {
+        if(path->depth == MAX_READ_STEPS)
+        {
+            return 0;
+        }
+        path->nodes[path->depth++] = node;
+        node = __atomic_load_n(&node->left, __ATOMIC_ACQUIRE);
+    }
+    path->next = (path->depth > 0) ? path->nodes[path->depth - 1]->data : NULL;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&tree->sequence, __ATOMIC_RELAXED) == path->sequence;
+}
+
+/**
+ * check whether the tree contains this item, without taking a lock.
+ * @param tree: the tree.
+ * @param reader: the calling thread's reader.
+ * @param data: item to check.
+ * @return: 0 if the item is not in the tree, other if it is.
+ */
+int concurrentRBTreeContains(ConcurrentRBTree *tree, RBReader *reader, const void *data)
+{
+    if(tree == NULL || reader == NULL || data == NULL)
+    {
+        return 0;
+    }
+    enterRead(tree, reader);
+    int found = validatedSearch(tree, data) != NULL;
+    leaveRead(reader);
+    return found;
+}
+
+/**
+ * Activate a function on each item of the tree in ascending order, without taking a lock. the scan
+ * steps along its path while no writer gets in the way, and finds its place again by a search when
+ * one did. if one of the activations of the function returns 0, the process stops.
+ * @param tree: the tree.
+ * @param reader: the calling thread's reader.
+ * @param func: the function to activate on all items.
+ * @param args: more optional arguments to the function.
+ * @return: 0 on failure, other on success.
+ */
+int concurrentForEachRBTree(ConcurrentRBTree *tree, RBReader *reader, forEachFunc func,
+                            void *args)
+{
+    if(tree == NULL || reader == NULL)
+    {
+        return 0;
+    }
+    enterRead(tree, reader);
+    int result = 1;
+    // the reader stays inside the read, so the nodes of the path and the previous item are not
+    // freed under it
+    ScanPath path;
+    findScanPath(tree, NULL, &path);
+    while(path.next != NULL)
+    {
+        void *item = path.next;
+        if(func(item, args) == 0)
+        {
+            result = 0;
+            break;
+        }
+        if(stepScanPath(tree, &path) == 0)
+        {
+            findScanPath(tree, item, &path);
+        }
+    }
+    leaveRead(reader);
+    return result;
+}
+
+/**
+ * get the statistics of the tree, measuring its shape under the write lock.
+ * @param tree: the tree.
+ * @param stats: filled with the statistics.
+ * @return: 0 on failure, other on success.
+ */
+int concurrentRBTreeGetStats(ConcurrentRBTree *tree, RBTreeStats *stats)
+{
+    if(tree == NULL)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&tree->writeLock);
+    int result = RBTreeGetStats(tree->tree, stats);
+    pthread_mutex_unlock(&tree->writeLock);
+    return result;
+}
+
+/**
+ * free all memory of the tree. no thread may use the tree anymore.
+ * @param tree: pointer to the tree to free.
+ */
+void freeConcurrentRBTree(ConcurrentRBTree **tree)
+{
+    if(tree == NULL || *tree == NULL)
+    {
+        return;
+    }
+    RetiredNode *retired = (*tree)->retired;
+    while(retired != NULL)
+    {
+        RetiredNode *next = retired->next;
+        freeRBTreeNode((*tree)->tree, retired->node);
+        free(retired);
+        retired = next;
+    }
+    RBReader *reader = (*tree)->readers;
+    while(reader != NULL)
+    {
+        RBReader *next = reader->next;
+        free(reader);
+        reader = next;
+    }
+    freeRBTree(&(*tree)->tree);
+    pthread_mutex_destroy(&(*tree)->writeLock);
+    free(*tree);
+    *tree = NULL;
+}
@@ -0,0 +1,132 @@
+//
+// Created by Yair Escott.
+//
+
+#ifndef RBTREE_CONCURRENTRBTREE_H
+#define RBTREE_CONCURRENTRBTREE_H
+
+#include <pthread.h>
+#include "RBTree.h"
+
+/*
+ * a reader of a concurrent tree. every thread that reads registers once and passes its reader to
+ * the read functions.
+ */
+typedef struct RBReader
+{
+	unsigned long epoch; // the epoch the reader entered at, 0 while it is not reading.
+	int inUse;
+	struct RBReader *next;
+} RBReader;
+
+/*
+ * a node that was removed from the tree but may still be seen by readers.
+ */
+typedef struct RetiredNode
+{
+	Node *node;
+	unsigned long epoch;
+	struct RetiredNode *next;
+} RetiredNode;
+
+/**
+ * a tree shared between threads. readers never take a lock: every lookup runs against a sequence
+ * counter that writers make odd while they change the tree (a seqlock), and is retried if a writer
+ * got in the way. writers store every link atomically but in no particular order, so a reader that
+ * overlapped a write may have taken a wrong turn and always retries. a reader therefore finishes
+ * only once it runs without a write in the middle: readers are obstruction-free, not lock-free, and
+ * a steady stream of writes can starve them. removed nodes are only freed once every reader that
+ * could still see them has left (epoch-based reclamation). writers are serialized by writeLock.
+ */
+typedef struct ConcurrentRBTree
+{
+	RBTree *tree;
+	pthread_mutex_t writeLock;
+	unsigned long sequence;
+	unsigned long epoch;
+	RBReader *readers;
+	RetiredNode *retired;
+} ConcurrentRBTree;
+
+/**
+ * constructs a new concurrent tree.
+ * @param compFunc: a function two compare two items. it is called by readers concurrently.
+ * @param freeFunc: a function to free an item.
+ * @return: the new tree, NULL on failure.
+ */
+ConcurrentRBTree *newConcurrentRBTree(CompareFunc compFunc, FreeFunc freeFunc);
+
+/**
+ * register the calling thread as a reader of the tree.
+ * @param tree: the tree.
+ * @return: the reader, NULL on failure.
+ */
+RBReader *concurrentRBTreeRegisterReader(ConcurrentRBTree *tree);
+
+/**
+ * give back a reader, once its thread is done reading.
+ * @param tree: the tree.
+ * @param reader: a reader of the tree that is not inside a read.
+ */
+void concurrentRBTreeUnregisterReader(ConcurrentRBTree *tree, RBReader *reader);
+
+/**
+ * add an item to the tree. writers are serialized.
+ * @param tree: the tree to add an item to.
+ * @param data: item to add to the tree.
+ * @return: 0 on failure, other on success. (if the item is already in the tree - failure).
+ */
+int concurrentInsertToRBTree(ConcurrentRBTree *tree, void *data);
+
+/**
+ * remove an item from the tree. the item is freed once no reader can see it anymore.
+ * @param tree: the tree to remove an item from.
+ * @param data: item to remove from the tree.
+ * @return: 0 on failure, other on success. (if data is not in the tree - failure).
+ */
+int concurrentDeleteFromRBTree(ConcurrentRBTree *tree, void *data);
+
+/**
+ * check whether the tree contains this item, without taking a lock.
+ * @param tree: the tree.
+ * @param reader: the calling thread's reader.
+ * @param data: item to check.
+ * @return: 0 if the item is not in the tree, other if it is.
+ */
+int concurrentRBTreeContains(ConcurrentRBTree *tree, RBReader *reader, const void *data);
+
+/**
+ * Activate a function on each item of the tree in ascending order, without taking a lock. every
+ * step finds the item that follows the previous one in the tree as it is at that moment, so
+ * concurrent writes are seen or not seen but never break the order. a step follows the path of the
+ * previous one in O(1) amortized while no write comes in between, and searches again in O(log n)
+ * after one, so a scan takes O(n) alone and up to O(n log n) under a steady stream of writes.
+ * the scan is one read from start to end: nodes removed while it runs are only freed after it
+ * ends, so a long scan holds back the reclamation of every write that overlaps it.
+ * if one of the activations of the function returns 0, the process stops. items can be used by
+ * func but not kept after it returns.
+ * @param tree: the tree.
+ * @param reader: the calling thread's reader.
+ * @param func: the function to activate on all items.
+ * @param args: more optional arguments to the function.
+ * @return: 0 on failure, other on success.
+ */
+int concurrentForEachRBTree(ConcurrentRBTree *tree, RBReader *reader, forEachFunc func,
+							void *args);
+
+/**
+ * get the statistics of the tree (see RBTreeGetStats). the shape is measured under the write lock,
+ * so writers wait for it, in O(n), while readers go on.
+ * @param tree: the tree.
+ * @param stats: filled with the statistics.
+ * @return: 0 on failure, other on success.
+ */
+int concurrentRBTreeGetStats(ConcurrentRBTree *tree, RBTreeStats *stats);
+
+/**
+ * free all memory of the tree. no thread may use the tree anymore.
+ * @param tree: pointer to the tree to free.
+ */
+void freeConcurrentRBTree(ConcurrentRBTree **tree);
+
+#endif //RBTREE_CONCURRENTRBTREE_H
@@ -34,7 +34,7 @@ void printGivenLevel(struct Node *root, int level)
     if (root == NULL)
         return;
     if (level == 1)
-        printf("(%d, %d)", (*(int *) root->data), root->color);
+        printf("(%d, %d)", (*(int *) root->data), rbColor(root));
     else if (level > 1)
     {
         printGivenLevel(root->left, level - 1);
@@ -0,0 +1,362 @@
+/** @file ParallelRBTree.c
+* @author  Yair Escott <yair.95@gmail.com>
+*
+* @brief visiting the items of a red black tree from several threads
+*/
+
+// ------------------------------ includes ------------------------------
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <pthread.h>
+#include "ParallelRBTree.h"
+
+// -------------------------- const definitions -------------------------
+
+// the tree is split into about this many subtrees per thread, so that stealing can even out skew
+#define TASKS_PER_THREAD 8
+
+/*
+ * a piece of the tree for one thread: a whole subtree, or only the item of a node above the
+ * subtrees. on a frozen tree, a task is a run of slots instead.
+ */
+typedef struct ParallelTask
+{
+    const Node *node;
+    int wholeSubtree;
+    long unsigned slots;
+} ParallelTask;
+
+/*
+ * the tasks dealt to one thread. the owner takes tasks from the bottom, thieves from the top.
+ */
+typedef struct TaskDeque
+{
+    pthread_mutex_t lock;
+    ParallelTask *tasks;
+    size_t top;
+    size_t bottom;
+} TaskDeque;
+
+/*
+ * a parallelForEachRBTree call, shared by its threads.
+ */
+typedef struct ParallelJob
+{
+    const RBTree *tree;
+    forEachFunc func;
+    TaskDeque *deques;
+    int nthreads;
+    int failed;
+} ParallelJob;
+
+/*
+ * one thread of a parallelForEachRBTree call.
+ */
+typedef struct ParallelWorker
+{
+    ParallelJob *job;
+    int index;
+    void *args;
+    int visited;
+    pthread_t thread;
+} ParallelWorker;
+
+// activates a function on each item of the tree from several threads
+int parallelForEachRBTree(const RBTree *tree, forEachFunc func, forEachFunc combine, void **args,
+                          int nthreads);
+
+// splits the top of the tree into tasks
+size_t splitTasks(const Node *node, int depth, ParallelTask *tasks, size_t count);
+
+// splits the slots of a frozen tree into tasks
+size_t splitFrozenTasks(const RBTree *tree, ParallelTask *tasks, size_t maxTasks);
+
+// activates the job's function on each item of a run of slots
+int visitSlots(ParallelWorker *worker, const Node *node, long unsigned slots);
+
+// takes the next task of a thread, stealing one if its own are done
+int takeTask(ParallelJob *job, int index, ParallelTask *task);
+
+// activates the job's function on each item of a subtree
+int visitSubtree(ParallelWorker *worker, const Node *node);
+
+// runs tasks until there are none left
+void *runWorker(void *pWorker);
+
+// ------------------------------ functions -----------------------------
+
+/**
+ * @brief splits the top levels of a tree into tasks: the nodes above the given depth are tasks of
+ * their own item, the subtrees at that depth are whole tasks
+ * @param node the root of the (sub)tree
+ * @param depth the depth of the subtrees, relative to node
+ * @param tasks the array to add the tasks to
+ * @param count the number of tasks already in the array
+ * @return the number of tasks in the array
+ */
+size_t splitTasks(const Node *node, int depth, ParallelTask *tasks, size_t count)
+{
+    if(node == NULL)
+    {
+        return count;
+    }
+    tasks[count].node = node;
+    tasks[count].wholeSubtree = (depth == 0);
+    tasks[count].slots = 0;
+    count++;
+    if(depth > 0)
+    {
+        count = splitTasks(node->left, depth - 1, tasks, count);
+        count = splitTasks(node->right, depth - 1, tasks, count);
+    }
+    return count;
+}
+
+/**
+ * @brief splits the slots of a frozen tree into runs of about the same length. the slots need not
+ * be visited in order, so no task depends on another
+ * @param tree the frozen tree
+ * @param tasks the array to add the tasks to
+ * @param maxTasks the number of entries in the array
+ * @return the number of tasks in the array
+ */
+size_t splitFrozenTasks(const RBTree *tree, ParallelTask *tasks, size_t maxTasks)
+{
+    size_t count = (tree->size < maxTasks) ? tree->size : maxTasks;
+    for(size_t i = 0; i < count; i++)
+    {
+        long unsigned first = 1 + tree->size * i / count;
+        long unsigned next = 1 + tree->size * (i + 1) / count;
+        tasks[i].node = (const Node *)((const char *)tree->frozen + first * tree->nodeBytes);
+        tasks[i].wholeSubtree = 0;
+        tasks[i].slots = next - first;
+    }
+    return count;
+}
+
+/**
+ * @brief activates the job's function on each item of a run of slots of a frozen tree
+ * @param worker the thread
+ * @param node the first slot of the run
+ * @param slots the number of slots in the run
+ * @return 0 if the job failed, 1 if not
+ */
+int visitSlots(ParallelWorker *worker, const Node *node, long unsigned slots)
+{
+    for(long unsigned i = 0; i < slots; i++)
+    {
+        if(__atomic_load_n(&worker->job->failed, __ATOMIC_RELAXED))
+        {
+            return 0;
+        }
+        const Node *slot = (const Node *)((const char *)node + i * worker->job->tree->nodeBytes);
+        worker->visited = 1;
+        if(worker->job->func(slot->data, worker->args) == 0)
+        {
+            __atomic_store_n(&worker->job->failed, 1, __ATOMIC_RELAXED);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief takes the next task of a thread from the bottom of its own deque. if the deque is
+ * empty, a task is stolen from the top of another thread's deque
+ * @param job the job
+ * @param index the index of the thread
+ * @param task out: the task
+ * @return 1 if a task was taken, 0 if no thread has tasks left
+ */
+int takeTask(ParallelJob *job, int index, ParallelTask *task)
+{
+    TaskDeque *own = &job->deques[index];
+    pthread_mutex_lock(&own->lock);
+    if(own->bottom > own->top)
+    {
+        own->bottom -= 1;
+        *task = own->tasks[own->bottom];
+        pthread_mutex_unlock(&own->lock);
+        return 1;
+    }
+    pthread_mutex_unlock(&own->lock);
+    for(int i = 1; i < job->nthreads; i++)
+    {
+        TaskDeque *victim = &job->deques[(index + i) % job->nthreads];
+        pthread_mutex_lock(&victim->lock);
+        if(victim->bottom > victim->top)
+        {
+            *task = victim->tasks[victim->top];
+            victim->top += 1;
+            pthread_mutex_unlock(&victim->lock);
+            return 1;
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return 0;
+}
+
+/**
+ * @brief activates the job's function on each item of a subtree. the subtree is walked through
+ * kid links only, so snapshots can be visited too. tombstones are skipped
+ * @param worker the thread
+ * @param node the root of the subtree
+ * @return 0 if the job failed, 1 if not
+ */
+int visitSubtree(ParallelWorker *worker, const Node *node)
+{
+    if(node == NULL)
+    {
+        return 1;
+    }
+    if(__atomic_load_n(&worker->job->failed, __ATOMIC_RELAXED))
+    {
+        return 0;
+    }
+    if(visitSubtree(worker, node->left) == 0)
+    {
+        return 0;
+    }
+    if(!RBTreeIsTombstone(worker->job->tree, node))
+    {
+        worker->visited = 1;
+        if(worker->job->func(node->data, worker->args) == 0)
+        {
+            __atomic_store_n(&worker->job->failed, 1, __ATOMIC_RELAXED);
+            return 0;
+        }
+    }
+    return visitSubtree(worker, node->right);
+}
+
+/**
+ * @brief the body of a thread: runs tasks until no thread has any left, or the job failed
+ * @param pWorker the thread's ParallelWorker
+ * @return NULL
+ */
+void *runWorker(void *pWorker)
+{
+    ParallelWorker *worker = (ParallelWorker *)pWorker;
+    ParallelJob *job = worker->job;
+    ParallelTask task;
+    while(takeTask(job, worker->index, &task))
+    {
+        if(task.slots > 0)
+        {
+            if(visitSlots(worker, task.node, task.slots) == 0)
+            {
+                break;
+            }
+            continue;
+        }
+        if(task.wholeSubtree)
+        {
+            if(visitSubtree(worker, task.node) == 0)
+            {
+                break;
+            }
+            continue;
+        }
+        if(__atomic_load_n(&job->failed, __ATOMIC_RELAXED))
+        {
+            break;
+        }
+        if(RBTreeIsTombstone(job->tree, task.node))
+        {
+            continue;
+        }
+        worker->visited = 1;
+        if(job->func(task.node->data, worker->args) == 0)
+        {
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Activate a function on each item of the tree from several threads, in no particular order, and
+ * reduce the threads' results into args[0]. the other threads are created and joined by every
+ * call. if one of the activations of the function returns 0, the process stops.
+ * @param tree: the tree with all the items. it must not change during the call.
+ * @param func: the function to activate on all items, with the args of the calling thread.
+ * @param combine: the reduction, called as combine(args[i], args[0]) (may be NULL).
+ * @param args: nthreads arguments, one per thread.
+ * @param nthreads: the number of threads to use, counting the calling thread.
+ * @return: 0 on failure, other on success.
+ */
+int parallelForEachRBTree(const RBTree *tree, forEachFunc func, forEachFunc combine, void **args,
+                          int nthreads)
+{
+    if(tree == NULL || func == NULL || args == NULL || nthreads < 1)
+    {
+        return 0;
+    }
+    // the smallest depth with at least TASKS_PER_THREAD subtrees per thread
+    int depth = 0;
+    while(((size_t)1 << depth) < (size_t)nthreads * TASKS_PER_THREAD && depth < 20)
+    {
+        depth++;
+    }
+    size_t maxTasks = ((size_t)1 << (depth + 1)) - 1;
+    ParallelTask *tasks = (ParallelTask *)malloc(maxTasks * sizeof(ParallelTask));
+    TaskDeque *deques = (TaskDeque *)malloc(nthreads * sizeof(TaskDeque));
+    ParallelWorker *workers = (ParallelWorker *)malloc(nthreads * sizeof(ParallelWorker));
+    if(tasks == NULL || deques == NULL || workers == NULL)
+    {
+        free(tasks);
+        free(deques);
+        free(workers);
+        return 0;
+    }
+    size_t count = (tree->frozen != NULL) ? splitFrozenTasks(tree, tasks, maxTasks) :
+                   splitTasks(tree->root, depth, tasks, 0);
+    for(int i = 0; i < nthreads; i++)
+    {
+        // every thread gets a contiguous share of the tasks
+        pthread_mutex_init(&deques[i].lock, NULL);
+        deques[i].tasks = tasks;
+        deques[i].top = count * i / nthreads;
+        deques[i].bottom = count * (i + 1) / nthreads;
+    }
+    ParallelJob job = {tree, func, deques, nthreads, 0};
+    for(int i = 0; i < nthreads; i++)
+    {
+        workers[i].job = &job;
+        workers[i].index = i;
+        workers[i].args = args[i];
+        workers[i].visited = 0;
+    }
+    // the calling thread is worker 0. a thread that cannot be started leaves its tasks to thieves
+    int *started = (int *)calloc(nthreads, sizeof(int));
+    for(int i = 1; i < nthreads && started != NULL; i++)
+    {
+        started[i] = (pthread_create(&workers[i].thread, NULL, runWorker, &workers[i]) == 0);
+    }
+    runWorker(&workers[0]);
+    for(int i = 1; i < nthreads && started != NULL; i++)
+    {
+        if(started[i])
+        {
+            pthread_join(workers[i].thread, NULL);
+        }
+    }
+    int result = !job.failed;
+    for(int i = 1; i < nthreads && result && combine != NULL; i++)
+    {
+        if(workers[i].visited && combine(args[i], args[0]) == 0)
+        {
+            result = 0;
+        }
+    }
+    for(int i = 0; i < nthreads; i++)
+    {
+        pthread_mutex_destroy(&deques[i].lock);
+    }
+    free(started);
+    free(tasks);
+    free(deques);
+    free(workers);
+    return result;
+}
@@ -0,0 +1,32 @@
+//
+// Created by Yair Escott.
+//
+
+#ifndef RBTREE_PARALLELRBTREE_H
+#define RBTREE_PARALLELRBTREE_H
+
+#include "RBTree.h"
+
+/**
+ * Activate a function on each item of the tree from several threads, in no particular order. the
+ * tree is split into subtrees near the root, which are dealt to the threads; a thread that runs
+ * out of subtrees steals from the others. every thread has its own args, and once all items were
+ * visited the results are reduced into args[0]. the tree must not change during the call.
+ * there is no thread pool: every call creates nthreads - 1 threads and joins them before it
+ * returns, so each call pays for starting them, and it is only worth it on trees large enough (or
+ * functions slow enough) to hide that. calls from different threads do not share threads.
+ * if one of the activations of the function returns 0, the process stops.
+ * @param tree: the tree with all the items.
+ * @param func: the function to activate on all items. it is called concurrently, each thread
+ * passing its own args.
+ * @param combine: the reduction (may be NULL): combine(args[i], args[0]) is called for every
+ * thread i > 0 that visited at least one item, after all threads are done.
+ * @param args: nthreads arguments, args[i] is passed to func by the i'th thread (the entries may
+ * be the same pointer if func does not keep state in them).
+ * @param nthreads: the number of threads to use, counting the calling thread.
+ * @return: 0 on failure, other on success.
+ */
+int parallelForEachRBTree(const RBTree *tree, forEachFunc func, forEachFunc combine, void **args,
+						  int nthreads);
+
+#endif //RBTREE_PARALLELRBTREE_H
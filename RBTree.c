@@ -5,14 +5,558 @@
 */
 
 // ------------------------------ includes ------------------------------
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include "RBTree.h"
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef RB_TREE_STATS
+#include <pthread.h>
+#endif
 
 // -------------------------- const definitions -------------------------
 
-// uses recursion to add a new node to the tree
-int treeRBinsert(RBTree* tree, Node* root, Node* new);
+// the slab size of a pooled tree created with an initial capacity of 0
+#define DEFAULT_SLAB_CAPACITY 64
+
+// slabs stop doubling once they hold this many nodes (later slabs never hold more)
+#define MAX_SLAB_CAPACITY 65536
+
+// the subtree size of a node of a tree that tracks sizes, stored right after the node
+#define subtreeSize(node) (*(long unsigned *)((Node *)(node) + 1))
+
+// the subtree size of a node that may be NULL
+#define sizeOf(node) ((node) == NULL ? 0 : subtreeSize(node))
+
+// the summary of a node of an augmented tree, stored after the subtree size
+#define summaryOf(tree, node) \
+    ((void *)((char *)((Node *)(node) + 1) + ((tree)->orderStatistics ? sizeof(long unsigned) : 0)))
+
+// the summary of a node that may be NULL
+#define summaryOrNull(tree, node) ((node) == NULL ? NULL : summaryOf(tree, node))
+
+// the subtree maximum of a node of a tree that keeps subtree maxima, its summary
+#define subtreeMax(tree, node) ((SubtreeMax *)summaryOf(tree, node))
+
+// the number of copies of an item of a counted multiset, stored right after the node
+#define copyCount(node) (*(long unsigned *)((Node *)(node) + 1))
+
+// the sharing state of a node of a tree with snapshots enabled, stored right after the node
+#define nodeShare(node) ((NodeShare *)((Node *)(node) + 1))
+
+// the tombstone slot of a node of a tree with lazy deletion, its last extra: 0 for a live node,
+// the place of a tombstone in the tree's list of tombstones counting from 1 otherwise
+#define tombstoneSlot(tree, node) \
+    (*(long unsigned *)((char *)(node) + (tree)->nodeBytes - sizeof(long unsigned)))
+
+// tells whether a node of a tree is a tombstone
+#define isTombstone(tree, node) ((tree)->lazyDelete && tombstoneSlot(tree, node) != 0)
+
+// the most nodes on a path from the root: a red black tree of n nodes is at most 2 log2(n + 1) high
+#define MAX_TREE_HEIGHT (2 * CHAR_BIT * (int)sizeof(long unsigned))
+
+// the first room of the list of tombstones of a tree (it doubles when full)
+#define DEFAULT_TOMBSTONE_CAPACITY 64
+
+// the value slot of a node of a map, the last pointer of the node (after the other extras)
+#define valueSlot(tree, node) ((void **)((char *)(node) + (tree)->nodeBytes - sizeof(void *)))
+
+// the node in a slot of a frozen tree. slots count from 1 in breadth first (Eytzinger) order, so
+// the kids of slot i are in slots 2i and 2i + 1
+#define frozenNode(tree, i) ((Node *)((char *)(tree)->frozen + (i) * (tree)->nodeBytes))
+
+// the slot of a node of a frozen tree
+#define frozenSlot(tree, node) \
+    ((long unsigned)((const char *)(node) - (const char *)(tree)->frozen) / (tree)->nodeBytes)
+
+// the items of a frozen tree by slot, packed after the nodes so that searches read 8 slots per
+// cache line
+#define frozenItems(tree) ((void **)frozenNode(tree, (tree)->size + 1))
+
+// a frozen search prefetches the slots this many levels below the current one (8 of them, one
+// cache line of frozenItems)
+#define FROZEN_PREFETCH_LEVELS 3
+
+#if defined(__GNUC__)
+#define prefetchNode(node) __builtin_prefetch(node)
+#else
+#define prefetchNode(node) ((void)0)
+#endif
+
+// stores a kid link (or the root) that the lock-free readers of a concurrent tree may be loading
+// at the same time. the readers do not rely on the order of these stores - they retry whenever a
+// write overlapped them (see ConcurrentRBTree.h) - but every store must be atomic
+#define setLink(link, node) __atomic_store_n(&(link), (node), __ATOMIC_RELEASE)
+
+// how deep below a sibling of the path a deletion's fixup may recolor or rotate
+#define DELETE_SIBLING_DEPTH 3
+
+#ifdef RB_TREE_STATS
+// counts an event of a tree in the calling thread's counters (see RBTreeGetStats)
+#define countStat(tree, counter) countEvent((tree)->stats, counter)
+#else
+// counting compiles to nothing unless the library is built with RB_TREE_STATS
+#define countStat(tree, counter) ((void)0)
+#endif
+
+// compares two items of a tree with its compFunc, counting the comparison
+#define compareItems(tree, a, b) (countStat(tree, STAT_COMPARISONS), (tree)->compFunc(a, b))
+
+// the number of trees whose counters a thread finds without taking a lock
+#define STATS_CACHE_SLOTS 8
+
+// the first bytes of a sorted stream (see RBTreeWriteSorted), followed by its version
+#define SORTED_STREAM_MAGIC "RBTS"
+#define SORTED_STREAM_VERSION 1
+
+// the first size of the buffer items are encoded into and decoded from (it grows to fit the
+// largest item)
+#define STREAM_BUFFER_SIZE 4096
+
+// the first bytes of a tree image (see RBTreeSave)
+#define IMAGE_MAGIC "RBTIMG1"
+
+// written natively into an image, to reject images of a machine with another byte order
+#define IMAGE_BYTE_ORDER ((uint64_t)0x0102030405060708ULL)
+
+// the address range images are laid out for. an image mapped at the address it was laid out for
+// is used as is, so the processes that map it share all of its pages
+#define IMAGE_BASE ((uintptr_t)(sizeof(void *) == 8 ? 0x100000000000ULL : 0x40000000ULL))
+#define IMAGE_BASE_SPREAD ((uintptr_t)(sizeof(void *) == 8 ? 0x100000000ULL : 0x1000000ULL))
+#define IMAGE_BASE_SLOTS 1024
+
+// the alignment of the items and of the slots in an image
+#define IMAGE_ITEM_ALIGNMENT 16
+#define IMAGE_SLOT_ALIGNMENT 64
+
+// rounds an offset up to a power of 2
+#define alignUp(offset, alignment) (((offset) + (alignment) - 1) & ~((uint64_t)(alignment) - 1))
+
+/*
+ * the sharing state of a node of a tree with snapshots. refs counts the trees (as their root) and
+ * the nodes that point to the node. itemRefs is NULL while the node is the only copy of its item,
+ * and counts the copies otherwise, so that the item is freed together with the last one.
+ */
+typedef struct NodeShare
+{
+    long unsigned refs;
+    long unsigned *itemRefs;
+} NodeShare;
+
+/*
+ * the item with the largest measure in a subtree (the first one in order on ties), and its
+ * measure.
+ */
+typedef struct SubtreeMax
+{
+    double measure;
+    void *item;
+} SubtreeMax;
+
+/*
+ * the versions of a tree with snapshots: the live tree and its read-only snapshots. freed
+ * together with the last of them.
+ */
+struct RBVersions
+{
+    long unsigned trees;
+    long unsigned snapshots;
+};
+
+#ifdef RB_TREE_STATS
+/*
+ * the counters of a tree, in the order of the fields of RBTreeStats.
+ */
+typedef enum StatCounter
+{
+    STAT_COMPARISONS, STAT_LOOKUPS, STAT_INSERTS, STAT_DELETES, STAT_ROTATIONS,
+    STAT_INSERT_RECOLORS, STAT_INSERT_SINGLE_ROTATIONS, STAT_INSERT_DOUBLE_ROTATIONS,
+    STAT_DELETE_CASE_B, STAT_DELETE_CASE_C, STAT_DELETE_CASE_D, STAT_DELETE_CASE_E,
+    STAT_NODE_ALLOCATIONS, STAT_NODE_RELEASES, STAT_COUNTERS
+} StatCounter;
+
+/*
+ * the counters of a tree in one thread. only that thread writes them, so counting takes no lock.
+ */
+typedef struct StatsBlock
+{
+    struct StatsBlock *next;
+    pthread_t thread;
+    long unsigned counts[STAT_COUNTERS];
+} StatsBlock;
+
+/*
+ * the counters of a tree: a block for every thread that used it, added under lock. serial tells
+ * the registry apart from freed ones at the same address in the threads' caches.
+ */
+struct RBStatsRegistry
+{
+    pthread_mutex_t lock;
+    StatsBlock *blocks;
+    long unsigned serial;
+};
+
+/*
+ * a registry a thread used lately, and the thread's block in it.
+ */
+typedef struct StatsCacheEntry
+{
+    const RBStatsRegistry *registry;
+    long unsigned serial;
+    StatsBlock *block;
+} StatsCacheEntry;
+#endif
+
+/*
+ * the header of a tree image. the image holds the encoded items from itemsOffset on, then the
+ * frozen slots of the tree (see RBTreeFreeze) from slotsOffset on. the pointers in the slots are
+ * offsets into the image plus base, the address the image was laid out for.
+ */
+typedef struct ImageHeader
+{
+    char magic[8];
+    uint64_t byteOrder;
+    uint64_t pointerBytes;
+    uint64_t base;
+    uint64_t size;
+    uint64_t nodeBytes;
+    uint64_t itemsOffset;
+    uint64_t slotsOffset;
+    uint64_t imageBytes;
+} ImageHeader;
+
+/*
+ * a detached subtree, for joining and splitting: its root is black and has no parent, and
+ * blackHeight counts the black nodes on every path from the root down to NULL.
+ */
+typedef struct Subtree
+{
+    Node *root;
+    int blackHeight;
+} Subtree;
+
+/*
+ * a block of nodes carved by a pooled tree. nodes are tree->nodeBytes apart.
+ */
+typedef struct NodeSlab
+{
+    struct NodeSlab *next;
+    long unsigned capacity;
+    Node nodes[];
+} NodeSlab;
+
+/*
+ * the node allocator of a pooled tree. released nodes are kept on a free list (linked through
+ * their left pointer) and handed out again before new slab space is carved. the first slab is
+ * only carved on the first insertion, so the node layout can still change until then.
+ */
+struct NodePool
+{
+    NodeSlab *slabs;
+    Node *freeList;
+    long unsigned used;
+    long unsigned initialCapacity;
+};
+
+#ifdef RB_TREE_STATS
+// the last serial given to a registry
+static long unsigned statsSerial = 0;
+
+// the registries the calling thread used lately, by serial
+static __thread StatsCacheEntry statsCache[STATS_CACHE_SLOTS];
+#endif
+
+// constructs a new RBTree whose nodes are carved from slabs
+RBTree *newRBTreeWithPool(CompareFunc compFunc, FreeFunc freeFunc, long unsigned initialCapacity);
+
+// adds a slab to the pool
+int addSlab(NodePool *pool, long unsigned capacity, long unsigned nodeBytes);
+
+// the i'th node of a slab
+Node * slabNode(const RBTree *tree, NodeSlab *slab, long unsigned i);
+
+// constructs a new RBTree whose nodes are embedded in the items
+RBTree *newIntrusiveRBTree(CompareFunc compFunc, FreeFunc freeFunc, long hookOffset);
+
+// allocates a node for an item of the tree
+Node * allocNode(RBTree *tree, void *data);
+
+// gives a node back to the tree's allocator
+void releaseNode(RBTree *tree, Node *node);
+
+// frees a node that was removed from the tree, or hands it to the tree's retireFunc
+void disposeNode(RBTree *tree, Node *node);
+
+// frees a node that was removed from the tree, together with its item
+void freeRBTreeNode(RBTree *tree, Node *node);
+
+// frees the item of a node (and its value, in a map)
+void freeItem(const RBTree *tree, Node *node);
+
+// constructs a new map
+RBTree *newRBMap(CompareFunc compFunc, FreeFunc freeKey, FreeFunc freeValue);
+
+// finds the value of a key
+void *RBMapGet(const RBTree *map, const void *key);
+
+// finds the value slot of a key, adding the key if it is missing
+void **RBMapGetOrInsert(RBTree *map, void *key, int *inserted);
+
+// sets the value of a key
+int RBMapPut(RBTree *map, void *key, void *value);
+
+// the value of a node of a map
+void *RBMapValue(const RBTree *map, const Node *node);
+
+// frees the items and slabs of a pooled tree
+void freePool(RBTree *tree);
+
+// makes the tree keep subtree sizes
+int RBTreeEnableOrderStatistics(RBTree *tree);
+
+// makes the tree keep a summary of every subtree
+int RBTreeEnableAugment(RBTree *tree, AugmentFunc augment, size_t summaryBytes);
+
+// the summary of the subtree of a node
+const void *RBTreeSummary(const RBTree *tree, const Node *node);
+
+// the number of nodes in the subtree of a node
+long unsigned RBTreeSubtreeSize(const RBTree *tree, const Node *node);
+
+// makes the tree keep the item with the largest measure of every subtree
+int RBTreeEnableSubtreeMax(RBTree *tree, MeasureFunc measure);
+
+// the AugmentFunc of subtree maxima
+void maxAugment(const RBTree *tree, void *summary, const void *item, const void *left,
+                const void *right);
+
+// finds the item with the largest measure
+void *RBTreeMaxByMeasure(const RBTree *tree);
+
+// constructs a new interval tree
+RBTree *newIntervalTree(CompareFunc compFunc, FreeFunc freeFunc, MeasureFunc low,
+                        MeasureFunc high);
+
+// activates a function on each interval that overlaps [low, high]
+int forEachOverlapRBTree(const RBTree *tree, double low, double high, forEachFunc func,
+                         void *args);
+
+// activates a function on each interval that contains a point
+int forEachStabRBTree(const RBTree *tree, double point, forEachFunc func, void *args);
+
+// activates a function on each interval of a subtree that overlaps [low, high]
+int overlapSubtree(const RBTree *tree, const Node *node, double low, double high,
+                   forEachFunc func, void *args);
+
+// the node size of a tree with the extras it keeps
+long unsigned extrasBytes(const RBTree *tree);
+
+// recomputes the subtree size and summary of a node from its kids
+void updateSummaries(const RBTree *tree, Node *node);
+
+// recomputes the summary of a node from its kids
+void updateAugment(const RBTree *tree, Node *node);
+
+// recomputes the summaries of a node and all of its ancestors
+void updateAugmentPath(const RBTree *tree, Node *node);
+
+// adds delta to the subtree sizes of a node and all of its ancestors
+void addToSizes(Node *node, long delta);
+
+// finds the k'th smallest item
+Node *RBTreeSelect(const RBTree *tree, long unsigned k);
+
+// counts the items smaller than data
+long unsigned RBTreeRank(const RBTree *tree, const void *data);
+
+// gets the statistics of a tree
+int RBTreeGetStats(const RBTree *tree, RBTreeStats *stats);
+
+// resets the counters of a tree
+void RBTreeResetStats(RBTree *tree);
+
+// the height of a subtree, summing the depths of its nodes
+int subtreeDepths(const Node *node, int depth, long unsigned *nodes, long unsigned *totalDepth);
+
+// the memory of the nodes of a tree
+long unsigned nodeMemory(const RBTree *tree, long unsigned nodes);
+
+#ifdef RB_TREE_STATS
+// constructs the counters of a new tree
+RBStatsRegistry * newStatsRegistry(void);
+
+// frees the counters of a tree
+void freeStatsRegistry(RBStatsRegistry *stats);
+
+// the calling thread's block of counters
+StatsBlock * statsBlock(RBStatsRegistry *stats);
+
+// counts an event in the calling thread's block
+void countEvent(RBStatsRegistry *stats, StatCounter counter);
+#endif
+
+// makes the tree keep equal items
+int RBTreeEnableMultiset(RBTree *tree, int counted);
+
+// finds where data goes after the items equal to it
+void lastPlace(const RBTree* tree, const void* data, Node** parent, int* comp);
+
+// takes one copy off an item of a counted multiset
+int dropCopy(RBTree *tree, Node *node);
+
+// counts the items equal to key
+long unsigned RBTreeCount(const RBTree *tree, const void *key);
+
+// the number of copies of the item of a node
+long unsigned RBTreeCopies(const RBTree *tree, const Node *node);
+
+// removes all the items equal to key
+long unsigned eraseAllRBTree(RBTree *tree, const void *key);
+
+// tells whether two items are out of the tree's order
+int outOfOrder(const RBTree *tree, const void *a, const void *b);
+
+// makes deletions mark tombstones
+int RBTreeEnableLazyDelete(RBTree *tree);
+
+// marks a node as a tombstone
+int buryNode(RBTree *tree, Node *node);
+
+// gives a tombstone a new item
+void reviveNode(RBTree *tree, Node *node, void *data);
+
+// tells whether a node is a tombstone
+int RBTreeIsTombstone(const RBTree *tree, const Node *node);
+
+// skips the tombstones from a node on
+Node * skipTombstones(const RBTree *tree, Node *node, int forward);
+
+// removes tombstones from the tree
+long unsigned RBTreeCompact(RBTree *tree, long unsigned budget);
+
+// removes all the tombstones of a tree
+void compactAll(RBTree *tree);
+
+// rebuilds the tree without its tombstones
+int rebuildLive(RBTree *tree);
+
+// links a sorted range of nodes into a balanced subtree
+Node * relinkHelper(Node **nodes, size_t lo, size_t hi, int depth, int redDepth);
+
+// makes the tree's nodes shareable with snapshots
+int RBTreeEnableSnapshots(RBTree *tree);
+
+// takes a read-only snapshot of the tree
+RBTree *RBTreeSnapshot(RBTree *tree);
+
+// whether writes to the tree have to copy the nodes they change
+int sharesNodes(const RBTree *tree);
+
+// replaces a shared node of the live tree with a private copy
+int unshareNode(RBTree *tree, Node **link);
+
+// unshares a node and the nodes a few levels below it
+int unshareTop(RBTree *tree, Node **link, int depth);
+
+// unshares every node that a write of data may change
+int unsharePath(RBTree *tree, const void *data, int deleting);
+
+// drops a reference to a node, freeing the nodes that are no longer shared
+void releaseShared(RBTree *tree, Node *node);
+
+// drops a copy of an item, tells whether it was the last one
+int lastItemCopy(Node *node);
+
+// builds a tree from sorted items
+RBTree *RBTreeBuildFromSorted(CompareFunc compFunc, FreeFunc freeFunc, void **items, size_t n);
+
+// links the nodes of a sorted range into a balanced subtree
+Node * buildHelper(RBTree *tree, void **items, size_t lo, size_t hi, int depth, int redDepth);
+
+// the depth of the red nodes of a balanced tree of n nodes
+int redDepthOf(size_t n);
+
+// writes the items of a tree as a binary sorted stream
+int RBTreeWriteSorted(const RBTree *tree, FILE *file, EncodeFunc encode);
+
+// constructs a new RBTree out of a binary sorted stream
+RBTree *RBTreeReadSorted(FILE *file, CompareFunc compFunc, FreeFunc freeFunc, DecodeFunc decode);
+
+// writes an unsigned number as little endian bytes
+int writeLittleEndian(FILE *file, uint64_t value, int bytes);
+
+// reads an unsigned number of little endian bytes
+int readLittleEndian(FILE *file, uint64_t *value, int bytes);
+
+// makes sure a stream buffer has room for a number of bytes
+int reserveBuffer(unsigned char **buffer, size_t *capacity, size_t size);
+
+// writes the tree as an image that RBTreeMap can map
+int RBTreeSave(const RBTree *tree, const char *path, EncodeFunc encode);
+
+// writes the items of a tree into an image, recording their addresses by slot
+int writeImageItems(const RBTree *tree, FILE *file, EncodeFunc encode, uintptr_t base,
+                    uintptr_t *slotItems, uint64_t *end);
+
+// writes the slots of an image
+int writeImageSlots(FILE *file, const uintptr_t *slotItems, long unsigned size);
+
+// maps an image written by RBTreeSave as a frozen tree
+RBTree *RBTreeMap(const char *path, CompareFunc compFunc);
+
+// checks that the header of an image matches the machine and the file
+int validImageHeader(const ImageHeader *header, off_t fileBytes);
+
+// moves the pointers of an image that was mapped away from its base
+int relocateImage(RBTree *tree, const ImageHeader *header, char *image);
+
+// picks the address that an image is laid out for
+uintptr_t imageBase(const char *path);
+
+// turns the tree into a read-only array
+int RBTreeFreeze(RBTree *tree);
+
+// copies the nodes of a tree into the slots of a frozen subtree
+Node * fillFrozen(RBTree *tree, long unsigned slot, Node *next);
+
+// frees the nodes of a subtree, keeping the items
+void releaseNodes(RBTree *tree, Node *node);
+
+// finds the first slot >= data (or > data) of a frozen tree
+Node * frozenBound(const RBTree *tree, const void *data, int strict);
+
+// moves a cursor of a frozen tree one item forward or back
+Node * frozenStep(const RBTree *tree, const Node *node, int forward);
+
+// the slot of the next (or previous) item of a frozen tree
+long unsigned stepSlot(long unsigned size, long unsigned slot, int forward);
+
+// the slot of the smallest (or largest) item of a frozen tree
+long unsigned edgeSlot(long unsigned size, int largest);
+
+// finds the attach point (or the duplicate) of data in a single descent
+Node * insertionPoint(const RBTree* tree, const void* data, Node** parent, int* comp);
+
+// finds the attach point (or the duplicate) of data in a subtree
+Node * insertionPointFrom(const RBTree* tree, Node* start, const void* data, Node** parent,
+                          int* comp);
+
+// finds the attach point (or the duplicate) of data that is not smaller than the finger's item
+Node * fingerSearch(const RBTree* tree, Node* finger, const void* data, Node** parent, int* comp);
+
+// inserts a batch of items
+int insertBatchRBTree(RBTree *tree, void **items, size_t n, int *results);
+
+// sorts indices of items by the tree's order
+void sortIndices(const RBTree *tree, void **items, size_t *indices, size_t *buffer, size_t n);
+
+// links a new node under its attach point
+void treeRBinsert(RBTree* tree, Node* parent, int comp, Node* new);
 
 //constructs a new RBTree with the given CompareFunc.
 RBTree *newRBTree(CompareFunc compFunc, FreeFunc freeFunc);
@@ -20,18 +564,40 @@ RBTree *newRBTree(CompareFunc compFunc, FreeFunc freeFunc);
 // add an item to the tree
 int insertToRBTree(RBTree *tree, void *data);
 
+// add an item to the tree, looking for its place next to a hint first
+int insertToRBTreeHint(RBTree *tree, Node *hint, void *data);
+
+// finds the attach point (or the duplicate) of data next to a hint
+Node * hintSearch(const RBTree* tree, Node* hint, const void* data, Node** parent, int* comp);
+
 // fixes the tree's colors after a new node was added
-void fixTreeInsert(RBTree* tree, Node* newlyAdded);
+int fixTreeInsert(RBTree* tree, Node* newlyAdded);
 
 // returns the nodes parent
 Node * getParent(Node* node);
 
+// finds the first node >= data (or > data)
+Node * boundNode(const RBTree *tree, const void *data, int strict);
+
+// finds the last node that is ordered before data
+Node * belowNode(const RBTree *tree, const void *data);
+
+// finds the first item that is not smaller than data
+Node *RBTreeLowerBound(const RBTree *tree, const void *data);
+
+// finds the first item that is greater than data
+Node *RBTreeUpperBound(const RBTree *tree, const void *data);
+
+// Activate a function on each item of the tree between lo and hi
+int forEachRangeRBTree(const RBTree *tree, const void *lo, const void *hi, forEachFunc func,
+                       void *args);
+
 // Activate a function on each item of the tree. the order is an ascending order. if one of the
 // activations of the function returns 0, the process stops.
 int forEachRBTree(const RBTree *tree, forEachFunc func, void *args);
 
 // returns the nodes uncle
-Node * getUncle(RBTree *tree, Node* node);
+Node * getUncle(Node* node);
 
 // rotates left
 void rotateLeft(RBTree *tree, Node* node);
@@ -51,29 +617,68 @@ void freeRBTree(RBTree **tree);
 // finds the successor of a node
 Node * inOrderSuccessor(Node *n);
 
+// finds the predecessor of a node
+Node * inOrderPredecessor(Node *n);
+
 // returns the minimum node
 Node * minValue(Node* node);
 
-// helper function for RBTreeContains
-int contains(const RBTree *tree, Node* node, const void * data);
+// returns the maximum node
+Node * maxValue(Node* node);
+
+// recomputes the cached smallest and largest nodes of a tree
+void resetEnds(RBTree *tree);
+
+// the node of the smallest item
+Node *RBTreeMin(const RBTree *tree);
+
+// the node of the largest item
+Node *RBTreeMax(const RBTree *tree);
+
+// removes the smallest item from the tree and returns it
+void *RBTreePopFront(RBTree *tree);
+
+// a cursor to the smallest item
+Node *RBTreeBegin(const RBTree *tree);
+
+// the past-the-end cursor
+Node *RBTreeEnd(const RBTree *tree);
+
+// advances a cursor
+Node *RBTreeNext(const RBTree *tree, Node *node);
+
+// moves a cursor back
+Node *RBTreePrev(const RBTree *tree, Node *node);
+
+// finds the node holding an item
+Node *RBTreeFindNode(const RBTree *tree, const void *data);
+
+// finds the stored item equal to data
+void *RBTreeFind(const RBTree *tree, const void *data);
 
-// finds a node in the tree
-Node* nodeFinder(RBTree * tree, Node * node, void* data);
+// removes the item of a node from the tree
+int deleteNodeFromRBTree(RBTree *tree, Node *node);
 
-// fixes the tree's colors after a node was deleted
-void fixTreeDelete(RBTree* tree, Node* node);
+// splices a node out of the tree and rebalances
+void removeNode(RBTree *tree, Node *node);
 
-// the first case- if the node is red
-void delete1(RBTree* tree, Node* node);
+// splices a node out of the tree and rebalances, without disposing of it
+void unlinkNode(RBTree *tree, Node *node);
 
-// the second case- if the node is black and its kid is red
-void delete2(RBTree* tree, Node* node, char side);
+// remove an item from the tree, looking for it next to a hint first
+int deleteFromRBTreeHint(RBTree *tree, Node *hint, void *data);
 
-// the third case- if the node is black and its kid is black or NULL
-void delete3(RBTree* tree, Node* node, char side);
+// fixes the tree's colors after a black node was unlinked
+void fixTreeDelete(RBTree* tree, Node* parent, Node* node);
 
-// replaces one node with another
-void treeReplaceNode(Node* n, Node* child);
+// tells whether a node is black, NULL leaves included
+int isBlack(const Node *node);
+
+// puts a node in the place of another in its parent
+void replaceChild(RBTree *tree, Node *parent, Node *old, Node *new);
+
+// swaps the places of a node and its successor
+void treeReplaceNode(RBTree *tree, Node* n, Node* child);
 
 // step 2 of the left rotate
 void rotateLeft2(RBTree *tree, Node* node);
@@ -81,32 +686,77 @@ void rotateLeft2(RBTree *tree, Node* node);
 // step 2 of the right rotate
 void rotateRight2(RBTree *tree, Node* node);
 
-// if the S is black and both of its kids are black
-void deleteB(RBTree* tree, Node* parent, char side);
+// rotates left around a node
+void rotateLeftDelete(RBTree *tree, Node *parent);
 
-// if the S is RED
-void deleteC(RBTree* tree, Node* parent, char side);
+// rotates right around a node
+void rotateRightDelete(RBTree *tree, Node *parent);
 
-// if the S is Black and the far kid from C is black and the closer one is red
-void deleteD(RBTree* tree, Node* parent, char side);
+// tells whether the nodes of a tree can be moved to another tree
+int nodesMovable(const RBTree *tree);
 
-// if the S is Black and the far kid from C is RED
-void deleteE(RBTree* tree, Node* parent, char side);
+// tells whether the nodes of two trees can be moved between them
+int joinable(const RBTree *t1, const RBTree *t2);
 
-// removes the node
-char removeM(RBTree* tree, Node* node);
+// tells whether two trees can be merged by the set operations
+int setOperable(const RBTree *t1, const RBTree *t2);
 
-// rotates left
-void rotateLeftDelete(RBTree *tree, Node *parent);
+// counts the black nodes on a path from a root down to NULL
+int blackHeight(const Node *root);
 
-// rotates right
-void rotateRightDelete(RBTree *tree, Node *parent);
+// detaches a kid of a node as a subtree of its own
+Subtree detachKid(Node *kid, int height);
 
-// helps free the tree
-void freeHelper(Node* node, FreeFunc func);
+// joins two subtrees with a pivot between them
+Subtree joinSubtrees(RBTree *tree, Subtree l, Node *pivot, Subtree r);
+
+// detaches the largest node of a subtree
+Node * splitLast(RBTree *tree, Subtree subtree, Subtree *rest);
+
+// joins two subtrees without a pivot
+Subtree joinTwo(RBTree *tree, Subtree l, Subtree r);
+
+// splits a subtree around a key
+Node * splitSubtree(RBTree *tree, Subtree subtree, const void *key, Subtree *lo, Subtree *hi);
+
+// disposes of all the nodes of a detached subtree
+void disposeSubtree(RBTree *tree, Node *node);
+
+// the union of two subtrees
+Subtree unionSubtrees(RBTree *t1, Subtree a, RBTree *t2, Subtree b, long unsigned *duplicates);
+
+// the intersection of two subtrees
+Subtree intersectSubtrees(RBTree *t1, Subtree a, RBTree *t2, Subtree b, long unsigned *kept);
+
+// the difference of two subtrees
+Subtree differenceSubtrees(RBTree *t1, Subtree a, RBTree *t2, Subtree b, long unsigned *removed);
 
-// helps go over the nodes
-int forEachHelper(Node *node, forEachFunc func, void* args);
+// the whole of a tree as a subtree
+Subtree wholeTree(const RBTree *tree);
+
+// joins two trees and a pivot between them
+int RBTreeJoin(RBTree *t1, void *pivot, RBTree *t2);
+
+// a new empty tree that nodes of the given tree can be moved into
+RBTree * emptyLike(const RBTree *tree);
+
+// splits a tree around a key
+int RBTreeSplit(RBTree *tree, const void *key, RBTree **lo, RBTree **hi);
+
+// sets the sizes of the two trees a tree was split into
+void countSplitSizes(RBTree *lo, RBTree *hi, long unsigned total);
+
+// moves the items of t2 into t1
+int RBTreeUnion(RBTree *t1, RBTree *t2);
+
+// keeps in t1 only the items that t2 has too
+int RBTreeIntersection(RBTree *t1, RBTree *t2);
+
+// removes from t1 the items that t2 has
+int RBTreeDifference(RBTree *t1, RBTree *t2);
+
+// helps free the tree
+void freeHelper(RBTree *tree, Node* node);
 
 // ------------------------------ functions -----------------------------
 
@@ -123,63 +773,3464 @@ RBTree *newRBTree(CompareFunc compFunc, FreeFunc freeFunc)
         return NULL;
     }
     tree->root = NULL;
+    tree->leftmost = NULL;
+    tree->rightmost = NULL;
     tree->compFunc = compFunc;
     tree->freeFunc = freeFunc;
     tree->size = 0;
+    tree->pool = NULL;
+    tree->hookOffset = RB_NOT_INTRUSIVE;
+    tree->nodeBytes = sizeof(Node);
+    tree->orderStatistics = 0;
+    tree->augment = NULL;
+    tree->summaryBytes = 0;
+    tree->measure = NULL;
+    tree->intervalLow = NULL;
+    tree->map = 0;
+    tree->freeValue = NULL;
+    tree->multiset = 0;
+    tree->counted = 0;
+    tree->frozen = NULL;
+    tree->image = NULL;
+    tree->imageBytes = 0;
+    tree->retireFunc = NULL;
+    tree->retireArgs = NULL;
+    tree->versions = NULL;
+    tree->readOnly = 0;
+    tree->lazyDelete = 0;
+    tree->tombstones = NULL;
+    tree->tombstoneCount = 0;
+    tree->tombstoneCapacity = 0;
+#ifdef RB_TREE_STATS
+    tree->stats = newStatsRegistry();
+    if(tree->stats == NULL)
+    {
+        free(tree);
+        return NULL;
+    }
+#endif
     return tree;
 }
 
 /**
- * @brief uses recursion to add a new node to the tree
- * @param tree the RB tree
- * @param root the recursed node
- * @param new the node to add
- * @return 0 if failed 1 if not
+ * constructs a new RBTree whose nodes are carved from slabs and recycled through a free list.
+ * @param compFunc: a function two compare two variables.
+ * @param freeFunc: a function to free an item.
+ * @param initialCapacity: the number of nodes in the first slab (0 for a default size).
+ * @return: the new tree, NULL on failure.
+ */
+RBTree *newRBTreeWithPool(CompareFunc compFunc, FreeFunc freeFunc, long unsigned initialCapacity)
+{
+    RBTree *tree = newRBTree(compFunc, freeFunc);
+    if(tree == NULL)
+    {
+        return NULL;
+    }
+    NodePool *pool = (NodePool *)malloc(sizeof(NodePool));
+    if(pool == NULL)
+    {
+        freeRBTree(&tree);
+        return NULL;
+    }
+    pool->slabs = NULL;
+    pool->freeList = NULL;
+    pool->used = 0;
+    pool->initialCapacity = (initialCapacity == 0) ? DEFAULT_SLAB_CAPACITY : initialCapacity;
+    tree->pool = pool;
+    return tree;
+}
+
+/**
+ * @brief adds a slab to the pool, new nodes are carved from it from now on
+ * @param pool the pool
+ * @param capacity the number of nodes in the slab
+ * @param nodeBytes the size of a node
+ * @return 0 on failure 1 if not
+ */
+int addSlab(NodePool *pool, long unsigned capacity, long unsigned nodeBytes)
+{
+    NodeSlab *slab = (NodeSlab *)malloc(sizeof(NodeSlab) + capacity * nodeBytes);
+    if(slab == NULL)
+    {
+        return 0;
+    }
+    slab->capacity = capacity;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->used = 0;
+    return 1;
+}
+
+/**
+ * @brief returns the i'th node of a slab
+ * @param tree the tree the slab belongs to
+ * @param slab the slab
+ * @param i the index of the node
+ * @return the node
+ */
+Node * slabNode(const RBTree *tree, NodeSlab *slab, long unsigned i)
+{
+    return (Node *)((char *)slab->nodes + i * tree->nodeBytes);
+}
+
+/**
+ * constructs a new intrusive RBTree: every item embeds its own Node (the hook), so inserting and
+ * deleting never allocate.
+ * @param compFunc: a function two compare two items.
+ * @param freeFunc: a function to free an item (together with its hook).
+ * @param hookOffset: the offset of the hook inside an item (see RB_HOOK_OFFSET).
+ * @return: the new tree, NULL on failure.
+ */
+RBTree *newIntrusiveRBTree(CompareFunc compFunc, FreeFunc freeFunc, long hookOffset)
+{
+    if(hookOffset < 0)
+    {
+        return NULL;
+    }
+    RBTree *tree = newRBTree(compFunc, freeFunc);
+    if(tree == NULL)
+    {
+        return NULL;
+    }
+    tree->hookOffset = hookOffset;
+    return tree;
+}
+
+/**
+ * @brief allocates a node for an item of the tree: its hook if the tree is intrusive, else from
+ * the tree's pool if it has one
+ * @param tree the tree
+ * @param data the item the node will hold
+ * @return the node, NULL on failure
  */
-int treeRBinsert(RBTree* tree, Node* root, Node* new)
+Node * allocNode(RBTree *tree, void *data)
+{
+    if(tree->hookOffset != RB_NOT_INTRUSIVE)
+    {
+        return (Node*)((char*)data + tree->hookOffset);
+    }
+    countStat(tree, STAT_NODE_ALLOCATIONS);
+    NodePool *pool = tree->pool;
+    if(pool == NULL)
+    {
+        return (Node*)malloc(tree->nodeBytes);
+    }
+    if(pool->freeList != NULL)
+    {
+        Node *node = pool->freeList;
+        pool->freeList = node->left;
+        return node;
+    }
+    if(pool->slabs == NULL || pool->used == pool->slabs->capacity)
+    {
+        long unsigned capacity = pool->initialCapacity;
+        if(pool->slabs != NULL)
+        {
+            capacity = pool->slabs->capacity * 2;
+            if(capacity > MAX_SLAB_CAPACITY)
+            {
+                capacity = MAX_SLAB_CAPACITY;
+            }
+        }
+        if(addSlab(pool, capacity, tree->nodeBytes) == 0)
+        {
+            return NULL;
+        }
+    }
+    Node *node = slabNode(tree, pool->slabs, pool->used);
+    pool->used += 1;
+    return node;
+}
+
+/**
+ * @brief gives a node back to the tree's allocator. the node's item must already be freed, and
+ * the node must not be touched afterwards
+ * @param tree the tree
+ * @param node the node
+ */
+void releaseNode(RBTree *tree, Node *node)
+{
+    if(tree->hookOffset != RB_NOT_INTRUSIVE)
+    {
+        // the hook was freed together with its item
+        return;
+    }
+    countStat(tree, STAT_NODE_RELEASES);
+    NodePool *pool = tree->pool;
+    if(pool == NULL)
+    {
+        free(node);
+        return;
+    }
+    // released nodes are told apart from live ones by their missing item
+    node->data = NULL;
+    node->left = pool->freeList;
+    pool->freeList = node;
+}
+
+/**
+ * @brief disposes of a node that was just removed from the tree: hands it to the tree's
+ * retireFunc if it has one (which then owns it), frees it together with its item otherwise
+ * @param tree the tree
+ * @param node the removed node
+ */
+void disposeNode(RBTree *tree, Node *node)
+{
+    if(tree->retireFunc != NULL)
+    {
+        tree->retireFunc(tree, node, tree->retireArgs);
+        return;
+    }
+    freeRBTreeNode(tree, node);
+}
+
+/**
+ * free a node that was removed from the tree, together with its item.
+ * @param tree: the tree the node was removed from.
+ * @param node: the node.
+ */
+void freeRBTreeNode(RBTree *tree, Node *node)
+{
+    if(tree->versions == NULL || lastItemCopy(node))
+    {
+        freeItem(tree, node);
+    }
+    releaseNode(tree, node);
+}
+
+/**
+ * @brief frees the item of a node, and its value if the tree is a map that owns its values
+ * @param tree the tree
+ * @param node the node
+ */
+void freeItem(const RBTree *tree, Node *node)
+{
+    if(tree->map && tree->freeValue != NULL && *valueSlot(tree, node) != NULL)
+    {
+        tree->freeValue(*valueSlot(tree, node));
+    }
+    tree->freeFunc(node->data);
+}
+
+/**
+ * constructs a new map: a tree whose nodes hold a value next to their item (the key).
+ * @param compFunc: a function to compare two keys.
+ * @param freeKey: a function to free a key.
+ * @param freeValue: a function to free a value (NULL if the map does not own its values).
+ * @return: the new map, NULL on failure.
+ */
+RBTree *newRBMap(CompareFunc compFunc, FreeFunc freeKey, FreeFunc freeValue)
+{
+    RBTree *map = newRBTree(compFunc, freeKey);
+    if(map == NULL)
+    {
+        return NULL;
+    }
+    map->map = 1;
+    map->freeValue = freeValue;
+    map->nodeBytes = sizeof(Node) + sizeof(void *);
+    return map;
+}
+
+/**
+ * find the value of a key, in one descent.
+ * @param map: the map.
+ * @param key: the key to look for.
+ * @return: the value, NULL if the key is not in the map (or its value is NULL).
+ */
+void *RBMapGet(const RBTree *map, const void *key)
+{
+    if(map == NULL || !map->map || key == NULL)
+    {
+        return NULL;
+    }
+    Node *node = RBTreeFindNode(map, key);
+    return (node == NULL) ? NULL : *valueSlot(map, node);
+}
+
+/**
+ * find the value slot of a key, adding the key with a NULL value if it is missing, in one
+ * descent.
+ * @param map: the map.
+ * @param key: the key. the map owns it only if it was added.
+ * @param inserted: optional out (may be NULL): 1 if the key was added, 0 if it was there already.
+ * @return: the slot, valid until the key is removed. NULL on failure.
+ */
+void **RBMapGetOrInsert(RBTree *map, void *key, int *inserted)
+{
+    if(map == NULL || !map->map || map->readOnly || key == NULL)
+    {
+        return NULL;
+    }
+    Node* parent;
+    int comp;
+    int added = 0;
+    Node* node = insertionPoint(map, key, &parent, &comp);
+    if(node == NULL)
+    {
+        node = allocNode(map, key);
+        if(node == NULL)
+        {
+            return NULL;
+        }
+        node->data = key;
+        treeRBinsert(map, parent, comp, node);
+        added = 1;
+    }
+    if(inserted != NULL)
+    {
+        *inserted = added;
+    }
+    return valueSlot(map, node);
+}
+
+/**
+ * set the value of a key (upsert), in one descent. an existing key's value is replaced in place.
+ * @param map: the map.
+ * @param key: the key. the map owns it only if it was added.
+ * @param value: the value, the map owns it on success. a replaced value is freed.
+ * @return: 0 on failure, 1 if the key was added, 2 if it was there already.
+ */
+int RBMapPut(RBTree *map, void *key, void *value)
+{
+    int inserted;
+    void **slot = RBMapGetOrInsert(map, key, &inserted);
+    if(slot == NULL)
+    {
+        return 0;
+    }
+    if(*slot != NULL && *slot != value && map->freeValue != NULL)
+    {
+        map->freeValue(*slot);
+    }
+    *slot = value;
+    return inserted ? 1 : 2;
+}
+
+/**
+ * get the value of a node of a map (from RBTreeFindNode, a bound or a cursor).
+ * @param map: the map.
+ * @param node: the node.
+ * @return: the value, NULL if the tree is not a map.
+ */
+void *RBMapValue(const RBTree *map, const Node *node)
+{
+    if(map == NULL || !map->map || node == NULL)
+    {
+        return NULL;
+    }
+    return *valueSlot(map, node);
+}
+
+/**
+ * @brief frees the items and then the slabs of a pooled tree. the slabs are scanned in memory
+ * order instead of walking the tree
+ * @param tree the tree
+ */
+void freePool(RBTree *tree)
+{
+    NodePool *pool = tree->pool;
+    long unsigned used = pool->used;
+    NodeSlab *slab = pool->slabs;
+    while(slab != NULL)
+    {
+        NodeSlab *next = slab->next;
+        for(long unsigned i = 0; i < used; i++)
+        {
+            Node *node = slabNode(tree, slab, i);
+            if(node->data != NULL)
+            {
+                freeItem(tree, node);
+            }
+        }
+        free(slab);
+        slab = next;
+        // only the newest slab is partially carved
+        if(slab != NULL)
+        {
+            used = slab->capacity;
+        }
+    }
+    free(pool);
+}
+
+/**
+ * make the tree keep the size of every subtree, for RBTreeSelect and RBTreeRank in O(log n).
+ * must be called before the first insertion, and not on intrusive trees.
+ * @param tree: the tree.
+ * @return: 0 on failure, other on success.
+ */
+int RBTreeEnableOrderStatistics(RBTree *tree)
+{
+    if(tree == NULL || tree->root != NULL || tree->readOnly ||
+       tree->hookOffset != RB_NOT_INTRUSIVE || tree->versions != NULL || tree->counted ||
+       tree->lazyDelete)
+    {
+        return 0;
+    }
+    if(tree->pool != NULL && tree->pool->slabs != NULL)
+    {
+        return 0;
+    }
+    tree->orderStatistics = 1;
+    tree->nodeBytes = extrasBytes(tree);
+    return 1;
+}
+
+/**
+ * the number of nodes in the subtree of a node, in O(1).
+ * @param tree: a tree with order statistics.
+ * @param node: a node of the tree (may be NULL).
+ * @return: the size of the subtree, 0 for NULL or a tree without order statistics.
+ */
+long unsigned RBTreeSubtreeSize(const RBTree *tree, const Node *node)
+{
+    if(tree == NULL || !tree->orderStatistics)
+    {
+        return 0;
+    }
+    return sizeOf(node);
+}
+
+/**
+ * make the tree keep a summary of every subtree, set by augment from the node's item and its
+ * kids' summaries. must be called before the first insertion, and not on intrusive trees or
+ * counted multisets.
+ * @param tree: the tree.
+ * @param augment: the function that sets a summary.
+ * @param summaryBytes: the size of a summary.
+ * @return: 0 on failure, other on success.
+ */
+int RBTreeEnableAugment(RBTree *tree, AugmentFunc augment, size_t summaryBytes)
+{
+    if(tree == NULL || augment == NULL || summaryBytes == 0 || tree->root != NULL ||
+       tree->readOnly || tree->augment != NULL || tree->hookOffset != RB_NOT_INTRUSIVE ||
+       tree->versions != NULL || tree->counted || tree->lazyDelete ||
+       (tree->pool != NULL && tree->pool->slabs != NULL))
+    {
+        return 0;
+    }
+    tree->augment = augment;
+    // rounded up, so that the value slot of a map stays aligned
+    tree->summaryBytes = (summaryBytes + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *);
+    tree->nodeBytes = extrasBytes(tree);
+    return 1;
+}
+
+/**
+ * the summary of the subtree of a node of an augmented tree.
+ * @param tree: the tree.
+ * @param node: a node of the tree.
+ * @return: the summary, NULL if there is no node or the tree is not augmented.
+ */
+const void *RBTreeSummary(const RBTree *tree, const Node *node)
+{
+    if(tree == NULL || node == NULL || tree->augment == NULL)
+    {
+        return NULL;
+    }
+    return summaryOf(tree, node);
+}
+
+/**
+ * make the tree keep, for every subtree, the item with the largest measure, so that
+ * RBTreeMaxByMeasure is O(1). it is the augmentation of the tree (see RBTreeEnableAugment).
+ * @param tree: the tree.
+ * @param measure: the measure of an item.
+ * @return: 0 on failure, other on success.
+ */
+int RBTreeEnableSubtreeMax(RBTree *tree, MeasureFunc measure)
+{
+    if(measure == NULL || RBTreeEnableAugment(tree, maxAugment, sizeof(SubtreeMax)) == 0)
+    {
+        return 0;
+    }
+    tree->measure = measure;
+    return 1;
+}
+
+/**
+ * @brief the AugmentFunc of subtree maxima: the item with the largest measure among the node's
+ * and its kids' maxima. ties go to the item that comes first in order
+ * @param tree the tree
+ * @param summary the SubtreeMax of the node
+ * @param item the item of the node
+ * @param left the SubtreeMax of the left kid, or NULL
+ * @param right the SubtreeMax of the right kid, or NULL
+ */
+void maxAugment(const RBTree *tree, void *summary, const void *item, const void *left,
+                const void *right)
+{
+    SubtreeMax max = {tree->measure(item), (void *)item};
+    if(left != NULL && ((const SubtreeMax *)left)->measure >= max.measure)
+    {
+        max = *(const SubtreeMax *)left;
+    }
+    if(right != NULL && ((const SubtreeMax *)right)->measure > max.measure)
+    {
+        max = *(const SubtreeMax *)right;
+    }
+    *(SubtreeMax *)summary = max;
+}
+
+/**
+ * find the item with the largest measure, in O(1).
+ * @param tree: a tree that keeps subtree maxima (see RBTreeEnableSubtreeMax).
+ * @return: the first item in order with the largest measure, NULL if the tree is empty or does
+ * not keep subtree maxima.
+ */
+void *RBTreeMaxByMeasure(const RBTree *tree)
+{
+    if(tree == NULL || tree->measure == NULL || tree->root == NULL)
+    {
+        return NULL;
+    }
+    return subtreeMax(tree, tree->root)->item;
+}
+
+/**
+ * constructs a new interval tree: a tree of intervals that keeps the largest high endpoint of
+ * every subtree.
+ * @param compFunc: orders the intervals by their low endpoints first.
+ * @param freeFunc: frees an interval.
+ * @param low: the low endpoint of an interval.
+ * @param high: the high endpoint of an interval.
+ * @return: the new tree, NULL on failure.
+ */
+RBTree *newIntervalTree(CompareFunc compFunc, FreeFunc freeFunc, MeasureFunc low,
+                        MeasureFunc high)
+{
+    if(low == NULL)
+    {
+        return NULL;
+    }
+    RBTree *tree = newRBTree(compFunc, freeFunc);
+    if(tree == NULL)
+    {
+        return NULL;
+    }
+    if(RBTreeEnableSubtreeMax(tree, high) == 0)
+    {
+        freeRBTree(&tree);
+        return NULL;
+    }
+    tree->intervalLow = low;
+    return tree;
+}
+
+/**
+ * Activate a function on each interval of an interval tree that overlaps [low, high] (endpoints
+ * included), in ascending order, in O(min(n, k log n)) for k such intervals. if one of the
+ * activations of the function returns 0, the process stops.
+ * @param tree: an interval tree (see newIntervalTree).
+ * @param low: the low end of the range.
+ * @param high: the high end of the range.
+ * @param func: the function to activate on the intervals.
+ * @param args: more optional arguments to the function (may be null if the given function support it).
+ * @return: 0 on failure, other on success.
+ */
+int forEachOverlapRBTree(const RBTree *tree, double low, double high, forEachFunc func,
+                         void *args)
+{
+    if(tree == NULL || tree->intervalLow == NULL || func == NULL)
+    {
+        return 0;
+    }
+    return overlapSubtree(tree, tree->root, low, high, func, args);
+}
+
+/**
+ * Activate a function on each interval of an interval tree that contains a point, in ascending
+ * order (see forEachOverlapRBTree).
+ * @param tree: an interval tree (see newIntervalTree).
+ * @param point: the point.
+ * @param func: the function to activate on the intervals.
+ * @param args: more optional arguments to the function (may be null if the given function support it).
+ * @return: 0 on failure, other on success.
+ */
+int forEachStabRBTree(const RBTree *tree, double point, forEachFunc func, void *args)
+{
+    return forEachOverlapRBTree(tree, point, point, func, args);
+}
+
+/**
+ * @brief activates a function on each interval of a subtree that overlaps [low, high], in order,
+ * keeping the path to the next node on a stack of its own (the parent links of a snapshot belong
+ * to the live tree). a subtree whose highest endpoint is below low is skipped, and the walk ends
+ * at the first node whose low endpoint is above high
+ * @param tree the interval tree
+ * @param node the root of the subtree (may be NULL)
+ * @param low the low end of the range
+ * @param high the high end of the range
+ * @param func the function
+ * @param args its arguments
+ * @return 0 if an activation failed (or the subtree is too high to be a red black tree), 1
+ * otherwise
+ */
+int overlapSubtree(const RBTree *tree, const Node *node, double low, double high,
+                   forEachFunc func, void *args)
+{
+    const Node *path[MAX_TREE_HEIGHT];
+    int depth = 0;
+    for(;;)
+    {
+        while(node != NULL && subtreeMax(tree, node)->measure >= low)
+        {
+            if(depth == MAX_TREE_HEIGHT)
+            {
+                return 0;
+            }
+            path[depth++] = node;
+            node = node->left;
+        }
+        if(depth == 0)
+        {
+            return 1;
+        }
+        node = path[--depth];
+        if(tree->intervalLow(node->data) > high)
+        {
+            // the nodes that follow start no lower
+            return 1;
+        }
+        if(tree->measure(node->data) >= low && func(node->data, args) == 0)
+        {
+            return 0;
+        }
+        node = node->right;
+    }
+}
+
+/**
+ * @brief the node size of a tree that allocates its own nodes: the node, the subtree size, the
+ * summary and the value slot, for the extras the tree keeps
+ * @param tree the tree
+ * @return the number of bytes
+ */
+long unsigned extrasBytes(const RBTree *tree)
+{
+    return sizeof(Node) + (tree->orderStatistics ? sizeof(long unsigned) : 0) +
+           tree->summaryBytes + (tree->map ? sizeof(void *) : 0);
+}
+
+/**
+ * @brief recomputes the subtree size and the summary of a node from its kids, for those the tree
+ * keeps
+ * @param tree the tree
+ * @param node the node
+ */
+void updateSummaries(const RBTree *tree, Node *node)
+{
+    if(tree->orderStatistics)
+    {
+        subtreeSize(node) = 1 + sizeOf(node->left) + sizeOf(node->right);
+    }
+    if(tree->augment != NULL)
+    {
+        updateAugment(tree, node);
+    }
+}
+
+/**
+ * @brief recomputes the summary of a node from its item and its kids' summaries
+ * @param tree the tree
+ * @param node the node
+ */
+void updateAugment(const RBTree *tree, Node *node)
+{
+    tree->augment(tree, summaryOf(tree, node), node->data, summaryOrNull(tree, node->left),
+                  summaryOrNull(tree, node->right));
+}
+
+/**
+ * @brief recomputes the summaries of a node and all of its ancestors, bottom up
+ * @param tree the tree
+ * @param node the lowest node to update (may be NULL)
+ */
+void updateAugmentPath(const RBTree *tree, Node *node)
+{
+    for(; node != NULL; node = rbParent(node))
+    {
+        updateAugment(tree, node);
+    }
+}
+
+/**
+ * @brief adds delta to the subtree sizes of a node and all of its ancestors
+ * @param node the lowest node to update (may be NULL)
+ * @param delta the change in size
+ */
+void addToSizes(Node *node, long delta)
+{
+    for(; node != NULL; node = rbParent(node))
+    {
+        subtreeSize(node) += delta;
+    }
+}
+
+/**
+ * find the k'th smallest item of the tree (counting from 0). O(log n) if the tree keeps
+ * subtree sizes, O(k) otherwise.
+ * @param tree: the tree.
+ * @param k: the index of the item in ascending order.
+ * @return: a cursor to the item, RBTreeEnd(tree) if the tree has k items or less.
+ */
+Node *RBTreeSelect(const RBTree *tree, long unsigned k)
+{
+    if(tree == NULL || k >= tree->size)
+    {
+        return NULL;
+    }
+    if(!tree->orderStatistics)
+    {
+        Node *node = RBTreeBegin(tree);
+        for(; k > 0; k--)
+        {
+            node = RBTreeNext(tree, node);
+        }
+        return node;
+    }
+    Node *node = tree->root;
+    while(node != NULL)
+    {
+        long unsigned leftSize = sizeOf(node->left);
+        if(k == leftSize)
+        {
+            return node;
+        }
+        if(k < leftSize)
+        {
+            node = node->left;
+        }
+        else
+        {
+            k -= leftSize + 1;
+            node = node->right;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * count the items of the tree that are smaller than data. O(log n) if the tree keeps subtree
+ * sizes, O(n) otherwise.
+ * @param tree: the tree.
+ * @param data: the item to rank.
+ * @return: the number of smaller items (the index data has or would have in ascending order).
+ */
+long unsigned RBTreeRank(const RBTree *tree, const void *data)
+{
+    if(tree == NULL || data == NULL)
+    {
+        return 0;
+    }
+    long unsigned rank = 0;
+    if(!tree->orderStatistics)
+    {
+        Node *node = RBTreeBegin(tree);
+        for(; node != RBTreeEnd(tree) && compareItems(tree, node->data, data) < 0;
+              node = RBTreeNext(tree, node))
+        {
+            rank++;
+        }
+        return rank;
+    }
+    Node *node = tree->root;
+    while(node != NULL)
+    {
+        if(compareItems(tree, node->data, data) < 0)
+        {
+            rank += sizeOf(node->left) + 1;
+            node = node->right;
+        }
+        else
+        {
+            node = node->left;
+        }
+    }
+    return rank;
+}
+
+/**
+ * get the statistics of a tree, in O(n) for its shape. the counters are kept only by a library
+ * built with RB_TREE_STATS. they may be read while other threads use the tree, but the shape walks
+ * the links, so no thread may write to the tree meanwhile (see concurrentRBTreeGetStats).
+ * @param tree: the tree.
+ * @param stats: filled with the statistics.
+ * @return: 0 on failure, other on success.
+ */
+int RBTreeGetStats(const RBTree *tree, RBTreeStats *stats)
+{
+    if(tree == NULL || stats == NULL)
+    {
+        return 0;
+    }
+    memset(stats, 0, sizeof(RBTreeStats));
+#ifdef RB_TREE_STATS
+    long unsigned counts[STAT_COUNTERS] = {0};
+    pthread_mutex_lock(&tree->stats->lock);
+    for(const StatsBlock *block = tree->stats->blocks; block != NULL; block = block->next)
+    {
+        for(int i = 0; i < STAT_COUNTERS; i++)
+        {
+            counts[i] += __atomic_load_n(&block->counts[i], __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&tree->stats->lock);
+    stats->counted = 1;
+    stats->comparisons = counts[STAT_COMPARISONS];
+    stats->lookups = counts[STAT_LOOKUPS];
+    stats->inserts = counts[STAT_INSERTS];
+    stats->deletes = counts[STAT_DELETES];
+    stats->rotations = counts[STAT_ROTATIONS];
+    stats->insertRecolors = counts[STAT_INSERT_RECOLORS];
+    stats->insertSingleRotations = counts[STAT_INSERT_SINGLE_ROTATIONS];
+    stats->insertDoubleRotations = counts[STAT_INSERT_DOUBLE_ROTATIONS];
+    stats->deleteCaseB = counts[STAT_DELETE_CASE_B];
+    stats->deleteCaseC = counts[STAT_DELETE_CASE_C];
+    stats->deleteCaseD = counts[STAT_DELETE_CASE_D];
+    stats->deleteCaseE = counts[STAT_DELETE_CASE_E];
+    stats->nodeAllocations = counts[STAT_NODE_ALLOCATIONS];
+    stats->nodeReleases = counts[STAT_NODE_RELEASES];
+#endif
+    long unsigned nodes = 0;
+    long unsigned totalDepth = 0;
+    if(tree->frozen != NULL)
+    {
+        // slot i is at depth floor(log2(i)) + 1
+        for(long unsigned i = 1; i <= tree->size; i++)
+        {
+            if((i & (i - 1)) == 0)
+            {
+                stats->height += 1;
+            }
+            totalDepth += (long unsigned)stats->height;
+        }
+        nodes = tree->size;
+    }
+    else
+    {
+        stats->height = subtreeDepths(tree->root, 1, &nodes, &totalDepth);
+    }
+    stats->size = tree->size;
+    stats->averageDepth = (nodes == 0) ? 0 : (double)totalDepth / (double)nodes;
+    stats->nodeBytes = tree->nodeBytes;
+    stats->totalNodeBytes = nodeMemory(tree, nodes);
+    return 1;
+}
+
+/**
+ * reset the counters of a tree to zero.
+ * @param tree: the tree. no other thread may use it meanwhile.
+ */
+void RBTreeResetStats(RBTree *tree)
+{
+#ifdef RB_TREE_STATS
+    if(tree == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&tree->stats->lock);
+    for(StatsBlock *block = tree->stats->blocks; block != NULL; block = block->next)
+    {
+        memset(block->counts, 0, sizeof(block->counts));
+    }
+    pthread_mutex_unlock(&tree->stats->lock);
+#else
+    (void)tree;
+#endif
+}
+
+/**
+ * @brief the height of a subtree, counting its nodes and summing their depths
+ * @param node the root of the subtree (may be NULL)
+ * @param depth the depth of the root
+ * @param nodes out: incremented by the number of nodes
+ * @param totalDepth out: incremented by the depths of the nodes
+ * @return the depth of the deepest node, depth - 1 for an empty subtree
+ */
+int subtreeDepths(const Node *node, int depth, long unsigned *nodes, long unsigned *totalDepth)
+{
+    if(node == NULL)
+    {
+        return depth - 1;
+    }
+    *nodes += 1;
+    *totalDepth += (long unsigned)depth;
+    int left = subtreeDepths(node->left, depth + 1, nodes, totalDepth);
+    int right = subtreeDepths(node->right, depth + 1, nodes, totalDepth);
+    return (left > right) ? left : right;
+}
+
+/**
+ * @brief the memory the nodes of a tree take: whole slabs for a pooled tree, the slots and items
+ * for a frozen one, none for an intrusive one (its hooks are part of the items)
+ * @param tree the tree
+ * @param nodes the number of nodes of the tree
+ * @return the number of bytes
+ */
+long unsigned nodeMemory(const RBTree *tree, long unsigned nodes)
+{
+    if(tree->frozen != NULL)
+    {
+        return (tree->size + 1) * (tree->nodeBytes + sizeof(void *));
+    }
+    if(tree->hookOffset != RB_NOT_INTRUSIVE)
+    {
+        return 0;
+    }
+    if(tree->pool == NULL)
+    {
+        return nodes * tree->nodeBytes;
+    }
+    long unsigned bytes = 0;
+    for(const NodeSlab *slab = tree->pool->slabs; slab != NULL; slab = slab->next)
+    {
+        bytes += sizeof(NodeSlab) + slab->capacity * tree->nodeBytes;
+    }
+    return bytes;
+}
+
+#ifdef RB_TREE_STATS
+/**
+ * @brief constructs the counters of a new tree, with no blocks yet
+ * @return the registry, NULL on failure
+ */
+RBStatsRegistry * newStatsRegistry(void)
+{
+    RBStatsRegistry *stats = (RBStatsRegistry *)malloc(sizeof(RBStatsRegistry));
+    if(stats == NULL)
+    {
+        return NULL;
+    }
+    if(pthread_mutex_init(&stats->lock, NULL) != 0)
+    {
+        free(stats);
+        return NULL;
+    }
+    stats->blocks = NULL;
+    stats->serial = __atomic_add_fetch(&statsSerial, 1, __ATOMIC_RELAXED);
+    return stats;
+}
+
+/**
+ * @brief frees the counters of a tree, with the blocks of all the threads
+ * @param stats the registry
+ */
+void freeStatsRegistry(RBStatsRegistry *stats)
+{
+    StatsBlock *block = stats->blocks;
+    while(block != NULL)
+    {
+        StatsBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    pthread_mutex_destroy(&stats->lock);
+    free(stats);
+}
+
+/**
+ * @brief the calling thread's block of counters in a registry, from the thread's cache if it used
+ * the tree lately, else found or added under the registry's lock
+ * @param stats the registry
+ * @return the block, NULL if it could not be allocated
+ */
+StatsBlock * statsBlock(RBStatsRegistry *stats)
+{
+    StatsCacheEntry *entry = &statsCache[stats->serial % STATS_CACHE_SLOTS];
+    if(entry->registry == stats && entry->serial == stats->serial)
+    {
+        return entry->block;
+    }
+    pthread_t self = pthread_self();
+    pthread_mutex_lock(&stats->lock);
+    StatsBlock *block = stats->blocks;
+    while(block != NULL && !pthread_equal(block->thread, self))
+    {
+        block = block->next;
+    }
+    if(block == NULL)
+    {
+        block = (StatsBlock *)calloc(1, sizeof(StatsBlock));
+        if(block != NULL)
+        {
+            block->thread = self;
+            block->next = stats->blocks;
+            stats->blocks = block;
+        }
+    }
+    pthread_mutex_unlock(&stats->lock);
+    if(block != NULL)
+    {
+        entry->registry = stats;
+        entry->serial = stats->serial;
+        entry->block = block;
+    }
+    return block;
+}
+
+/**
+ * @brief counts an event in the calling thread's block. the owner is the only writer, so a plain
+ * increment is published with a relaxed store for the readers of RBTreeGetStats
+ * @param stats the registry
+ * @param counter the counter of the event
+ */
+void countEvent(RBStatsRegistry *stats, StatCounter counter)
+{
+    StatsBlock *block = statsBlock(stats);
+    if(block != NULL)
+    {
+        __atomic_store_n(&block->counts[counter], block->counts[counter] + 1, __ATOMIC_RELAXED);
+    }
+}
+#endif
+
+/**
+ * make the tree keep equal items instead of rejecting them. must be called before the first
+ * insertion, and not on maps or trees with snapshots.
+ * @param tree: the tree.
+ * @param counted: 0 to keep every item in a node of its own, after the equal items that are there
+ * already. other to keep one item per key with a count (not on intrusive trees or together with
+ * order statistics).
+ * @return: 0 on failure, other on success.
+ */
+int RBTreeEnableMultiset(RBTree *tree, int counted)
+{
+    if(tree == NULL || tree->root != NULL || tree->readOnly || tree->map ||
+       tree->versions != NULL || tree->multiset || tree->counted)
+    {
+        return 0;
+    }
+    if(!counted)
+    {
+        if(tree->lazyDelete)
+        {
+            return 0;
+        }
+        tree->multiset = 1;
+        return 1;
+    }
+    if(tree->hookOffset != RB_NOT_INTRUSIVE || tree->orderStatistics || tree->augment != NULL ||
+       (tree->pool != NULL && tree->pool->slabs != NULL))
+    {
+        return 0;
+    }
+    tree->counted = 1;
+    // the count goes right after the node, before the tombstone slot of lazy deletion
+    tree->nodeBytes += sizeof(long unsigned);
+    return 1;
+}
+
+/**
+ * @brief finds where data belongs in a multiset: after all the items that are not greater, so
+ * that equal items stay in the order they were added
+ * @param tree the RB tree
+ * @param data the data to place
+ * @param parent out: the node the data should be attached to (NULL if the tree is empty)
+ * @param comp out: < 0 - attach as a right kid, > 0 - as a left kid
+ */
+void lastPlace(const RBTree* tree, const void* data, Node** parent, int* comp)
+{
+    Node* current = tree->root;
+    *parent = NULL;
+    *comp = 0;
+    while (current != NULL)
+    {
+        *parent = current;
+        *comp = compareItems(tree, current->data, data);
+        if (*comp <= 0)
+        {
+            *comp = -1;
+            current = current->right;
+        }
+        else
+        {
+            current = current->left;
+        }
+    }
+}
+
+/**
+ * @brief takes one copy off the item of a node of a counted multiset
+ * @param tree the tree
+ * @param node the node
+ * @return 1 if the node still holds copies (nothing else to do), 0 if the node should be removed
+ */
+int dropCopy(RBTree *tree, Node *node)
+{
+    if(!tree->counted || copyCount(node) == 1)
+    {
+        return 0;
+    }
+    copyCount(node) -= 1;
+    return 1;
+}
+
+/**
+ * count the items of the tree that are equal to key, in O(log n + k) for k such items (O(log n)
+ * on a counted multiset).
+ * @param tree: the tree.
+ * @param key: the item to count.
+ * @return: the number of equal items.
+ */
+long unsigned RBTreeCount(const RBTree *tree, const void *key)
+{
+    Node *node = RBTreeFindNode(tree, key);
+    if(node == NULL)
+    {
+        return 0;
+    }
+    if(tree->counted)
+    {
+        return copyCount(node);
+    }
+    long unsigned count = 0;
+    for(; node != RBTreeEnd(tree) && compareItems(tree, node->data, key) == 0;
+          node = RBTreeNext(tree, node))
+    {
+        count++;
+    }
+    return count;
+}
+
+/**
+ * the number of copies of the item of a node, in O(1).
+ * @param tree: the tree.
+ * @param node: a node of the tree.
+ * @return: its count in a counted multiset, 1 in any other tree, 0 if there is no node.
+ */
+long unsigned RBTreeCopies(const RBTree *tree, const Node *node)
+{
+    if(tree == NULL || node == NULL)
+    {
+        return 0;
+    }
+    return tree->counted ? copyCount(node) : 1;
+}
+
+/**
+ * remove all the items of the tree that are equal to key, in O(log n + k) for k such items.
+ * @param tree: the tree.
+ * @param key: the item to remove. it may be one of the removed items only on a tree that is not a
+ * multiset.
+ * @return: the number of removed items (0 if there were none, or on failure).
+ */
+long unsigned eraseAllRBTree(RBTree *tree, const void *key)
+{
+    if(tree == NULL || tree->readOnly || key == NULL)
+    {
+        return 0;
+    }
+    Node *node = RBTreeFindNode(tree, key);
+    if(node == NULL)
+    {
+        return 0;
+    }
+    if(!tree->multiset)
+    {
+        long unsigned count = tree->counted ? copyCount(node) : 1;
+        if(sharesNodes(tree))
+        {
+            return deleteFromRBTree(tree, node->data) ? count : 0;
+        }
+        removeNode(tree, node);
+        return count;
+    }
+    long unsigned count = 0;
+    while(node != NULL && compareItems(tree, node->data, key) == 0)
+    {
+        // the successor keeps its node when node swaps places with it
+        Node *next = inOrderSuccessor(node);
+        removeNode(tree, node);
+        node = next;
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief tells whether an item may not come right before another in the tree: it is greater, or
+ * equal to it in a tree that is not a multiset
+ * @param tree the tree
+ * @param a the first item
+ * @param b the second item
+ * @return 1 if a cannot come before b, 0 if it can
+ */
+int outOfOrder(const RBTree *tree, const void *a, const void *b)
+{
+    int comp = compareItems(tree, a, b);
+    return tree->multiset ? comp > 0 : comp >= 0;
+}
+
+/**
+ * make deletions lazy: deleted items are marked as tombstones, to be removed by RBTreeCompact.
+ * must be called before the first insertion, and not on intrusive trees, maps, multisets that are
+ * not counted, or trees with order statistics, summaries or snapshots.
+ * @param tree: the tree.
+ * @return: 0 on failure, other on success.
+ */
+int RBTreeEnableLazyDelete(RBTree *tree)
+{
+    if(tree == NULL || tree->root != NULL || tree->readOnly || tree->lazyDelete ||
+       tree->hookOffset != RB_NOT_INTRUSIVE || tree->map || tree->multiset ||
+       tree->orderStatistics || tree->augment != NULL || tree->versions != NULL ||
+       (tree->pool != NULL && tree->pool->slabs != NULL))
+    {
+        return 0;
+    }
+    tree->lazyDelete = 1;
+    tree->nodeBytes += sizeof(long unsigned);
+    return 1;
+}
+
+/**
+ * @brief marks a node as a tombstone instead of removing it, and lists it for compaction
+ * @param tree the tree, with lazy deletion
+ * @param node a node that is not a tombstone
+ * @return 1 on success, 0 if the list could not grow (the node is left as it was)
+ */
+int buryNode(RBTree *tree, Node *node)
+{
+    if(tree->tombstoneCount == tree->tombstoneCapacity)
+    {
+        long unsigned capacity = (tree->tombstoneCapacity == 0) ? DEFAULT_TOMBSTONE_CAPACITY :
+                                 tree->tombstoneCapacity * 2;
+        Node **tombstones = (Node **)realloc(tree->tombstones, capacity * sizeof(Node *));
+        if(tombstones == NULL)
+        {
+            return 0;
+        }
+        tree->tombstones = tombstones;
+        tree->tombstoneCapacity = capacity;
+    }
+    tree->tombstones[tree->tombstoneCount] = node;
+    tree->tombstoneCount += 1;
+    tombstoneSlot(tree, node) = tree->tombstoneCount;
+    tree->size -= 1;
+    return 1;
+}
+
+/**
+ * @brief gives a tombstone a new item equal to its old one, which is freed (unless it is the same
+ * item), and takes the node off the list of tombstones
+ * @param tree the tree, with lazy deletion
+ * @param node a tombstone
+ * @param data the new item
+ */
+void reviveNode(RBTree *tree, Node *node, void *data)
+{
+    // the last tombstone of the list takes the node's place in it
+    Node *last = tree->tombstones[tree->tombstoneCount - 1];
+    tree->tombstones[tombstoneSlot(tree, node) - 1] = last;
+    tombstoneSlot(tree, last) = tombstoneSlot(tree, node);
+    tree->tombstoneCount -= 1;
+    tombstoneSlot(tree, node) = 0;
+    if(node->data != data)
+    {
+        tree->freeFunc(node->data);
+        node->data = data;
+    }
+    if(tree->counted)
+    {
+        copyCount(node) = 1;
+    }
+    tree->size += 1;
+}
+
+/**
+ * tell whether a node is a tombstone: its item was deleted from a tree with lazy deletion, and the
+ * node only waits for RBTreeCompact.
+ * @param tree: the tree.
+ * @param node: a node of the tree.
+ * @return: 0 for a live node (always, without lazy deletion), other for a tombstone.
+ */
+int RBTreeIsTombstone(const RBTree *tree, const Node *node)
+{
+    return tree != NULL && node != NULL && isTombstone(tree, node);
+}
+
+/**
+ * @brief skips the tombstones from a node on, in order
+ * @param tree the tree
+ * @param node the node to start from (may be NULL)
+ * @param forward 1 to go to greater items, 0 to smaller ones
+ * @return the first node that is not a tombstone, NULL if there is none
+ */
+Node * skipTombstones(const RBTree *tree, Node *node, int forward)
+{
+    while(node != NULL && isTombstone(tree, node))
+    {
+        node = forward ? inOrderSuccessor(node) : inOrderPredecessor(node);
+    }
+    return node;
+}
+
+/**
+ * remove up to budget tombstones from a tree with lazy deletion, the most recent first, freeing
+ * their items. once half of the nodes (or more) are tombstones, the tree is rebuilt in O(n)
+ * instead.
+ * @param tree: the tree.
+ * @param budget: the largest number of tombstones to remove one by one.
+ * @return: the number of tombstones removed.
+ */
+long unsigned RBTreeCompact(RBTree *tree, long unsigned budget)
+{
+    if(tree == NULL || !tree->lazyDelete || budget == 0 || tree->tombstoneCount == 0)
+    {
+        return 0;
+    }
+    long unsigned removed = tree->tombstoneCount;
+    if(removed >= tree->size && rebuildLive(tree))
+    {
+        return removed;
+    }
+    removed = 0;
+    while(removed < budget && tree->tombstoneCount > 0)
+    {
+        tree->tombstoneCount -= 1;
+        Node *node = tree->tombstones[tree->tombstoneCount];
+        tombstoneSlot(tree, node) = 0;
+        // counted back as an item, for unlinkNode to take it off
+        tree->size += 1;
+        unlinkNode(tree, node);
+        disposeNode(tree, node);
+        removed++;
+    }
+    return removed;
+}
+
+/**
+ * @brief removes all the tombstones of a tree, before an operation that moves its nodes
+ * @param tree the tree (may be NULL, or without lazy deletion)
+ */
+void compactAll(RBTree *tree)
+{
+    if(tree != NULL)
+    {
+        RBTreeCompact(tree, tree->tombstoneCount);
+    }
+}
+
+/**
+ * @brief rebuilds a tree with lazy deletion from the nodes that are not tombstones, linked into a
+ * balanced tree in O(n), and disposes of the tombstones
+ * @param tree the tree
+ * @return 1 on success, 0 if there was no memory for the rebuild (the tree is left as it was)
+ */
+int rebuildLive(RBTree *tree)
+{
+    Node **nodes = NULL;
+    if(tree->size > 0)
+    {
+        nodes = (Node **)malloc(tree->size * sizeof(Node *));
+        if(nodes == NULL)
+        {
+            return 0;
+        }
+    }
+    long unsigned n = 0;
+    for(Node *node = tree->leftmost; node != NULL; node = inOrderSuccessor(node))
+    {
+        if(!isTombstone(tree, node))
+        {
+            nodes[n++] = node;
+        }
+    }
+    // the walk needed the tombstones' links, they are disposed of only now
+    for(long unsigned i = 0; i < tree->tombstoneCount; i++)
+    {
+        disposeNode(tree, tree->tombstones[i]);
+    }
+    tree->tombstoneCount = 0;
+    tree->root = relinkHelper(nodes, 0, n, 0, redDepthOf(n));
+    resetEnds(tree);
+    free(nodes);
+    return 1;
+}
+
+/**
+ * @brief links a sorted range of nodes into a balanced subtree, as buildHelper does with items
+ * @param nodes the nodes, in ascending order
+ * @param lo the first index of the range
+ * @param hi the index after the last one
+ * @param depth the depth of the subtree's root
+ * @param redDepth the depth of the nodes that are colored red (the root is always black)
+ * @return the root of the subtree, NULL for an empty range
+ */
+Node * relinkHelper(Node **nodes, size_t lo, size_t hi, int depth, int redDepth)
+{
+    if(lo >= hi)
+    {
+        return NULL;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    Node *node = nodes[mid];
+    node->left = relinkHelper(nodes, lo, mid, depth + 1, redDepth);
+    node->right = relinkHelper(nodes, mid + 1, hi, depth + 1, redDepth);
+    if(node->left != NULL)
+    {
+        rbSetParent(node->left, node);
+    }
+    if(node->right != NULL)
+    {
+        rbSetParent(node->right, node);
+    }
+    rbInitParentColor(node, NULL, (depth == redDepth && depth > 0) ? RED : BLACK);
+    return node;
+}
+
+/**
+ * make the tree's nodes shareable with snapshots. must be called before the first insertion, and
+ * only on a tree that is not pooled, not intrusive and does not keep subtree sizes.
+ * @param tree: the tree.
+ * @return: 0 on failure, other on success.
+ */
+int RBTreeEnableSnapshots(RBTree *tree)
+{
+    if(tree == NULL || tree->root != NULL || tree->readOnly || tree->versions != NULL ||
+       tree->pool != NULL || tree->hookOffset != RB_NOT_INTRUSIVE || tree->orderStatistics ||
+       tree->augment != NULL || tree->map || tree->multiset || tree->counted || tree->lazyDelete)
+    {
+        return 0;
+    }
+    RBVersions *versions = (RBVersions *)malloc(sizeof(RBVersions));
+    if(versions == NULL)
+    {
+        return 0;
+    }
+    versions->trees = 1;
+    versions->snapshots = 0;
+    tree->versions = versions;
+    tree->nodeBytes = sizeof(Node) + sizeof(NodeShare);
+    return 1;
+}
+
+/**
+ * take a read-only snapshot of a tree with snapshots enabled, in O(1): the snapshot shares the
+ * root (and so every node) of the tree.
+ * @param tree: the tree (or another snapshot of it).
+ * @return: the snapshot, NULL on failure.
+ */
+RBTree *RBTreeSnapshot(RBTree *tree)
+{
+    if(tree == NULL || tree->versions == NULL)
+    {
+        return NULL;
+    }
+    RBTree *snapshot = newRBTree(tree->compFunc, tree->freeFunc);
+    if(snapshot == NULL)
+    {
+        return NULL;
+    }
+    snapshot->root = tree->root;
+    snapshot->leftmost = tree->leftmost;
+    snapshot->rightmost = tree->rightmost;
+    snapshot->size = tree->size;
+    snapshot->nodeBytes = tree->nodeBytes;
+    snapshot->versions = tree->versions;
+    snapshot->readOnly = 1;
+    if(tree->root != NULL)
+    {
+        nodeShare(tree->root)->refs += 1;
+    }
+    tree->versions->trees += 1;
+    tree->versions->snapshots += 1;
+    return snapshot;
+}
+
+/**
+ * @brief tells whether some nodes of the tree may be shared with snapshots, so that writes have
+ * to copy the nodes they change first
+ * @param tree the tree
+ * @return 1 if snapshots of the tree exist, 0 if not
+ */
+int sharesNodes(const RBTree *tree)
+{
+    return tree->versions != NULL && tree->versions->snapshots > 0;
+}
+
+/**
+ * @brief replaces a shared node of the live tree with a private copy, which takes its place under
+ * its (already private) parent. the old node stays in the snapshots; only the parent links of its
+ * kids move to the copy, which snapshots never follow
+ * @param tree the live tree
+ * @param link the link from the parent (or the root) to the node, may hold NULL
+ * @return 0 on failure 1 if not
+ */
+int unshareNode(RBTree *tree, Node **link)
+{
+    Node *shared = *link;
+    if(shared == NULL || nodeShare(shared)->refs == 1)
+    {
+        return 1;
+    }
+    Node *copy = (Node *)malloc(tree->nodeBytes);
+    if(copy == NULL)
+    {
+        return 0;
+    }
+    long unsigned *itemRefs = nodeShare(shared)->itemRefs;
+    if(itemRefs == NULL)
+    {
+        itemRefs = (long unsigned *)malloc(sizeof(long unsigned));
+        if(itemRefs == NULL)
+        {
+            free(copy);
+            return 0;
+        }
+        *itemRefs = 1;
+        nodeShare(shared)->itemRefs = itemRefs;
+    }
+    countStat(tree, STAT_NODE_ALLOCATIONS);
+    *itemRefs += 1;
+    copy->parentColor = shared->parentColor;
+    copy->left = shared->left;
+    copy->right = shared->right;
+    copy->data = shared->data;
+    nodeShare(copy)->refs = 1;
+    nodeShare(copy)->itemRefs = itemRefs;
+    nodeShare(shared)->refs -= 1;
+    if(copy->left != NULL)
+    {
+        nodeShare(copy->left)->refs += 1;
+        rbSetParent(copy->left, copy);
+    }
+    if(copy->right != NULL)
+    {
+        nodeShare(copy->right)->refs += 1;
+        rbSetParent(copy->right, copy);
+    }
+    replaceChild(tree, rbParent(shared), shared, copy);
+    if(tree->leftmost == shared)
+    {
+        tree->leftmost = copy;
+    }
+    if(tree->rightmost == shared)
+    {
+        tree->rightmost = copy;
+    }
+    return 1;
+}
+
+/**
+ * @brief unshares a node and its descendants up to a given depth
+ * @param tree the live tree
+ * @param link the link to the node (its parent must be private already)
+ * @param depth the number of levels to unshare, counting the node
+ * @return 0 on failure 1 if not
+ */
+int unshareTop(RBTree *tree, Node **link, int depth)
+{
+    if(unshareNode(tree, link) == 0)
+    {
+        return 0;
+    }
+    Node *node = *link;
+    if(node == NULL || depth <= 1)
+    {
+        return 1;
+    }
+    return unshareTop(tree, &node->left, depth - 1) && unshareTop(tree, &node->right, depth - 1);
+}
+
+/**
+ * @brief path copying: makes private every node that inserting or deleting data may change - the
+ * search path (down to the successor when deleting), the siblings along it that insertion
+ * recolors, and the top of the sibling subtrees that the deletion fixup recolors and rotates.
+ * that is O(log n) nodes
+ * @param tree the live tree
+ * @param data the item about to be inserted (not in the tree) or deleted (in the tree)
+ * @param deleting 0 for an insertion, other for a deletion
+ * @return 0 on failure 1 if not
+ */
+int unsharePath(RBTree *tree, const void *data, int deleting)
+{
+    int depth = deleting ? DELETE_SIBLING_DEPTH : 1;
+    int found = 0;
+    Node **link = &tree->root;
+    while (*link != NULL)
+    {
+        if(unshareNode(tree, link) == 0)
+        {
+            return 0;
+        }
+        Node *node = *link;
+        int goLeft = 1;
+        if(!found)
+        {
+            int comp = compareItems(tree, node->data, data);
+            // the deleted item swaps places with its successor, the leftmost node on its right
+            found = (comp == 0);
+            goLeft = (comp > 0);
+        }
+        if(unshareTop(tree, goLeft ? &node->right : &node->left, depth) == 0)
+        {
+            return 0;
+        }
+        link = goLeft ? &node->left : &node->right;
+    }
+    return 1;
+}
+
+/**
+ * @brief drops a reference to a node. a node that is no longer referenced is freed, together with
+ * its item if this was its last copy, and drops its references to its kids
+ * @param tree the version that lets go of the node
+ * @param node the node (may be NULL)
+ */
+void releaseShared(RBTree *tree, Node *node)
+{
+    if(node == NULL)
+    {
+        return;
+    }
+    nodeShare(node)->refs -= 1;
+    if(nodeShare(node)->refs > 0)
+    {
+        return;
+    }
+    releaseShared(tree, node->left);
+    releaseShared(tree, node->right);
+    freeRBTreeNode(tree, node);
+}
+
+/**
+ * @brief drops one copy of a node's item
+ * @param node a node of a tree with snapshots that is about to be freed
+ * @return 1 if it was the last copy (the item should be freed), 0 if not
+ */
+int lastItemCopy(Node *node)
+{
+    long unsigned *itemRefs = nodeShare(node)->itemRefs;
+    if(itemRefs == NULL)
+    {
+        return 1;
+    }
+    *itemRefs -= 1;
+    if(*itemRefs > 0)
+    {
+        return 0;
+    }
+    free(itemRefs);
+    return 1;
+}
+
+/**
+ * constructs a new RBTree out of sorted items in O(n), without any rebalancing. the nodes are
+ * allocated as one contiguous block (the first slab of a pooled tree).
+ * @param compFunc: a function two compare two items.
+ * @param freeFunc: a function to free an item.
+ * @param items: the items, in strictly ascending order. the tree takes ownership on success.
+ * @param n: the number of items.
+ * @return: the new tree, NULL on failure (including items that are not strictly ascending).
+ */
+RBTree *RBTreeBuildFromSorted(CompareFunc compFunc, FreeFunc freeFunc, void **items, size_t n)
+{
+    if(n > 0 && items == NULL)
+    {
+        return NULL;
+    }
+    for(size_t i = 0; i < n; i++)
+    {
+        if(items[i] == NULL || (i > 0 && compFunc(items[i - 1], items[i]) >= 0))
+        {
+            return NULL;
+        }
+    }
+    RBTree *tree = newRBTreeWithPool(compFunc, freeFunc, n);
+    if(tree == NULL)
+    {
+        return NULL;
+    }
+    if(n == 0)
+    {
+        return tree;
+    }
+    if(addSlab(tree->pool, n, tree->nodeBytes) == 0)
+    {
+        freeRBTree(&tree);
+        return NULL;
+    }
+    tree->pool->used = n;
+    tree->root = buildHelper(tree, items, 0, n, 0, redDepthOf(n));
+    tree->size = n;
+    resetEnds(tree);
+    return tree;
+}
+
+/**
+ * @brief links the nodes of a sorted range into a balanced subtree. node i of the slab holds
+ * item i, so the nodes lie in memory in ascending order
+ * @param tree the tree being built
+ * @param items all the items
+ * @param lo the first index of the range
+ * @param hi the index after the last one
+ * @param depth the depth of the subtree's root
+ * @param redDepth the depth of the nodes that are colored red (the root is always black)
+ * @return the root of the subtree, NULL for an empty range
+ */
+Node * buildHelper(RBTree *tree, void **items, size_t lo, size_t hi, int depth, int redDepth)
+{
+    if(lo >= hi)
+    {
+        return NULL;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    Node *node = slabNode(tree, tree->pool->slabs, mid);
+    node->data = items[mid];
+    node->left = buildHelper(tree, items, lo, mid, depth + 1, redDepth);
+    node->right = buildHelper(tree, items, mid + 1, hi, depth + 1, redDepth);
+    if(node->left != NULL)
+    {
+        rbSetParent(node->left, node);
+    }
+    if(node->right != NULL)
+    {
+        rbSetParent(node->right, node);
+    }
+    rbInitParentColor(node, NULL, (depth == redDepth && depth > 0) ? RED : BLACK);
+    return node;
+}
+
+/**
+ * @brief the depth of the red nodes of a tree of n nodes linked by midpoint splits. only its
+ * deepest level can be incomplete - it is colored red, so every path has the same number of blacks
+ * @param n the number of nodes
+ * @return the depth of the deepest level
+ */
+int redDepthOf(size_t n)
+{
+    int redDepth = 0;
+    for(size_t levelSize = n; levelSize > 1; levelSize /= 2)
+    {
+        redDepth++;
+    }
+    return redDepth;
+}
+
+/**
+ * write the items of a tree to a binary sorted stream, in ascending order: the magic bytes, the
+ * version and the number of items, then every item as its length and its encoded bytes. the
+ * numbers are little endian, so a stream can be read on any machine.
+ * @param tree: the tree (not a map or a multiset).
+ * @param file: the stream to write to.
+ * @param encode: the function to encode an item.
+ * @return: 0 on failure, other on success.
+ */
+int RBTreeWriteSorted(const RBTree *tree, FILE *file, EncodeFunc encode)
+{
+    if(tree == NULL || file == NULL || encode == NULL || tree->map || tree->multiset ||
+       tree->counted)
+    {
+        return 0;
+    }
+    size_t capacity = STREAM_BUFFER_SIZE;
+    unsigned char *buffer = (unsigned char *)malloc(capacity);
+    if(buffer == NULL)
+    {
+        return 0;
+    }
+    int result = fwrite(SORTED_STREAM_MAGIC, 1, 4, file) == 4 &&
+                 writeLittleEndian(file, SORTED_STREAM_VERSION, 4) &&
+                 writeLittleEndian(file, tree->size, 8);
+    for(Node *node = RBTreeBegin(tree); result && node != RBTreeEnd(tree);
+        node = RBTreeNext(tree, node))
+    {
+        size_t length = encode(node->data, buffer, capacity);
+        if(length != RB_ENCODE_FAILED && length > capacity)
+        {
+            // the item did not fit: grow the buffer once and encode it again
+            result = reserveBuffer(&buffer, &capacity, length);
+            length = result ? encode(node->data, buffer, capacity) : RB_ENCODE_FAILED;
+        }
+        result = result && length != RB_ENCODE_FAILED && length <= capacity &&
+                 length <= UINT32_MAX && writeLittleEndian(file, length, 4) &&
+                 fwrite(buffer, 1, length, file) == length;
+    }
+    free(buffer);
+    return result;
+}
+
+/**
+ * construct a new RBTree out of a binary sorted stream (see RBTreeWriteSorted) in O(n), the way
+ * RBTreeBuildFromSorted does.
+ * @param file: the stream to read from, at the start of the sorted stream.
+ * @param compFunc: a function two compare two items.
+ * @param freeFunc: a function to free an item.
+ * @param decode: the function to decode an item.
+ * @return: the new tree, NULL on failure (including a stream that is cut, of another version,
+ * or not strictly ascending).
+ */
+RBTree *RBTreeReadSorted(FILE *file, CompareFunc compFunc, FreeFunc freeFunc, DecodeFunc decode)
+{
+    if(file == NULL || compFunc == NULL || decode == NULL)
+    {
+        return NULL;
+    }
+    char magic[4];
+    uint64_t version = 0, count = 0;
+    if(fread(magic, 1, 4, file) != 4 || memcmp(magic, SORTED_STREAM_MAGIC, 4) != 0 ||
+       readLittleEndian(file, &version, 4) == 0 || version != SORTED_STREAM_VERSION ||
+       readLittleEndian(file, &count, 8) == 0 || count > SIZE_MAX / sizeof(void *))
+    {
+        return NULL;
+    }
+    size_t capacity = STREAM_BUFFER_SIZE;
+    unsigned char *buffer = (unsigned char *)malloc(capacity);
+    // the item array grows as items are read, so a corrupt count does not allocate up front
+    size_t itemCapacity = 0, n = 0;
+    void **items = NULL;
+    int result = (buffer != NULL);
+    while(result && n < count)
+    {
+        uint64_t length = 0;
+        if(n == itemCapacity)
+        {
+            size_t grown = (itemCapacity == 0) ? DEFAULT_SLAB_CAPACITY : itemCapacity * 2;
+            grown = (grown < count) ? grown : (size_t)count;
+            void **moved = (void **)realloc(items, grown * sizeof(void *));
+            if(moved == NULL)
+            {
+                result = 0;
+                break;
+            }
+            items = moved;
+            itemCapacity = grown;
+        }
+        result = readLittleEndian(file, &length, 4) && reserveBuffer(&buffer, &capacity, length) &&
+                 fread(buffer, 1, length, file) == length;
+        if(result)
+        {
+            items[n] = decode(buffer, length);
+            result = (items[n] != NULL);
+            n += result;
+        }
+    }
+    free(buffer);
+    RBTree *tree = result ? RBTreeBuildFromSorted(compFunc, freeFunc, items, n) : NULL;
+    if(tree == NULL && freeFunc != NULL)
+    {
+        for(size_t i = 0; i < n; i++)
+        {
+            freeFunc(items[i]);
+        }
+    }
+    free(items);
+    return tree;
+}
+
+/**
+ * @brief writes an unsigned number as little endian bytes
+ * @param file the stream
+ * @param value the number
+ * @param bytes the number of bytes to write (up to 8)
+ * @return 1 on success, 0 on failure
+ */
+int writeLittleEndian(FILE *file, uint64_t value, int bytes)
+{
+    unsigned char encoded[8];
+    for(int i = 0; i < bytes; i++)
+    {
+        encoded[i] = (unsigned char)(value >> (8 * i));
+    }
+    return fwrite(encoded, 1, bytes, file) == (size_t)bytes;
+}
+
+/**
+ * @brief reads an unsigned number of little endian bytes
+ * @param file the stream
+ * @param value out: the number
+ * @param bytes the number of bytes to read (up to 8)
+ * @return 1 on success, 0 if the stream is cut
+ */
+int readLittleEndian(FILE *file, uint64_t *value, int bytes)
+{
+    unsigned char encoded[8];
+    if(fread(encoded, 1, bytes, file) != (size_t)bytes)
+    {
+        return 0;
+    }
+    *value = 0;
+    for(int i = 0; i < bytes; i++)
+    {
+        *value |= (uint64_t)encoded[i] << (8 * i);
+    }
+    return 1;
+}
+
+/**
+ * @brief makes sure a stream buffer has room for a number of bytes, growing it if not. the buffer
+ * only grows, so a stream reallocates it once per item that is longer than all before it
+ * @param buffer the buffer, may be moved
+ * @param capacity the size of the buffer, updated
+ * @param size the number of bytes
+ * @return 1 on success, 0 on failure (the buffer is left as it was)
+ */
+int reserveBuffer(unsigned char **buffer, size_t *capacity, size_t size)
+{
+    if(size <= *capacity)
+    {
+        return 1;
+    }
+    unsigned char *grown = (unsigned char *)realloc(*buffer, size);
+    if(grown == NULL)
+    {
+        return 0;
+    }
+    *buffer = grown;
+    *capacity = size;
+    return 1;
+}
+
+/**
+ * write the tree as an image file that RBTreeMap maps back as a frozen tree. the image holds the
+ * encoded items, then the slots of the frozen tree; the pointers in the slots are offsets into
+ * the image plus the address the image was laid out for.
+ * @param tree: the tree (not a map or a multiset).
+ * @param path: the file to write.
+ * @param encode: the function to encode an item.
+ * @return: 0 on failure, other on success.
+ */
+int RBTreeSave(const RBTree *tree, const char *path, EncodeFunc encode)
+{
+    if(tree == NULL || path == NULL || encode == NULL || tree->map || tree->multiset ||
+       tree->counted || tree->size >= SIZE_MAX / sizeof(uintptr_t))
+    {
+        return 0;
+    }
+    uintptr_t *slotItems = (uintptr_t *)calloc(tree->size + 1, sizeof(uintptr_t));
+    if(slotItems == NULL)
+    {
+        return 0;
+    }
+    FILE *file = fopen(path, "wb");
+    if(file == NULL)
+    {
+        free(slotItems);
+        return 0;
+    }
+    ImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+    header.byteOrder = IMAGE_BYTE_ORDER;
+    header.pointerBytes = sizeof(void *);
+    header.base = imageBase(path);
+    header.size = tree->size;
+    header.nodeBytes = sizeof(Node);
+    header.itemsOffset = alignUp(sizeof(ImageHeader), IMAGE_ITEM_ALIGNMENT);
+    uint64_t end = header.itemsOffset;
+    static const char padding[IMAGE_SLOT_ALIGNMENT];
+    // the header is written again once the offsets are known
+    int result = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(padding, 1, end - sizeof(header), file) == end - sizeof(header) &&
+                 writeImageItems(tree, file, encode, (uintptr_t)header.base, slotItems, &end);
+    if(result)
+    {
+        header.slotsOffset = alignUp(end, IMAGE_SLOT_ALIGNMENT);
+        header.imageBytes = header.slotsOffset +
+                            (header.size + 1) * (header.nodeBytes + sizeof(void *));
+        result = fwrite(padding, 1, header.slotsOffset - end, file) == header.slotsOffset - end &&
+                 writeImageSlots(file, slotItems, tree->size) && fseek(file, 0, SEEK_SET) == 0 &&
+                 fwrite(&header, sizeof(header), 1, file) == 1;
+    }
+    free(slotItems);
+    result = (fclose(file) == 0) && result;
+    if(result == 0)
+    {
+        remove(path);
+    }
+    return result;
+}
+
+/**
+ * @brief writes the encoded items of a tree into an image, each aligned to IMAGE_ITEM_ALIGNMENT,
+ * and records the address each will have in the mapped image by the slot of its item
+ * @param tree the tree
+ * @param file the image, at the first item
+ * @param encode the function to encode an item
+ * @param base the address the image is laid out for
+ * @param slotItems out: the address of every item, by slot (1 to size)
+ * @param end in: the offset of the first item, out: the offset after the last one
+ * @return 1 on success, 0 on failure
+ */
+int writeImageItems(const RBTree *tree, FILE *file, EncodeFunc encode, uintptr_t base,
+                    uintptr_t *slotItems, uint64_t *end)
+{
+    static const char padding[IMAGE_ITEM_ALIGNMENT];
+    size_t capacity = STREAM_BUFFER_SIZE;
+    unsigned char *buffer = (unsigned char *)malloc(capacity);
+    int result = (buffer != NULL);
+    // the items are written in ascending order, the slots are visited in the same order
+    long unsigned slot = (tree->size > 0) ? edgeSlot(tree->size, 0) : 0;
+    for(Node *node = RBTreeBegin(tree); result && node != RBTreeEnd(tree);
+        node = RBTreeNext(tree, node))
+    {
+        size_t length = encode(node->data, buffer, capacity);
+        if(length != RB_ENCODE_FAILED && length > capacity)
+        {
+            result = reserveBuffer(&buffer, &capacity, length);
+            length = result ? encode(node->data, buffer, capacity) : RB_ENCODE_FAILED;
+        }
+        uint64_t aligned = alignUp(*end + length, IMAGE_ITEM_ALIGNMENT);
+        result = result && length != RB_ENCODE_FAILED && length <= capacity &&
+                 aligned <= UINTPTR_MAX - base && fwrite(buffer, 1, length, file) == length &&
+                 fwrite(padding, 1, aligned - *end - length, file) == aligned - *end - length;
+        slotItems[slot] = base + (uintptr_t)*end;
+        *end = aligned;
+        slot = stepSlot(tree->size, slot, 1);
+    }
+    free(buffer);
+    return result;
+}
+
+/**
+ * @brief writes the slots of an image in the layout of a frozen tree: size + 1 nodes without
+ * links (slot 0 is unused), then the item of every slot
+ * @param file the image, at the first slot
+ * @param slotItems the address of every item, by slot
+ * @param size the number of items
+ * @return 1 on success, 0 on failure
+ */
+int writeImageSlots(FILE *file, const uintptr_t *slotItems, long unsigned size)
+{
+    for(long unsigned slot = 0; slot <= size; slot++)
+    {
+        Node node;
+        memset(&node, 0, sizeof(node));
+        node.data = (void *)slotItems[slot];
+        if(fwrite(&node, sizeof(node), 1, file) != 1)
+        {
+            return 0;
+        }
+    }
+    return fwrite(slotItems, sizeof(uintptr_t), size + 1, file) == size + 1;
+}
+
+/**
+ * map an image written by RBTreeSave as a frozen tree, without reading its items. the image is
+ * mapped privately at the address it was laid out for if it is free, otherwise wherever it can
+ * be and its pointers are moved.
+ * @param path: the image.
+ * @param compFunc: a function two compare two items (as they were encoded).
+ * @return: the tree, NULL on failure.
+ */
+RBTree *RBTreeMap(const char *path, CompareFunc compFunc)
+{
+    if(path == NULL || compFunc == NULL)
+    {
+        return NULL;
+    }
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        return NULL;
+    }
+    ImageHeader header;
+    struct stat status;
+    RBTree *tree = NULL;
+    if(fstat(fd, &status) == 0 && pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+       validImageHeader(&header, status.st_size))
+    {
+        tree = newRBTree(compFunc, NULL);
+    }
+    void *image = MAP_FAILED;
+    if(tree != NULL)
+    {
+        image = mmap((void *)(uintptr_t)header.base, header.imageBytes, PROT_READ, MAP_PRIVATE,
+                     fd, 0);
+    }
+    close(fd);
+    if(image == MAP_FAILED)
+    {
+        if(tree != NULL)
+        {
+            freeRBTree(&tree);
+        }
+        return NULL;
+    }
+    tree->image = image;
+    tree->imageBytes = header.imageBytes;
+    tree->frozen = (Node *)((char *)image + header.slotsOffset);
+    tree->size = header.size;
+    if(image != (void *)(uintptr_t)header.base && relocateImage(tree, &header, image) == 0)
+    {
+        // unmaps the image
+        freeRBTree(&tree);
+        return NULL;
+    }
+    if(tree->size > 0)
+    {
+        tree->leftmost = frozenNode(tree, edgeSlot(tree->size, 0));
+        tree->rightmost = frozenNode(tree, edgeSlot(tree->size, 1));
+    }
+    tree->readOnly = 1;
+    return tree;
+}
+
+/**
+ * @brief checks that the header of an image was written on a machine like this one, and that
+ * its parts fit in the file
+ * @param header the header
+ * @param fileBytes the size of the file
+ * @return 1 if the image can be mapped, 0 if not
+ */
+int validImageHeader(const ImageHeader *header, off_t fileBytes)
+{
+    if(memcmp(header->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0 ||
+       header->byteOrder != IMAGE_BYTE_ORDER || header->pointerBytes != sizeof(void *) ||
+       header->nodeBytes != sizeof(Node) || header->base % IMAGE_SLOT_ALIGNMENT != 0 ||
+       header->slotsOffset % IMAGE_SLOT_ALIGNMENT != 0 || fileBytes < 0 ||
+       header->imageBytes != (uint64_t)fileBytes || header->imageBytes > SIZE_MAX ||
+       header->itemsOffset < sizeof(ImageHeader) || header->slotsOffset < header->itemsOffset ||
+       header->size >= header->imageBytes)
+    {
+        return 0;
+    }
+    // the slots are the rest of the image
+    return header->slotsOffset <= header->imageBytes &&
+           (header->imageBytes - header->slotsOffset) ==
+           (header->size + 1) * (header->nodeBytes + sizeof(void *));
+}
+
+/**
+ * @brief moves the item pointers of an image that could not be mapped at its base. only the
+ * pages of the slots are written (and so copied for this process), the items are left shared
+ * @param tree the mapped tree
+ * @param header the header of the image
+ * @param image the address the image was mapped at
+ * @return 1 on success, 0 on failure (including pointers outside the items of the image)
+ */
+int relocateImage(RBTree *tree, const ImageHeader *header, char *image)
+{
+    // the slots start on a page boundary or share the page with the last items
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t first = (size_t)header->slotsOffset / page * page;
+    if(mprotect(image + first, header->imageBytes - first, PROT_READ | PROT_WRITE) != 0)
+    {
+        return 0;
+    }
+    uintptr_t delta = (uintptr_t)image - (uintptr_t)header->base;
+    void **items = frozenItems(tree);
+    int result = 1;
+    for(long unsigned slot = 1; slot <= tree->size; slot++)
+    {
+        uintptr_t offset = (uintptr_t)frozenNode(tree, slot)->data - (uintptr_t)header->base;
+        if(offset < header->itemsOffset || offset >= header->slotsOffset ||
+           (uintptr_t)items[slot] != (uintptr_t)frozenNode(tree, slot)->data)
+        {
+            result = 0;
+            break;
+        }
+        frozenNode(tree, slot)->data = (char *)frozenNode(tree, slot)->data + delta;
+        items[slot] = frozenNode(tree, slot)->data;
+    }
+    return mprotect(image + first, header->imageBytes - first, PROT_READ) == 0 && result;
+}
+
+/**
+ * @brief picks the address an image is laid out for, spreading the images by their paths so
+ * that a process can usually map several of them where they were laid out for
+ * @param path the path of the image
+ * @return the address
+ */
+uintptr_t imageBase(const char *path)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for(; *path != '\0'; path++)
+    {
+        hash = (hash ^ (unsigned char)*path) * 1099511628211ULL;
+    }
+    return IMAGE_BASE + (uintptr_t)(hash % IMAGE_BASE_SLOTS) * IMAGE_BASE_SPREAD;
+}
+
+/**
+ * turn the tree into a read-only, contiguous array of its nodes in breadth first (Eytzinger)
+ * order. the kids of a slot are found by its position, so the array holds no links.
+ * @param tree: the tree, without snapshots.
+ * @return: 0 on failure (the tree is left as it was), other on success.
+ */
+int RBTreeFreeze(RBTree *tree)
+{
+    if(tree == NULL || tree->readOnly || tree->versions != NULL || tree->retireFunc != NULL)
+    {
+        return 0;
+    }
+    Node *frozen = (Node *)malloc((tree->size + 1) * (tree->nodeBytes + sizeof(void *)));
+    if(frozen == NULL)
+    {
+        return 0;
+    }
+    // the tombstones are not counted in the size, and are removed once freezing cannot fail
+    compactAll(tree);
+    tree->frozen = frozen;
+    fillFrozen(tree, 1, tree->leftmost);
+    if(tree->pool != NULL)
+    {
+        NodeSlab *slab = tree->pool->slabs;
+        while(slab != NULL)
+        {
+            NodeSlab *next = slab->next;
+            free(slab);
+            slab = next;
+        }
+        free(tree->pool);
+        tree->pool = NULL;
+    }
+    else if(tree->hookOffset == RB_NOT_INTRUSIVE)
+    {
+        releaseNodes(tree, tree->root);
+    }
+    tree->root = NULL;
+    tree->leftmost = NULL;
+    tree->rightmost = NULL;
+    if(tree->size > 0)
+    {
+        tree->leftmost = frozenNode(tree, edgeSlot(tree->size, 0));
+        tree->rightmost = frozenNode(tree, edgeSlot(tree->size, 1));
+    }
+    // positions are found by the slots, the subtree sizes and summaries are left unused
+    tree->orderStatistics = 0;
+    tree->augment = NULL;
+    tree->measure = NULL;
+    tree->intervalLow = NULL;
+    tree->lazyDelete = 0;
+    tree->readOnly = 1;
+    return 1;
+}
+
+/**
+ * @brief fills the slots of a frozen subtree with copies of the tree's nodes, in ascending order
+ * @param tree the tree being frozen
+ * @param slot the root slot of the subtree
+ * @param next the node of the subtree's smallest item
+ * @return the node that follows the subtree's largest item
+ */
+Node * fillFrozen(RBTree *tree, long unsigned slot, Node *next)
+{
+    if(slot > tree->size)
+    {
+        return next;
+    }
+    next = fillFrozen(tree, 2 * slot, next);
+    Node *node = frozenNode(tree, slot);
+    memcpy(node, next, tree->nodeBytes);
+    node->parentColor = 0;
+    node->left = NULL;
+    node->right = NULL;
+    frozenItems(tree)[slot] = node->data;
+    return fillFrozen(tree, 2 * slot + 1, inOrderSuccessor(next));
+}
+
+/**
+ * @brief frees the nodes of a subtree of a tree that allocates them one by one, keeping the items.
+ * iterative, rotating left kids up as freeHelper does
+ * @param tree the tree
+ * @param node the root of the subtree (may be NULL)
+ */
+void releaseNodes(RBTree *tree, Node *node)
+{
+    while(node != NULL)
+    {
+        Node *left = node->left;
+        if(left != NULL)
+        {
+            node->left = left->right;
+            left->right = node;
+            node = left;
+            continue;
+        }
+        Node *right = node->right;
+        releaseNode(tree, node);
+        node = right;
+    }
+}
+
+/**
+ * @brief finds the first item of a frozen tree that is not smaller than data (or greater, if
+ * strict), descending the slots without branching on the comparisons
+ * @param tree the frozen tree
+ * @param data the bound
+ * @param strict 0 for the first item >= data, other for the first item > data
+ * @return the node of the item, NULL if there is none
+ */
+Node * frozenBound(const RBTree *tree, const void *data, int strict)
+{
+    void **items = frozenItems(tree);
+    long unsigned slot = 1;
+    while (slot <= tree->size)
+    {
+        long unsigned ahead = slot << FROZEN_PREFETCH_LEVELS;
+        if (ahead <= tree->size)
+        {
+            prefetchNode(&items[ahead]);
+        }
+        int comp = compareItems(tree, items[slot], data);
+        slot = 2 * slot + (comp < 0 || (comp == 0 && strict));
+    }
+    // the bound is where the search last went left: drop the right turns after it, then it
+    while (slot & 1)
+    {
+        slot >>= 1;
+    }
+    slot >>= 1;
+    return (slot == 0) ? NULL : frozenNode(tree, slot);
+}
+
+/**
+ * @brief moves a cursor of a frozen tree to the next (or previous) item, by slot arithmetic
+ * @param tree the frozen tree
+ * @param node the cursor
+ * @param forward 1 for the next item, 0 for the previous one
+ * @return the node, NULL past the end
+ */
+Node * frozenStep(const RBTree *tree, const Node *node, int forward)
+{
+    long unsigned slot = stepSlot(tree->size, frozenSlot(tree, node), forward);
+    return (slot == 0) ? NULL : frozenNode(tree, slot);
+}
+
+/**
+ * @brief finds the slot of the next (or previous) item of a frozen tree
+ * @param size the number of slots
+ * @param slot the slot of the item
+ * @param forward 1 for the next item, 0 for the previous one
+ * @return the slot, 0 past the end
+ */
+long unsigned stepSlot(long unsigned size, long unsigned slot, int forward)
+{
+    long unsigned toward = forward ? 1 : 0;
+    if (2 * slot + toward <= size)
+    {
+        // the nearest slot on the side of the step, down its subtree
+        slot = 2 * slot + toward;
+        while (2 * slot + 1 - toward <= size)
+        {
+            slot = 2 * slot + 1 - toward;
+        }
+        return slot;
+    }
+    // the first ancestor that the slot is not on the side of the step of
+    while (slot != 0 && (slot & 1) == toward)
+    {
+        slot >>= 1;
+    }
+    return slot >> 1;
+}
+
+/**
+ * @brief finds the slot of the smallest (or largest) item of a frozen tree: the end of the path
+ * of left (or right) kids from the root
+ * @param size the number of slots, at least 1
+ * @param largest 0 for the smallest item, other for the largest one
+ * @return the slot
+ */
+long unsigned edgeSlot(long unsigned size, int largest)
+{
+    long unsigned toward = largest ? 1 : 0;
+    long unsigned slot = 1;
+    while (2 * slot + toward <= size)
+    {
+        slot = 2 * slot + toward;
+    }
+    return slot;
+}
+
+/**
+ * @brief finds where data belongs in the tree, in a single descent (one compFunc call per level)
+ * @param tree the RB tree
+ * @param data the data to look for
+ * @param parent out: the node the data should be attached to (NULL if the tree is empty)
+ * @param comp out: the last comparison result (< 0 - attach as a right kid, > 0 - as a left kid)
+ * @return the node holding an equal item if there is one, NULL otherwise
+ */
+Node * insertionPoint(const RBTree* tree, const void* data, Node** parent, int* comp)
+{
+    return insertionPointFrom(tree, tree->root, data, parent, comp);
+}
+
+/**
+ * @brief finds where data belongs in a subtree that is known to contain its place
+ * @param tree the RB tree
+ * @param start the root of the subtree
+ * @param data the data to look for
+ * @param parent out: the node the data should be attached to (NULL if the subtree is empty)
+ * @param comp out: the last comparison result (< 0 - attach as a right kid, > 0 - as a left kid)
+ * @return the node holding an equal item if there is one, NULL otherwise
+ */
+Node * insertionPointFrom(const RBTree* tree, Node* start, const void* data, Node** parent,
+                          int* comp)
+{
+    Node* current = start;
+    *parent = NULL;
+    *comp = 0;
+    while (current != NULL)
+    {
+        *comp = compareItems(tree, current->data, data);
+        if (*comp == 0)
+        {
+            //duplicate
+            return current;
+        }
+        *parent = current;
+        current = (*comp < 0) ? current->right : current->left;
+    }
+    return NULL;
+}
+
+/**
+ * @brief links a new node under the attach point found by insertionPoint and rebalances
+ * @param tree the RB tree
+ * @param parent the attach point (NULL if the tree is empty)
+ * @param comp the last comparison result returned by insertionPoint
+ * @param new the node to add
+ */
+void treeRBinsert(RBTree* tree, Node* parent, int comp, Node* new)
+{
+    countStat(tree, STAT_INSERTS);
+    new->left = NULL;
+    new->right = NULL;
+    rbInitParentColor(new, parent, RED);
+    if (tree->orderStatistics)
+    {
+        subtreeSize(new) = 1;
+        addToSizes(parent, 1);
+    }
+    if (tree->versions != NULL)
+    {
+        nodeShare(new)->refs = 1;
+        nodeShare(new)->itemRefs = NULL;
+    }
+    if (tree->map)
+    {
+        *valueSlot(tree, new) = NULL;
+    }
+    if (tree->counted)
+    {
+        copyCount(new) = 1;
+    }
+    if (tree->lazyDelete)
+    {
+        tombstoneSlot(tree, new) = 0;
+    }
+    if (parent == NULL)
+    {
+        setLink(tree->root, new);
+        tree->leftmost = new;
+        tree->rightmost = new;
+    }
+    else if (comp < 0)
+    {
+        setLink(parent->right, new);
+        if (parent == tree->rightmost)
+        {
+            tree->rightmost = new;
+        }
+    }
+    else
+    {
+        setLink(parent->left, new);
+        if (parent == tree->leftmost)
+        {
+            tree->leftmost = new;
+        }
+    }
+    if (tree->augment != NULL)
+    {
+        updateAugmentPath(tree, new);
+    }
+    fixTreeInsert(tree, new);
+    tree->size += 1;
+}
+
+/**
+ * add an item to the tree
+ * @param tree: the tree to add an item to.
+ * @param data: item to add to the tree.
+ * @return: 0 on failure, other on success. (if the item is already in the tree - failure).
+ */
+int insertToRBTree(RBTree *tree, void *data)
+{
+    if(tree == NULL || tree->readOnly)
+    {
+        return 0;
+    }
+    if(data == NULL)
+    {
+        return 0;
+    }
+    Node* parent;
+    int comp;
+    if(tree->multiset)
+    {
+        lastPlace(tree, data, &parent, &comp);
+    }
+    else
+    {
+        Node* equal = insertionPoint(tree, data, &parent, &comp);
+        if(equal != NULL && isTombstone(tree, equal))
+        {
+            reviveNode(tree, equal, data);
+            return 1;
+        }
+        if(equal != NULL && !tree->counted)
+        {
+            return 0;
+        }
+        if(equal != NULL)
+        {
+            // a counted multiset keeps the first copy only
+            copyCount(equal) += 1;
+            if(equal->data != data)
+            {
+                tree->freeFunc(data);
+            }
+            return 1;
+        }
+    }
+    if(sharesNodes(tree))
+    {
+        if(unsharePath(tree, data, 0) == 0)
+        {
+            return 0;
+        }
+        // the attach point may have been copied
+        insertionPoint(tree, data, &parent, &comp);
+    }
+    Node* newNode = allocNode(tree, data);
+    if(newNode == NULL)
+    {
+        return 0;
+    }
+    newNode->data = data;
+    treeRBinsert(tree, parent, comp, newNode);
+    return 1;
+}
+
+/**
+ * add an item to the tree, trying the place next to a hint before searching from the root. when
+ * data belongs right before or after the hint, this is O(1) amortized.
+ * @param tree: the tree to add an item to.
+ * @param hint: a cursor of the tree near the item's place, RBTreeEnd(tree) for after the largest.
+ * @param data: item to add to the tree.
+ * @return: 0 on failure, other on success. (if the item is already in the tree - failure).
+ */
+int insertToRBTreeHint(RBTree *tree, Node *hint, void *data)
+{
+    if(tree == NULL || tree->readOnly)
+    {
+        return 0;
+    }
+    if(data == NULL)
+    {
+        return 0;
+    }
+    if(sharesNodes(tree) || tree->multiset || tree->counted)
+    {
+        // the path from the root has to be copied anyway, or equal items are not rejected
+        return insertToRBTree(tree, data);
+    }
+    if(hint == RBTreeEnd(tree))
+    {
+        hint = tree->rightmost;
+    }
+    Node* parent = NULL;
+    int comp = 0;
+    Node* equal = (hint == NULL) ? NULL : hintSearch(tree, hint, data, &parent, &comp);
+    if(equal != NULL && isTombstone(tree, equal))
+    {
+        reviveNode(tree, equal, data);
+        return 1;
+    }
+    if(equal != NULL)
+    {
+        return 0;
+    }
+    Node* newNode = allocNode(tree, data);
+    if(newNode == NULL)
+    {
+        return 0;
+    }
+    newNode->data = data;
+    treeRBinsert(tree, parent, comp, newNode);
+    return 1;
+}
+
+/**
+ * @brief finds where data belongs, starting from a hint node. data that falls between the hint
+ * and one of its neighbors is placed there in O(1) amortized; data above the hint is looked for
+ * by a finger search, and data below the hint's predecessor from the root
+ * @param tree the RB tree
+ * @param hint a node of the tree
+ * @param data the data to look for
+ * @param parent out: the node the data should be attached to
+ * @param comp out: the last comparison result (< 0 - attach as a right kid, > 0 - as a left kid)
+ * @return the node holding an equal item if there is one, NULL otherwise
+ */
+Node * hintSearch(const RBTree* tree, Node* hint, const void* data, Node** parent, int* comp)
+{
+    int hintComp = compareItems(tree, hint->data, data);
+    if (hintComp == 0)
+    {
+        *parent = rbParent(hint);
+        *comp = 0;
+        return hint;
+    }
+    if (hintComp < 0)
+    {
+        return fingerSearch(tree, hint, data, parent, comp);
+    }
+    Node* prev = (hint == tree->leftmost) ? NULL : inOrderPredecessor(hint);
+    int prevComp = (prev == NULL) ? -1 : compareItems(tree, prev->data, data);
+    if (prevComp == 0)
+    {
+        *parent = rbParent(prev);
+        *comp = 0;
+        return prev;
+    }
+    if (prevComp > 0)
+    {
+        return insertionPoint(tree, data, parent, comp);
+    }
+    // the place between the predecessor and the hint
+    if (hint->left == NULL)
+    {
+        *parent = hint;
+        *comp = 1;
+    }
+    else
+    {
+        *parent = maxValue(hint->left);
+        *comp = -1;
+    }
+    return NULL;
+}
+
+/**
+ * @brief finds where data belongs, starting from a finger node whose item is not greater. if data
+ * falls right after the finger it is placed next to it in O(1) amortized; otherwise the search
+ * climbs from the finger's successor only until an ancestor is greater than data, so nearby items
+ * cost O(log distance)
+ * @param tree the RB tree
+ * @param finger a node whose item is not greater than data
+ * @param data the data to look for
+ * @param parent out: the node the data should be attached to
+ * @param comp out: the last comparison result (< 0 - attach as a right kid, > 0 - as a left kid)
+ * @return the node holding an equal item if there is one, NULL otherwise
+ */
+Node * fingerSearch(const RBTree* tree, Node* finger, const void* data, Node** parent, int* comp)
+{
+    Node* next = (finger == tree->rightmost) ? NULL : inOrderSuccessor(finger);
+    int nextComp = (next == NULL) ? 1 : compareItems(tree, next->data, data);
+    if (nextComp > 0)
+    {
+        if (compareItems(tree, finger->data, data) == 0)
+        {
+            *parent = rbParent(finger);
+            *comp = 0;
+            return finger;
+        }
+        // the place between the finger and its successor
+        if (finger->right == NULL)
+        {
+            *parent = finger;
+            *comp = -1;
+        }
+        else
+        {
+            *parent = minValue(finger->right);
+            *comp = 1;
+        }
+        return NULL;
+    }
+    if (nextComp == 0)
+    {
+        *parent = rbParent(next);
+        *comp = 0;
+        return next;
+    }
+    Node* subtree = next;
+    Node* up = rbParent(subtree);
+    while (up != NULL)
+    {
+        // everything in a right subtree is greater than its parent, and so is data
+        if (up->left == subtree)
+        {
+            int upComp = compareItems(tree, up->data, data);
+            if (upComp == 0)
+            {
+                *parent = rbParent(up);
+                *comp = 0;
+                return up;
+            }
+            if (upComp > 0)
+            {
+                break;
+            }
+        }
+        subtree = up;
+        up = rbParent(subtree);
+    }
+    return insertionPointFrom(tree, subtree, data, parent, comp);
+}
+
+/**
+ * @brief merge sorts indices of items by the tree's order. the sort is stable
+ * @param tree the tree whose compFunc is used
+ * @param items the items
+ * @param indices the indices to sort
+ * @param buffer scratch space for n indices
+ * @param n the number of indices
+ */
+void sortIndices(const RBTree *tree, void **items, size_t *indices, size_t *buffer, size_t n)
+{
+    size_t *from = indices;
+    size_t *to = buffer;
+    for(size_t width = 1; width < n; width *= 2)
+    {
+        for(size_t lo = 0; lo < n; lo += 2 * width)
+        {
+            size_t mid = (lo + width < n) ? lo + width : n;
+            size_t hi = (lo + 2 * width < n) ? lo + 2 * width : n;
+            size_t i = lo, j = mid, k = lo;
+            while(i < mid && j < hi)
+            {
+                if(compareItems(tree, items[from[j]], items[from[i]]) < 0)
+                {
+                    to[k++] = from[j++];
+                }
+                else
+                {
+                    to[k++] = from[i++];
+                }
+            }
+            while(i < mid)
+            {
+                to[k++] = from[i++];
+            }
+            while(j < hi)
+            {
+                to[k++] = from[j++];
+            }
+        }
+        size_t *swap = from;
+        from = to;
+        to = swap;
+    }
+    if(from != indices)
+    {
+        for(size_t i = 0; i < n; i++)
+        {
+            indices[i] = from[i];
+        }
+    }
+}
+
+/**
+ * add a batch of items to the tree. the batch is sorted with the tree's compFunc and every item
+ * is placed by a finger search from the previous one, instead of descending from the root.
+ * @param tree: the tree to add the items to.
+ * @param items: the items to add.
+ * @param n: the number of items.
+ * @param results: optional (may be NULL), n entries. results[i] is set to 1 if items[i] was added,
+ * and to 0 if it was not (already in the tree, an earlier item of the batch equal to it, NULL).
+ * @return: 0 on failure (allocation failure), other on success.
+ */
+int insertBatchRBTree(RBTree *tree, void **items, size_t n, int *results)
+{
+    if(tree == NULL || tree->readOnly || (n > 0 && items == NULL))
+    {
+        return 0;
+    }
+    if(results != NULL)
+    {
+        for(size_t i = 0; i < n; i++)
+        {
+            results[i] = 0;
+        }
+    }
+    if(n == 0)
+    {
+        return 1;
+    }
+    if(tree->multiset || tree->counted)
+    {
+        // equal items are all added, in the batch's order
+        for(size_t i = 0; i < n; i++)
+        {
+            if(items[i] == NULL)
+            {
+                continue;
+            }
+            if(insertToRBTree(tree, items[i]) == 0)
+            {
+                return 0;
+            }
+            if(results != NULL)
+            {
+                results[i] = 1;
+            }
+        }
+        return 1;
+    }
+    size_t *indices = (size_t *)malloc(2 * n * sizeof(size_t));
+    if(indices == NULL)
+    {
+        return 0;
+    }
+    size_t count = 0;
+    for(size_t i = 0; i < n; i++)
+    {
+        if(items[i] != NULL)
+        {
+            indices[count++] = i;
+        }
+    }
+    // batches are often already in order - then the sort is skipped
+    size_t sorted = 1;
+    while(sorted < count && compareItems(tree, items[indices[sorted - 1]], items[indices[sorted]]) <= 0)
+    {
+        sorted++;
+    }
+    if(sorted < count)
+    {
+        sortIndices(tree, items, indices, indices + n, count);
+    }
+    Node* finger = NULL;
+    for(size_t i = 0; i < count; i++)
+    {
+        void *data = items[indices[i]];
+        Node* parent;
+        int comp;
+        Node* placed = (finger == NULL) ? insertionPoint(tree, data, &parent, &comp) :
+                       fingerSearch(tree, finger, data, &parent, &comp);
+        if(placed != NULL)
+        {
+            // a duplicate - the next items of the batch are still greater than it
+            finger = placed;
+            if(isTombstone(tree, placed))
+            {
+                reviveNode(tree, placed, data);
+                if(results != NULL)
+                {
+                    results[indices[i]] = 1;
+                }
+            }
+            continue;
+        }
+        if(sharesNodes(tree))
+        {
+            // copying the path may replace the attach point
+            if(unsharePath(tree, data, 0) == 0)
+            {
+                free(indices);
+                return 0;
+            }
+            insertionPoint(tree, data, &parent, &comp);
+        }
+        Node* newNode = allocNode(tree, data);
+        if(newNode == NULL)
+        {
+            free(indices);
+            return 0;
+        }
+        newNode->data = data;
+        treeRBinsert(tree, parent, comp, newNode);
+        finger = newNode;
+        if(results != NULL)
+        {
+            results[indices[i]] = 1;
+        }
+    }
+    free(indices);
+    return 1;
+}
+
+/**
+ * @brief returns the nodes parent
+ * @param node the node
+ * @return  the parent
+ */
+Node * getParent(Node* node)
+{
+    if(node == NULL || rbParent(node) == NULL)
+    {
+        return NULL;
+    }
+    else
+    {
+        return rbParent(node);
+    }
+}
+
+/**
+ * @brief returns the nodes uncle
+ * @param node the node
+ * @return  the uncle
+ */
+Node * getUncle(Node* node)
+{
+    Node * parent = getParent(node);
+    Node* grandParent = getParent(parent);
+    if(grandParent == NULL)
+    {
+        return NULL;
+    }
+    return (grandParent->left == parent) ? grandParent->right : grandParent->left;
+}
+
+/**
+ * @brief fixes the tree's colors after a new node was added, walking up from the new node
+ * @param tree the RB tree
+ * @param newlyAdded the new node
+ * @return 1 if the root had to be turned black (the black height of the tree grew), 0 if not
+ */
+int fixTreeInsert(RBTree* tree, Node* newlyAdded)
+{
+    Node* node = newlyAdded;
+    // case 1 - the node is the root, case 2 - the parent is black: no need to change
+    while (node != tree->root && rbColor(getParent(node)) == RED)
+    {
+        // a red parent is never the root, so the node has a grandparent
+        Node* uncle = getUncle(node);
+        Node* parent = getParent(node);
+        Node* grandParent = getParent(parent);
+        //case 3
+        if (uncle != NULL && rbColor(uncle) == RED)
+        {
+            countStat(tree, STAT_INSERT_RECOLORS);
+            rbSetColor(parent, BLACK);
+            rbSetColor(uncle, BLACK);
+            rbSetColor(grandParent, RED);
+            node = grandParent;
+        }
+        // if the uncle is black or null
+        else
+        {
+            if (parent->left == node)
+            {
+                rotateRight(tree, node);
+            }
+            else
+            {
+                rotateLeft(tree, node);
+            }
+            break;
+        }
+    }
+    int grew = (rbColor(tree->root) == RED);
+    rbSetColor(tree->root, BLACK);
+    return grew;
+}
+
+/**
+ * @brief rotates left
+ * @param node the node to rotate
+ */
+void rotateLeft(RBTree *tree, Node* node)
+{
+    Node* parent = getParent(node);
+    Node* grandParent = getParent(getParent(node));
+    //case the right kid of a left kid
+    if(grandParent->left == parent)
+    {
+        setLink(grandParent->left, node);
+        if(node->left != NULL)
+        {
+            rbSetParent(node->left, parent);
+        }
+        setLink(parent->right, node->left);
+        setLink(node->left, parent);
+        rbSetParent(node, grandParent);
+        rbSetParent(parent, node);
+        updateSummaries(tree, parent);
+        updateSummaries(tree, node);
+        countStat(tree, STAT_ROTATIONS);
+        countStat(tree, STAT_INSERT_DOUBLE_ROTATIONS);
+        rotateRight2(tree, parent);
+        rbSetColor(node, BLACK);
+    }
+    // case right kid of  right kid
+    else
+    {
+        countStat(tree, STAT_INSERT_SINGLE_ROTATIONS);
+        rotateLeft2(tree, node);
+        rbSetColor(parent, BLACK);
+    }
+    rbSetColor(grandParent, RED);
+}
+
+/**
+ * @brief rotates right
+ * @param node the node to rotate
+ */
+void rotateRight(RBTree *tree, Node* node)
+{
+    Node* parent = getParent(node);
+    Node* grandParent = getParent(getParent(node));
+    // case left kid of a right kid
+    if(grandParent->right == parent)
+    {
+        setLink(grandParent->right, node);
+        if(node->right != NULL)
+        {
+            rbSetParent(node->right, parent);
+        }
+        setLink(parent->left, node->right);
+        setLink(node->right, parent);
+        rbSetParent(node, grandParent);
+        rbSetParent(parent, node);
+        updateSummaries(tree, parent);
+        updateSummaries(tree, node);
+        countStat(tree, STAT_ROTATIONS);
+        countStat(tree, STAT_INSERT_DOUBLE_ROTATIONS);
+        rotateLeft2(tree, parent);
+        rbSetColor(node, BLACK);
+
+    }
+        //case left kid of a left kid
+    else
+    {
+        countStat(tree, STAT_INSERT_SINGLE_ROTATIONS);
+        rotateRight2(tree, node);
+        rbSetColor(parent, BLACK);
+    }
+    rbSetColor(grandParent, RED);
+}
+
+
+/**
+ * @brief step 2 of the left rotate
+ * @param tree the tree
+ * @param node the new node
+ */
+void rotateLeft2(RBTree *tree, Node* node)
+{
+    countStat(tree, STAT_ROTATIONS);
+    Node * grandParent = getParent(getParent(node));
+    Node* parent = getParent(node);
+
+    setLink(grandParent->right, parent->left);
+    if(parent->left != NULL)
+    {
+        rbSetParent(parent->left, grandParent);
+    }
+    setLink(parent->left, grandParent);
+    // grandparent is the root
+    if(rbParent(grandParent) == NULL)
+    {
+        setLink(tree->root, parent);
+        rbSetParent(parent, NULL);
+        rbSetColor(parent, BLACK);
+        rbSetParent(grandParent, parent);
+    }
+    else
+    {
+        if(rbParent(grandParent)->left == grandParent)
+        {
+            setLink(rbParent(grandParent)->left, parent);
+        }
+        else
+        {
+            setLink(rbParent(grandParent)->right, parent);
+        }
+        rbSetParent(parent, rbParent(grandParent));
+        rbSetParent(grandParent, parent);
+    }
+    updateSummaries(tree, grandParent);
+    updateSummaries(tree, parent);
+}
+
+/**
+ * @brief step 2 of the right rotate
+ * @param tree the tree
+ * @param node the new node
+ */
+void rotateRight2(RBTree *tree, Node* node)
+{
+    countStat(tree, STAT_ROTATIONS);
+    Node * grandParent = getParent(getParent(node));
+    Node* parent = getParent(node);
+    setLink(grandParent->left, parent->right);
+    if(parent->right != NULL)
+    {
+        rbSetParent(parent->right, grandParent);
+    }
+    setLink(parent->right, grandParent);
+    // grandparent is the root
+    if(rbParent(grandParent) == NULL)
+    {
+        setLink(tree->root, parent);
+        rbSetParent(parent, NULL);
+        rbSetColor(parent, BLACK);
+        rbSetParent(grandParent, parent);
+    }
+    else
+    {
+        if(rbParent(grandParent)->left == grandParent)
+        {
+            setLink(rbParent(grandParent)->left, parent);
+        }
+        else
+        {
+            setLink(rbParent(grandParent)->right, parent);
+        }
+        rbSetParent(parent, rbParent(grandParent));
+        rbSetParent(grandParent, parent);
+    }
+    updateSummaries(tree, grandParent);
+    updateSummaries(tree, parent);
+    rbSetColor(grandParent, RED);
+}
+
+/**
+ * @brief finds the successor of a node, the next node in ascending order
+ * @param n the node
+ * @return the successor, NULL if n is the maximum
+ */
+Node * inOrderSuccessor(Node *n)
+{
+    if (n == NULL)
+    {
+        return NULL;
+    }
+    if (n->right != NULL)
+    {
+        return minValue(n->right);
+    }
+    // the first ancestor that n is in the left subtree of
+    Node* parent = rbParent(n);
+    while (parent != NULL && parent->right == n)
+    {
+        n = parent;
+        parent = rbParent(n);
+    }
+    return parent;
+}
+
+/**
+ * @brief finds the predecessor of a node, the previous node in ascending order
+ * @param n the node
+ * @return the predecessor, NULL if n is the minimum
+ */
+Node * inOrderPredecessor(Node *n)
+{
+    if (n == NULL)
+    {
+        return NULL;
+    }
+    if (n->left != NULL)
+    {
+        return maxValue(n->left);
+    }
+    // the first ancestor that n is in the right subtree of
+    Node* parent = rbParent(n);
+    while (parent != NULL && parent->left == n)
+    {
+        n = parent;
+        parent = rbParent(n);
+    }
+    return parent;
+}
+
+/**
+ * @brief returns the minimum node
+ * @param node the node to search in its subtree
+ * @return the minimal node
+ */
+Node * minValue(Node* node)
+{
+    Node* current = node;
+    if(current == NULL)
+    {
+        return NULL;
+    }
+    while (current->left != NULL)
+    {
+        current = current->left;
+    }
+    return current;
+}
+
+/**
+ * @brief returns the maximum node
+ * @param node the node to search in its subtree
+ * @return the maximal node
+ */
+Node * maxValue(Node* node)
+{
+    Node* current = node;
+    if(current == NULL)
+    {
+        return NULL;
+    }
+    while (current->right != NULL)
+    {
+        current = current->right;
+    }
+    return current;
+}
+
+/**
+ * @brief recomputes the cached smallest and largest nodes of a tree whose root was replaced as a
+ * whole (by a build, a join or a split)
+ * @param tree the tree
+ */
+void resetEnds(RBTree *tree)
+{
+    tree->leftmost = minValue(tree->root);
+    tree->rightmost = maxValue(tree->root);
+}
+
+/**
+ * get the node of the smallest item of the tree, in O(1).
+ * @param tree: the tree.
+ * @return: the node, NULL if the tree is empty.
+ */
+Node *RBTreeMin(const RBTree *tree)
+{
+    return (tree == NULL) ? NULL : skipTombstones(tree, tree->leftmost, 1);
+}
+
+/**
+ * get the node of the largest item of the tree, in O(1).
+ * @param tree: the tree.
+ * @return: the node, NULL if the tree is empty.
+ */
+Node *RBTreeMax(const RBTree *tree)
+{
+    return (tree == NULL) ? NULL : skipTombstones(tree, tree->rightmost, 0);
+}
+
+/**
+ * remove the smallest item from the tree without freeing it, in O(1) amortized.
+ * @param tree: the tree.
+ * @return: the item, which the caller owns now. NULL if the tree is empty or the item cannot be
+ * handed over (a snapshot still holds it, or the tree defers reclamation).
+ */
+void *RBTreePopFront(RBTree *tree)
+{
+    if(tree == NULL || tree->readOnly || tree->leftmost == NULL)
+    {
+        return NULL;
+    }
+    if(sharesNodes(tree) || tree->retireFunc != NULL || tree->counted)
+    {
+        return NULL;
+    }
+    Node *node = RBTreeBegin(tree);
+    if(node == RBTreeEnd(tree))
+    {
+        // only tombstones are left
+        return NULL;
+    }
+    void *data = node->data;
+    unlinkNode(tree, node);
+    if(tree->versions != NULL)
+    {
+        lastItemCopy(node);
+    }
+    releaseNode(tree, node);
+    return data;
+}
+
+/**
+ * get a cursor to the smallest item of the tree.
+ * @param tree: the tree.
+ * @return: the node of the smallest item, RBTreeEnd(tree) if the tree is empty.
+ */
+Node *RBTreeBegin(const RBTree *tree)
+{
+    if(tree == NULL)
+    {
+        return NULL;
+    }
+    return skipTombstones(tree, tree->leftmost, 1);
+}
+
+/**
+ * get the past-the-end cursor of the tree.
+ * @param tree: the tree.
+ * @return: the cursor that follows the largest item (NULL).
+ */
+Node *RBTreeEnd(const RBTree *tree)
+{
+    (void)tree;
+    return NULL;
+}
+
+/**
+ * advance a cursor to the next item in ascending order.
+ * @param tree: the tree the cursor belongs to.
+ * @param node: the cursor.
+ * @return: the next node, RBTreeEnd(tree) after the largest item.
+ */
+Node *RBTreeNext(const RBTree *tree, Node *node)
+{
+    if(tree == NULL || node == NULL)
+    {
+        return NULL;
+    }
+    if(tree->frozen != NULL)
+    {
+        return frozenStep(tree, node, 1);
+    }
+    if(tree->readOnly)
+    {
+        // the parent links of a snapshot's nodes belong to the live tree
+        return boundNode(tree, node->data, 1);
+    }
+    return skipTombstones(tree, inOrderSuccessor(node), 1);
+}
+
+/**
+ * move a cursor back to the previous item in ascending order.
+ * @param tree: the tree the cursor belongs to.
+ * @param node: the cursor, RBTreeEnd(tree) to get the largest item.
+ * @return: the previous node, NULL before the smallest item.
+ */
+Node *RBTreePrev(const RBTree *tree, Node *node)
+{
+    if(tree == NULL)
+    {
+        return NULL;
+    }
+    if(node == RBTreeEnd(tree))
+    {
+        return skipTombstones(tree, tree->rightmost, 0);
+    }
+    if(tree->frozen != NULL)
+    {
+        return frozenStep(tree, node, 0);
+    }
+    if(tree->readOnly)
+    {
+        return belowNode(tree, node->data);
+    }
+    return skipTombstones(tree, inOrderPredecessor(node), 0);
+}
+
+
+/**
+ * @brief puts a node in the place of another in its parent (or the root)
+ * @param tree the tree
+ * @param parent the parent of old (NULL if old is the root)
+ * @param old the node to replace
+ * @param new the node to put instead
+ */
+void replaceChild(RBTree *tree, Node *parent, Node *old, Node *new)
+{
+    if(parent == NULL)
+    {
+        setLink(tree->root, new);
+    }
+    else if(parent->left == old)
+    {
+        setLink(parent->left, new);
+    }
+    else
+    {
+        setLink(parent->right, new);
+    }
+}
+
+/**
+ * @brief swaps the places (links and colors) of a node and its successor in the tree. the items
+ * stay in their nodes, so nodes are never moved to another item
+ * @param tree the tree
+ * @param n the node to replace
+ * @param child the successor of n, the node to replace n with
+ */
+void treeReplaceNode(RBTree *tree, Node* n, Node* child)
+{
+    Node* parent = rbParent(n);
+    Node* left = n->left;
+    Node* childRight = child->right;
+    Color color = rbColor(n);
+    if(child == n->right)
+    {
+        setLink(child->right, n);
+        rbInitParentColor(n, child, rbColor(child));
+    }
+    else
+    {
+        Node* childParent = rbParent(child);
+        setLink(child->right, n->right);
+        rbSetParent(n->right, child);
+        setLink(childParent->left, n);
+        rbInitParentColor(n, childParent, rbColor(child));
+    }
+    setLink(child->left, left);
+    if(left != NULL)
+    {
+        rbSetParent(left, child);
+    }
+    replaceChild(tree, parent, n, child);
+    rbInitParentColor(child, parent, color);
+    setLink(n->left, NULL);
+    setLink(n->right, childRight);
+    if(childRight != NULL)
+    {
+        rbSetParent(childRight, n);
+    }
+    if(tree->orderStatistics)
+    {
+        long unsigned size = subtreeSize(n);
+        subtreeSize(n) = subtreeSize(child);
+        subtreeSize(child) = size;
+    }
+}
+
+/**
+ * remove an item from the tree. the item is located once, and its node is spliced out and
+ * rebalanced by removeNode.
+ * @param tree: the tree to remove an item from.
+ * @param data: item to remove from the tree.
+ * @return: 0 on failure, other on success. (if data is not in the tree - failure).
+ */
+int deleteFromRBTree(RBTree *tree, void *data)
 {
-    int comp = tree->compFunc(root->data, new->data);
-    if (comp == 0)
+    if(tree == NULL || tree->readOnly)
     {
-        //duplicate
         return 0;
     }
-    else if (comp < 0)
+    if(data == NULL)
     {
-        if (root->right != NULL)
-        {
-            treeRBinsert(tree, root->right, new);
-        }
-        else
-        {
-            root->right = new;
-            new->parent = root;
-        }
+        return 0;
     }
-    else
+    Node* node = RBTreeFindNode(tree, data);
+    if(node == NULL)
     {
-        if (root->left != NULL)
-        {
-            treeRBinsert(tree, root->left, new);
-        }
-        else
+        return 0;
+    }
+    if(sharesNodes(tree))
+    {
+        if(unsharePath(tree, data, 1) == 0)
         {
-            root->left = new;
-            new->parent = root;
+            return 0;
         }
+        node = RBTreeFindNode(tree, data);
     }
+    if(dropCopy(tree, node))
+    {
+        return 1;
+    }
+    removeNode(tree, node);
     return 1;
 }
 
 /**
- * add an item to the tree
- * @param tree: the tree to add an item to.
- * @param data: item to add to the tree.
- * @return: 0 on failure, other on success. (if the item is already in the tree - failure).
+ * remove an item from the tree, looking for it at a hint and its neighbors before searching from
+ * the root. when the hint is the item's node or next to it, this is O(1) amortized.
+ * @param tree: the tree to remove an item from.
+ * @param hint: a cursor of the tree near the item, RBTreeEnd(tree) for the largest item.
+ * @param data: item to remove from the tree.
+ * @return: 0 on failure, other on success. (if data is not in the tree - failure).
  */
-int insertToRBTree(RBTree *tree, void *data)
+int deleteFromRBTreeHint(RBTree *tree, Node *hint, void *data)
 {
-    if(tree == NULL)
+    if(tree == NULL || tree->readOnly)
     {
         return 0;
     }
@@ -187,903 +4238,1206 @@ int insertToRBTree(RBTree *tree, void *data)
     {
         return 0;
     }
-    if(RBTreeContains(tree, data) == 1)
+    if(hint == RBTreeEnd(tree))
     {
-        return 0;
+        hint = tree->rightmost;
     }
-    Node* newNode = (Node*)malloc(sizeof(Node));
-    if(newNode == NULL)
+    if(hint == NULL || sharesNodes(tree) || tree->multiset)
+    {
+        return deleteFromRBTree(tree, data);
+    }
+    Node* parent;
+    int comp;
+    Node* node = hintSearch(tree, hint, data, &parent, &comp);
+    if(node == NULL || isTombstone(tree, node))
     {
         return 0;
     }
-    newNode->left = NULL;
-    newNode->right = NULL;
-    newNode->parent = NULL;
-    newNode->color = RED;
-    newNode->data = data;
-    if(tree->root == NULL)
+    if(dropCopy(tree, node))
     {
-        newNode->color = BLACK;
-        tree->root = newNode;
-        tree->size += 1;
         return 1;
     }
-    else if(treeRBinsert(tree, tree->root, newNode) == 0)
+    removeNode(tree, node);
+    return 1;
+}
+
+/**
+ * remove the item of a node from the tree without searching for it.
+ * @param tree: the tree the node belongs to.
+ * @param node: a node of the tree (from RBTreeFindNode, a bound or a cursor).
+ * @return: 0 on failure (the node is a tombstone already), other on success.
+ */
+int deleteNodeFromRBTree(RBTree *tree, Node *node)
+{
+    if(tree == NULL || tree->readOnly || node == NULL || isTombstone(tree, node))
     {
         return 0;
     }
-    else
+    if(sharesNodes(tree))
+    {
+        // the copies of the path are found by the item
+        return deleteFromRBTree(tree, node->data);
+    }
+    if(dropCopy(tree, node))
     {
-        fixTreeInsert(tree, newNode);
-        tree->size += 1;
         return 1;
     }
+    removeNode(tree, node);
+    return 1;
 }
 
 /**
- * @brief returns the nodes parent
- * @param node the node
- * @return  the parent
+ * @brief splices a node out of the tree and rebalances (see unlinkNode), then disposes of it
+ * @param tree the tree
+ * @param node the node to remove
  */
-Node * getParent(Node* node)
+void removeNode(RBTree *tree, Node *node)
 {
-    if(node == NULL || node->parent == NULL)
-    {
-        return NULL;
-    }
-    else
+    if(tree->lazyDelete && buryNode(tree, node))
     {
-        return node->parent;
+        return;
     }
+    unlinkNode(tree, node);
+    disposeNode(tree, node);
 }
 
 /**
- * @brief returns the nodes uncle
- * @param node the node
- * @return  the uncle
+ * @brief splices a node out of the tree and rebalances, leaving the node and its item to the
+ * caller. a node with two kids first swaps places with its successor, so the node that is
+ * unlinked has one kid at most
+ * @param tree the tree
+ * @param node the node to unlink
  */
-Node * getUncle(RBTree *tree, Node* node)
+void unlinkNode(RBTree *tree, Node *node)
 {
-    Node * parent = getParent(node);
-    Node* grandParent = getParent(parent);
-    if(grandParent != NULL)
+    countStat(tree, STAT_DELETES);
+    // an end node has one kid at most, the new end is next to it
+    if(node == tree->leftmost)
+    {
+        tree->leftmost = (node->right != NULL) ? minValue(node->right) : rbParent(node);
+    }
+    if(node == tree->rightmost)
+    {
+        tree->rightmost = (node->left != NULL) ? maxValue(node->left) : rbParent(node);
+    }
+    if(node->left != NULL && node->right != NULL)
     {
-        if(grandParent->left != NULL)
+        treeReplaceNode(tree, node, minValue(node->right));
+    }
+    Node* child = (node->left != NULL) ? node->left : node->right;
+    Node* parent = rbParent(node);
+    if(child != NULL)
+    {
+        rbSetParent(child, parent);
+    }
+    replaceChild(tree, parent, node, child);
+    if(tree->orderStatistics)
+    {
+        addToSizes(parent, -1);
+    }
+    if(tree->augment != NULL)
+    {
+        updateAugmentPath(tree, parent);
+    }
+    if(rbColor(node) == BLACK)
+    {
+        // a black node with a single kid has a red one, which takes over its black
+        if(child != NULL && rbColor(child) == RED)
         {
-            if (tree->compFunc(grandParent->left->data, parent->data) != 0)
-            {
-                return grandParent->left;
-            }
-            if(grandParent->right != NULL)
-            {
-                return grandParent->right;
-            }
+            rbSetColor(child, BLACK);
+        }
+        else
+        {
+            fixTreeDelete(tree, parent, child);
         }
     }
-    return NULL;
+    tree->size -= 1;
 }
 
 /**
- * @brief fixes the tree's colors after a new node was added
+ * @brief fixes the tree's colors after a black node was unlinked: the subtree that took its place
+ * is one black node short. walks up from there until the missing black is made up for
  * @param tree the RB tree
- * @param newlyAdded the new node
+ * @param parent the parent of the short subtree (NULL if it is the whole tree)
+ * @param node the root of the short subtree (may be NULL)
  */
-void fixTreeInsert(RBTree* tree, Node* newlyAdded)
+void fixTreeDelete(RBTree* tree, Node* parent, Node* node)
 {
-    Node* uncle = getUncle(tree, newlyAdded);
-    Node* parent = getParent(newlyAdded);
-    Node* grandParent = getParent(parent);
-    // case 1
-    if (tree->compFunc(tree->root->data, newlyAdded->data) == 0)
-    {
-        newlyAdded->color = BLACK;
-    }
-    else
+    while (node != tree->root && (node == NULL || rbColor(node) == BLACK))
     {
-        //case 2- no need to change
-        if (parent->color == RED)
+        // the sibling's side has a black node more, so the sibling exists
+        if (node == parent->left)
         {
-            //case 3
-            // if the node has an uncle then it has a grandparent
-            if (uncle != NULL && uncle->color == RED)
+            Node* sibling = parent->right;
+            if (rbColor(sibling) == RED)
             {
-                parent->color = BLACK;
-                uncle->color = BLACK;
-                grandParent->color = RED;
-                fixTreeInsert(tree, grandParent);
+                countStat(tree, STAT_DELETE_CASE_B);
+                rbSetColor(sibling, BLACK);
+                rbSetColor(parent, RED);
+                rotateLeftDelete(tree, parent);
+                sibling = parent->right;
             }
-            // if the uncle is black or null
-            else
+            if (isBlack(sibling->left) && isBlack(sibling->right))
             {
-                if (parent->left != NULL && tree->compFunc(newlyAdded->data, parent->left->data)
-                    == 0)
-                {
-                    rotateRight(tree, newlyAdded);
-                }
-                else
-                {
-                    rotateLeft(tree, newlyAdded);
-                }
+                countStat(tree, STAT_DELETE_CASE_C);
+                rbSetColor(sibling, RED);
+                node = parent;
+                parent = rbParent(node);
+                continue;
+            }
+            if (isBlack(sibling->right))
+            {
+                countStat(tree, STAT_DELETE_CASE_D);
+                rbSetColor(sibling->left, BLACK);
+                rbSetColor(sibling, RED);
+                rotateRightDelete(tree, sibling);
+                sibling = parent->right;
+            }
+            countStat(tree, STAT_DELETE_CASE_E);
+            rbSetColor(sibling, rbColor(parent));
+            rbSetColor(parent, BLACK);
+            rbSetColor(sibling->right, BLACK);
+            rotateLeftDelete(tree, parent);
+        }
+        else
+        {
+            Node* sibling = parent->left;
+            if (rbColor(sibling) == RED)
+            {
+                countStat(tree, STAT_DELETE_CASE_B);
+                rbSetColor(sibling, BLACK);
+                rbSetColor(parent, RED);
+                rotateRightDelete(tree, parent);
+                sibling = parent->left;
+            }
+            if (isBlack(sibling->left) && isBlack(sibling->right))
+            {
+                countStat(tree, STAT_DELETE_CASE_C);
+                rbSetColor(sibling, RED);
+                node = parent;
+                parent = rbParent(node);
+                continue;
+            }
+            if (isBlack(sibling->left))
+            {
+                countStat(tree, STAT_DELETE_CASE_D);
+                rbSetColor(sibling->right, BLACK);
+                rbSetColor(sibling, RED);
+                rotateLeftDelete(tree, sibling);
+                sibling = parent->left;
             }
+            countStat(tree, STAT_DELETE_CASE_E);
+            rbSetColor(sibling, rbColor(parent));
+            rbSetColor(parent, BLACK);
+            rbSetColor(sibling->left, BLACK);
+            rotateRightDelete(tree, parent);
         }
+        return;
+    }
+    if (node != NULL)
+    {
+        rbSetColor(node, BLACK);
     }
 }
 
 /**
- * @brief rotates left
- * @param node the node to rotate
+ * @brief tells whether a node is black, NULL leaves included
+ * @param node the node (may be NULL)
+ * @return 1 if it is black, 0 if it is red
  */
-void rotateLeft(RBTree *tree, Node* node)
+int isBlack(const Node *node)
 {
-    Node* parent = getParent(node);
-    Node* grandParent = getParent(getParent(node));
-    //case the right kid of a left kid
-    if(grandParent->left != NULL && tree->compFunc(parent->data, grandParent->left->data) == 0)
+    return node == NULL || rbColor(node) == BLACK;
+}
+
+/**
+ * @brief rotates right around a node: its left kid takes its place
+ * @param tree the tree
+ * @param parent the node to rotate around
+ */
+void rotateRightDelete(RBTree *tree, Node *parent)
+{
+    countStat(tree, STAT_ROTATIONS);
+    Node* s = parent->left;
+    Node* up = rbParent(parent);
+    setLink(parent->left, s->right);
+    if(s->right != NULL)
     {
-        grandParent->left = node;
-        if(node->left != NULL)
-        {
-            node->left->parent = parent;
-        }
-        parent->right = node->left;
-        node->left = parent;
-        node->parent = grandParent;
-        parent->parent = node;
-        rotateRight2(tree, parent);
-        node->color = BLACK;
+        rbSetParent(s->right, parent);
     }
-    // case right kid of  right kid
-    else
+    setLink(s->right, parent);
+    rbSetParent(s, up);
+    rbSetParent(parent, s);
+    updateSummaries(tree, parent);
+    updateSummaries(tree, s);
+    replaceChild(tree, up, parent, s);
+}
+
+/**
+ * @brief rotates left around a node: its right kid takes its place
+ * @param tree the tree
+ * @param parent the node to rotate around
+ */
+void rotateLeftDelete(RBTree *tree, Node *parent)
+{
+    countStat(tree, STAT_ROTATIONS);
+    Node* s = parent->right;
+    Node* up = rbParent(parent);
+    setLink(parent->right, s->left);
+    if(s->left != NULL)
     {
-        rotateLeft2(tree, node);
-        parent->color = BLACK;
+        rbSetParent(s->left, parent);
     }
-    grandParent->color = RED;
+    setLink(s->left, parent);
+    rbSetParent(s, up);
+    rbSetParent(parent, s);
+    updateSummaries(tree, parent);
+    updateSummaries(tree, s);
+    replaceChild(tree, up, parent, s);
 }
 
 /**
- * @brief rotates right
- * @param node the node to rotate
+ * find the node holding an item equal to data. compFunc is called once per level.
+ * @param tree: the tree to search in.
+ * @param data: item to look for.
+ * @return: the node holding the item, NULL if the item is not in the tree.
  */
-void rotateRight(RBTree *tree, Node* node)
+Node *RBTreeFindNode(const RBTree *tree, const void *data)
 {
-    Node* parent = getParent(node);
-    Node* grandParent = getParent(getParent(node));
-    // case left kid of a right kid
-    if(grandParent->right != NULL && tree->compFunc(parent->data, grandParent->right->data) == 0)
+    if(tree == NULL || data == NULL)
     {
-        grandParent->right = node;
-        if(node->right != NULL)
+        return NULL;
+    }
+    countStat(tree, STAT_LOOKUPS);
+    if (tree->frozen != NULL)
+    {
+        Node* bound = frozenBound(tree, data, 0);
+        return (bound != NULL && compareItems(tree, bound->data, data) == 0) ? bound : NULL;
+    }
+    Node* node = tree->root;
+    Node* found = NULL;
+    while (node != NULL)
+    {
+        int comp = compareItems(tree, node->data, data);
+        if (comp == 0)
         {
-            node->right->parent = parent;
+            found = node;
+            if (!tree->multiset)
+            {
+                break;
+            }
+            // the first of the equal items of a multiset is further left
+            comp = 1;
         }
-        parent->left = node->right;
-        node->right = parent;
-        node->parent = grandParent;
-        parent->parent = node;
-        rotateLeft2(tree, parent);
-        node->color = BLACK;
-
+        node = (comp < 0) ? node->right : node->left;
     }
-        //case left kid of a left kid
-    else if(tree->compFunc(parent->data, grandParent->left->data) == 0)
+    if(found != NULL && isTombstone(tree, found))
     {
-        rotateRight2(tree, node);
-        parent->color = BLACK;
+        // only a multiset keeps equal items, and a lazy tree is no multiset
+        return NULL;
     }
-    grandParent->color = RED;
+    return found;
 }
 
-
 /**
- * @brief step 2 of the left rotate
- * @param tree the tree
- * @param node the new node
+ * find the item stored in the tree that is equal to data.
+ * @param tree: the tree to search in.
+ * @param data: item to look for.
+ * @return: the stored item, NULL if the item is not in the tree.
  */
-void rotateLeft2(RBTree *tree, Node* node)
+void *RBTreeFind(const RBTree *tree, const void *data)
 {
-    Node * grandParent = getParent(getParent(node));
-    Node* parent = getParent(node);
-
-    grandParent->right = parent->left;
-    if(parent->left != NULL)
+    Node* node = RBTreeFindNode(tree, data);
+    if(node == NULL)
     {
-        parent->left->parent = grandParent;
+        return NULL;
     }
-    parent->left = grandParent;
-    // grandparent is the root
-    if(grandParent->parent == NULL)
+    return node->data;
+}
+
+/**
+ * check whether the tree RBTreeContains this item.
+ * @param tree: the tree to add an item to.
+ * @param data: item to check.
+ * @return: 0 if the item is not in the tree, other if it is.
+ */
+int RBTreeContains(const RBTree *tree, const void *data)
+{
+    return RBTreeFindNode(tree, data) != NULL;
+}
+
+
+
+/**
+ * @brief finds the first node that is not ordered before data (lower) or that is ordered after it
+ * @param tree the tree
+ * @param data the bound
+ * @param strict 0 for the first node >= data, other for the first node > data
+ * @return the node, NULL if there is none
+ */
+Node * boundNode(const RBTree *tree, const void *data, int strict)
+{
+    if (tree->frozen != NULL)
     {
-        tree->root = parent;
-        parent->parent = NULL;
-        parent->color = BLACK;
-        grandParent->parent = parent;
+        return frozenBound(tree, data, strict);
     }
-    else
+    Node* bound = NULL;
+    Node* node = tree->root;
+    while (node != NULL)
     {
-        if(tree->compFunc(grandParent->parent->left->data, grandParent->data) == 0)
+        int comp = compareItems(tree, node->data, data);
+        if (comp > 0 || (comp == 0 && !strict))
         {
-            grandParent->parent->left = parent;
+            bound = node;
+            node = node->left;
         }
         else
         {
-            grandParent->parent->right = parent;
+            node = node->right;
         }
-        parent->parent = grandParent->parent;
-        grandParent->parent = parent;
     }
+    return skipTombstones(tree, bound, 1);
 }
 
 /**
- * @brief step 2 of the right rotate
+ * @brief finds the last node that is ordered before data
  * @param tree the tree
- * @param node the new node
+ * @param data the bound
+ * @return the node, NULL if there is none
  */
-void rotateRight2(RBTree *tree, Node* node)
+Node * belowNode(const RBTree *tree, const void *data)
 {
-    Node * grandParent = getParent(getParent(node));
-    Node* parent = getParent(node);
-    grandParent->left = parent->right;
-    if(parent->right != NULL)
-    {
-        parent->right->parent = grandParent;
-    }
-    parent->right = grandParent;
-    // grandparent is the root
-    if(grandParent->parent == NULL)
+    if (tree->frozen != NULL)
     {
-        tree->root = parent;
-        parent->parent = NULL;
-        parent->color = BLACK;
-        grandParent->parent = parent;
+        Node* bound = frozenBound(tree, data, 0);
+        return (bound == NULL) ? tree->rightmost : frozenStep(tree, bound, 0);
     }
-    else
+    Node* below = NULL;
+    Node* node = tree->root;
+    while (node != NULL)
     {
-        if(tree->compFunc(grandParent->parent->left->data, grandParent->data) == 0)
+        if (compareItems(tree, node->data, data) < 0)
         {
-            grandParent->parent->left = parent;
+            below = node;
+            node = node->right;
         }
         else
         {
-            grandParent->parent->right = parent;
+            node = node->left;
         }
-        parent->parent = grandParent->parent;
-        grandParent->parent = parent;
     }
-    grandParent->color = RED;
+    return skipTombstones(tree, below, 0);
 }
 
 /**
- * @brief finds the successor of a node
- * @param root the root of the tree
- * @param n the node
- * @return the successor
+ * find the first item of the tree that is not smaller than data.
+ * @param tree: the tree to search in.
+ * @param data: the bound.
+ * @return: the node of that item, RBTreeEnd(tree) if all items are smaller.
  */
-Node * inOrderSuccessor(Node *n)
+Node *RBTreeLowerBound(const RBTree *tree, const void *data)
 {
-    if (n == NULL)
-    {
-        return NULL;
-    }
-    if (n->right != NULL)
-    {
-        return minValue(n->right);
-    }
-    else
+    if(tree == NULL || data == NULL)
     {
         return NULL;
     }
+    return boundNode(tree, data, 0);
 }
 
 /**
- * @brief returns the minimum node
- * @param node the node to search in its subtree
- * @return the minimal node
+ * find the first item of the tree that is greater than data.
+ * @param tree: the tree to search in.
+ * @param data: the bound.
+ * @return: the node of that item, RBTreeEnd(tree) if no item is greater.
  */
-Node * minValue(Node* node)
+Node *RBTreeUpperBound(const RBTree *tree, const void *data)
 {
-    Node* current = node;
-    while (current->left != NULL)
+    if(tree == NULL || data == NULL)
     {
-        current = current->left;
-
-        if(current == NULL)
-        {
-            return NULL;
-        }
+        return NULL;
     }
-    return current;
-}
-
-
-/**
- * @brief replaces one node with another
- * @param n the node to replace
- * @param child the node to replace n with
- */
-void treeReplaceNode(Node* n, Node* child)
-{
-    void *temp = n->data;
-    n->data = child->data;
-    child->data = temp;
+    return boundNode(tree, data, 1);
 }
 
 /**
- * remove an item from the tree
- * @param tree: the tree to remove an item from.
- * @param data: item to remove from the tree.
- * @return: 0 on failure, other on success. (if data is not in the tree - failure).
+ * Activate a function on each item of the tree between lo and hi (inclusive), in ascending order.
+ * if one of the activations of the function returns 0, the process stops.
+ * @param tree: the tree with all the items.
+ * @param lo: the smallest item to visit (NULL to start from the smallest item of the tree).
+ * @param hi: the largest item to visit (NULL to go on to the largest item of the tree).
+ * @param func: the function to activate on the items.
+ * @param args: more optional arguments to the function (may be null if the given function support it).
+ * @return: 0 on failure, other on success.
  */
-int deleteFromRBTree(RBTree *tree, void *data)
+int forEachRangeRBTree(const RBTree *tree, const void *lo, const void *hi, forEachFunc func,
+                       void *args)
 {
     if(tree == NULL)
     {
         return 0;
     }
-    if(data == NULL)
-    {
-        return 0;
-    }
-    if(RBTreeContains(tree, data) == 0)
+    Node* node = (lo == NULL) ? RBTreeBegin(tree) : boundNode(tree, lo, 0);
+    for(; node != RBTreeEnd(tree); node = RBTreeNext(tree, node))
     {
-        return 0;
+        if(hi != NULL && compareItems(tree, node->data, hi) > 0)
+        {
+            break;
+        }
+        if(func(node->data, args) == 0)
+        {
+            return 0;
+        }
     }
-    Node* node = nodeFinder(tree, tree->root, data);
-    if(node == NULL)
+    return 1;
+}
+
+/**
+ * Activate a function on each item of the tree. the order is an ascending order. if one of the activations of the
+ * function returns 0, the process stops.
+ * @param tree: the tree with all the items.
+ * @param func: the function to activate on all items.
+ * @param args: more optional arguments to the function (may be null if the given function support it).
+ * @return: 0 on failure, other on success.
+ */
+int forEachRBTree(const RBTree *tree, forEachFunc func, void *args)
+{
+    if(tree == NULL)
     {
         return 0;
     }
-    Node* suc = inOrderSuccessor(node);
-    if(suc != NULL)
+    for(Node *node = RBTreeBegin(tree); node != RBTreeEnd(tree); node = RBTreeNext(tree, node))
     {
-        treeReplaceNode(node, suc);
-        fixTreeDelete(tree, suc);
-    }
-
-    else
-    {
-        fixTreeDelete(tree, node);
+        if(func(node->data, args) == 0)
+        {
+            return 0;
+        }
     }
-    tree->size -= 1;
     return 1;
 }
 
+
+/**
+ * @brief tells whether the nodes of a tree can be moved to another tree. the nodes of pooled
+ * trees belong to their slabs and those of trees with snapshots may be shared, so they cannot
+ * @param tree the tree
+ * @return 1 if they can, 0 if not
+ */
+int nodesMovable(const RBTree *tree)
+{
+    return tree != NULL && tree->pool == NULL && tree->versions == NULL && !tree->readOnly;
+}
+
 /**
- * @brief fixes the tree's colors after a node was deleted
- * @param tree the RB tree
- * @param node the new node
+ * @brief tells whether the nodes of two trees can be moved between them: both are plain or
+ * intrusive alike, track the same extras and use the same compFunc
+ * @param t1 the first tree
+ * @param t2 the second tree
+ * @return 1 if they can, 0 if not
  */
-void fixTreeDelete(RBTree* tree, Node* node)
+int joinable(const RBTree *t1, const RBTree *t2)
 {
-    if(node->color == RED)
+    if(!nodesMovable(t1) || !nodesMovable(t2) || t1 == t2)
     {
-        delete1(tree, node);
+        return 0;
     }
-    else if(node->color == BLACK)
+    return t1->compFunc == t2->compFunc && t1->hookOffset == t2->hookOffset &&
+           t1->orderStatistics == t2->orderStatistics && t1->augment == t2->augment &&
+           t1->summaryBytes == t2->summaryBytes && t1->measure == t2->measure &&
+           t1->intervalLow == t2->intervalLow && t1->map == t2->map &&
+           t1->multiset == t2->multiset && t1->counted == t2->counted &&
+           t1->lazyDelete == t2->lazyDelete;
+}
+
+/**
+ * @brief tells whether two trees can be merged by the set operations: they are joinable and keep
+ * one item per key, without counts
+ * @param t1 the first tree
+ * @param t2 the second tree
+ * @return 1 if they can, 0 if not
+ */
+int setOperable(const RBTree *t1, const RBTree *t2)
+{
+    return joinable(t1, t2) && !t1->multiset && !t1->counted;
+}
+
+/**
+ * @brief counts the black nodes on a path from a root down to NULL
+ * @param root the root (may be NULL)
+ * @return the black height, 0 for an empty tree
+ */
+int blackHeight(const Node *root)
+{
+    int height = 0;
+    for(; root != NULL; root = root->left)
     {
-        if(node->right != NULL && node->right->color == RED)
+        if(rbColor(root) == BLACK)
         {
-            delete2(tree, node, 'r');
+            height++;
         }
-        else if(node->left != NULL && node->left->color == RED)
-        {
-            delete2(tree, node, 'l');
+    }
+    return height;
+}
 
-        }
-        else
+/**
+ * @brief detaches a kid of a node as a subtree of its own, with a black root
+ * @param kid the kid (may be NULL)
+ * @param height the black height of the kid as it is
+ * @return the subtree
+ */
+Subtree detachKid(Node *kid, int height)
+{
+    Subtree subtree = {kid, height};
+    if(kid != NULL)
+    {
+        if(rbColor(kid) == RED)
         {
-            Node* parent = node->parent;
-            char side = removeM(tree, node);
-            if(side != 't')
-            {
-                delete3(tree, parent, side);
-            }
+            subtree.blackHeight += 1;
         }
+        rbInitParentColor(kid, NULL, BLACK);
     }
+    return subtree;
 }
 
 /**
- * @brief if the S is black and both of its kids are black
- * @param parent the parent of the node deleted
- * @param tree the tree
+ * @brief joins two subtrees with a pivot between them. the pivot is hung at the black height of
+ * the lower subtree on the facing spine of the higher one (as a red node), and the insertion
+ * fixup repairs the colors from there. O(difference of the black heights + 1)
+ * @param tree the tree whose compFunc and extras the subtrees have
+ * @param l the subtree of the items smaller than the pivot
+ * @param pivot a detached node
+ * @param r the subtree of the items greater than the pivot
+ * @return the joined subtree
  */
-void deleteB(RBTree* tree, Node* parent, char side)
+Subtree joinSubtrees(RBTree *tree, Subtree l, Node *pivot, Subtree r)
 {
-    // case i
-    if(parent->color == RED)
+    Subtree joined;
+    if(l.blackHeight == r.blackHeight)
     {
-        parent->color = BLACK;
-        if(side == 'l')
+        pivot->left = l.root;
+        pivot->right = r.root;
+        rbInitParentColor(pivot, NULL, BLACK);
+        if(l.root != NULL)
         {
-            parent->right->color = RED;
+            rbSetParent(l.root, pivot);
         }
-        else if(side == 'r')
+        if(r.root != NULL)
         {
-            parent->left->color = RED;
+            rbSetParent(r.root, pivot);
         }
+        updateSummaries(tree, pivot);
+        joined.root = pivot;
+        joined.blackHeight = l.blackHeight + 1;
+        return joined;
     }
-    else
+    // the pivot goes down the right spine of l, or the left spine of r
+    int right = (l.blackHeight > r.blackHeight);
+    Subtree high = right ? l : r;
+    Subtree low = right ? r : l;
+    Node* parent = NULL;
+    Node* spine = high.root;
+    int height = high.blackHeight;
+    while (spine != NULL && (height > low.blackHeight || rbColor(spine) == RED))
     {
-        if(side == 'l')
+        if (rbColor(spine) == BLACK)
         {
-            parent->right->color = RED;
-        }
-        else
-        {
-            parent->left->color = RED;
-            if(parent->parent != NULL)
-            {
-                if (tree->compFunc(parent->data, parent->parent->left->data) == 0)
-                {
-                    delete3(tree, parent->parent, 'l');
-                }
-                else
-                {
-                    delete3(tree, parent->parent, 'r');
-                }
-            }
+            height--;
         }
+        parent = spine;
+        spine = right ? spine->right : spine->left;
     }
-}
-
-/**
- * @brief if the S is Black and the far kid from C is black and the closer one is red
- * @param parent the parent of the node deleted
- * @param tree the tree
- */
-void deleteD(RBTree* tree, Node* parent, char side)
-{
-    if(side == 'l')
+    pivot->left = right ? spine : low.root;
+    pivot->right = right ? low.root : spine;
+    rbInitParentColor(pivot, parent, RED);
+    if(spine != NULL)
     {
-        parent->right->left->color = BLACK;
-        parent->right->color = RED;
-        rotateRightDelete(tree, parent->right);
-        deleteE(tree, parent, side);
+        rbSetParent(spine, pivot);
+    }
+    if(low.root != NULL)
+    {
+        rbSetParent(low.root, pivot);
+    }
+    if(right)
+    {
+        parent->right = pivot;
     }
     else
     {
-        parent->left->right->color = BLACK;
-        parent->left->color = RED;
-        rotateLeftDelete(tree, parent->left);
-        deleteE(tree, parent, side);
+        parent->left = pivot;
+    }
+    if(tree->orderStatistics)
+    {
+        updateSummaries(tree, pivot);
+        addToSizes(parent, 1 + (long)sizeOf(low.root));
+    }
+    if(tree->augment != NULL)
+    {
+        updateAugmentPath(tree, pivot);
     }
+    RBTree scratch = *tree;
+    scratch.root = high.root;
+    joined.blackHeight = high.blackHeight + fixTreeInsert(&scratch, pivot);
+    joined.root = scratch.root;
+    return joined;
 }
 
 /**
- * @brief if the S is Black and the far kid from C is RED
- * @param parent the parent of the node deleted
- * @param tree the tree
+ * @brief detaches the largest node of a non-empty subtree
+ * @param tree the tree whose compFunc and extras the subtree has
+ * @param subtree the subtree
+ * @param rest out: the subtree without its largest node
+ * @return the largest node, detached
  */
-void deleteE(RBTree* tree, Node* parent, char side)
+Node * splitLast(RBTree *tree, Subtree subtree, Subtree *rest)
 {
-    if(side == 'l')
-    {
-        Node* S = parent->right;
-        Color par = parent->color;
-        Color Sc = parent->right->color;
-        parent->color = Sc;
-        parent->right->color = par;
-        rotateLeftDelete(tree, parent);
-        S->right->color = BLACK;
-    }
-    else if(side == 'r')
+    Node* node = subtree.root;
+    Subtree left = detachKid(node->left, subtree.blackHeight - 1);
+    if(node->right == NULL)
     {
-        Node* S = parent->left;
-        Color par = parent->color;
-        Color Sc = parent->left->color;
-        parent->color = Sc;
-        parent->left->color = par;
-        rotateRightDelete(tree, parent);
-        S->left->color = BLACK;
+        *rest = left;
+        return node;
     }
-
+    Subtree right = detachKid(node->right, subtree.blackHeight - 1);
+    Subtree remaining;
+    Node* last = splitLast(tree, right, &remaining);
+    *rest = joinSubtrees(tree, left, node, remaining);
+    return last;
 }
 
 /**
- * @brief if the S is RED
- * @param parent the parent of the node deleted
- * @param tree the tree
+ * @brief joins two subtrees without a pivot (the largest node of l becomes the pivot)
+ * @param tree the tree whose compFunc and extras the subtrees have
+ * @param l the subtree of the smaller items
+ * @param r the subtree of the greater items
+ * @return the joined subtree
  */
-void deleteC(RBTree* tree, Node* parent, char side)
+Subtree joinTwo(RBTree *tree, Subtree l, Subtree r)
 {
-    if(side == 'l')
+    if(l.root == NULL)
     {
-        Color par = parent->color;
-        Color  S = parent->right->color;
-        parent->color = S;
-        parent->right->color = par;
-        // rotate left
-        rotateLeftDelete(tree, parent);
+        return r;
     }
-    else if(side == 'r')
+    if(r.root == NULL)
     {
-        Color par = parent->color;
-        Color  S = parent->left->color;
-        parent->color = S;
-        parent->left->color = par;
-        // rotate right
-        rotateRightDelete(tree, parent);
+        return l;
     }
-    delete3(tree, parent, side);
+    Subtree rest;
+    Node* last = splitLast(tree, l, &rest);
+    return joinSubtrees(tree, rest, last, r);
 }
 
 /**
- * @brief rotates right
- * @param tree the tree
- * @param parent the P node
+ * @brief splits a subtree around a key: walks down to the key, and joins the pieces that hang
+ * off each side of the path back up. O(log n), as the joins' black heights telescope
+ * @param tree the tree whose compFunc and extras the subtree has
+ * @param subtree the subtree
+ * @param key the key to split around
+ * @param lo out: the subtree of the items smaller than key
+ * @param hi out: the subtree of the items greater than key
+ * @return the node of the item equal to key, detached, NULL if there is none
  */
-void rotateRightDelete(RBTree *tree, Node *parent)
+Node * splitSubtree(RBTree *tree, Subtree subtree, const void *key, Subtree *lo, Subtree *hi)
 {
-    Node* s = parent->left;
-    parent->left = s->right;
-    if(s-> right != NULL)
+    Node* node = subtree.root;
+    if(node == NULL)
     {
-        s->right->parent = parent;
+        *lo = subtree;
+        *hi = subtree;
+        return NULL;
     }
-    s->right = parent;
-    s->parent = parent->parent;
-    if(parent->parent != NULL)
+    Subtree left = detachKid(node->left, subtree.blackHeight - 1);
+    Subtree right = detachKid(node->right, subtree.blackHeight - 1);
+    int comp = compareItems(tree, node->data, key);
+    if(comp == 0 && !tree->multiset)
     {
-        if(parent->parent->left != NULL && tree->compFunc(parent->data, parent->parent->left->data)
-           == 0)
-        {
-            parent->parent->left = s;
-        }
-        else
-        {
-            parent->parent->right = s;
-        }
+        *lo = left;
+        *hi = right;
+        return node;
+    }
+    Subtree middle;
+    Node* found;
+    // the items of a multiset that are equal to key may be on both sides, and all go to hi
+    if(comp >= 0)
+    {
+        found = splitSubtree(tree, left, key, lo, &middle);
+        *hi = joinSubtrees(tree, middle, node, right);
     }
     else
     {
-        tree->root = s;
+        found = splitSubtree(tree, right, key, &middle, hi);
+        *lo = joinSubtrees(tree, left, node, middle);
     }
-    parent-> parent = s;
+    return found;
 }
 
 /**
- * @brief rotates left
- * @param tree the tree
- * @param parent the P node
+ * @brief disposes of all the nodes of a detached subtree, together with their items
+ * @param tree the tree the subtree came from
+ * @param node the root of the subtree (may be NULL)
  */
-void rotateLeftDelete(RBTree *tree, Node *parent)
+void disposeSubtree(RBTree *tree, Node *node)
 {
-    Node* s = parent->right;
-    parent->right = s->left;
-    if(s-> left != NULL)
+    if(node != NULL)
     {
-        s->left->parent = parent;
+        disposeSubtree(tree, node->left);
+        disposeSubtree(tree, node->right);
+        disposeNode(tree, node);
     }
-    s->left = parent;
-    s->parent = parent->parent;
-    if(parent->parent != NULL)
+}
+
+/**
+ * @brief the union of two subtrees: the second one is split around the root of the first, and
+ * the halves are merged recursively. O(m log(n / m + 1)) for sizes m <= n
+ * @param t1 the tree of a
+ * @param a a subtree of t1 (its items are kept on duplicates)
+ * @param t2 the tree of b
+ * @param b a subtree of t2 (its duplicates are disposed of)
+ * @param duplicates in/out: counts the disposed duplicates
+ * @return the united subtree
+ */
+Subtree unionSubtrees(RBTree *t1, Subtree a, RBTree *t2, Subtree b, long unsigned *duplicates)
+{
+    if(a.root == NULL)
     {
-        if(tree->compFunc(parent->data, parent->parent->left->data) == 0)
-        {
-            parent->parent->left = s;
-        }
-        else
-        {
-            parent->parent->right = s;
-        }
+        return b;
     }
-    else
+    if(b.root == NULL)
     {
-        tree->root = s;
+        return a;
     }
-    parent-> parent = s;
+    Node* node = a.root;
+    Subtree left = detachKid(node->left, a.blackHeight - 1);
+    Subtree right = detachKid(node->right, a.blackHeight - 1);
+    Subtree lo, hi;
+    Node* duplicate = splitSubtree(t2, b, node->data, &lo, &hi);
+    if(duplicate != NULL)
+    {
+        disposeNode(t2, duplicate);
+        *duplicates += 1;
+    }
+    Subtree l = unionSubtrees(t1, left, t2, lo, duplicates);
+    Subtree r = unionSubtrees(t1, right, t2, hi, duplicates);
+    return joinSubtrees(t1, l, node, r);
 }
 
 /**
- * @brief the third case- if the node is black and its kid is black - both of its kis are null
- * @param tree the treeRBTree* tree, Node* node
- * @param node the node to delete
+ * @brief the intersection of two subtrees, built like unionSubtrees
+ * @param t1 the tree of a
+ * @param a a subtree of t1 (its items are kept when they are in b too)
+ * @param t2 the tree of b
+ * @param b a subtree of t2 (all of its nodes are disposed of)
+ * @param kept in/out: counts the kept items
+ * @return the intersected subtree
  */
-void delete3(RBTree* tree, Node* pnode, char side)
+Subtree intersectSubtrees(RBTree *t1, Subtree a, RBTree *t2, Subtree b, long unsigned *kept)
 {
-    if (side == 'l')
+    if(a.root == NULL || b.root == NULL)
     {
-        if(!(pnode->left != NULL && tree->compFunc(tree->root->data, pnode->left->data) != 0))
-        {
-            if (pnode->right != NULL && pnode->right->color == BLACK)
-            {
-                if ((pnode->right->right == NULL || pnode->right->right->color == BLACK) &&
-                    (pnode->right->left == NULL || pnode->right->left->color == BLACK))
-                {
-                    deleteB(tree, pnode, side);
-                }
-                else if (pnode->right->left != NULL && pnode->right->left->color == RED &&
-                         (pnode->right->right == NULL || pnode->right->right->color == BLACK))
-                {
-                    deleteD(tree, pnode, side);
-                }
-                else if (pnode->right->right != NULL && pnode->right->right->color == RED)
-                {
-                    deleteE(tree, pnode, side);
-                }
-            }
-            else
-            {
-                deleteC(tree, pnode, side);
-            }
-        }
+        disposeSubtree(t1, a.root);
+        disposeSubtree(t2, b.root);
+        Subtree empty = {NULL, 0};
+        return empty;
     }
-    else if (side == 'r')
+    Node* node = a.root;
+    Subtree left = detachKid(node->left, a.blackHeight - 1);
+    Subtree right = detachKid(node->right, a.blackHeight - 1);
+    Subtree lo, hi;
+    Node* match = splitSubtree(t2, b, node->data, &lo, &hi);
+    Subtree l = intersectSubtrees(t1, left, t2, lo, kept);
+    Subtree r = intersectSubtrees(t1, right, t2, hi, kept);
+    if(match != NULL)
     {
-        if(!(pnode->right != NULL && tree->compFunc(tree->root->data, pnode->right->data) == 0))
-        {
-            if (pnode->left != NULL && pnode->left->color == BLACK)
-            {
-                if ((pnode->left->right == NULL || pnode->left->right->color == BLACK) &&
-                    (pnode->left->left == NULL || pnode->left->left->color == BLACK))
-                {
-                    deleteB(tree, pnode, side);
-                }
-                else if (pnode->left->right != NULL && pnode->left->right->color == RED &&
-                         (pnode->left->left == NULL || pnode->left->left->color == BLACK))
-                {
-                    deleteD(tree, pnode, side);
-                }
-                else if (pnode->left->left != NULL && pnode->left->left->color == RED)
-                {
-                    deleteE(tree, pnode, side);
-                }
-            }
-            else
-            {
-                deleteC(tree, pnode, side);
-            }
-        }
+        disposeNode(t2, match);
+        *kept += 1;
+        return joinSubtrees(t1, l, node, r);
     }
+    disposeNode(t1, node);
+    return joinTwo(t1, l, r);
 }
 
 /**
- * @brief removes the node
- * @param tree the tree
- * @param node the node to delete
+ * @brief the difference of two subtrees: the first one is split around the root of the second,
+ * and the halves are subtracted recursively
+ * @param t1 the tree of a
+ * @param a a subtree of t1 (its items are kept when they are not in b)
+ * @param t2 the tree of b
+ * @param b a subtree of t2 (all of its nodes are disposed of)
+ * @param removed in/out: counts the items removed from a
+ * @return the subtracted subtree
  */
-char removeM(RBTree* tree, Node* node)
+Subtree differenceSubtrees(RBTree *t1, Subtree a, RBTree *t2, Subtree b, long unsigned *removed)
 {
-    if(node->parent != NULL)
+    if(a.root == NULL || b.root == NULL)
     {
-        if (node->parent->left != NULL && tree->compFunc(node->data, node->parent->left->data) == 0)
-        {
-            node->parent->left = node->left;
-            if (node->left != NULL)
-            {
-                node->left->parent = node->parent;
-            }
-            tree->freeFunc(node->data);
-            free(node);
-            node = NULL;
-            return 'l';
-        }
-        else
-        {
-            node->parent->right = node->right;
-            if (node->right != NULL)
-            {
-                node->right->parent = node->parent;
-            }
-            tree->freeFunc(node->data);
-            free(node);
-            node = NULL;
-            return 'r';
-        }
+        disposeSubtree(t2, b.root);
+        return a;
     }
-    else
+    Node* node = b.root;
+    Subtree left = detachKid(node->left, b.blackHeight - 1);
+    Subtree right = detachKid(node->right, b.blackHeight - 1);
+    Subtree lo, hi;
+    Node* match = splitSubtree(t1, a, node->data, &lo, &hi);
+    disposeNode(t2, node);
+    if(match != NULL)
     {
-        // case A the node is the root
-        tree->root = node->right;
-        if (node->right != NULL)
-        {
-            node->right->parent = NULL;
-        }
-        tree->freeFunc(node->data);
-        free(node);
-        node = NULL;
-        return 't';
+        disposeNode(t1, match);
+        *removed += 1;
     }
+    Subtree l = differenceSubtrees(t1, lo, t2, left, removed);
+    Subtree r = differenceSubtrees(t1, hi, t2, right, removed);
+    return joinTwo(t1, l, r);
 }
 
 /**
- * @brief the second case- if the node is black and its kid is red
+ * @brief the whole of a tree as a subtree
  * @param tree the tree
- * @param node the node to delete
+ * @return the subtree
+ */
+Subtree wholeTree(const RBTree *tree)
+{
+    Subtree subtree = {tree->root, blackHeight(tree->root)};
+    return subtree;
+}
+
+/**
+ * join t1, pivot and t2 into t1 in O(log n). all the items of t1 must be smaller than the pivot,
+ * and the pivot smaller than all the items of t2. t2 is left empty.
+ * @param t1: the tree of the smaller items, and of the result.
+ * @param pivot: the item between the trees (NULL to just concatenate them).
+ * @param t2: the tree of the greater items.
+ * @return: 0 on failure (the trees are left as they were), other on success.
  */
-void delete2(RBTree* tree, Node* node, char side)
+int RBTreeJoin(RBTree *t1, void *pivot, RBTree *t2)
 {
-    if(side == 'r')
+    if(!joinable(t1, t2))
     {
-        node->right->parent = node->parent;
-        if(tree->compFunc(node->parent->right->data, node->data) == 0)
+        return 0;
+    }
+    // the order is checked on the live items, and the tombstones are only removed once the join
+    // cannot fail
+    Node* max = RBTreeMax(t1);
+    Node* min = RBTreeMin(t2);
+    if(pivot == NULL)
+    {
+        if(max != NULL && min != NULL && outOfOrder(t1, max->data, min->data))
         {
-            node->parent->right = node->right;
+            return 0;
         }
-        else
+    }
+    else if((max != NULL && outOfOrder(t1, max->data, pivot)) ||
+            (min != NULL && outOfOrder(t1, pivot, min->data)))
+    {
+        return 0;
+    }
+    Node* node = NULL;
+    if(pivot != NULL)
+    {
+        node = allocNode(t1, pivot);
+        if(node == NULL)
         {
-            node->parent->left = node->right;
+            return 0;
         }
-        node->right->color = BLACK;
+    }
+    compactAll(t1);
+    compactAll(t2);
+    Subtree joined;
+    if(pivot == NULL)
+    {
+        joined = joinTwo(t1, wholeTree(t1), wholeTree(t2));
     }
     else
     {
-        if(node->parent == NULL)
+        node->data = pivot;
+        if(t1->map)
         {
-            tree->root = node->left;
-            node->left->parent = node->parent;
+            *valueSlot(t1, node) = NULL;
         }
-        else
+        if(t1->counted)
         {
-            node->left->parent = node->parent;
-            if (tree->compFunc(node->parent->right->data, node->data) == 0)
-            {
-                node->parent->right = node->left;
-            }
-            else
-            {
-                node->parent->left = node->left;
-            }
+            copyCount(node) = 1;
+        }
+        if(t1->lazyDelete)
+        {
+            tombstoneSlot(t1, node) = 0;
         }
-        node->left->color = BLACK;
+        joined = joinSubtrees(t1, wholeTree(t1), node, wholeTree(t2));
+        t1->size += 1;
     }
-    tree->freeFunc(node->data);
-    free(node);
-    node = NULL;
+    t1->root = joined.root;
+    t1->size += t2->size;
+    resetEnds(t1);
+    t2->root = NULL;
+    t2->size = 0;
+    resetEnds(t2);
+    return 1;
 }
 
 /**
- * @brief the first case- if the node is red both of its kids are null (if not- then the black
- * length to its kids will be different
+ * @brief a new empty tree that nodes of the given tree can be moved into
  * @param tree the tree
- * @param node the node to delete
+ * @return the new tree, NULL on failure
  */
-void delete1(RBTree* tree, Node* node)
+RBTree * emptyLike(const RBTree *tree)
 {
-    if(node->parent->right != NULL && tree->compFunc(node->parent->right->data, node->data) == 0)
-    {
-        node->parent->right = NULL;
-    }
-    else
+    RBTree *like = newRBTree(tree->compFunc, tree->freeFunc);
+    if(like == NULL)
     {
-        node->parent->left = NULL;
+        return NULL;
     }
-    tree->freeFunc(node->data);
-    free(node);
-    node = NULL;
+    like->hookOffset = tree->hookOffset;
+    like->nodeBytes = tree->nodeBytes;
+    like->orderStatistics = tree->orderStatistics;
+    like->augment = tree->augment;
+    like->summaryBytes = tree->summaryBytes;
+    like->measure = tree->measure;
+    like->intervalLow = tree->intervalLow;
+    like->map = tree->map;
+    like->freeValue = tree->freeValue;
+    like->multiset = tree->multiset;
+    like->counted = tree->counted;
+    like->lazyDelete = tree->lazyDelete;
+    like->retireFunc = tree->retireFunc;
+    like->retireArgs = tree->retireArgs;
+    return like;
 }
 
 /**
- * @brief finds a node in the tree
- * @param tree the tree
- * @param data the data of the node to find
+ * split the items of a tree into two new trees: the items smaller than key, and the rest. the
+ * tree is left empty. the split itself is O(log n). the sizes of the new trees are read from the
+ * subtree sizes if the tree keeps them, and counted on the smaller of the two new trees otherwise,
+ * which makes the whole split O(log n + min(|lo|, |hi|)).
+ * @param tree: the tree to split.
+ * @param key: the item to split around. an item equal to it goes to hi.
+ * @param lo: out: a new tree of the items smaller than key.
+ * @param hi: out: a new tree of the items not smaller than key.
+ * @return: 0 on failure (the tree is left as it was), other on success.
  */
-Node* nodeFinder(RBTree * tree, Node * node, void* data)
+int RBTreeSplit(RBTree *tree, const void *key, RBTree **lo, RBTree **hi)
 {
-    if(tree->compFunc(node->data, data) == 0 || node == NULL)
+    if(lo == NULL || hi == NULL)
     {
-        return node;
+        return 0;
     }
-    else if(tree->compFunc(node->data, data) < 0)
+    *lo = NULL;
+    *hi = NULL;
+    if(!nodesMovable(tree) || key == NULL)
     {
-        return nodeFinder(tree, node->right, data);
+        return 0;
     }
-    else
+    *lo = emptyLike(tree);
+    *hi = emptyLike(tree);
+    if(*lo == NULL || *hi == NULL)
     {
-        return nodeFinder(tree, node->left, data);
+        freeRBTree(lo);
+        freeRBTree(hi);
+        return 0;
     }
-}
-
-/**
- * check whether the tree RBTreeContains this item.
- * @param tree: the tree to add an item to.
- * @param data: item to check.
- * @return: 0 if the item is not in the tree, other if it is.
- */
-int RBTreeContains(const RBTree *tree, const void *data)
-{
-    if(tree == NULL)
+    compactAll(tree);
+    Subtree smaller, greater;
+    Node* equal = splitSubtree(tree, wholeTree(tree), key, &smaller, &greater);
+    if(equal != NULL)
     {
-        return 0;
+        Subtree empty = {NULL, 0};
+        greater = joinSubtrees(tree, empty, equal, greater);
     }
-    return contains(tree, tree->root, data);
+    (*lo)->root = smaller.root;
+    (*hi)->root = greater.root;
+    resetEnds(*lo);
+    resetEnds(*hi);
+    countSplitSizes(*lo, *hi, tree->size);
+    tree->root = NULL;
+    tree->size = 0;
+    resetEnds(tree);
+    return 1;
 }
 
 /**
- * @brief helper function for RBTreeContains
- * @param node the node to check
- * @param data the data to check
- * @return 1 if the tree does contain the data 0 if not
+ * @brief sets the sizes of the two trees a tree was split into. without subtree sizes, both
+ * trees are walked at once until the smaller one ends
+ * @param lo the tree of the smaller items
+ * @param hi the tree of the greater items
+ * @param total the size of the split tree
  */
-int contains(const RBTree *tree, Node* node, const void * data)
+void countSplitSizes(RBTree *lo, RBTree *hi, long unsigned total)
 {
-    if(node != NULL)
+    if(lo->orderStatistics)
     {
-        if(tree->compFunc(node->data, data) == 0)
-        {
-            return 1;
-        }
-        if(tree->compFunc(node->data, data) < 0)
-        {
-            return contains(tree, node->right, data);
-        }
-        else
-        {
-            return contains(tree, node->left, data);
-        }
+        lo->size = sizeOf(lo->root);
+        hi->size = total - lo->size;
+        return;
+    }
+    Node* up = lo->leftmost;
+    Node* down = hi->rightmost;
+    long unsigned steps = 0;
+    while (up != NULL && down != NULL)
+    {
+        up = inOrderSuccessor(up);
+        down = inOrderPredecessor(down);
+        steps++;
+    }
+    if(up == NULL)
+    {
+        lo->size = steps;
+        hi->size = total - steps;
     }
     else
     {
-        return 0;
+        hi->size = steps;
+        lo->size = total - steps;
     }
 }
 
-
-
 /**
- * Activate a function on each item of the tree. the order is an ascending order. if one of the activations of the
- * function returns 0, the process stops.
- * @param tree: the tree with all the items.
- * @param func: the function to activate on all items.
- * @param args: more optional arguments to the function (may be null if the given function support it).
- * @return: 0 on failure, other on success.
+ * move the items of t2 into t1, in O(m log(n / m + 1)) for sizes m <= n. on duplicates, the item
+ * of t1 is kept and the one of t2 is freed. t2 is left empty.
+ * @param t1: the tree to add the items to.
+ * @param t2: the tree to take the items from.
+ * @return: 0 on failure (the trees are left as they were), other on success.
  */
-int forEachRBTree(const RBTree *tree, forEachFunc func, void *args)
+int RBTreeUnion(RBTree *t1, RBTree *t2)
 {
-    if(tree == NULL)
+    if(!setOperable(t1, t2))
     {
         return 0;
     }
-    return forEachHelper(tree->root, func, args);
+    compactAll(t1);
+    compactAll(t2);
+    long unsigned duplicates = 0;
+    t1->root = unionSubtrees(t1, wholeTree(t1), t2, wholeTree(t2), &duplicates).root;
+    t1->size += t2->size - duplicates;
+    resetEnds(t1);
+    t2->root = NULL;
+    t2->size = 0;
+    resetEnds(t2);
+    return 1;
 }
 
 /**
- * @brief helps go over the nodes
- * @return 1 if successful 0 if not
+ * keep in t1 only the items that t2 has too, in O(m log(n / m + 1)) for sizes m <= n. the items
+ * that are dropped from t1, and all the items of t2, are freed. t2 is left empty.
+ * @param t1: the tree to keep the items in.
+ * @param t2: the tree of the items to keep.
+ * @return: 0 on failure (the trees are left as they were), other on success.
  */
-int forEachHelper(Node *node, forEachFunc func, void * args)
+int RBTreeIntersection(RBTree *t1, RBTree *t2)
 {
-    if(node == NULL)
-    {
-        return 1;
-    }
-    int left = forEachHelper(node->left, func, args);
-    int try = func(node->data, args);
-    if(try == 0 || left == 0)
+    if(!setOperable(t1, t2))
     {
         return 0;
     }
-    int right = forEachHelper(node->right, func, args);
-    if(right == 0)
+    compactAll(t1);
+    compactAll(t2);
+    long unsigned kept = 0;
+    t1->root = intersectSubtrees(t1, wholeTree(t1), t2, wholeTree(t2), &kept).root;
+    t1->size = kept;
+    resetEnds(t1);
+    t2->root = NULL;
+    t2->size = 0;
+    resetEnds(t2);
+    return 1;
+}
+
+/**
+ * remove from t1 the items that t2 has, in O(m log(n / m + 1)) for sizes m <= n. the removed
+ * items, and all the items of t2, are freed. t2 is left empty.
+ * @param t1: the tree to remove the items from.
+ * @param t2: the tree of the items to remove.
+ * @return: 0 on failure (the trees are left as they were), other on success.
+ */
+int RBTreeDifference(RBTree *t1, RBTree *t2)
+{
+    if(!setOperable(t1, t2))
     {
         return 0;
     }
+    compactAll(t1);
+    compactAll(t2);
+    long unsigned removed = 0;
+    t1->root = differenceSubtrees(t1, wholeTree(t1), t2, wholeTree(t2), &removed).root;
+    t1->size -= removed;
+    resetEnds(t1);
+    t2->root = NULL;
+    t2->size = 0;
+    resetEnds(t2);
     return 1;
 }
 
-
 /**
  * free all memory of the data structure.
- * @param tree the tree to free
+ * @param tree the tree to free (may point to NULL). it is set to NULL
  */
 void freeRBTree(RBTree **tree)
 {
-    Node* node = (*tree)->root;
-    freeHelper(node, (*tree)->freeFunc);
+    if(tree == NULL || *tree == NULL)
+    {
+        return;
+    }
+    RBVersions *versions = (*tree)->versions;
+    if((*tree)->image != NULL)
+    {
+        // the items are part of the image
+        munmap((*tree)->image, (*tree)->imageBytes);
+    }
+    else if((*tree)->frozen != NULL)
+    {
+        for(long unsigned i = 1; i <= (*tree)->size; i++)
+        {
+            freeItem(*tree, frozenNode(*tree, i));
+        }
+        free((*tree)->frozen);
+    }
+    else if(versions != NULL)
+    {
+        // only the nodes that no other version shares are freed
+        releaseShared(*tree, (*tree)->root);
+        versions->trees -= 1;
+        if((*tree)->readOnly)
+        {
+            versions->snapshots -= 1;
+        }
+        if(versions->trees == 0)
+        {
+            free(versions);
+        }
+    }
+    else if((*tree)->pool != NULL)
+    {
+        freePool(*tree);
+    }
+    else
+    {
+        freeHelper(*tree, (*tree)->root);
+    }
+    // the tombstones are in the tree, and are freed with it
+    free((*tree)->tombstones);
+#ifdef RB_TREE_STATS
+    freeStatsRegistry((*tree)->stats);
+#endif
     free(*tree);
+    *tree = NULL;
 }
 
 /**
- * @brief helps free the data
- * @param node the node to free
+ * @brief helps free the data, in O(n) with no recursion and no extra memory: while the top node
+ * has a left kid it is rotated right, and then it is freed and its right kid takes its place. the
+ * right kid is read first, since an intrusive node is freed together with its item
+ * @param tree the tree
+ * @param node the root of the subtree to free (may be NULL)
  */
-void freeHelper(Node* node, FreeFunc func)
+void freeHelper(RBTree *tree, Node* node)
 {
-    if(node != NULL)
+    while(node != NULL)
     {
-        freeHelper(node->right, func);
-        func(node->data);
-        freeHelper(node->left, func);
-        free(node);
+        Node* left = node->left;
+        if(left != NULL)
+        {
+            node->left = left->right;
+            left->right = node;
+            node = left;
+            continue;
+        }
+        Node* right = node->right;
+        freeItem(tree, node);
+        releaseNode(tree, node);
+        node = right;
     }
-}
\ No newline at end of file
+}
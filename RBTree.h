@@ -1,7 +1,11 @@
 #ifndef RBTREE_RBTREE_H
 #define RBTREE_RBTREE_H
 
-// a color of a Node.
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// a color of a Node. it is stored in the lowest bit of the node's parent pointer.
 typedef enum Color
 {
 	RED, BLACK
@@ -28,33 +32,447 @@ typedef int (*forEachFunc)(const void *object, void *args);
  */
 typedef void (*FreeFunc)(void *data);
 
+/**
+ * a function to encode an item into bytes, for sorted streams (see RBTreeWriteSorted).
+ * @item: a pointer to an item of the tree.
+ * @buffer: where to write the bytes.
+ * @size: the size of buffer.
+ * @return: the number of bytes of the item (nothing is written if it is larger than size, the
+ * function is then called again with a buffer that big), RB_ENCODE_FAILED on failure.
+ */
+typedef size_t (*EncodeFunc)(const void *item, void *buffer, size_t size);
+
+/**
+ * a function to measure an item, for subtree maxima (see RBTreeEnableSubtreeMax). it is called
+ * on every rebalancing step, so it should be cheap (e.g. cached in the item).
+ * @item: a pointer to an item of the tree.
+ * @return: the measure of the item.
+ */
+typedef double (*MeasureFunc)(const void *item);
+
+struct RBTree;
+
+/**
+ * a function to summarize a subtree, for augmented trees (see RBTreeEnableAugment). it sets the
+ * summary of a node from its item and the summaries of its kids, and is called bottom up whenever
+ * the kids of a node change, so it should be O(1).
+ * @tree: the tree.
+ * @summary: the summary of the node, to set.
+ * @item: the item of the node.
+ * @left: the summary of the left kid, NULL if there is none.
+ * @right: the summary of the right kid, NULL if there is none.
+ */
+typedef void (*AugmentFunc)(const struct RBTree *tree, void *summary, const void *item,
+                            const void *left, const void *right);
+
+// the return value of an EncodeFunc that failed.
+#define RB_ENCODE_FAILED ((size_t)-1)
+
+/**
+ * a function to decode an item from the bytes an EncodeFunc wrote.
+ * @buffer: the bytes of the item.
+ * @size: the number of bytes.
+ * @return: a new item (that the tree owns), NULL on failure.
+ */
+typedef void *(*DecodeFunc)(const void *buffer, size_t size);
+
 /*
- * a node of the tree.
+ * a node of the tree. nodes are at least pointer aligned, so the color is packed into the lowest
+ * bit of the parent pointer - use the accessors below instead of touching parentColor.
  */
 typedef struct Node
 {
-	struct Node *parent, *left, *right;
-	Color color;
+	uintptr_t parentColor;
+	struct Node *left, *right;
 	void *data;
 } Node;
 
+// the bit of parentColor that holds the color.
+#define RB_COLOR_MASK ((uintptr_t)1)
+
+// the parent of a node (NULL for the root).
+#define rbParent(node) ((Node *)((node)->parentColor & ~RB_COLOR_MASK))
+
+// the color of a node.
+#define rbColor(node) ((Color)((node)->parentColor & RB_COLOR_MASK))
+
+// sets the parent of a node, keeping its color.
+#define rbSetParent(node, p) \
+	((node)->parentColor = (uintptr_t)(p) | ((node)->parentColor & RB_COLOR_MASK))
+
+// sets the color of a node, keeping its parent.
+#define rbSetColor(node, c) \
+	((node)->parentColor = ((node)->parentColor & ~RB_COLOR_MASK) | (uintptr_t)(c))
+
+// sets both the parent and the color of a node that was not linked yet.
+#define rbInitParentColor(node, p, c) ((node)->parentColor = (uintptr_t)(p) | (uintptr_t)(c))
+
+/*
+ * the slab allocator of a pooled tree (see newRBTreeWithPool).
+ */
+typedef struct NodePool NodePool;
+
+/*
+ * the versions (the live tree and its snapshots) that share the nodes of a tree with snapshots
+ * enabled (see RBTreeEnableSnapshots).
+ */
+typedef struct RBVersions RBVersions;
+
+#ifdef RB_TREE_STATS
+/*
+ * the operation counters of a tree built with RB_TREE_STATS: a block of counters per thread that
+ * used the tree (see RBTreeGetStats).
+ */
+typedef struct RBStatsRegistry RBStatsRegistry;
+#endif
+
+struct RBTree;
+
+/**
+ * a function that takes over a node once it is removed from the tree, instead of freeing it right
+ * away (for deferred reclamation). it must eventually call freeRBTreeNode.
+ * @tree: the tree the node was removed from.
+ * @node: the removed node, still holding its item.
+ * @args: the tree's retireArgs.
+ */
+typedef void (*RetireFunc)(struct RBTree *tree, Node *node, void *args);
+
 /**
- * represents the tree
+ * represents the tree. leftmost and rightmost cache the nodes of the smallest and the largest
+ * items (NULL while the tree is empty). augment is set while the tree keeps a summary of
+ * summaryBytes in every node (see RBTreeEnableAugment), measure while the summaries are subtree
+ * maxima (see RBTreeEnableSubtreeMax), and intervalLow in an interval tree (see newIntervalTree).
+ * a map (see newRBMap) keeps a value next to every item.
+ * multiset and counted tell how equal items are kept (see RBTreeEnableMultiset). a frozen tree
+ * (see RBTreeFreeze) has no root: its nodes are the slots 1 to size of the frozen array, nodeBytes
+ * apart. a tree mapped by RBTreeMap is frozen, and its array is part of image, imageBytes long.
+ * with lazyDelete set (see RBTreeEnableLazyDelete), deleted items stay in the tree as tombstones:
+ * tombstones lists tombstoneCount of them (room for tombstoneCapacity), and size counts the rest.
  */
 typedef struct RBTree
 {
 	Node *root;
+	Node *leftmost, *rightmost;
 	CompareFunc compFunc;
 	FreeFunc freeFunc;
 	long unsigned size;
+	NodePool *pool;
+	long hookOffset;
+	long unsigned nodeBytes;
+	int orderStatistics;
+	AugmentFunc augment;
+	long unsigned summaryBytes;
+	MeasureFunc measure;
+	MeasureFunc intervalLow;
+	int map;
+	FreeFunc freeValue;
+	int multiset;
+	int counted;
+	Node *frozen;
+	void *image;
+	size_t imageBytes;
+	RetireFunc retireFunc;
+	void *retireArgs;
+	RBVersions *versions;
+	int readOnly;
+	int lazyDelete;
+	Node **tombstones;
+	long unsigned tombstoneCount;
+	long unsigned tombstoneCapacity;
+#ifdef RB_TREE_STATS
+	RBStatsRegistry *stats;
+#endif
 } RBTree;
 
+// the hookOffset of a tree that allocates its own nodes.
+#define RB_NOT_INTRUSIVE (-1L)
+
+// the offset of an embedded hook (a Node member) inside an item type, for newIntrusiveRBTree.
+#define RB_HOOK_OFFSET(type, member) ((long)offsetof(type, member))
+
+// the item that embeds the given hook.
+#define rbContainerOf(node, type, member) ((type *)((char *)(node) - offsetof(type, member)))
+
+// the number of leading bytes of a string that rbStringPrefix packs.
+#define RB_STRING_PREFIX_BYTES 8
+
+/**
+ * pack the first RB_STRING_PREFIX_BYTES bytes of a string into a big endian number, zero padded,
+ * so that the prefixes of two strings compare as numbers like the strings compare by strcmp, as
+ * far as the prefixes go. string keys cache it to settle most comparisons without the strings.
+ * @param str: the string.
+ * @return: the packed prefix.
+ */
+static inline uint64_t rbStringPrefix(const char *str)
+{
+	uint64_t prefix = 0;
+	for (int i = 0; i < RB_STRING_PREFIX_BYTES && str[i] != '\0'; i++)
+	{
+		prefix |= (uint64_t)(unsigned char)str[i] << (8 * (RB_STRING_PREFIX_BYTES - 1 - i));
+	}
+	return prefix;
+}
+
 /**
  * constructs a new RBTree with the given CompareFunc.
  * comp: a function two compare two variables.
  */
 RBTree *newRBTree(CompareFunc compFunc, FreeFunc freeFunc); // implement it in RBTree.c
 
+/**
+ * constructs a new RBTree whose nodes are carved from slabs. deleted nodes are recycled through a
+ * free list, and freeRBTree releases the slabs without walking the tree.
+ * @param compFunc: a function two compare two variables.
+ * @param freeFunc: a function to free an item.
+ * @param initialCapacity: the number of nodes in the first slab (0 for a default size).
+ * @return: the new tree, NULL on failure.
+ */
+RBTree *newRBTreeWithPool(CompareFunc compFunc, FreeFunc freeFunc, long unsigned initialCapacity);
+
+/**
+ * constructs a new intrusive RBTree. every item embeds a Node member (its hook) that the tree
+ * links in place, so inserting and deleting do no allocation. the tree's functions still take and
+ * return the items themselves; a deleted item is passed to freeFunc together with its hook.
+ * @param compFunc: a function two compare two items.
+ * @param freeFunc: a function to free an item.
+ * @param hookOffset: the offset of the hook inside an item, RB_HOOK_OFFSET(type, member).
+ * @return: the new tree, NULL on failure.
+ */
+RBTree *newIntrusiveRBTree(CompareFunc compFunc, FreeFunc freeFunc, long hookOffset);
+
+/**
+ * constructs a new RBTree out of sorted items in O(n), bottom up and without rebalancing. the
+ * nodes are allocated as one contiguous block; the tree is pooled, so later insertions carve
+ * new slabs (see newRBTreeWithPool). like every pooled tree, it cannot take snapshots (see
+ * RBTreeEnableSnapshots) and its nodes cannot move to other trees: RBTreeSplit, RBTreeJoin and
+ * the set operations refuse it. build a tree by insertions to use them.
+ * @param compFunc: a function two compare two items.
+ * @param freeFunc: a function to free an item.
+ * @param items: the items, in strictly ascending order. the tree owns them on success.
+ * @param n: the number of items.
+ * @return: the new tree, NULL on failure (including items that are not strictly ascending).
+ */
+RBTree *RBTreeBuildFromSorted(CompareFunc compFunc, FreeFunc freeFunc, void **items, size_t n);
+
+/**
+ * write the items of the tree to a binary sorted stream: a small header, then every item in
+ * ascending order as its length and the bytes encode gave it. a single pass, that allocates one
+ * buffer (grown for items that do not fit). RBTreeReadSorted loads the stream back in O(n).
+ * works on snapshots and frozen trees too.
+ * @param tree: the tree, not a map or a multiset (their values or copies are not streamed).
+ * @param file: the stream to write to.
+ * @param encode: a function to encode an item.
+ * @return: 0 on failure, other on success.
+ */
+int RBTreeWriteSorted(const RBTree *tree, FILE *file, EncodeFunc encode);
+
+/**
+ * construct a new RBTree out of a binary sorted stream written by RBTreeWriteSorted, bottom up
+ * as RBTreeBuildFromSorted does (no comparisons beyond checking the order, no rebalancing), so
+ * the tree is pooled alike.
+ * @param file: the stream to read from.
+ * @param compFunc: a function two compare two items.
+ * @param freeFunc: a function to free an item.
+ * @param decode: a function to decode an item.
+ * @return: the new tree, NULL on failure (the decoded items are freed).
+ */
+RBTree *RBTreeReadSorted(FILE *file, CompareFunc compFunc, FreeFunc freeFunc, DecodeFunc decode);
+
+/**
+ * save the tree as an image file, for RBTreeMap. the image holds the encoded items followed by
+ * the tree in the layout of a frozen tree (see RBTreeFreeze), with the item pointers stored as
+ * offsets into the image (biased by the address the image is laid out for). the mapped tree
+ * compares the encoded bytes in place, so encode must write an item as it lies in memory (a flat
+ * item, without pointers), and the image can only be mapped on machines with the same byte order
+ * and pointer size.
+ * @param tree: the tree (not a map or a multiset).
+ * @param path: the file to write.
+ * @param encode: a function to encode an item.
+ * @return: 0 on failure (no file is left behind), other on success.
+ */
+int RBTreeSave(const RBTree *tree, const char *path, EncodeFunc encode);
+
+/**
+ * map an image written by RBTreeSave as a frozen, read-only tree, in O(1): nothing is read or
+ * allocated per item, so pages are only faulted in as lookups, cursors and range queries touch
+ * them, and the processes that map the same image share its physical pages. when the address the
+ * image was laid out for is taken in this process, the image is mapped elsewhere and the item
+ * pointers of its slots are moved (copying only the slot pages, in O(n)). the items are the
+ * encoded bytes inside the mapping; they are not freed by freeRBTree, which unmaps the image.
+ * the image must not change while it is mapped.
+ * @param path: the image.
+ * @param compFunc: a function to compare two items (as they were encoded).
+ * @return: the tree, NULL on failure.
+ */
+RBTree *RBTreeMap(const char *path, CompareFunc compFunc);
+
+/**
+ * constructs a new map: a tree whose items are keys, each with a value stored in its node. the
+ * usual tree functions work on a map too (on the keys, the value of a key added by
+ * insertToRBTree is NULL), and deleting or freeing a key frees its value as well.
+ * not supported together with snapshots.
+ * @param compFunc: a function to compare two keys.
+ * @param freeKey: a function to free a key.
+ * @param freeValue: a function to free a value (NULL if the map does not own its values).
+ * NULL values are never passed to it.
+ * @return: the new map, NULL on failure.
+ */
+RBTree *newRBMap(CompareFunc compFunc, FreeFunc freeKey, FreeFunc freeValue);
+
+/**
+ * make the tree keep the size of every subtree (maintained by the insert and delete rotations),
+ * so that RBTreeSelect and RBTreeRank run in O(log n). must be called on a new tree, before the
+ * first insertion. not supported for intrusive trees or counted multisets.
+ * @param tree: the tree.
+ * @return: 0 on failure, other on success.
+ */
+int RBTreeEnableOrderStatistics(RBTree *tree);
+
+/**
+ * the number of nodes in the subtree of a node, in O(1).
+ * @param tree: a tree with order statistics (see RBTreeEnableOrderStatistics).
+ * @param node: a node of the tree (may be NULL).
+ * @return: the size of the subtree, 0 for NULL or a tree without order statistics.
+ */
+long unsigned RBTreeSubtreeSize(const RBTree *tree, const Node *node);
+
+/**
+ * make the tree keep, in every node, a summary of its subtree (e.g. its sum or its maximum),
+ * stored inline after the node. augment recomputes a summary from the kids' ones, and is called
+ * by the insert and delete rotations, joins and along the changed path, so updates stay O(log n)
+ * calls. must be called on a new tree, before the first insertion; a tree has one augmentation
+ * at most. not supported for intrusive trees, counted multisets or snapshots; freezing the tree
+ * drops the summaries.
+ * @param tree: the tree.
+ * @param augment: the function that sets a summary.
+ * @param summaryBytes: the size of a summary. summaries are aligned to pointers.
+ * @return: 0 on failure, other on success.
+ */
+int RBTreeEnableAugment(RBTree *tree, AugmentFunc augment, size_t summaryBytes);
+
+/**
+ * the summary of the subtree of a node, kept by an augmented tree (see RBTreeEnableAugment). the
+ * summary of the root summarizes the whole tree. it may not be changed.
+ * @param tree: the tree.
+ * @param node: a node of the tree.
+ * @return: the summary, NULL if there is no node or the tree is not augmented.
+ */
+const void *RBTreeSummary(const RBTree *tree, const Node *node);
+
+/**
+ * make the tree keep, in every node, the item with the largest measure in its subtree, as its
+ * augmentation (see RBTreeEnableAugment), so that RBTreeMaxByMeasure runs in O(1).
+ * @param tree: the tree.
+ * @param measure: a function to measure an item.
+ * @return: 0 on failure, other on success.
+ */
+int RBTreeEnableSubtreeMax(RBTree *tree, MeasureFunc measure);
+
+/**
+ * find the item with the largest measure in O(1) (see RBTreeEnableSubtreeMax).
+ * @param tree: the tree.
+ * @return: the first item in ascending order with the largest measure, NULL if the tree is empty
+ * or does not keep subtree maxima.
+ */
+void *RBTreeMaxByMeasure(const RBTree *tree);
+
+/**
+ * constructs a new interval tree: a tree of intervals that keeps the largest high endpoint of
+ * every subtree (see RBTreeEnableSubtreeMax), for overlap queries in O(min(n, k log n)).
+ * @param compFunc: a function to compare two intervals. it must order them by their low
+ * endpoints first.
+ * @param freeFunc: a function to free an interval.
+ * @param low: the low endpoint of an interval.
+ * @param high: the high endpoint of an interval.
+ * @return: the new tree, NULL on failure.
+ */
+RBTree *newIntervalTree(CompareFunc compFunc, FreeFunc freeFunc, MeasureFunc low,
+                        MeasureFunc high);
+
+/**
+ * make the tree keep equal items instead of rejecting them. must be called on a new tree, before
+ * the first insertion. not supported for maps or together with snapshots. in a multiset,
+ * RBTreeFindNode and deleteFromRBTree find the first of the equal items, and RBTreeSplit sends
+ * all the equal items to hi. the set operations (RBTreeUnion and the like) are not supported.
+ * @param tree: the tree.
+ * @param counted: 0 to keep every item in a node of its own, after the equal items that were
+ * added before it (for items that hold more than their key). other for a counted multiset, where
+ * a key has one node with a count: adding an equal item frees it and bumps the count, deleting
+ * drops the count, and the node goes away with its last copy. the tree's size counts the items it
+ * holds, not the copies. counting is not supported for intrusive trees, together with order
+ * statistics, or by RBTreePopFront.
+ * @return: 0 on failure, other on success.
+ */
+int RBTreeEnableMultiset(RBTree *tree, int counted);
+
+/**
+ * make the tree's nodes shareable, so that RBTreeSnapshot can take snapshots of it. must be called
+ * on a new tree, before the first insertion. not supported for pooled or intrusive trees, maps,
+ * multisets, or together with order statistics.
+ * @param tree: the tree.
+ * @return: 0 on failure, other on success.
+ */
+int RBTreeEnableSnapshots(RBTree *tree);
+
+/**
+ * make deletions lazy: a deleted item's node is only marked as a tombstone, in O(log n) without
+ * any rebalancing, and is removed later by RBTreeCompact. lookups, cursors and the functions
+ * built on them skip tombstones, adding an item equal to a tombstone's takes over its node, and
+ * the operations that move nodes between trees (joins, splits, the set operations and
+ * RBTreeFreeze) compact the tree first. a tombstone's item is freed when it is compacted. must
+ * be called on a new tree, before the first insertion. not supported for intrusive trees, maps,
+ * multisets that are not counted, or together with order statistics, summaries or snapshots.
+ * @param tree: the tree.
+ * @return: 0 on failure, other on success.
+ */
+int RBTreeEnableLazyDelete(RBTree *tree);
+
+/**
+ * remove up to budget tombstones of a tree with lazy deletion (see RBTreeEnableLazyDelete) from
+ * it, each in O(log n), the most recent first. once half of the nodes (or more) are tombstones,
+ * the tree is rebuilt from its items in O(n) instead, whatever the budget (but 0), so that the
+ * cost of a mass deletion can be spread over idle time.
+ * @param tree: the tree.
+ * @param budget: the largest number of tombstones to remove one by one.
+ * @return: the number of tombstones removed.
+ */
+long unsigned RBTreeCompact(RBTree *tree, long unsigned budget);
+
+/**
+ * tell whether a node is a tombstone: its item was deleted from a tree with lazy deletion, and the
+ * node only waits for RBTreeCompact. code that walks the kid links itself must skip tombstones.
+ * @param tree: the tree.
+ * @param node: a node of the tree.
+ * @return: 0 for a live node (always, without lazy deletion), other for a tombstone.
+ */
+int RBTreeIsTombstone(const RBTree *tree, const Node *node);
+
+/**
+ * take a read-only, point-in-time snapshot of a tree with snapshots enabled, in O(1). the snapshot
+ * shares all of its nodes with the tree; while snapshots exist, every insertion or deletion copies
+ * the O(log n) nodes it is about to change instead of changing them in place (so cursors of the
+ * tree do not survive writes). the snapshot is read with the usual lookup, bound and iteration
+ * functions (cursor steps cost O(log n) there, as snapshots do not follow parent links), rejects
+ * insertions and deletions, and is freed with freeRBTree, which only frees what it does not share.
+ * the tree and its snapshots may be freed in any order.
+ * @param tree: the tree (or another snapshot of it).
+ * @return: the snapshot, NULL on failure.
+ */
+RBTree *RBTreeSnapshot(RBTree *tree);
+
+/**
+ * freeze the tree: turn it into a read-only, contiguous array of its nodes in breadth first
+ * (Eytzinger) order, for read-mostly trees. the array holds no links (the kids of a slot are
+ * found by its position), so searches touch a few cache lines near the top instead of scattered
+ * nodes, and prefetch the slots below them. the lookup, bound, range and cursor functions work on
+ * a frozen tree as before (cursors step by slot arithmetic); insertions, deletions, joins and
+ * splits are rejected. the nodes of the tree (not its items) are freed, so earlier cursors are
+ * invalid. not supported for trees with snapshots.
+ * @param tree: the tree.
+ * @return: 0 on failure (the tree is left as it was), other on success.
+ */
+int RBTreeFreeze(RBTree *tree);
+
 /**
  * add an item to the tree
  * @param tree: the tree to add an item to.
@@ -63,6 +481,32 @@ RBTree *newRBTree(CompareFunc compFunc, FreeFunc freeFunc); // implement it in R
  */
 int insertToRBTree(RBTree *tree, void *data); // implement it in RBTree.c
 
+/**
+ * add an item to the tree, trying its place next to a hint before searching from the root. if the
+ * item belongs right before or right after the hint (e.g. appending after RBTreeMax), this costs
+ * O(1) amortized; an item above the hint is found by climbing from it, in O(log distance). on a
+ * tree with snapshots, this is insertToRBTree.
+ * @param tree: the tree to add an item to.
+ * @param hint: a cursor of the tree near the item's place, or RBTreeEnd(tree) for after the
+ * largest item.
+ * @param data: item to add to the tree.
+ * @return: 0 on failure, other on success. (if the item is already in the tree - failure).
+ */
+int insertToRBTreeHint(RBTree *tree, Node *hint, void *data);
+
+/**
+ * add a batch of items to the tree. the batch is sorted with the tree's compFunc, and each item is
+ * placed by a finger search from the previous one instead of a descent from the root, so
+ * clustered keys cost far less than n separate insertToRBTree calls.
+ * @param tree: the tree to add the items to.
+ * @param items: the items to add.
+ * @param n: the number of items.
+ * @param results: optional (may be NULL), n entries. results[i] is set to 1 if items[i] was added,
+ * and to 0 if it was not (it is NULL, already in the tree, or equal to an earlier item of the batch).
+ * @return: 0 on failure (the items that were not added yet are left out), other on success.
+ */
+int insertBatchRBTree(RBTree *tree, void **items, size_t n, int *results);
+
 /**
  * remove an item from the tree
  * @param tree: the tree to remove an item from.
@@ -71,6 +515,26 @@ int insertToRBTree(RBTree *tree, void *data); // implement it in RBTree.c
  */
 int deleteFromRBTree(RBTree *tree, void *data); // implement it in RBTree.c
 
+/**
+ * remove an item from the tree, looking for it at a hint and the hint's neighbors before searching
+ * from the root (O(1) amortized when the hint is right, see insertToRBTreeHint).
+ * @param tree: the tree to remove an item from.
+ * @param hint: a cursor of the tree near the item, or RBTreeEnd(tree) for the largest item.
+ * @param data: item to remove from the tree.
+ * @return: 0 on failure, other on success. (if data is not in the tree - failure).
+ */
+int deleteFromRBTreeHint(RBTree *tree, Node *hint, void *data);
+
+/**
+ * remove the item of a node from the tree without searching for it first (on a tree with
+ * snapshots, the node's item is looked up anyway, since the path has to be copied).
+ * @param tree: the tree the node belongs to.
+ * @param node: a node of the tree, from RBTreeFindNode, a bound, or a cursor. it is freed (or
+ * becomes a tombstone, with lazy deletion).
+ * @return: 0 on failure (also for a node that is a tombstone already), other on success.
+ */
+int deleteNodeFromRBTree(RBTree *tree, Node *node);
+
 /**
  * check whether the tree RBTreeContains this item.
  * @param tree: the tree to add an item to.
@@ -79,7 +543,88 @@ int deleteFromRBTree(RBTree *tree, void *data); // implement it in RBTree.c
  */
 int RBTreeContains(const RBTree *tree, const void *data); // implement it in RBTree.c
 
+/**
+ * find the item stored in the tree that is equal to data (one compFunc call per level).
+ * @param tree: the tree to search in.
+ * @param data: item to look for.
+ * @return: the stored item, NULL if the item is not in the tree.
+ */
+void *RBTreeFind(const RBTree *tree, const void *data);
+
+/**
+ * find the node holding an item equal to data (one compFunc call per level). the node stays
+ * attached to its item until that item is removed from the tree.
+ * @param tree: the tree to search in.
+ * @param data: item to look for.
+ * @return: the node holding the item, NULL if the item is not in the tree.
+ */
+Node *RBTreeFindNode(const RBTree *tree, const void *data);
+
+
+/**
+ * count the items of the tree that are equal to key, in O(log n + k) for k such items (O(log n) on
+ * a counted multiset, see RBTreeEnableMultiset). a tree that is not a multiset has 0 or 1.
+ * @param tree: the tree.
+ * @param key: the item to count.
+ * @return: the number of equal items.
+ */
+long unsigned RBTreeCount(const RBTree *tree, const void *key);
+
+/**
+ * the number of copies of the item of a node, in O(1): its count in a counted multiset, 1 in any
+ * other tree.
+ * @param tree: the tree.
+ * @param node: a node of the tree.
+ * @return: the number of copies, 0 if there is no node.
+ */
+long unsigned RBTreeCopies(const RBTree *tree, const Node *node);
+
+/**
+ * remove all the items of the tree that are equal to key, in O(log n + k) for k such items.
+ * @param tree: the tree.
+ * @param key: the item to remove. on a multiset it must not be one of the removed items, as they
+ * are freed along the way.
+ * @return: the number of removed items (all the copies, on a counted multiset). 0 if there were
+ * none, or on failure.
+ */
+long unsigned eraseAllRBTree(RBTree *tree, const void *key);
+
+/**
+ * find the value of a key in a map, in one descent.
+ * @param map: the map.
+ * @param key: the key to look for.
+ * @return: the value, NULL if the key is not in the map (or its value is NULL).
+ */
+void *RBMapGet(const RBTree *map, const void *key);
+
+/**
+ * set the value of a key in a map (upsert), in one descent. if the key is there already its value
+ * is replaced in place, without any change to the tree's structure.
+ * @param map: the map.
+ * @param key: the key. the map owns it only if it was added (return value 1).
+ * @param value: the value, which the map owns on success. the replaced value is freed.
+ * @return: 0 on failure, 1 if the key was added, 2 if it was in the map already.
+ */
+int RBMapPut(RBTree *map, void *key, void *value);
 
+/**
+ * find the value slot of a key in a map, adding the key with a NULL value if it is missing, in
+ * one descent. the slot can be read and written in place (e.g. a counter), and stays valid until
+ * the key is removed.
+ * @param map: the map.
+ * @param key: the key. the map owns it only if it was added.
+ * @param inserted: optional out (may be NULL): 1 if the key was added, 0 if it was there already.
+ * @return: the slot, NULL on failure.
+ */
+void **RBMapGetOrInsert(RBTree *map, void *key, int *inserted);
+
+/**
+ * get the value of a node of a map (from RBTreeFindNode, a bound or a cursor).
+ * @param map: the map.
+ * @param node: the node.
+ * @return: the value, NULL if map is not a map.
+ */
+void *RBMapValue(const RBTree *map, const Node *node);
 
 /**
  * Activate a function on each item of the tree. the order is an ascending order. if one of the activations of the
@@ -91,9 +636,251 @@ int RBTreeContains(const RBTree *tree, const void *data); // implement it in RBT
  */
 int forEachRBTree(const RBTree *tree, forEachFunc func, void *args); // implement it in RBTree.c
 
+/**
+ * Activate a function on each item of the tree between lo and hi (inclusive), in ascending order,
+ * in O(log n + k) for k visited items. if one of the activations of the function returns 0, the
+ * process stops.
+ * @param tree: the tree with all the items.
+ * @param lo: the smallest item to visit (NULL for no lower limit).
+ * @param hi: the largest item to visit (NULL for no upper limit).
+ * @param func: the function to activate on the items.
+ * @param args: more optional arguments to the function (may be null if the given function support it).
+ * @return: 0 on failure, other on success.
+ */
+int forEachRangeRBTree(const RBTree *tree, const void *lo, const void *hi, forEachFunc func,
+					   void *args);
+
+/**
+ * Activate a function on each interval of an interval tree that overlaps [low, high] (endpoints
+ * included), in ascending order, in O(min(n, k log n)) for k such intervals: subtrees whose
+ * largest high endpoint is below low are skipped, but a reported interval may cost a path. if one of the activations of the function returns 0,
+ * the process stops.
+ * @param tree: an interval tree (see newIntervalTree).
+ * @param low: the low end of the range.
+ * @param high: the high end of the range.
+ * @param func: the function to activate on the intervals.
+ * @param args: more optional arguments to the function (may be null if the given function support it).
+ * @return: 0 on failure, other on success.
+ */
+int forEachOverlapRBTree(const RBTree *tree, double low, double high, forEachFunc func,
+						 void *args);
+
+/**
+ * Activate a function on each interval of an interval tree that contains a point, in ascending
+ * order, in O(min(n, k log n)) (see forEachOverlapRBTree).
+ * @param tree: an interval tree (see newIntervalTree).
+ * @param point: the point.
+ * @param func: the function to activate on the intervals.
+ * @param args: more optional arguments to the function (may be null if the given function support it).
+ * @return: 0 on failure, other on success.
+ */
+int forEachStabRBTree(const RBTree *tree, double point, forEachFunc func, void *args);
+
+/**
+ * get the node of the smallest item of the tree, in O(1).
+ * @param tree: the tree.
+ * @return: the node, NULL if the tree is empty.
+ */
+Node *RBTreeMin(const RBTree *tree);
+
+/**
+ * get the node of the largest item of the tree, in O(1).
+ * @param tree: the tree.
+ * @return: the node, NULL if the tree is empty.
+ */
+Node *RBTreeMax(const RBTree *tree);
+
+/**
+ * remove the smallest item from the tree and hand it to the caller instead of freeing it, in O(1)
+ * amortized. not supported while the tree has snapshots, or on a tree that defers reclamation.
+ * @param tree: the tree.
+ * @return: the item (the caller owns it now), NULL on failure or if the tree is empty.
+ */
+void *RBTreePopFront(RBTree *tree);
+
+/**
+ * get a cursor to the smallest item of the tree, in O(1). cursors are nodes: the item is
+ * node->data, and a cursor stays valid until its own item is removed. iterate with
+ * for (Node *n = RBTreeBegin(tree); n != RBTreeEnd(tree); n = RBTreeNext(tree, n)).
+ * @param tree: the tree.
+ * @return: the node of the smallest item, RBTreeEnd(tree) if the tree is empty.
+ */
+Node *RBTreeBegin(const RBTree *tree);
+
+/**
+ * get the past-the-end cursor of the tree.
+ * @param tree: the tree.
+ * @return: the cursor that follows the largest item.
+ */
+Node *RBTreeEnd(const RBTree *tree);
+
+/**
+ * advance a cursor to the next item in ascending order, in O(1) amortized steps.
+ * @param tree: the tree the cursor belongs to.
+ * @param node: the cursor.
+ * @return: the next node, RBTreeEnd(tree) after the largest item.
+ */
+Node *RBTreeNext(const RBTree *tree, Node *node);
+
+/**
+ * move a cursor back to the previous item in ascending order, in O(1) amortized steps.
+ * @param tree: the tree the cursor belongs to.
+ * @param node: the cursor, or RBTreeEnd(tree) to get the largest item (in O(1)).
+ * @return: the previous node, NULL before the smallest item.
+ */
+Node *RBTreePrev(const RBTree *tree, Node *node);
+
+/**
+ * find the first item of the tree that is not smaller than data.
+ * @param tree: the tree to search in.
+ * @param data: the bound.
+ * @return: a cursor to that item, RBTreeEnd(tree) if all items are smaller.
+ */
+Node *RBTreeLowerBound(const RBTree *tree, const void *data);
+
+/**
+ * find the first item of the tree that is greater than data.
+ * @param tree: the tree to search in.
+ * @param data: the bound.
+ * @return: a cursor to that item, RBTreeEnd(tree) if no item is greater.
+ */
+Node *RBTreeUpperBound(const RBTree *tree, const void *data);
+
+/**
+ * find the k'th smallest item of the tree, counting from 0. O(log n) on a tree with order
+ * statistics enabled, O(k) otherwise.
+ * @param tree: the tree.
+ * @param k: the index of the item in ascending order.
+ * @return: a cursor to the item, RBTreeEnd(tree) if the tree has k items or less.
+ */
+Node *RBTreeSelect(const RBTree *tree, long unsigned k);
+
+/**
+ * count the items of the tree that are smaller than data. O(log n) on a tree with order
+ * statistics enabled, O(n) otherwise.
+ * @param tree: the tree.
+ * @param data: the item to rank.
+ * @return: the number of smaller items, the index data has (or would have) in ascending order.
+ */
+long unsigned RBTreeRank(const RBTree *tree, const void *data);
+
+/**
+ * what a tree did and how it looks (see RBTreeGetStats). the counters are kept only when the
+ * library is built with RB_TREE_STATS defined (counted is then 1), and are zero otherwise: every
+ * thread counts in a block of its own, and the blocks are summed when the statistics are read.
+ * comparisons are the compFunc calls of RBTree.c, and rotations all the single rotations, joins
+ * included. an insert fix either recolors (and moves up) or ends with a single or a double
+ * rotation. the delete fix cases are: B - a red sibling (rotate towards the node), C - a black
+ * sibling with black kids (recolor and move up), D - a black sibling whose far kid is black
+ * (rotate the sibling), E - a black sibling whose far kid is red (rotate, done).
+ * the shape and the memory are measured on every call: height and averageDepth count the root as
+ * depth 1, and totalNodeBytes is the memory of the nodes the tree allocated (0 for intrusive
+ * trees, whole slabs for pooled ones).
+ */
+typedef struct RBTreeStats
+{
+	int counted;
+	long unsigned comparisons;
+	long unsigned lookups;
+	long unsigned inserts;
+	long unsigned deletes;
+	long unsigned rotations;
+	long unsigned insertRecolors;
+	long unsigned insertSingleRotations;
+	long unsigned insertDoubleRotations;
+	long unsigned deleteCaseB;
+	long unsigned deleteCaseC;
+	long unsigned deleteCaseD;
+	long unsigned deleteCaseE;
+	long unsigned nodeAllocations;
+	long unsigned nodeReleases;
+	long unsigned size;
+	int height;
+	double averageDepth;
+	long unsigned nodeBytes;
+	long unsigned totalNodeBytes;
+} RBTreeStats;
+
+/**
+ * get the statistics of a tree, in O(n) for its shape. the counters may be read while other
+ * threads use the tree (they are then a recent sum). the shape walks the links of the tree, so no
+ * thread may write to it meanwhile: the statistics of a ConcurrentRBTree are read with
+ * concurrentRBTreeGetStats.
+ * @param tree: the tree.
+ * @param stats: filled with the statistics.
+ * @return: 0 on failure, other on success.
+ */
+int RBTreeGetStats(const RBTree *tree, RBTreeStats *stats);
+
+/**
+ * reset the counters of a tree to zero (see RBTreeGetStats).
+ * @param tree: the tree. no other thread may use it meanwhile.
+ */
+void RBTreeResetStats(RBTree *tree);
+
+/**
+ * join t1, a pivot and t2 into t1, in O(log n) by black height. all the items of t1 must be
+ * smaller than the pivot, and the pivot smaller than all the items of t2. the nodes of t2 move to
+ * t1, so both trees must be alike (the same compFunc, both plain or both intrusive with the same
+ * hook, order statistics and the same augmentation on both or neither) and neither pooled nor
+ * with snapshots.
+ * @param t1: the tree of the smaller items, and of the result.
+ * @param pivot: the item between the trees (NULL to just concatenate them).
+ * @param t2: the tree of the greater items. it is left empty (and still has to be freed).
+ * @return: 0 on failure (the trees are left as they were), other on success.
+ */
+int RBTreeJoin(RBTree *t1, void *pivot, RBTree *t2);
+
+/**
+ * split a tree into two new trees: the items smaller than key, and the rest. O(log n) with order
+ * statistics (see RBTreeEnableOrderStatistics); without them, the sizes of the new trees are
+ * counted on the smaller one of them, in O(log n + min(|lo|, |hi|)). not supported for pooled
+ * trees or trees with snapshots.
+ * @param tree: the tree to split. it is left empty (and still has to be freed).
+ * @param key: the item to split around. a stored item equal to it goes to hi.
+ * @param lo: out: a new tree of the items smaller than key (NULL on failure).
+ * @param hi: out: a new tree of the items that are not smaller than key (NULL on failure).
+ * @return: 0 on failure (the tree is left as it was), other on success.
+ */
+int RBTreeSplit(RBTree *tree, const void *key, RBTree **lo, RBTree **hi);
+
+/**
+ * move all the items of t2 into t1, by splits and joins: O(m log(n / m + 1)) for sizes m <= n.
+ * an item of t2 that t1 already has is freed. the trees must be alike (see RBTreeJoin).
+ * @param t1: the tree to add the items to.
+ * @param t2: the tree to take the items from. it is left empty (and still has to be freed).
+ * @return: 0 on failure (the trees are left as they were), other on success.
+ */
+int RBTreeUnion(RBTree *t1, RBTree *t2);
+
+/**
+ * keep in t1 only the items that t2 has too, in O(m log(n / m + 1)) for sizes m <= n. the items
+ * dropped from t1 and all the items of t2 are freed. the trees must be alike (see RBTreeJoin).
+ * @param t1: the tree to keep the items in.
+ * @param t2: the tree of the items to keep. it is left empty (and still has to be freed).
+ * @return: 0 on failure (the trees are left as they were), other on success.
+ */
+int RBTreeIntersection(RBTree *t1, RBTree *t2);
+
+/**
+ * remove from t1 the items that t2 has, in O(m log(n / m + 1)) for sizes m <= n. the removed
+ * items and all the items of t2 are freed. the trees must be alike (see RBTreeJoin).
+ * @param t1: the tree to remove the items from.
+ * @param t2: the tree of the items to remove. it is left empty (and still has to be freed).
+ * @return: 0 on failure (the trees are left as they were), other on success.
+ */
+int RBTreeDifference(RBTree *t1, RBTree *t2);
+
+/**
+ * free a node that was removed from the tree, together with its item (see RetireFunc).
+ * @param tree: the tree the node was removed from.
+ * @param node: the node.
+ */
+void freeRBTreeNode(RBTree *tree, Node *node);
+
 /**
  * free all memory of the data structure.
- * @param tree: pointer to the tree to free.
+ * @param tree: pointer to the tree to free (may point to NULL). it is set to NULL.
  */
 void freeRBTree(RBTree **tree); // implement it in RBTree.c
 
@@ -5,17 +5,96 @@
 #ifndef EX3_RBUTILITIES_H
 #define EX3_RBUTILITIES_H
 
+#include <stdio.h>
 #include "RBTree.h"
 
 #define BASE_PATH "./"
 #define PYTHON "python3"
 #define JSON_FILE "tree.json"
 
+// the size of the buffer the JSON of a tree is written through
+#define JSON_BUFFER_SIZE 8192
+
+// the room for the text of one item in the JSON of a tree
+#define JSON_ITEM_SIZE 256
+
+/**
+ * a function to print an item, snprintf style.
+ * @item: a pointer to an item of the tree.
+ * @buffer: where to write the text of the item.
+ * @size: the size of buffer, counting the terminating null character.
+ * @return: the length of the text (the text is cut if it is size or longer).
+ */
+typedef size_t (*ToStringFunc)(const void *item, char *buffer, size_t size);
+
+/**
+ * the invariant a tree breaks (see RBTreeValidate).
+ */
+typedef enum RBViolation
+{
+	RB_VALID,          // no invariant is broken
+	RB_RED_ROOT,       // the root is red
+	RB_BROKEN_PARENT,  // a node is not the parent of its kid, or the root has a parent
+	RB_SHARED_KID,     // a node has the same node as both kids
+	RB_RED_RED,        // a red node has a red kid
+	RB_BLACK_HEIGHT,   // two paths from the root down to NULL have different numbers of black nodes
+	RB_ORDER,          // an item is ordered before the item before it (or equal to it, in a set)
+	RB_SIZE,           // the tree has another number of nodes than its size
+	RB_ENDS,           // the cached smallest or largest node is not the first or last one
+	RB_SUBTREE_SIZE,   // a subtree size (order statistics) is not its kids' sizes plus one
+	RB_SUMMARY,        // a summary (augmented trees) is not the one augment makes of its kids'
+	RB_COPY_COUNT,     // an item of a counted multiset has no copies
+	RB_NO_MEMORY       // there was no memory to recompute the summaries of an augmented tree
+} RBViolation;
+
+/**
+ * the result of validating a tree: the first broken invariant found, and where.
+ * @violation: RB_VALID if the tree is valid.
+ * @node: the node the violation was found at (NULL for RB_VALID, and for an RB_SIZE or RB_ENDS of
+ * the whole tree).
+ * @nodes: the number of nodes checked.
+ */
+typedef struct RBValidation
+{
+	RBViolation violation;
+	const Node *node;
+	long unsigned nodes;
+} RBValidation;
+
+/**
+ * check every invariant of a tree in a single iterative pass: the colors, the black heights, the
+ * order, the size, the cached ends, the parent pointers, and the extras the nodes keep (subtree
+ * sizes, summaries and copy counts). O(n), no recursion, and O(1) memory: the walk goes down the
+ * kid links with a fixed path of 2 log(n + 1) nodes at most, the height of any valid tree, so it
+ * is fit for huge trees and small thread stacks, and a corrupt or degenerate tree is reported, not
+ * looped on. the parent pointers of a tree with snapshots belong to the live tree (its nodes are
+ * shared), so they are not checked.
+ * @param tree: the tree.
+ * @param result: set to the first violation found (may be NULL). a NULL tree is an RB_SIZE.
+ * @return: 1 if the tree is valid, 0 if not.
+ */
+int RBTreeValidate(const RBTree *tree, RBValidation *result);
+
+/**
+ * @return: a description of a violation.
+ */
+const char *RBViolationText(RBViolation violation);
+
 // tree correctness validation
 int isValidRBTree(RBTree *tree);
 
 // tree visualizations
-int viewTree(RBTree *tree, char* (*toString)(void*));
+int viewTree(RBTree *tree, ToStringFunc toString);
+
+/**
+ * write the tree as JSON (the format of the visualizer) in a single pass through a fixed
+ * size buffer, without allocating per node. not supported for frozen trees.
+ * @return: 0 on failure, other on success.
+ */
+int RBTreeWriteJSON(RBTree *tree, FILE *file, ToStringFunc toString);
+
+// write the tree as JSON to a file
+int RBTreeToJSON(RBTree *tree, char *filename, ToStringFunc toString);
 
 // tree print to console
 void printRBTree(Node *tree);
@@ -2,104 +2,283 @@
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
+#include <limits.h>
 
 #include "RBUtilities.h"
 
+// a red black tree of n nodes is at most 2 log(n + 1) deep, and n fits in a long unsigned
+#define MAX_VALID_HEIGHT (2 * CHAR_BIT * (int)sizeof(long unsigned))
+
 /**
- * return a single (always left) path number of blacks.
+ * record a violation found at a node. returns 0, for the validator to return.
  */
-int getPathBlacksNum(Node *node, int blacks)
+int failValidation(RBValidation *result, RBViolation violation, const Node *node)
 {
-	if (node == NULL)
+	result->violation = violation;
+	result->node = node;
+	return 0;
+}
+
+/**
+ * check the extras of a node against its kids' ones: the subtree size of a tree with order
+ * statistics, the summary of an augmented tree (recomputed into summary, which starts as a copy of
+ * the node's one, so padding compares equal) and the copy count of a counted multiset.
+ */
+RBViolation extrasViolation(const RBTree *tree, const Node *node, void *summary)
+{
+	if (tree->orderStatistics &&
+		RBTreeSubtreeSize(tree, node) != 1 + RBTreeSubtreeSize(tree, node->left) +
+										 RBTreeSubtreeSize(tree, node->right))
 	{
-		return blacks + 1;
+		return RB_SUBTREE_SIZE;
 	}
-
-	if (node->color == BLACK)
+	if (summary != NULL)
+	{
+		const void *kept = RBTreeSummary(tree, node);
+		memcpy(summary, kept, tree->summaryBytes);
+		tree->augment(tree, summary, node->data, RBTreeSummary(tree, node->left),
+					  RBTreeSummary(tree, node->right));
+		if (memcmp(summary, kept, tree->summaryBytes) != 0)
+		{
+			return RB_SUMMARY;
+		}
+	}
+	if (RBTreeCopies(tree, node) == 0)
 	{
-		return getPathBlacksNum(node->left, blacks+1);
+		return RB_COPY_COUNT;
 	}
-	return getPathBlacksNum(node->left, blacks);
+	return RB_VALID;
 }
 
 /**
- * return true if all paths from node to a leaf have (shouldBe - blacks) blacks
+ * check a node as the walk enters it from above: the parent pointers of its kids (unless parents
+ * is 0), their colors, and the extras the node keeps about its subtree.
  */
-int validatePaths(Node *node, int blacks, int shouldBe)
+RBViolation nodeViolation(const RBTree *tree, const Node *node, int parents, void *summary)
 {
-	if (node == NULL)
+	if (node->left != NULL && node->left == node->right)
 	{
-		return blacks + 1 == shouldBe;
+		return RB_SHARED_KID;
 	}
-
-	blacks += (node->color == BLACK) ? 1 : 0;
-	return validatePaths(node->left, blacks, shouldBe) &&
-		   validatePaths(node->right, blacks, shouldBe);
+	if (parents && ((node->left != NULL && rbParent(node->left) != node) ||
+					(node->right != NULL && rbParent(node->right) != node)))
+	{
+		return RB_BROKEN_PARENT;
+	}
+	if (rbColor(node) == RED && ((node->left != NULL && rbColor(node->left) == RED) ||
+								 (node->right != NULL && rbColor(node->right) == RED)))
+	{
+		return RB_RED_RED;
+	}
+	return extrasViolation(tree, node, summary);
 }
 
 /**
- * return true if all nodes follow the color code requirements for RB tree
+ * return true if a path down to NULL with the given number of blacks has the black height of the
+ * tree. the first path sets it (blackHeight is -1 until then).
  */
-int validateColors(Node *node)
+int sameBlackHeight(int blacks, int *blackHeight)
 {
-	if (node == NULL)
+	if (*blackHeight < 0)
 	{
-		return 1;
+		*blackHeight = blacks;
 	}
-	if (node->color == RED && node->parent && node->parent->color == RED)
+	return blacks == *blackHeight;
+}
+
+/**
+ * return true if node may follow previous in order: after it, or next to it in a multiset.
+ */
+int inOrder(const RBTree *tree, const Node *previous, const Node *node)
+{
+	if (previous == NULL)
 	{
-		return 0;
+		return 1;
 	}
-	return validateColors(node->left) && validateColors(node->right);
+	int comp = tree->compFunc(previous->data, node->data);
+	return comp < 0 || (comp == 0 && tree->multiset);
 }
 
-int validateBST(RBTree *tree, Node *node)
+/**
+ * the in order walk of RBTreeValidate, down the kid links. path holds the nodes whose right
+ * subtree is yet to be walked, with the number of blacks from the root down to each.
+ */
+int validateSubtrees(const RBTree *tree, int parents, long unsigned linked, void *summary,
+					 RBValidation *result)
 {
-	if (node == NULL)
+	const Node *path[MAX_VALID_HEIGHT];
+	int pathBlacks[MAX_VALID_HEIGHT];
+	int depth = 0;
+	const Node *node = tree->root;
+	const Node *previous = NULL;
+	int blacks = 0;
+	int blackHeight = -1;
+	while (1)
 	{
-		return 1;
+		if (node != NULL)
+		{
+			// a corrupt tree cannot make the walk longer than the tree's size
+			if (++result->nodes > linked)
+			{
+				return failValidation(result, RB_SIZE, node);
+			}
+			// no path of a balanced tree is that long
+			if (depth == MAX_VALID_HEIGHT)
+			{
+				return failValidation(result, RB_BLACK_HEIGHT, node);
+			}
+			RBViolation violation = nodeViolation(tree, node, parents, summary);
+			if (violation != RB_VALID)
+			{
+				return failValidation(result, violation, node);
+			}
+			blacks += (rbColor(node) == BLACK) ? 1 : 0;
+			path[depth] = node;
+			pathBlacks[depth] = blacks;
+			depth++;
+			node = node->left;
+			continue;
+		}
+		// a path down to NULL ends here
+		if (!sameBlackHeight(blacks, &blackHeight))
+		{
+			return failValidation(result, RB_BLACK_HEIGHT, (depth > 0) ? path[depth - 1] : NULL);
+		}
+		if (depth == 0)
+		{
+			break;
+		}
+		// the left subtree of the deepest node on the path is done, the node is next in order
+		depth--;
+		node = path[depth];
+		blacks = pathBlacks[depth];
+		if (!inOrder(tree, previous, node))
+		{
+			return failValidation(result, RB_ORDER, node);
+		}
+		if (previous == NULL && tree->leftmost != node)
+		{
+			return failValidation(result, RB_ENDS, node);
+		}
+		previous = node;
+		node = node->right;
 	}
-	if (node->left != NULL && 0 < tree->compFunc(node->left->data, node->data))
+
+	if (result->nodes != linked)
 	{
-		return 0;
+		return failValidation(result, RB_SIZE, NULL);
 	}
-	if (node->right != NULL && 0 < tree->compFunc(node->data, node->right->data))
+	if (tree->rightmost != previous || (previous == NULL && tree->leftmost != NULL))
 	{
-		return 0;
+		return failValidation(result, RB_ENDS, previous);
 	}
-	return validateBST(tree, node->left) && validateBST(tree, node->right);
+	return 1;
 }
 
-int validatePointers(Node *node)
+/**
+ * validate a frozen tree: its slots are always balanced, so only the order and the size are left.
+ */
+int validateFrozen(const RBTree *tree, RBValidation *result)
 {
-	if (node == NULL)
+	const Node *previous = NULL;
+	for (Node *node = RBTreeBegin(tree); node != RBTreeEnd(tree); node = RBTreeNext(tree, node))
 	{
-		return 1;
-	}
-	if (node->left != NULL)
-	{
-		if (node->left->parent != node)
+		if (++result->nodes > tree->size)
+		{
+			return failValidation(result, RB_SIZE, node);
+		}
+		if (!inOrder(tree, previous, node))
 		{
-			return 0;
+			return failValidation(result, RB_ORDER, node);
 		}
+		previous = node;
+	}
+	if (result->nodes != tree->size)
+	{
+		return failValidation(result, RB_SIZE, NULL);
+	}
+	return 1;
+}
+
+int RBTreeValidate(const RBTree *tree, RBValidation *result)
+{
+	RBValidation ignored;
+	if (result == NULL)
+	{
+		result = &ignored;
 	}
-	if (node->right != NULL)
+	result->violation = RB_VALID;
+	result->node = NULL;
+	result->nodes = 0;
+	if (tree == NULL)
 	{
-		if (node->right->parent != node)
+		return failValidation(result, RB_SIZE, NULL);
+	}
+	if (tree->frozen != NULL)
+	{
+		return validateFrozen(tree, result);
+	}
+
+	// the nodes of a tree with snapshots are shared, and their parent pointers belong to the live
+	// tree only: the walk goes down the kid links, so it never needs them
+	int parents = (tree->versions == NULL);
+	// the tombstones of lazy deletion are still linked into the tree
+	long unsigned linked = tree->size + tree->tombstoneCount;
+	const Node *root = tree->root;
+	if (parents && root != NULL && rbParent(root) != NULL)
+	{
+		return failValidation(result, RB_BROKEN_PARENT, root);
+	}
+	if (root != NULL && rbColor(root) != BLACK)
+	{
+		return failValidation(result, RB_RED_ROOT, root);
+	}
+	void *summary = NULL;
+	if (tree->augment != NULL)
+	{
+		summary = malloc(tree->summaryBytes);
+		if (summary == NULL)
 		{
-			return 0;
+			return failValidation(result, RB_NO_MEMORY, NULL);
 		}
 	}
-	return validatePointers(node->left) && validatePointers(node->right);
+	int valid = validateSubtrees(tree, parents, linked, summary, result);
+	free(summary);
+	return valid;
 }
 
-int treeSize(Node *node, int sum)
+const char *RBViolationText(RBViolation violation)
 {
-	if (node == NULL)
+	switch (violation)
 	{
-		return sum;
+		case RB_VALID:
+			return "The tree is valid.";
+		case RB_RED_ROOT:
+			return "Root must be black.";
+		case RB_BROKEN_PARENT:
+			return "Double pointers aren't matching.";
+		case RB_SHARED_KID:
+			return "A node has the same node as both kids.";
+		case RB_RED_RED:
+			return "All nodes must be BLACK or RED, and no consecutive RED nodes allowed.";
+		case RB_BLACK_HEIGHT:
+			return "Not all paths between the root and leafs have the same number of blacks.";
+		case RB_ORDER:
+			return "BST invariant isn't preserved.";
+		case RB_SIZE:
+			return "Calculated tree size and tree.size property are different.";
+		case RB_ENDS:
+			return "The cached smallest or largest node is not the first or last one.";
+		case RB_SUBTREE_SIZE:
+			return "A subtree size is not the sum of its kids' sizes plus one.";
+		case RB_SUMMARY:
+			return "A summary is not the one its item and its kids' summaries make.";
+		case RB_COPY_COUNT:
+			return "An item of a counted multiset has no copies.";
+		case RB_NO_MEMORY:
+			return "There was no memory to check the summaries.";
 	}
-	return treeSize(node->left, sum) + treeSize(node->right, sum) + 1;
+	return "Unknown violation.";
 }
 
 /**
@@ -107,43 +286,11 @@ int treeSize(Node *node, int sum)
  */
 int isValidRBTree(RBTree *tree)
 {
-	Node *root = tree->root;
-
-	if (root != NULL)
+	RBValidation result;
+	if (!RBTreeValidate(tree, &result))
 	{
-		if (root->color != BLACK)
-		{
-			printf("Root must be black\n");
-			return 0;
-		}
-
-		int pathBlacks = getPathBlacksNum(root, 0);
-		if (!validatePaths(root, 0, pathBlacks))
-		{
-			fprintf(stderr, "Not all paths between the root and leafs have the same number of blacks (should be %d)\n", pathBlacks);
-			return 0;
-		}
-		if (!validateColors(root))
-		{
-			fprintf(stderr, "All nodes must be BLACK or RED, and no consecutive RED nodes allowed.\n");
-			return 0;
-		}
-		if (!validateBST(tree, root))
-		{
-			fprintf(stderr, "BST invariant isn't preserved.\n");
-			return 0;
-		}
-		if (!validatePointers(tree->root))
-		{
-			fprintf(stderr, "Double pointers aren't matching\n");
-			return 0;
-		}
-		if (treeSize(tree->root, 0) != (int)tree->size)
-		{
-			fprintf(stderr, "%d - %d \n", treeSize(tree->root, 0), (int)tree->size);
-			fprintf(stderr, "Calculated tree size and tree.size property are different.\n");
-			return 0;
-		}
+		fprintf(stderr, "%s\n", RBViolationText(result.violation));
+		return 0;
 	}
 	return 1;
 }
@@ -161,7 +308,7 @@ int _print_t(Node *tree, int isLeftBranch, int offset, int depth, char printBuff
 		return 0;
 	}
 
-	char color = (tree->color == RED) ? 'r' : 'b';
+	char color = (rbColor(tree) == RED) ? 'r' : 'b';
 	sprintf(nodeBuffer, "(%03d %c)", *(int*)(tree->data), color);
 
 	int left  = _print_t(tree->left, 1, offset,depth + 1, printBuffer);
@@ -212,60 +359,150 @@ void printRBTree(Node *tree)
 // ------------------------------------
 
 
-void nodeToJSON(Node *node, char *buffer, char* (*toString)(void*))
+/**
+ * the JSON of a tree is written through a fixed size buffer, so writing it costs a single pass
+ * and no allocation, whatever the size of the tree.
+ */
+typedef struct JSONStream
+{
+	FILE *file;
+	size_t used;
+	int failed;
+	char buffer[JSON_BUFFER_SIZE];
+	char item[JSON_ITEM_SIZE];
+} JSONStream;
+
+/**
+ * write the buffered text to the file.
+ */
+void jsonFlush(JSONStream *stream)
+{
+	if (stream->used > 0 && fwrite(stream->buffer, 1, stream->used, stream->file) != stream->used)
+	{
+		stream->failed = 1;
+	}
+	stream->used = 0;
+}
+
+/**
+ * add text to the stream.
+ */
+void jsonWrite(JSONStream *stream, const char *text, size_t length)
+{
+	while (length > 0)
+	{
+		if (stream->used == JSON_BUFFER_SIZE)
+		{
+			jsonFlush(stream);
+		}
+		size_t chunk = JSON_BUFFER_SIZE - stream->used;
+		chunk = (length < chunk) ? length : chunk;
+		memcpy(stream->buffer + stream->used, text, chunk);
+		stream->used += chunk;
+		text += chunk;
+		length -= chunk;
+	}
+}
+
+/**
+ * add the text of an item to the stream as the body of a JSON string, escaping quotes,
+ * backslashes and control characters.
+ */
+void jsonWriteString(JSONStream *stream, const char *text)
+{
+	for (; *text != '\0'; text++)
+	{
+		unsigned char c = (unsigned char)*text;
+		if (c == '"' || c == '\\')
+		{
+			char escaped[2] = {'\\', (char)c};
+			jsonWrite(stream, escaped, 2);
+		}
+		else if (c < 0x20)
+		{
+			char escaped[8];
+			int length = sprintf(escaped, "\\u%04x", c);
+			jsonWrite(stream, escaped, (size_t)length);
+		}
+		else
+		{
+			jsonWrite(stream, text, 1);
+		}
+	}
+}
+
+#define jsonLiteral(stream, text) jsonWrite((stream), (text), sizeof(text) - 1)
+
+void nodeToJSON(Node *node, JSONStream *stream, ToStringFunc toString)
 {
 	if (node == NULL)
 	{
-		strcat(buffer, "null");
+		jsonLiteral(stream, "null");
 		return;
 	}
 
-	char *tmp = (char*)calloc(255, sizeof(char));
-	char color = (node->color == RED) ? 'r' : 'b';
-	char *data = toString(node->data);
-	sprintf(tmp, "{\n\"data\": \"%s\",\n\"color\": \"%c\",\n", data, color);
-	strcat(buffer, tmp);
-	free(data);
-	free(tmp);
-
-	strcat(buffer, "\"left\": ");
-	nodeToJSON(node->left, buffer, toString);
-	strcat(buffer, ",\n\"right\": ");
-	nodeToJSON(node->right, buffer, toString);
-	strcat(buffer, "}");
+	// an item longer than JSON_ITEM_SIZE - 1 characters is cut
+	stream->item[0] = '\0';
+	toString(node->data, stream->item, JSON_ITEM_SIZE);
+	stream->item[JSON_ITEM_SIZE - 1] = '\0';
+	jsonLiteral(stream, "{\n\"data\": \"");
+	jsonWriteString(stream, stream->item);
+	jsonLiteral(stream, "\",\n\"color\": \"");
+	jsonWrite(stream, (rbColor(node) == RED) ? "r" : "b", 1);
+	jsonLiteral(stream, "\",\n");
+
+	jsonLiteral(stream, "\"left\": ");
+	nodeToJSON(node->left, stream, toString);
+	jsonLiteral(stream, ",\n\"right\": ");
+	nodeToJSON(node->right, stream, toString);
+	jsonLiteral(stream, "}");
 }
 
-int RBTreeToJSON(RBTree *tree, char *filename, char* (*toString)(void*))
+int RBTreeWriteJSON(RBTree *tree, FILE *file, ToStringFunc toString)
 {
-	if (!isValidRBTree(tree))
+	if (tree == NULL || file == NULL || toString == NULL || tree->frozen != NULL)
 	{
-		printf("printing invalid tree - visualizer behaviour might be undefined");
+		return 0;
 	}
 
-	if (tree->root == NULL)
+	JSONStream *stream = (JSONStream*)malloc(sizeof(JSONStream));
+	if (stream == NULL)
 	{
-		printf("tree is empty");
-		return 1;
+		return 0;
 	}
+	stream->file = file;
+	stream->used = 0;
+	stream->failed = 0;
 
-	FILE *json = fopen(filename, "w");
-	assert(json != NULL && "failed file open");
+	nodeToJSON(tree->root, stream, toString);
+	jsonLiteral(stream, "\n");
+	jsonFlush(stream);
 
-	size_t bufferSize = tree->size * (256 * sizeof(char));
-	char *buffer = (char*)calloc(bufferSize, sizeof(char));
-	assert(buffer != NULL && "failed alloc");
+	int result = !stream->failed;
+	free(stream);
+	return result;
+}
 
-	nodeToJSON(tree->root, buffer, toString);
+int RBTreeToJSON(RBTree *tree, char *filename, ToStringFunc toString)
+{
+	if (!isValidRBTree(tree))
+	{
+		fprintf(stderr, "printing invalid tree - visualizer behaviour might be undefined\n");
+	}
 
-	fwrite(buffer, sizeof(char), strlen(buffer), json);
-	fclose(json);
-	return 1;
+	FILE *json = fopen(filename, "w");
+	if (json == NULL)
+	{
+		return 0;
+	}
+	int result = RBTreeWriteJSON(tree, json, toString);
+	return (fclose(json) == 0) && result;
 }
 
-int viewTree(RBTree *tree, char* (*toString)(void*))
+int viewTree(RBTree *tree, ToStringFunc toString)
 {
 	if (!RBTreeToJSON(tree, JSON_FILE, toString))
 		return 0;
 	system(PYTHON " " BASE_PATH"utilities/visualizer.py " JSON_FILE);
 	return 1;
-}
\ No newline at end of file
+}
@@ -6,11 +6,47 @@
 
 // ------------------------------ includes ------------------------------
 #include "Structs.h"
+#include "ParallelRBTree.h"
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define VECTOR_KERNELS_X86
+#elif defined(__GNUC__) && defined(__aarch64__)
+#include <arm_neon.h>
+#define VECTOR_KERNELS_NEON
+#endif
 // -------------------------- const definitions -------------------------
 
+// the number of slots of a new StringTable (a power of 2)
+#define STRING_TABLE_INITIAL_CAPACITY 16
+
+// the FNV-1a offset basis and prime
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/**
+ * a hash table of interned keys, with linear probing. the slots are a power of 2, at most half
+ * full.
+ */
+struct StringTable
+{
+    StringKey **slots;
+    size_t capacity;
+    size_t count;
+};
+
+/**
+ * the vector with the largest norm that keepIfNormIsLarger has seen, and the square of its norm,
+ * so that the norm of every vector is calculated once. best is NULL before the first vector.
+ */
+typedef struct NormMax
+{
+    const Vector *best;
+    double squaredNorm;
+} NormMax;
+
 //CompFunc for strings (assumes strings end with "\0")
 int stringCompare(const void *a, const void *b);
 
@@ -20,6 +56,42 @@ int concatenate(const void *word, void *pConcatenated);
 // FreeFunc for strings
 void freeString(void *s);
 
+// ForEach function that appends the given word and \n at the end a StringJoin keeps
+int joinString(const void *word, void *pJoin);
+
+// allocates a string key with a copy of a string
+StringKey *newStringKey(const char *s);
+
+// CompFunc for string keys
+int stringKeyCompare(const void *a, const void *b);
+
+// checks whether two string keys are equal
+int stringKeyEquals(const StringKey *a, const StringKey *b);
+
+// FreeFunc for string keys
+void freeStringKey(void *key);
+
+// allocates a string key of len chars, with its hash and prefix, not in a table
+StringKey *makeStringKey(const char *s, size_t len, uint64_t hash);
+
+// the FNV-1a hash of a string
+uint64_t hashString(const char *s, size_t len);
+
+// allocates an empty table of string keys
+StringTable *newStringTable(void);
+
+// the key of a string in a table
+StringKey *internString(StringTable *table, const char *s);
+
+// doubles the slots of a table
+int growStringTable(StringTable *table);
+
+// removes a key from its table
+void removeStringKey(StringTable *table, const StringKey *key);
+
+// frees a table, leaving its keys to their holders
+void freeStringTable(StringTable **table);
+
 // CompFunc for Vectors, compares element by element, the vector that has the first larger
 int vectorCompare1By1(const void *a, const void *b);
 
@@ -29,15 +101,84 @@ void freeVector(void *pVector);
 // copy pVector to pMaxVector
 int copyIfNormIsLarger(const void *pVector, void *pMaxVector);
 
+// keeps pVector in a NormMax if its norm is larger
+int keepIfNormIsLarger(const void *pVector, void *pMax);
+
+// keeps the vector of a NormMax in another if its norm is larger
+int keepLargerOfBest(const void *pMax, void *pMaxOfMax);
+
+// allocates a vector of zeros
+Vector *newVector(int len);
+
+// sets an element of a vector
+void vectorSet(Vector *vector, int i, double value);
+
+// the square of the norm of a vector
+double vectorSquaredNorm(const void *pVector);
+
+// allocates a normed vector of zeros
+NormedVector *newNormedVector(int len);
+
+// sets an element of a normed vector
+void normedVectorSet(NormedVector *vector, int i, double value);
+
+// forgets the cached norm of a normed vector
+void normedVectorForgetNorm(NormedVector *vector);
+
+// the square of the norm of a normed vector, cached in it
+double normedVectorSquaredNorm(const void *pVector);
+
 // This function allocates memory it does not free.
 Vector *findMaxNormVectorInTree(RBTree *tree);
 
+// finds the vector with the largest norm from several threads
+Vector *parallelFindMaxNormVectorInTree(RBTree *tree, int nthreads);
+
 // calculates the norm of the vector
 double normCalculator(Vector* vector);
 
 // finds the minimum
 int min(int num1, int num2);
 
+// finds the first index where two arrays of doubles differ, one element at a time
+int firstMismatchScalar(const double *a, const double *b, int n);
+
+// calculates the sum of the squares of an array of doubles, one element at a time
+double squaredNormScalar(const double *x, int n);
+
+#if defined(VECTOR_KERNELS_X86)
+// finds the first index where two arrays of doubles differ, 2 elements at a time
+int firstMismatchSSE2(const double *a, const double *b, int n);
+
+// calculates the sum of the squares of an array of doubles, 2 elements at a time
+double squaredNormSSE2(const double *x, int n);
+
+// finds the first index where two arrays of doubles differ, 8 elements at a time
+int firstMismatchAVX2(const double *a, const double *b, int n);
+
+// calculates the sum of the squares of an array of doubles, 16 elements at a time
+double squaredNormAVX2(const double *x, int n);
+
+// picks the kernels by the features of the CPU
+void selectVectorKernels(void);
+#elif defined(VECTOR_KERNELS_NEON)
+// finds the first index where two arrays of doubles differ, 4 elements at a time
+int firstMismatchNEON(const double *a, const double *b, int n);
+
+// calculates the sum of the squares of an array of doubles, 8 elements at a time
+double squaredNormNEON(const double *x, int n);
+#endif
+
+// the kernels that vectorCompare1By1 and normCalculator use. on x86 they are picked before main
+// by the features of the CPU; the scalar ones are used until then and on other compilers
+#if defined(VECTOR_KERNELS_NEON)
+static int (*firstMismatch)(const double *, const double *, int) = firstMismatchNEON;
+static double (*squaredNorm)(const double *, int) = squaredNormNEON;
+#else
+static int (*firstMismatch)(const double *, const double *, int) = firstMismatchScalar;
+static double (*squaredNorm)(const double *, int) = squaredNormScalar;
+#endif
+
 // ------------------------------ functions -----------------------------
 
 /**
@@ -65,10 +206,9 @@ int concatenate(const void *word, void *pConcatenated)
     {
         return 0;
     }
-    char* word2 = (char*)word;
     char* pConc = (char*) pConcatenated;
-    strcat(word2, pConc);
-    strcat(word2, "\n");
+    strcat(pConc, (const char *)word);
+    strcat(pConc, "\n");
     return 1;
 }
 
@@ -81,6 +221,303 @@ void freeString(void *s)
     free(s);
 }
 
+/**
+ * ForEach function that appends the given word and \n to the buffer of a StringJoin, at the end it
+ * keeps. the buffer is already allocated with enough space.
+ * @param word - char* to add
+ * @param pJoin - StringJoin*
+ * @return 0 on failure, other on success
+ */
+int joinString(const void *word, void *pJoin)
+{
+    if(word == NULL || pJoin == NULL)
+    {
+        return 0;
+    }
+    StringJoin *join = (StringJoin *)pJoin;
+    size_t len = strlen((const char *)word);
+    memcpy(join->buffer + join->length, word, len);
+    join->length += len;
+    join->buffer[join->length++] = '\n';
+    join->buffer[join->length] = '\0';
+    return 1;
+}
+
+/**
+ * @brief the FNV-1a hash of a string
+ * @param s the string
+ * @param len its length
+ * @return the hash
+ */
+uint64_t hashString(const char *s, size_t len)
+{
+    uint64_t hash = FNV_OFFSET;
+    for(size_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ (unsigned char)s[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * @brief allocates a string key of len chars, with its hash and prefix, not in a table
+ * @param s the chars
+ * @param len the number of chars
+ * @param hash their hash
+ * @return the new key, NULL on failure
+ */
+StringKey *makeStringKey(const char *s, size_t len, uint64_t hash)
+{
+    StringKey *key = (StringKey *)malloc(sizeof(StringKey) + len + 1);
+    if(key == NULL)
+    {
+        return NULL;
+    }
+    key->len = len;
+    key->hash = hash;
+    key->prefix = rbStringPrefix(s);
+    key->table = NULL;
+    key->refs = 1;
+    memcpy(key->chars, s, len + 1);
+    return key;
+}
+
+/**
+ * @brief allocates a string key with a copy of a string
+ * @param s the string
+ * @return the new key, NULL on failure
+ */
+StringKey *newStringKey(const char *s)
+{
+    if(s == NULL)
+    {
+        return NULL;
+    }
+    size_t len = strlen(s);
+    return makeStringKey(s, len, hashString(s, len));
+}
+
+/**
+ * CompFunc for string keys, in the order of stringCompare
+ * @param a - StringKey* pointer
+ * @param b - StringKey* pointer
+ * @return equal to 0 iff a == b. lower than 0 if a < b. Greater than 0 iff b < a. (lexicographic
+ * order)
+ */
+int stringKeyCompare(const void *a, const void *b)
+{
+    const StringKey *ak = (const StringKey *)a;
+    const StringKey *bk = (const StringKey *)b;
+    if(ak == bk)
+    {
+        return 0;
+    }
+    if(ak->prefix != bk->prefix)
+    {
+        return (ak->prefix < bk->prefix) ? -1 : 1;
+    }
+    size_t shorter = (ak->len < bk->len) ? ak->len : bk->len;
+    if(shorter > RB_STRING_PREFIX_BYTES)
+    {
+        int comp = memcmp(ak->chars + RB_STRING_PREFIX_BYTES, bk->chars + RB_STRING_PREFIX_BYTES,
+                          shorter - RB_STRING_PREFIX_BYTES);
+        if(comp != 0)
+        {
+            return comp;
+        }
+    }
+    return (ak->len > bk->len) - (ak->len < bk->len);
+}
+
+/**
+ * @brief checks whether two string keys are equal. keys of the same table are equal only if they
+ * are the same key
+ * @param a the first key
+ * @param b the second key
+ * @return 1 if they are equal, 0 otherwise
+ */
+int stringKeyEquals(const StringKey *a, const StringKey *b)
+{
+    if(a == b)
+    {
+        return 1;
+    }
+    if(a->len != b->len || a->hash != b->hash || (a->table != NULL && a->table == b->table))
+    {
+        return 0;
+    }
+    return memcmp(a->chars, b->chars, a->len) == 0;
+}
+
+/**
+ * @brief FreeFunc for string keys. an interned key leaves its table with its last holder
+ * @param key the key
+ */
+void freeStringKey(void *key)
+{
+    StringKey *stringKey = (StringKey *)key;
+    if(stringKey == NULL || --stringKey->refs > 0)
+    {
+        return;
+    }
+    if(stringKey->table != NULL)
+    {
+        removeStringKey(stringKey->table, stringKey);
+    }
+    free(stringKey);
+}
+
+/**
+ * @brief allocates an empty table of string keys
+ * @return the new table, NULL on failure
+ */
+StringTable *newStringTable(void)
+{
+    StringTable *table = (StringTable *)malloc(sizeof(StringTable));
+    if(table == NULL)
+    {
+        return NULL;
+    }
+    table->slots = (StringKey **)calloc(STRING_TABLE_INITIAL_CAPACITY, sizeof(StringKey *));
+    if(table->slots == NULL)
+    {
+        free(table);
+        return NULL;
+    }
+    table->capacity = STRING_TABLE_INITIAL_CAPACITY;
+    table->count = 0;
+    return table;
+}
+
+/**
+ * @brief the key of a string in a table: the key already there, with one more holder, or a new
+ * one
+ * @param table the table
+ * @param s the string
+ * @return the key, NULL on failure
+ */
+StringKey *internString(StringTable *table, const char *s)
+{
+    if(table == NULL || s == NULL)
+    {
+        return NULL;
+    }
+    size_t len = strlen(s);
+    uint64_t hash = hashString(s, len);
+    size_t mask = table->capacity - 1;
+    size_t i = hash & mask;
+    for(; table->slots[i] != NULL; i = (i + 1) & mask)
+    {
+        StringKey *key = table->slots[i];
+        if(key->hash == hash && key->len == len && memcmp(key->chars, s, len) == 0)
+        {
+            key->refs++;
+            return key;
+        }
+    }
+    if(2 * (table->count + 1) > table->capacity)
+    {
+        if(growStringTable(table) == 0)
+        {
+            return NULL;
+        }
+        mask = table->capacity - 1;
+        for(i = hash & mask; table->slots[i] != NULL; i = (i + 1) & mask)
+        {
+        }
+    }
+    StringKey *key = makeStringKey(s, len, hash);
+    if(key == NULL)
+    {
+        return NULL;
+    }
+    key->table = table;
+    table->slots[i] = key;
+    table->count++;
+    return key;
+}
+
+/**
+ * @brief doubles the slots of a table, placing its keys again
+ * @param table the table
+ * @return 1 on success, 0 on failure
+ */
+int growStringTable(StringTable *table)
+{
+    size_t capacity = 2 * table->capacity;
+    StringKey **slots = (StringKey **)calloc(capacity, sizeof(StringKey *));
+    if(slots == NULL)
+    {
+        return 0;
+    }
+    for(size_t j = 0; j < table->capacity; j++)
+    {
+        StringKey *key = table->slots[j];
+        if(key != NULL)
+        {
+            size_t i = key->hash & (capacity - 1);
+            for(; slots[i] != NULL; i = (i + 1) & (capacity - 1))
+            {
+            }
+            slots[i] = key;
+        }
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+    return 1;
+}
+
+/**
+ * @brief removes a key from its table. the keys after it in its run are shifted back, so no
+ * probe passes an empty slot before its key
+ * @param table the table
+ * @param key the key
+ */
+void removeStringKey(StringTable *table, const StringKey *key)
+{
+    size_t mask = table->capacity - 1;
+    size_t i = key->hash & mask;
+    while(table->slots[i] != key)
+    {
+        i = (i + 1) & mask;
+    }
+    for(size_t j = (i + 1) & mask; table->slots[j] != NULL; j = (j + 1) & mask)
+    {
+        // a key that is further from its home slot than the gap is may fill it
+        size_t home = table->slots[j]->hash & mask;
+        if(((j - home) & mask) >= ((j - i) & mask))
+        {
+            table->slots[i] = table->slots[j];
+            i = j;
+        }
+    }
+    table->slots[i] = NULL;
+    table->count--;
+}
+
+/**
+ * @brief frees a table. the keys still held leave it, and are freed by their last holder
+ * @param table a pointer to the table, set to NULL
+ */
+void freeStringTable(StringTable **table)
+{
+    if(table == NULL || *table == NULL)
+    {
+        return;
+    }
+    for(size_t i = 0; i < (*table)->capacity; i++)
+    {
+        if((*table)->slots[i] != NULL)
+        {
+            (*table)->slots[i]->table = NULL;
+        }
+    }
+    free((*table)->slots);
+    free(*table);
+    *table = NULL;
+}
+
 /**
  * @brief finds the minium
  * @param num1 the first number
@@ -106,16 +543,11 @@ int vectorCompare1By1(const void *a, const void *b)
     Vector* bv = (Vector*) b;
     int alen = av->len;
     int blen = bv->len;
-    for(int i = 0; i<min(alen, blen); i++)
+    int shorter = min(alen, blen);
+    int i = firstMismatch(av->vector, bv->vector, shorter);
+    if(i < shorter)
     {
-        if(av->vector[i] < bv->vector[i])
-        {
-            return -1;
-        }
-        else if(av->vector[i] > bv->vector[i])
-        {
-            return 1;
-        }
+        return (av->vector[i] < bv->vector[i]) ? -1 : 1;
     }
     if(alen == blen)
     {
@@ -131,6 +563,229 @@ int vectorCompare1By1(const void *a, const void *b)
     }
 }
 
+/**
+ * @brief finds the first index where two arrays of doubles differ, one element at a time. elements
+ * that are neither smaller nor larger than each other (equal, or NaN) do not differ
+ * @param a the first array
+ * @param b the second array
+ * @param n the number of elements to compare
+ * @return the first index where the arrays differ, n if there is none
+ */
+int firstMismatchScalar(const double *a, const double *b, int n)
+{
+    for(int i = 0; i < n; i++)
+    {
+        if(a[i] < b[i] || a[i] > b[i])
+        {
+            return i;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief calculates the sum of the squares of an array of doubles, one element at a time
+ * @param x the array
+ * @param n the number of elements
+ * @return the sum of the squares
+ */
+double squaredNormScalar(const double *x, int n)
+{
+    double sum = 0;
+    for(int i = 0; i < n; i++)
+    {
+        sum += x[i] * x[i];
+    }
+    return sum;
+}
+
+#if defined(VECTOR_KERNELS_X86)
+/**
+ * @brief finds the first index where two arrays of doubles differ, 2 elements at a time (see
+ * firstMismatchScalar)
+ * @param a the first array
+ * @param b the second array
+ * @param n the number of elements to compare
+ * @return the first index where the arrays differ, n if there is none
+ */
+__attribute__((target("sse2")))
+int firstMismatchSSE2(const double *a, const double *b, int n)
+{
+    int i = 0;
+    for(; i + 4 <= n; i += 4)
+    {
+        __m128d a0 = _mm_loadu_pd(a + i), b0 = _mm_loadu_pd(b + i);
+        __m128d a1 = _mm_loadu_pd(a + i + 2), b1 = _mm_loadu_pd(b + i + 2);
+        // < or >, so that NaNs do not differ, as in the scalar kernel
+        int mask = _mm_movemask_pd(_mm_or_pd(_mm_cmplt_pd(a0, b0), _mm_cmpgt_pd(a0, b0))) |
+                   (_mm_movemask_pd(_mm_or_pd(_mm_cmplt_pd(a1, b1), _mm_cmpgt_pd(a1, b1))) << 2);
+        if(mask != 0)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + firstMismatchScalar(a + i, b + i, n - i);
+}
+
+/**
+ * @brief calculates the sum of the squares of an array of doubles, 2 elements at a time
+ * @param x the array
+ * @param n the number of elements
+ * @return the sum of the squares
+ */
+__attribute__((target("sse2")))
+double squaredNormSSE2(const double *x, int n)
+{
+    __m128d sum0 = _mm_setzero_pd(), sum1 = _mm_setzero_pd();
+    int i = 0;
+    for(; i + 4 <= n; i += 4)
+    {
+        __m128d x0 = _mm_loadu_pd(x + i), x1 = _mm_loadu_pd(x + i + 2);
+        sum0 = _mm_add_pd(sum0, _mm_mul_pd(x0, x0));
+        sum1 = _mm_add_pd(sum1, _mm_mul_pd(x1, x1));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(sum0, sum1));
+    return lanes[0] + lanes[1] + squaredNormScalar(x + i, n - i);
+}
+
+/**
+ * @brief finds the first index where two arrays of doubles differ, 8 elements at a time (see
+ * firstMismatchScalar)
+ * @param a the first array
+ * @param b the second array
+ * @param n the number of elements to compare
+ * @return the first index where the arrays differ, n if there is none
+ */
+__attribute__((target("avx2")))
+int firstMismatchAVX2(const double *a, const double *b, int n)
+{
+    int i = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        __m256d a0 = _mm256_loadu_pd(a + i), b0 = _mm256_loadu_pd(b + i);
+        __m256d a1 = _mm256_loadu_pd(a + i + 4), b1 = _mm256_loadu_pd(b + i + 4);
+        // ordered not-equal, so that NaNs do not differ, as in the scalar kernel
+        int mask = _mm256_movemask_pd(_mm256_cmp_pd(a0, b0, _CMP_NEQ_OQ)) |
+                   (_mm256_movemask_pd(_mm256_cmp_pd(a1, b1, _CMP_NEQ_OQ)) << 4);
+        if(mask != 0)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    // the tail is left to SSE2 code, which is slow to run after AVX code without clearing it
+    _mm256_zeroupper();
+    return i + firstMismatchSSE2(a + i, b + i, n - i);
+}
+
+/**
+ * @brief calculates the sum of the squares of an array of doubles, 16 elements at a time with
+ * fused multiply-adds
+ * @param x the array
+ * @param n the number of elements
+ * @return the sum of the squares
+ */
+__attribute__((target("avx2,fma")))
+double squaredNormAVX2(const double *x, int n)
+{
+    __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+    __m256d sum2 = _mm256_setzero_pd(), sum3 = _mm256_setzero_pd();
+    int i = 0;
+    for(; i + 16 <= n; i += 16)
+    {
+        __m256d x0 = _mm256_loadu_pd(x + i), x1 = _mm256_loadu_pd(x + i + 4);
+        __m256d x2 = _mm256_loadu_pd(x + i + 8), x3 = _mm256_loadu_pd(x + i + 12);
+        sum0 = _mm256_fmadd_pd(x0, x0, sum0);
+        sum1 = _mm256_fmadd_pd(x1, x1, sum1);
+        sum2 = _mm256_fmadd_pd(x2, x2, sum2);
+        sum3 = _mm256_fmadd_pd(x3, x3, sum3);
+    }
+    __m256d sum = _mm256_add_pd(_mm256_add_pd(sum0, sum1), _mm256_add_pd(sum2, sum3));
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+    double lanes[2];
+    _mm_storeu_pd(lanes, half);
+    _mm256_zeroupper();
+    return lanes[0] + lanes[1] + squaredNormSSE2(x + i, n - i);
+}
+
+/**
+ * @brief picks the widest kernels the CPU supports. runs before main, so the kernels never change
+ * while threads use them
+ */
+__attribute__((constructor))
+void selectVectorKernels(void)
+{
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+    {
+        firstMismatch = firstMismatchAVX2;
+    }
+    else if(__builtin_cpu_supports("sse2"))
+    {
+        firstMismatch = firstMismatchSSE2;
+    }
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        squaredNorm = squaredNormAVX2;
+    }
+    else if(__builtin_cpu_supports("sse2"))
+    {
+        squaredNorm = squaredNormSSE2;
+    }
+}
+#elif defined(VECTOR_KERNELS_NEON)
+/**
+ * @brief finds the first index where two arrays of doubles differ, 4 elements at a time (see
+ * firstMismatchScalar)
+ * @param a the first array
+ * @param b the second array
+ * @param n the number of elements to compare
+ * @return the first index where the arrays differ, n if there is none
+ */
+int firstMismatchNEON(const double *a, const double *b, int n)
+{
+    int i = 0;
+    for(; i + 4 <= n; i += 4)
+    {
+        float64x2_t a0 = vld1q_f64(a + i), b0 = vld1q_f64(b + i);
+        float64x2_t a1 = vld1q_f64(a + i + 2), b1 = vld1q_f64(b + i + 2);
+        // < or >, so that NaNs do not differ, as in the scalar kernel
+        uint64x2_t differ0 = vorrq_u64(vcltq_f64(a0, b0), vcgtq_f64(a0, b0));
+        uint64x2_t differ1 = vorrq_u64(vcltq_f64(a1, b1), vcgtq_f64(a1, b1));
+        if(vmaxvq_u32(vreinterpretq_u32_u64(vorrq_u64(differ0, differ1))) != 0)
+        {
+            break;
+        }
+    }
+    return i + firstMismatchScalar(a + i, b + i, n - i);
+}
+
+/**
+ * @brief calculates the sum of the squares of an array of doubles, 8 elements at a time with
+ * fused multiply-adds
+ * @param x the array
+ * @param n the number of elements
+ * @return the sum of the squares
+ */
+double squaredNormNEON(const double *x, int n)
+{
+    float64x2_t sum0 = vdupq_n_f64(0), sum1 = vdupq_n_f64(0);
+    float64x2_t sum2 = vdupq_n_f64(0), sum3 = vdupq_n_f64(0);
+    int i = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        float64x2_t x0 = vld1q_f64(x + i), x1 = vld1q_f64(x + i + 2);
+        float64x2_t x2 = vld1q_f64(x + i + 4), x3 = vld1q_f64(x + i + 6);
+        sum0 = vfmaq_f64(sum0, x0, x0);
+        sum1 = vfmaq_f64(sum1, x1, x1);
+        sum2 = vfmaq_f64(sum2, x2, x2);
+        sum3 = vfmaq_f64(sum3, x3, x3);
+    }
+    float64x2_t sum = vaddq_f64(vaddq_f64(sum0, sum1), vaddq_f64(sum2, sum3));
+    return vaddvq_f64(sum) + squaredNormScalar(x + i, n - i);
+}
+#endif
+
 /**
  * @brief frees a vector
  * @param pVector the vector to free
@@ -154,17 +809,22 @@ void freeVector(void *pVector)
  */
 int copyIfNormIsLarger(const void *pVector, void *pMaxVector)
 {
+    if(pVector == NULL || pMaxVector == NULL)
+    {
+        return 0;
+    }
     Vector * first = (Vector*) pVector;
     Vector * second = (Vector*) pMaxVector;
-    if(second->vector == NULL || normCalculator(first) > normCalculator(second))
+    if(second->vector == NULL || vectorSquaredNorm(first) > vectorSquaredNorm(second))
     {
         if(first->len != second->len)
         {
-            second->vector = realloc(second->vector, (first->len) * sizeof(double));
-            if(second->vector == NULL)
+            double *copy = realloc(second->vector, (first->len) * sizeof(double));
+            if(copy == NULL && first->len > 0)
             {
                 return 0;
             }
+            second->vector = copy;
         }
         for(int i = 0; i < first -> len; i++)
         {
@@ -175,6 +835,159 @@ int copyIfNormIsLarger(const void *pVector, void *pMaxVector)
     return 1;
 }
 
+/**
+ * @brief ForEach function that keeps pVector in a NormMax if it has none yet or the norm of
+ * pVector is larger, without copying
+ * @param pVector pointer to Vector
+ * @param pMax pointer to NormMax
+ * @return 1 on success, 0 on failure
+ */
+int keepIfNormIsLarger(const void *pVector, void *pMax)
+{
+    if(pVector == NULL || pMax == NULL)
+    {
+        return 0;
+    }
+    NormMax *max = (NormMax *)pMax;
+    double norm = vectorSquaredNorm(pVector);
+    if(max->best == NULL || norm > max->squaredNorm)
+    {
+        max->best = (const Vector *)pVector;
+        max->squaredNorm = norm;
+    }
+    return 1;
+}
+
+/**
+ * @brief reduces the maxima of two threads: keeps the vector of a thread's NormMax in the first
+ * thread's if its norm is larger
+ * @param pMax pointer to the NormMax of a thread
+ * @param pMaxOfMax pointer to the NormMax of the first thread
+ * @return 1
+ */
+int keepLargerOfBest(const void *pMax, void *pMaxOfMax)
+{
+    const NormMax *max = (const NormMax *)pMax;
+    NormMax *maxOfMax = (NormMax *)pMaxOfMax;
+    if(max->best != NULL && (maxOfMax->best == NULL || max->squaredNorm > maxOfMax->squaredNorm))
+    {
+        *maxOfMax = *max;
+    }
+    return 1;
+}
+
+/**
+ * @brief allocates a vector of zeros
+ * @param len the number of elements
+ * @return the new vector, NULL on failure
+ */
+Vector *newVector(int len)
+{
+    if(len < 0)
+    {
+        return NULL;
+    }
+    Vector *vector = (Vector *)malloc(sizeof(Vector));
+    if(vector == NULL)
+    {
+        return NULL;
+    }
+    vector->vector = (double *)calloc(len > 0 ? len : 1, sizeof(double));
+    if(vector->vector == NULL)
+    {
+        free(vector);
+        return NULL;
+    }
+    vector->len = len;
+    return vector;
+}
+
+/**
+ * @brief sets an element of a vector
+ * @param vector the vector
+ * @param i the index of the element
+ * @param value the new value
+ */
+void vectorSet(Vector *vector, int i, double value)
+{
+    vector->vector[i] = value;
+}
+
+/**
+ * @brief the square of the norm of a vector
+ * @param pVector pointer to Vector
+ * @return the square of the L2 norm
+ */
+double vectorSquaredNorm(const void *pVector)
+{
+    const Vector *vector = (const Vector *)pVector;
+    return squaredNorm(vector->vector, vector->len);
+}
+
+/**
+ * @brief allocates a normed vector of zeros, whose norm is known to be 0
+ * @param len the number of elements
+ * @return the new vector, NULL on failure
+ */
+NormedVector *newNormedVector(int len)
+{
+    if(len < 0)
+    {
+        return NULL;
+    }
+    NormedVector *vector = (NormedVector *)malloc(sizeof(NormedVector));
+    if(vector == NULL)
+    {
+        return NULL;
+    }
+    vector->vector.vector = (double *)calloc(len > 0 ? len : 1, sizeof(double));
+    if(vector->vector.vector == NULL)
+    {
+        free(vector);
+        return NULL;
+    }
+    vector->vector.len = len;
+    vector->squaredNorm = 0;
+    return vector;
+}
+
+/**
+ * @brief sets an element of a normed vector, forgetting its cached norm
+ * @param vector the vector
+ * @param i the index of the element
+ * @param value the new value
+ */
+void normedVectorSet(NormedVector *vector, int i, double value)
+{
+    vector->vector.vector[i] = value;
+    vector->squaredNorm = VECTOR_NORM_UNKNOWN;
+}
+
+/**
+ * @brief forgets the cached norm of a normed vector
+ * @param vector the vector
+ */
+void normedVectorForgetNorm(NormedVector *vector)
+{
+    vector->squaredNorm = VECTOR_NORM_UNKNOWN;
+}
+
+/**
+ * @brief the square of the norm of a normed vector, calculated on the first call and cached in
+ * it (a vector is logically unchanged by it, so const vectors cache it too)
+ * @param pVector pointer to NormedVector
+ * @return the square of the L2 norm
+ */
+double normedVectorSquaredNorm(const void *pVector)
+{
+    NormedVector *vector = (NormedVector *)pVector;
+    if(vector->squaredNorm == VECTOR_NORM_UNKNOWN)
+    {
+        vector->squaredNorm = vectorSquaredNorm(&vector->vector);
+    }
+    return vector->squaredNorm;
+}
+
 /**
  * @brief calculates the norm of the vector
  * @param vector the vector
@@ -182,29 +995,90 @@ int copyIfNormIsLarger(const void *pVector, void *pMaxVector)
  */
 double normCalculator(Vector* vector)
 {
-    double sum = 0;
-    for(int i = 0; i < vector->len; i++)
-    {
-        sum += pow(vector->vector[i], 2);
-    }
-    return sqrt(sum);
+    return sqrt(vectorSquaredNorm(vector));
 }
 
 /**
- * This function allocates memory it does not free.
+ * This function allocates memory it does not free. the largest vector is tracked by pointer, next
+ * to its norm, and copied once, with copyIfNormIsLarger. a tree that keeps subtree maxima of
+ * vectorSquaredNorm or normedVectorSquaredNorm has it at its root.
  * @param tree a pointer to a tree of Vectors
  * @return pointer to a *copy* of the vector that has the largest norm (L2 Norm), NULL on failure.
  */
 Vector *findMaxNormVectorInTree(RBTree *tree)
 {
+    if(tree == NULL)
+    {
+        return NULL;
+    }
+    NormMax max = {NULL, 0};
+    if(tree->measure == vectorSquaredNorm || tree->measure == normedVectorSquaredNorm)
+    {
+        max.best = (const Vector *)RBTreeMaxByMeasure(tree);
+    }
+    else if(forEachRBTree(tree, keepIfNormIsLarger, &max) == 0)
+    {
+        return NULL;
+    }
     Vector * vector = (Vector *)malloc(sizeof(Vector));
+    if(vector == NULL)
+    {
+        return NULL;
+    }
     vector->len = 0;
     vector->vector = NULL;
-    int treeResult = forEachRBTree(tree, copyIfNormIsLarger, vector);
-    if(treeResult == 0)
+    if(max.best != NULL && copyIfNormIsLarger(max.best, vector) == 0)
     {
+        freeVector(vector);
         return NULL;
     }
     return vector;
 }
 
+
+/**
+ * This function allocates memory it does not free. every thread keeps its own maximum with
+ * keepIfNormIsLarger, the maxima are reduced with keepLargerOfBest, and the largest vector is
+ * copied once at the end.
+ * @param tree a pointer to a tree of Vectors
+ * @param nthreads the number of threads to use
+ * @return pointer to a *copy* of the vector that has the largest norm (L2 Norm), NULL on failure.
+ */
+Vector *parallelFindMaxNormVectorInTree(RBTree *tree, int nthreads)
+{
+    if(nthreads < 1)
+    {
+        return NULL;
+    }
+    NormMax *maxima = (NormMax *)calloc(nthreads, sizeof(NormMax));
+    void **args = (void **)malloc(nthreads * sizeof(void *));
+    Vector *vector = (Vector *)malloc(sizeof(Vector));
+    int result = (maxima != NULL && args != NULL && vector != NULL);
+    for(int i = 0; result && i < nthreads; i++)
+    {
+        args[i] = &maxima[i];
+    }
+    if(result)
+    {
+        result = parallelForEachRBTree(tree, keepIfNormIsLarger, keepLargerOfBest, args,
+                                       nthreads);
+    }
+    if(result)
+    {
+        vector->len = 0;
+        vector->vector = NULL;
+        if(maxima[0].best != NULL && copyIfNormIsLarger(maxima[0].best, vector) == 0)
+        {
+            freeVector(vector);
+            vector = NULL;
+            result = 0;
+        }
+    }
+    else
+    {
+        free(vector);
+    }
+    free(maxima);
+    free(args);
+    return result ? vector : NULL;
+}
@@ -3,12 +3,17 @@
 //
 
 #include "RBTree.h"
+#include <stddef.h>
+#include <stdint.h>
 
 #ifndef TA_EX3_STRUCTS_H
 #define TA_EX3_STRUCTS_H
 
+// the squaredNorm of a NormedVector whose norm is not known
+#define VECTOR_NORM_UNKNOWN (-1.0)
+
 /**
- * Represents a vector. The double* should be dynamically allocated
+ * Represents a vector. The double* should be dynamically allocated.
  */
 typedef struct Vector
 {
@@ -16,6 +21,73 @@ typedef struct Vector
 	double *vector;
 } Vector;
 
+/**
+ * a vector that caches the square of its norm: it is calculated the first time it is needed, and
+ * forgotten when an element is set through normedVectorSet (or normedVectorForgetNorm). the Vector
+ * comes first, so a NormedVector* is a Vector* to all the functions of vectors (and freeVector).
+ * only trees that opt in hold them, measured by normedVectorSquaredNorm.
+ */
+typedef struct NormedVector
+{
+	Vector vector;
+	double squaredNorm;
+} NormedVector;
+
+/**
+ * allocates a vector of zeros.
+ * @param len the number of elements
+ * @return the new vector, NULL on failure
+ */
+Vector *newVector(int len);
+
+/**
+ * sets an element of a vector. the vector must not be in a tree, since its order changes.
+ * @param vector the vector
+ * @param i the index of the element
+ * @param value the new value
+ */
+void vectorSet(Vector *vector, int i, double value);
+
+/**
+ * the square of the norm of a vector, calculated on every call. a MeasureFunc, so
+ * RBTreeEnableSubtreeMax(tree, vectorSquaredNorm) makes a tree of vectors keep its largest norm,
+ * for findMaxNormVectorInTree in O(1) (though the tree recalculates norms as it changes).
+ * @param pVector pointer to Vector
+ * @return the square of the L2 norm
+ */
+double vectorSquaredNorm(const void *pVector);
+
+/**
+ * allocates a normed vector of zeros, with a known norm of 0.
+ * @param len the number of elements
+ * @return the new vector, NULL on failure
+ */
+NormedVector *newNormedVector(int len);
+
+/**
+ * sets an element of a normed vector, forgetting its cached norm. the vector must not be in a
+ * tree, since its order and norm change.
+ * @param vector the vector
+ * @param i the index of the element
+ * @param value the new value
+ */
+void normedVectorSet(NormedVector *vector, int i, double value);
+
+/**
+ * forgets the cached norm of a normed vector, after its elements were written directly.
+ * @param vector the vector
+ */
+void normedVectorForgetNorm(NormedVector *vector);
+
+/**
+ * the square of the norm of a normed vector, calculated on the first call and then cached in it.
+ * a MeasureFunc: RBTreeEnableSubtreeMax(tree, normedVectorSquaredNorm) makes a tree of normed
+ * vectors keep its largest norm without recalculating norms as it changes.
+ * @param pVector pointer to NormedVector
+ * @return the square of the L2 norm
+ */
+double normedVectorSquaredNorm(const void *pVector);
+
 
 /**
  * CompFunc for strings (assumes strings end with "\0")
@@ -28,7 +100,8 @@ int stringCompare(const void *a, const void *b); // implement it in Structs.c
 
 /**
  * ForEach function that concatenates the given word and \n to pConcatenated. pConcatenated is
- * already allocated with enough space.
+ * already allocated with enough space. the end of pConcatenated is found again on every call, so
+ * joining a whole tree is quadratic; joinString keeps the end instead.
  * @param word - char* to add to pConcatenated
  * @param pConcatenated - char*
  * @return 0 on failure, other on success
@@ -40,6 +113,99 @@ int concatenate(const void *word, void *pConcatenated); // implement it in Struc
  */
 void freeString(void *s); // implement it in Structs.c
 
+/**
+ * the state of joinString: the buffer the words are joined into, and the number of chars written
+ * to it so far (start it at 0).
+ */
+typedef struct StringJoin
+{
+	char *buffer;
+	size_t length;
+} StringJoin;
+
+/**
+ * ForEach function that appends the given word and \n to the buffer of a StringJoin, at the end it
+ * keeps, so joining a tree is linear in the total length. the buffer is already allocated with
+ * enough space, and is kept \0 terminated.
+ * @param word - char* to add
+ * @param pJoin - StringJoin*
+ * @return 0 on failure, other on success
+ */
+int joinString(const void *word, void *pJoin);
+
+/**
+ * a table of interned string keys (see internString).
+ */
+typedef struct StringTable StringTable;
+
+/**
+ * a string key: the chars with their length, their hash, and their prefix (see rbStringPrefix),
+ * so that comparing prefixes as numbers orders them like strcmp. keys interned in the
+ * same table are shared by all the holders of equal strings, and counted by refs.
+ */
+typedef struct StringKey
+{
+	size_t len;
+	uint64_t hash;
+	uint64_t prefix;
+	StringTable *table;
+	long unsigned refs;
+	char chars[];
+} StringKey;
+
+/**
+ * allocates a string key with a copy of a string.
+ * @param s the string
+ * @return the new key, NULL on failure
+ */
+StringKey *newStringKey(const char *s);
+
+/**
+ * CompFunc for string keys, in the order of stringCompare. the prefixes are compared first, so
+ * most comparisons don't touch the chars, and a key is equal to itself at once.
+ * @param a - StringKey* pointer
+ * @param b - StringKey* pointer
+ * @return equal to 0 iff a == b. lower than 0 if a < b. Greater than 0 iff b < a. (lexicographic
+ * order)
+ */
+int stringKeyCompare(const void *a, const void *b);
+
+/**
+ * checks whether two string keys are equal, rejecting keys of different lengths or hashes without
+ * reading their chars.
+ * @param a the first key
+ * @param b the second key
+ * @return 1 if they are equal, 0 otherwise
+ */
+int stringKeyEquals(const StringKey *a, const StringKey *b);
+
+/**
+ * FreeFunc for string keys. an interned key is freed (and leaves its table) when its last holder
+ * frees it.
+ */
+void freeStringKey(void *key);
+
+/**
+ * allocates an empty table to intern string keys in.
+ * @return the new table, NULL on failure
+ */
+StringTable *newStringTable(void);
+
+/**
+ * the key of a string in a table: the key already there, with one more holder, or a new one.
+ * @param table the table
+ * @param s the string
+ * @return the key, NULL on failure
+ */
+StringKey *internString(StringTable *table, const char *s);
+
+/**
+ * frees a table. the keys still held are not freed: they leave the table and are freed by their
+ * last freeStringKey.
+ * @param table a pointer to the table, set to NULL
+ */
+void freeStringTable(StringTable **table);
+
 /**
  * CompFunc for Vectors, compares element by element, the vector that has the first larger
  * element is considered larger. If vectors are of different lengths and identify for the length
@@ -65,10 +231,23 @@ void freeVector(void *pVector); // implement it in Structs.c
 int copyIfNormIsLarger(const void *pVector, void *pMaxVector); // implement it in Structs.c
 
 /**
+ * the largest norm found so far is kept next to its vector, so every vector's norm is calculated
+ * once, and the largest vector is copied once, at the end. on a tree that keeps subtree maxima of
+ * vectorSquaredNorm or normedVectorSquaredNorm (see RBTreeEnableSubtreeMax), the vector is found
+ * in O(1).
  * @param tree a pointer to a tree of Vectors
- * @return pointer to a *copy* of the vector that has the largest norm (L2 Norm).
+ * @return pointer to a *copy* of the vector that has the largest norm (L2 Norm), NULL on failure.
  */
 Vector *findMaxNormVectorInTree(RBTree *tree); // implement it in Structs.c You must use copyIfNormIsLarger in the implementation!
 
+/**
+ * like findMaxNormVectorInTree, but the tree is searched by several threads, each keeping its own
+ * maximum, and the maxima are reduced at the end (see parallelForEachRBTree).
+ * @param tree a pointer to a tree of Vectors
+ * @param nthreads the number of threads to use, counting the calling thread
+ * @return pointer to a *copy* of the vector that has the largest norm (L2 Norm), NULL on failure.
+ */
+Vector *parallelFindMaxNormVectorInTree(RBTree *tree, int nthreads);
+
 
 #endif //TA_EX3_STRUCTS_H
@@ -0,0 +1,414 @@
+//
+// Created by Yair Escott.
+//
+
+#ifndef RBTREE_TYPEDRBTREE_H
+#define RBTREE_TYPEDRBTREE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "RBTree.h"
+
+/*
+ * red black trees specialized for one key type. RB_DEFINE_TREE(Name, KeyType, compareKeys,
+ * freeKey) defines the types Name and Name##Node and static inline functions that work on them:
+ *   void Name##Init(Name *tree);
+ *   int Name##Insert(Name *tree, KeyType key);            0 if the key is in the tree already.
+ *   int Name##Contains(const Name *tree, KeyType key);
+ *   Name##Node *Name##Find(const Name *tree, KeyType key);
+ *   int Name##Delete(Name *tree, KeyType key);            0 if the key is not in the tree.
+ *   Name##Node *Name##Begin(const Name *tree);            NULL if the tree is empty.
+ *   Name##Node *Name##Next(const Name##Node *node);       NULL after the largest key.
+ *   void Name##Clear(Name *tree);                         frees all the nodes and keys.
+ * the keys are stored in the nodes themselves and compared by compareKeys(a, b) - a macro or an
+ * inline function that returns < 0, 0 or > 0 like a CompareFunc - so the compiler can inline the
+ * comparisons instead of calling through a pointer. freeKey(key) is called on a key that leaves
+ * the tree (RB_KEEP_KEY if the tree does not own its keys). a deletion moves the successor's key
+ * into the deleted key's node, so cursors do not survive deletions.
+ */
+
+// compares two numbers (integers, or doubles that are not NaN), for RB_DEFINE_TREE
+#define RB_COMPARE_NUMBERS(a, b) (((a) > (b)) - ((a) < (b)))
+
+// the freeKey of a tree that does not own its keys
+#define RB_KEEP_KEY(key) ((void)(key))
+
+/*
+ * a string key whose first bytes are cached by rbStringPrefix (as StringKey of Structs.h does), so
+ * that most comparisons are settled by the prefixes without reaching the strings. make keys with
+ * rbStringKey, and define string trees with RB_DEFINE_STRING_TREE.
+ */
+typedef struct RBStringKey
+{
+	uint64_t prefix;
+	const char *str;
+} RBStringKey;
+
+/**
+ * make the key of a string.
+ * @param str: the string (kept by pointer, not copied).
+ * @return: the key.
+ */
+static inline RBStringKey rbStringKey(const char *str)
+{
+	RBStringKey key;
+	key.prefix = rbStringPrefix(str);
+	key.str = str;
+	return key;
+}
+
+/**
+ * compare two string keys in strcmp order.
+ * @param a, b: the keys.
+ * @return: lower than 0 if a < b, 0 if they are equal, greater than 0 if b < a.
+ */
+static inline int rbCompareStringKeys(RBStringKey a, RBStringKey b)
+{
+	if (a.prefix != b.prefix)
+	{
+		return (a.prefix < b.prefix) ? -1 : 1;
+	}
+	if ((a.prefix & 0xff) == 0)
+	{
+		// both strings end inside the prefix
+		return 0;
+	}
+	return strcmp(a.str + RB_STRING_PREFIX_BYTES, b.str + RB_STRING_PREFIX_BYTES);
+}
+
+// defines a tree of RBStringKey keys. freeKey gets the RBStringKey.
+#define RB_DEFINE_STRING_TREE(Name, freeKey) \
+	RB_DEFINE_TREE(Name, RBStringKey, rbCompareStringKeys, freeKey)
+
+#define RB_DEFINE_TREE(Name, KeyType, compareKeys, freeKey) \
+\
+typedef struct Name##Node \
+{ \
+	uintptr_t parentColor; \
+	struct Name##Node *left, *right; \
+	KeyType key; \
+} Name##Node; \
+\
+typedef struct Name \
+{ \
+	Name##Node *root; \
+	long unsigned size; \
+} Name; \
+\
+static inline void Name##Init(Name *tree) \
+{ \
+	tree->root = NULL; \
+	tree->size = 0; \
+} \
+\
+static inline Name##Node *Name##Parent(const Name##Node *node) \
+{ \
+	return (Name##Node *)(node->parentColor & ~RB_COLOR_MASK); \
+} \
+\
+static inline int Name##IsBlack(const Name##Node *node) \
+{ \
+	return node == NULL || rbColor(node) == BLACK; \
+} \
+\
+static inline Name##Node *Name##Find(const Name *tree, KeyType key) \
+{ \
+	Name##Node *node = tree->root; \
+	while (node != NULL) \
+	{ \
+		int comp = compareKeys(node->key, key); \
+		if (comp == 0) \
+		{ \
+			return node; \
+		} \
+		node = (comp < 0) ? node->right : node->left; \
+	} \
+	return NULL; \
+} \
+\
+static inline int Name##Contains(const Name *tree, KeyType key) \
+{ \
+	return Name##Find(tree, key) != NULL; \
+} \
+\
+static inline void Name##ReplaceChild(Name *tree, Name##Node *parent, Name##Node *old, \
+									  Name##Node *new) \
+{ \
+	if (parent == NULL) \
+	{ \
+		tree->root = new; \
+	} \
+	else if (parent->left == old) \
+	{ \
+		parent->left = new; \
+	} \
+	else \
+	{ \
+		parent->right = new; \
+	} \
+} \
+\
+static inline void Name##RotateLeft(Name *tree, Name##Node *node) \
+{ \
+	Name##Node *right = node->right; \
+	Name##Node *parent = Name##Parent(node); \
+	node->right = right->left; \
+	if (right->left != NULL) \
+	{ \
+		rbSetParent(right->left, node); \
+	} \
+	right->left = node; \
+	rbSetParent(node, right); \
+	rbSetParent(right, parent); \
+	Name##ReplaceChild(tree, parent, node, right); \
+} \
+\
+static inline void Name##RotateRight(Name *tree, Name##Node *node) \
+{ \
+	Name##Node *left = node->left; \
+	Name##Node *parent = Name##Parent(node); \
+	node->left = left->right; \
+	if (left->right != NULL) \
+	{ \
+		rbSetParent(left->right, node); \
+	} \
+	left->right = node; \
+	rbSetParent(node, left); \
+	rbSetParent(left, parent); \
+	Name##ReplaceChild(tree, parent, node, left); \
+} \
+\
+static inline void Name##FixInsert(Name *tree, Name##Node *node) \
+{ \
+	Name##Node *parent; \
+	while ((parent = Name##Parent(node)) != NULL && rbColor(parent) == RED) \
+	{ \
+		/* a red parent is not the root, so the grandparent exists */ \
+		Name##Node *grand = Name##Parent(parent); \
+		Name##Node *uncle = (parent == grand->left) ? grand->right : grand->left; \
+		if (uncle != NULL && rbColor(uncle) == RED) \
+		{ \
+			rbSetColor(parent, BLACK); \
+			rbSetColor(uncle, BLACK); \
+			rbSetColor(grand, RED); \
+			node = grand; \
+			continue; \
+		} \
+		if (parent == grand->left) \
+		{ \
+			if (node == parent->right) \
+			{ \
+				Name##RotateLeft(tree, parent); \
+				parent = node; \
+			} \
+			Name##RotateRight(tree, grand); \
+		} \
+		else \
+		{ \
+			if (node == parent->left) \
+			{ \
+				Name##RotateRight(tree, parent); \
+				parent = node; \
+			} \
+			Name##RotateLeft(tree, grand); \
+		} \
+		rbSetColor(parent, BLACK); \
+		rbSetColor(grand, RED); \
+		break; \
+	} \
+	rbSetColor(tree->root, BLACK); \
+} \
+\
+static inline int Name##Insert(Name *tree, KeyType key) \
+{ \
+	Name##Node *parent = NULL; \
+	Name##Node **link = &tree->root; \
+	while (*link != NULL) \
+	{ \
+		int comp = compareKeys((*link)->key, key); \
+		if (comp == 0) \
+		{ \
+			return 0; \
+		} \
+		parent = *link; \
+		link = (comp < 0) ? &parent->right : &parent->left; \
+	} \
+	Name##Node *node = (Name##Node *)malloc(sizeof(Name##Node)); \
+	if (node == NULL) \
+	{ \
+		return 0; \
+	} \
+	node->left = NULL; \
+	node->right = NULL; \
+	node->key = key; \
+	rbInitParentColor(node, parent, RED); \
+	*link = node; \
+	Name##FixInsert(tree, node); \
+	tree->size += 1; \
+	return 1; \
+} \
+\
+static inline void Name##FixDelete(Name *tree, Name##Node *parent, Name##Node *node) \
+{ \
+	while (node != tree->root && Name##IsBlack(node)) \
+	{ \
+		/* the sibling's side has a black node more, so the sibling exists */ \
+		if (node == parent->left) \
+		{ \
+			Name##Node *sibling = parent->right; \
+			if (rbColor(sibling) == RED) \
+			{ \
+				rbSetColor(sibling, BLACK); \
+				rbSetColor(parent, RED); \
+				Name##RotateLeft(tree, parent); \
+				sibling = parent->right; \
+			} \
+			if (Name##IsBlack(sibling->left) && Name##IsBlack(sibling->right)) \
+			{ \
+				rbSetColor(sibling, RED); \
+				node = parent; \
+				parent = Name##Parent(node); \
+				continue; \
+			} \
+			if (Name##IsBlack(sibling->right)) \
+			{ \
+				rbSetColor(sibling->left, BLACK); \
+				rbSetColor(sibling, RED); \
+				Name##RotateRight(tree, sibling); \
+				sibling = parent->right; \
+			} \
+			rbSetColor(sibling, rbColor(parent)); \
+			rbSetColor(parent, BLACK); \
+			rbSetColor(sibling->right, BLACK); \
+			Name##RotateLeft(tree, parent); \
+		} \
+		else \
+		{ \
+			Name##Node *sibling = parent->left; \
+			if (rbColor(sibling) == RED) \
+			{ \
+				rbSetColor(sibling, BLACK); \
+				rbSetColor(parent, RED); \
+				Name##RotateRight(tree, parent); \
+				sibling = parent->left; \
+			} \
+			if (Name##IsBlack(sibling->left) && Name##IsBlack(sibling->right)) \
+			{ \
+				rbSetColor(sibling, RED); \
+				node = parent; \
+				parent = Name##Parent(node); \
+				continue; \
+			} \
+			if (Name##IsBlack(sibling->left)) \
+			{ \
+				rbSetColor(sibling->right, BLACK); \
+				rbSetColor(sibling, RED); \
+				Name##RotateLeft(tree, sibling); \
+				sibling = parent->left; \
+			} \
+			rbSetColor(sibling, rbColor(parent)); \
+			rbSetColor(parent, BLACK); \
+			rbSetColor(sibling->left, BLACK); \
+			Name##RotateRight(tree, parent); \
+		} \
+		node = tree->root; \
+	} \
+	if (node != NULL) \
+	{ \
+		rbSetColor(node, BLACK); \
+	} \
+} \
+\
+static inline int Name##Delete(Name *tree, KeyType key) \
+{ \
+	Name##Node *node = Name##Find(tree, key); \
+	if (node == NULL) \
+	{ \
+		return 0; \
+	} \
+	freeKey(node->key); \
+	if (node->left != NULL && node->right != NULL) \
+	{ \
+		/* the successor's key moves up, and its node is removed instead */ \
+		Name##Node *next = node->right; \
+		while (next->left != NULL) \
+		{ \
+			next = next->left; \
+		} \
+		node->key = next->key; \
+		node = next; \
+	} \
+	Name##Node *child = (node->left != NULL) ? node->left : node->right; \
+	Name##Node *parent = Name##Parent(node); \
+	if (child != NULL) \
+	{ \
+		rbSetParent(child, parent); \
+	} \
+	Name##ReplaceChild(tree, parent, node, child); \
+	if (rbColor(node) == BLACK) \
+	{ \
+		if (child != NULL && rbColor(child) == RED) \
+		{ \
+			rbSetColor(child, BLACK); \
+		} \
+		else \
+		{ \
+			Name##FixDelete(tree, parent, child); \
+		} \
+	} \
+	free(node); \
+	tree->size -= 1; \
+	return 1; \
+} \
+\
+static inline Name##Node *Name##Begin(const Name *tree) \
+{ \
+	Name##Node *node = tree->root; \
+	while (node != NULL && node->left != NULL) \
+	{ \
+		node = node->left; \
+	} \
+	return node; \
+} \
+\
+static inline Name##Node *Name##Next(const Name##Node *node) \
+{ \
+	if (node->right != NULL) \
+	{ \
+		Name##Node *next = node->right; \
+		while (next->left != NULL) \
+		{ \
+			next = next->left; \
+		} \
+		return next; \
+	} \
+	Name##Node *parent = Name##Parent(node); \
+	while (parent != NULL && parent->right == node) \
+	{ \
+		node = parent; \
+		parent = Name##Parent(node); \
+	} \
+	return parent; \
+} \
+\
+static inline void Name##FreeNodes(Name##Node *node) \
+{ \
+	while (node != NULL) \
+	{ \
+		Name##Node *right = node->right; \
+		Name##FreeNodes(node->left); \
+		freeKey(node->key); \
+		free(node); \
+		node = right; \
+	} \
+} \
+\
+static inline void Name##Clear(Name *tree) \
+{ \
+	Name##FreeNodes(tree->root); \
+	tree->root = NULL; \
+	tree->size = 0; \
+}
+
+#endif //RBTREE_TYPEDRBTREE_H
@@ -2,13 +2,19 @@
 // Created by Maor on 21/05/2020.
 //
 
+#define _POSIX_C_SOURCE 200809L
 #include "RBTree.h"
 #include "RBUtilities.h"
 #include "Structs.h"
+#include "ConcurrentRBTree.h"
+#include "ParallelRBTree.h"
+#include "TypedRBTree.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #define LAST_NUMBER_OF_NODES_TO_CHECK 2000
 
@@ -21,6 +27,53 @@
 #define MAX_INPUT_TO_SHOW_TREE 25
 #define CHECK_DELETE true
 
+#define RANDOM_KEYS 500
+#define RANDOM_OPS 5000
+
+#define MAX_BULK_SIZE 70
+
+#define BATCH_SIZE 200
+#define BATCHES 10
+
+#define STRESS_KEYS 2000
+#define STRESS_WRITES 20000
+#define STRESS_READERS 3
+
+#define PARALLEL_THREADS 4
+
+#define SET_KEYS 500
+
+#define MULTISET_KEYS 50
+
+#define TYPED_KEYS 1000
+#define TYPED_STRINGS 200
+#define TYPED_STRING_LENGTH 16
+
+#define MAX_FROZEN_SIZE 70
+
+#define SIMD_VECTORS 200
+#define MAX_SIMD_LENGTH 40
+
+#define NORM_VECTORS 300
+#define NORM_DELETES 50
+
+#define STRING_KEYS 200
+#define MAX_STRING_KEY_LENGTH 20
+
+#define INTERVALS 1000
+#define INTERVAL_QUERIES 200
+#define MAX_INTERVAL_LENGTH 50
+
+#define VALIDATOR_KEYS 1000
+#define VALIDATOR_PRIME 7919
+
+#define LAZY_KEYS 100
+
+#define freeTypedString(key) free((void*) (key).str)
+
+RB_DEFINE_TREE(TypedInts, int, RB_COMPARE_NUMBERS, RB_KEEP_KEY)
+RB_DEFINE_STRING_TREE(TypedStrings, freeTypedString)
+
 int compInt(void* data1, void* data2)
 {
     int a = *((int*) data1);
@@ -41,6 +94,22 @@ void intFree(void* data)
     }
 }
 
+void check(bool condition, const char* what)
+{
+    if(!condition)
+    {
+        printf("ERROR - %s\n", what);
+        exit(EXIT_FAILURE);
+    }
+}
+
+int* newInt(int value)
+{
+    int* p = (int*) malloc(sizeof(int));
+    *p = value;
+    return p;
+}
+
 void insert(RBTree* t, void* data, const int i, const void* arr, const char* testName)
 {
     insertToRBTree(t, data);
@@ -270,11 +339,2154 @@ void vectorTree()
     printf("\n\n*****passed the test of vectors tree*****\n\n");
 }
 
-int main()
+int firstPresent(const bool* present, int from, int keys)
 {
-    //intTree();
-    stringTree();
-    vectorTree();
-    printf("\nPassed All tests!!\n");
-    return EXIT_SUCCESS;
-}
\ No newline at end of file
+    while(from < keys && (from < 0 || !present[from]))
+    {
+        from++;
+    }
+    return from;
+}
+
+typedef struct KeyScan
+{
+    const bool* present;
+    int keys;
+    int next;
+    bool ordered;
+} KeyScan;
+
+int scanKey(const void* object, void* args)
+{
+    KeyScan* scan = (KeyScan*) args;
+    scan->next = firstPresent(scan->present, scan->next, scan->keys);
+    scan->ordered = scan->ordered && *((const int*) object) == scan->next;
+    scan->next++;
+    return 1;
+}
+
+void checkItems(const RBTree* t, const bool* present, int keys, const char* what)
+{
+    long unsigned count = 0;
+    for(int key = 0; key < keys; key++)
+    {
+        count += present[key];
+    }
+    KeyScan scan = {present, keys, 0, true};
+    check(forEachRBTree(t, scanKey, &scan) && scan.ordered &&
+          firstPresent(present, scan.next, keys) == keys && t->size == count, what);
+    // the cursors walk the same items
+    Node* node = RBTreeBegin(t);
+    for(int key = firstPresent(present, 0, keys); key < keys; key = firstPresent(present, key + 1, keys))
+    {
+        check(node != RBTreeEnd(t) && *((int*) node->data) == key, what);
+        node = RBTreeNext(t, node);
+    }
+    check(node == RBTreeEnd(t), what);
+}
+
+void checkKeys(const RBTree* t, const bool* present, int keys, const char* what)
+{
+    check(isValidRBTree((RBTree*) t), what);
+    checkItems(t, present, keys, what);
+}
+
+RBTree* keyTree(bool* present, int keys)
+{
+    RBTree* t = newRBTree((CompareFunc) &compInt, free);
+    for(int key = 0; key < keys; key++)
+    {
+        present[key] = rand() % 2;
+        if(present[key])
+        {
+            insertToRBTree(t, newInt(key));
+        }
+    }
+    return t;
+}
+
+void randomOps(RBTree* t, bool* present, int keys, int ops, const char* what)
+{
+    for(int i = 0; i < ops; i++)
+    {
+        int key = rand() % keys;
+        if(rand() % 3 == 0)
+        {
+            check(deleteFromRBTree(t, &key) == present[key], what);
+            present[key] = false;
+            continue;
+        }
+        int* item = newInt(key);
+        bool inserted = insertToRBTree(t, item);
+        check(inserted == !present[key], what);
+        if(!inserted)
+        {
+            free(item);
+        }
+        present[key] = true;
+        if(i % (ops / 10 + 1) == 0)
+        {
+            check(isValidRBTree(t), what);
+        }
+    }
+    checkKeys(t, present, keys, what);
+}
+
+// the number of calls to countedCompInt
+long unsigned comparisons = 0;
+
+int countedCompInt(void* data1, void* data2)
+{
+    comparisons++;
+    return compInt(data1, data2);
+}
+
+void insertTree()
+{
+    // an insert that finds an equal item must leave the tree as it was
+    bool present[RANDOM_KEYS] = {false};
+    RBTree* t = newRBTree((CompareFunc) &compInt, free);
+    randomOps(t, present, RANDOM_KEYS, RANDOM_OPS, "a random insert or delete went wrong");
+    for(int key = 0; key < RANDOM_KEYS; key++)
+    {
+        int* item = newInt(key);
+        if(present[key])
+        {
+            check(!insertToRBTree(t, item), "inserted an item twice");
+            free(item);
+        }
+        else
+        {
+            check(insertToRBTree(t, item), "could not insert a missing item");
+            present[key] = true;
+        }
+    }
+    checkKeys(t, present, RANDOM_KEYS, "inserting every key went wrong");
+    freeRBTree(&t);
+
+    // an insert descends once: it compares no more than a lookup of the same item does
+    t = newRBTree((CompareFunc) &countedCompInt, free);
+    for(int i = 0; i < RANDOM_OPS; i++)
+    {
+        int key = rand() % RANDOM_KEYS;
+        comparisons = 0;
+        RBTreeContains(t, &key);
+        long unsigned lookup = comparisons;
+        comparisons = 0;
+        int* item = newInt(key);
+        if(!insertToRBTree(t, item))
+        {
+            free(item);
+        }
+        check(comparisons <= lookup, "an insert searched the tree more than once");
+    }
+    check(isValidRBTree(t), "inserts went wrong");
+    freeRBTree(&t);
+    printf("\n\n*****passed the test of inserts*****\n\n");
+}
+
+int treeHeight(const Node* node)
+{
+    if(node == NULL)
+    {
+        return 0;
+    }
+    int left = treeHeight(node->left);
+    int right = treeHeight(node->right);
+    return 1 + (left > right ? left : right);
+}
+
+void findTree()
+{
+    bool present[RANDOM_KEYS];
+    RBTree* t = newRBTree((CompareFunc) &countedCompInt, free);
+    for(int key = 0; key < RANDOM_KEYS; key++)
+    {
+        present[key] = rand() % 2;
+        if(present[key])
+        {
+            insertToRBTree(t, newInt(key));
+        }
+    }
+    int height = treeHeight(t->root);
+    comparisons = 0;
+    for(int key = -1; key <= RANDOM_KEYS; key++)
+    {
+        bool expected = key >= 0 && key < RANDOM_KEYS && present[key];
+        int* found = RBTreeFind(t, &key);
+        Node* node = RBTreeFindNode(t, &key);
+        check((found != NULL) == expected && (found == NULL || *found == key),
+              "find returned the wrong item");
+        check((node != NULL) == expected && (node == NULL || node->data == found),
+              "find returned the wrong node");
+        check((RBTreeContains(t, &key) != 0) == expected, "contains went wrong");
+    }
+    // a lookup calls compFunc at most once per level
+    check(comparisons <= 3 * (long unsigned) (RANDOM_KEYS + 2) * height,
+          "a lookup compared more than once per level");
+    freeRBTree(&t);
+    printf("\n\n*****passed the test of lookups*****\n\n");
+}
+
+int compNodes(const void* a, const void* b)
+{
+    uintptr_t first = (uintptr_t) *((Node* const*) a);
+    uintptr_t second = (uintptr_t) *((Node* const*) b);
+    return (first > second) - (first < second);
+}
+
+void poolTree()
+{
+    bool present[RANDOM_KEYS];
+    Node* nodes[RANDOM_KEYS];
+    RBTree* t = newRBTreeWithPool((CompareFunc) &compInt, free, 8);
+    check(t != NULL, "could not create a pooled tree");
+    for(int key = 0; key < RANDOM_KEYS; key++)
+    {
+        check(insertToRBTree(t, newInt(key)), "could not insert into a pooled tree");
+        present[key] = true;
+        nodes[key] = RBTreeFindNode(t, &key);
+    }
+    checkKeys(t, present, RANDOM_KEYS, "a pooled tree lost items");
+
+    // the nodes are carved one after the other from slabs of 8, 16, 32... nodes
+    int first = 0;
+    for(int slab = 8; first + slab <= RANDOM_KEYS; slab *= 2)
+    {
+        long step = (long) ((char*) nodes[first + 1] - (char*) nodes[first]);
+        check(step >= (long) sizeof(Node), "pooled nodes overlap");
+        for(int key = first + 1; key < first + slab; key++)
+        {
+            check((long) ((char*) nodes[key] - (char*) nodes[key - 1]) == step,
+                  "a slab was not carved in order");
+        }
+        first += slab;
+    }
+
+    // deleted nodes are recycled, so refilling the tree reuses the same nodes
+    qsort(nodes, RANDOM_KEYS, sizeof(Node*), compNodes);
+    for(int key = 0; key < RANDOM_KEYS; key++)
+    {
+        check(deleteFromRBTree(t, &key), "could not delete from a pooled tree");
+        present[key] = false;
+    }
+    checkKeys(t, present, RANDOM_KEYS, "a pooled tree was not emptied");
+    for(int key = RANDOM_KEYS - 1; key >= 0; key--)
+    {
+        check(insertToRBTree(t, newInt(key)), "could not refill a pooled tree");
+        present[key] = true;
+        Node* node = RBTreeFindNode(t, &key);
+        check(bsearch(&node, nodes, RANDOM_KEYS, sizeof(Node*), compNodes) != NULL,
+              "a pooled tree did not recycle its nodes");
+    }
+    randomOps(t, present, RANDOM_KEYS, RANDOM_OPS, "a recycled insert or delete went wrong");
+    freeRBTree(&t);
+    printf("\n\n*****passed the test of pooled trees*****\n\n");
+}
+
+void checkLinks(const Node* node)
+{
+    if(node == NULL)
+    {
+        return;
+    }
+    check(((uintptr_t) node & RB_COLOR_MASK) == 0, "a node is not aligned");
+    check((node->left == NULL || rbParent(node->left) == node) &&
+          (node->right == NULL || rbParent(node->right) == node),
+          "a kid does not point back at its parent");
+    checkLinks(node->left);
+    checkLinks(node->right);
+}
+
+void colorTree()
+{
+    // the color lives in the low bit of the parent pointer, and the accessors keep the other part
+    Node parent;
+    Node node;
+    check(sizeof(Node) == sizeof(uintptr_t) + 3 * sizeof(void*), "a node is bigger than its links");
+    rbInitParentColor(&node, &parent, RED);
+    check(rbParent(&node) == &parent && rbColor(&node) == RED, "the parent and color were mixed");
+    rbSetColor(&node, BLACK);
+    check(rbParent(&node) == &parent && rbColor(&node) == BLACK, "setting the color lost the parent");
+    rbSetParent(&node, NULL);
+    check(rbParent(&node) == NULL && rbColor(&node) == BLACK, "setting the parent lost the color");
+
+    // every node of a tree is aligned, and its kids point back at it
+    bool present[RANDOM_KEYS] = {false};
+    RBTree* t = newRBTree((CompareFunc) &compInt, free);
+    randomOps(t, present, RANDOM_KEYS, RANDOM_OPS, "a random insert or delete went wrong");
+    check(t->root == NULL || rbParent(t->root) == NULL, "the root has a parent");
+    checkLinks(t->root);
+    freeRBTree(&t);
+    printf("\n\n*****passed the test of packed colors*****\n\n");
+}
+
+typedef struct Record
+{
+    int key;
+    Node hook;
+} Record;
+
+void intrusiveTree()
+{
+    bool present[RANDOM_KEYS] = {false};
+    RBTree* t = newIntrusiveRBTree((CompareFunc) &compInt, free, RB_HOOK_OFFSET(Record, hook));
+    check(t != NULL, "could not create an intrusive tree");
+    for(int i = 0; i < RANDOM_OPS; i++)
+    {
+        Record probe = {rand() % RANDOM_KEYS, {0, NULL, NULL, NULL}};
+        if(rand() % 3 == 0)
+        {
+            check(deleteFromRBTree(t, &probe) == present[probe.key], "an intrusive delete went wrong");
+            present[probe.key] = false;
+            continue;
+        }
+        Record* record = malloc(sizeof(Record));
+        check(record != NULL, "out of memory");
+        record->key = probe.key;
+        bool inserted = insertToRBTree(t, record);
+        check(inserted == !present[probe.key], "an intrusive insert went wrong");
+        if(inserted)
+        {
+            check(RBTreeFindNode(t, record) == &record->hook, "the tree did not link the hook");
+        }
+        else
+        {
+            free(record);
+        }
+        present[probe.key] = true;
+    }
+    checkKeys(t, present, RANDOM_KEYS, "an intrusive tree lost items");
+    for(int key = 0; key < RANDOM_KEYS; key++)
+    {
+        Node* node = RBTreeFindNode(t, &key);
+        check((node != NULL) == present[key] &&
+              (node == NULL || rbContainerOf(node, Record, hook) == node->data),
+              "a hook is not in its item");
+    }
+    freeRBTree(&t);
+    printf("\n\n*****passed the test of intrusive trees*****\n\n");
+}
+
+void cursorTree()
+{
+    bool present[RANDOM_KEYS] = {false};
+    RBTree* t = newRBTree((CompareFunc) &compInt, free);
+    check(RBTreeBegin(t) == RBTreeEnd(t) && RBTreePrev(t, RBTreeEnd(t)) == NULL,
+          "an empty tree has a cursor");
+    randomOps(t, present, RANDOM_KEYS, RANDOM_OPS, "a random insert or delete went wrong");
+
+    // backwards from the end, against the same keys
+    Node* node = RBTreePrev(t, RBTreeEnd(t));
+    check(node == RBTreeMax(t), "the last cursor is not the largest item");
+    for(int key = RANDOM_KEYS - 1; key >= 0; key--)
+    {
+        if(present[key])
+        {
+            check(node != NULL && *((int*) node->data) == key, "a backward walk went wrong");
+            node = RBTreePrev(t, node);
+        }
+    }
+    check(node == NULL, "a backward walk went past the smallest item");
+
+    // a cursor survives the removal of the other items
+    Node* kept = RBTreeBegin(t);
+    int keptKey = *((int*) kept->data);
+    for(int key = 0; key < RANDOM_KEYS; key += 2)
+    {
+        if(key != keptKey && present[key])
+        {
+            check(deleteFromRBTree(t, &key), "could not delete an item");
+            present[key] = false;
+        }
+    }
+    check(*((int*) kept->data) == keptKey, "a cursor lost its item");
+    node = RBTreeNext(t, kept);
+    for(int key = keptKey + 1; key < RANDOM_KEYS; key++)
+    {
+        if(present[key])
+        {
+            check(node != NULL && *((int*) node->data) == key, "a kept cursor walked wrong");
+            break;
+        }
+    }
+    checkKeys(t, present, RANDOM_KEYS, "a forward walk went wrong");
+    freeRBTree(&t);
+    printf("\n\n*****passed the test of cursors*****\n\n");
+}
+
+int sumItems(const void* object, void* args)
+{
+    *((long*) args) += *((const int*) object);
+    return 1;
+}
+
+void boundTree()
+{
+    bool present[RANDOM_KEYS];
+    RBTree* t = keyTree(present, RANDOM_KEYS);
+    for(int key = -1; key <= RANDOM_KEYS; key++)
+    {
+        int lower = firstPresent(present, key, RANDOM_KEYS);
+        int upper = firstPresent(present, key + 1, RANDOM_KEYS);
+        Node* node = RBTreeLowerBound(t, &key);
+        check(lower >= RANDOM_KEYS ? node == RBTreeEnd(t) : *((int*) node->data) == lower,
+              "a lower bound went wrong");
+        node = RBTreeUpperBound(t, &key);
+        check(upper >= RANDOM_KEYS ? node == RBTreeEnd(t) : *((int*) node->data) == upper,
+              "an upper bound went wrong");
+    }
+    for(int i = 0; i < RANDOM_KEYS; i++)
+    {
+        int lo = rand() % RANDOM_KEYS;
+        int hi = lo + rand() % (RANDOM_KEYS / 10);
+        long expected = 0;
+        for(int key = lo; key <= hi && key < RANDOM_KEYS; key++)
+        {
+            expected += present[key] ? key : 0;
+        }
+        long sum = 0;
+        check(forEachRangeRBTree(t, &lo, &hi, sumItems, &sum) && sum == expected,
+              "a range visited the wrong items");
+    }
+    long all = 0;
+    long expected = 0;
+    forEachRBTree(t, sumItems, &expected);
+    check(forEachRangeRBTree(t, NULL, NULL, sumItems, &all) && all == expected,
+          "an open range did not visit every item");
+    freeRBTree(&t);
+    printf("\n\n*****passed the test of bounds and ranges*****\n\n");
+}
+
+void checkRanks(const RBTree* t, const bool* present, const char* what)
+{
+    long unsigned rank = 0;
+    for(int key = 0; key < RANDOM_KEYS; key++)
+    {
+        check(RBTreeRank(t, &key) == rank, what);
+        if(present[key])
+        {
+            Node* node = RBTreeSelect(t, rank);
+            check(node != RBTreeEnd(t) && *((int*) node->data) == key, what);
+            rank++;
+        }
+    }
+    check(RBTreeSelect(t, rank) == RBTreeEnd(t), what);
+}
+
+void rankTree()
+{
+    bool present[RANDOM_KEYS] = {false};
+    RBTree* t = newRBTree((CompareFunc) &compInt, free);
+    check(RBTreeEnableOrderStatistics(t), "could not enable order statistics");
+    randomOps(t, present, RANDOM_KEYS, RANDOM_OPS, "an insert or delete broke the subtree sizes");
+    check(RBTreeSubtreeSize(t, t->root) == t->size, "the root does not count the tree");
+    checkRanks(t, present, "rank or select went wrong");
+    freeRBTree(&t);
+
+    // without the sizes, rank and select walk the items, with the same results
+    t = keyTree(present, RANDOM_KEYS);
+    checkRanks(t, present, "rank or select without order statistics went wrong");
+    freeRBTree(&t);
+    printf("\n\n*****passed the test of rank and select*****\n\n");
+}
+
+RBTree* buildTree(bool* present, int keys)
+{
+    void* items[RANDOM_KEYS];
+    int n = 0;
+    for(int key = 0; key < keys; key++)
+    {
+        present[key] = rand() % 2;
+        if(present[key])
+        {
+            items[n++] = newInt(key);
+        }
+    }
+    RBTree* t = RBTreeBuildFromSorted((CompareFunc) &compInt, free, items, n);
+    check(t != NULL, "could not build a tree from sorted items");
+    return t;
+}
+
+void bulkTree()
+{
+    bool present[RANDOM_KEYS];
+    // every small size, where the red level of the built tree changes most often
+    for(int keys = 0; keys <= MAX_BULK_SIZE; keys++)
+    {
+        for(int key = 0; key < keys; key++)
+        {
+            present[key] = true;
+        }
+        void* items[MAX_BULK_SIZE];
+        for(int key = 0; key < keys; key++)
+        {
+            items[key] = newInt(key);
+        }
+        RBTree* t = RBTreeBuildFromSorted((CompareFunc) &compInt, free, items, keys);
+        checkKeys(t, present, keys, "a built tree is not valid");
+        freeRBTree(&t);
+    }
+
+    // a built tree keeps changing like any other
+    RBTree* t = buildTree(present, RANDOM_KEYS);
+    checkKeys(t, present, RANDOM_KEYS, "a built tree lost items");
+    randomOps(t, present, RANDOM_KEYS, RANDOM_OPS, "a built tree went wrong after changes");
+
+    // a built tree is pooled, so its nodes stay where they are and no snapshots are taken
+    RBTree* lo = NULL;
+    RBTree* hi = NULL;
+    RBTree* other = newRBTree((CompareFunc) &compInt, free);
+    RBTree* empty = RBTreeBuildFromSorted((CompareFunc) &compInt, free, NULL, 0);
+    int key = RANDOM_KEYS / 2;
+    check(!RBTreeSplit(t, &key, &lo, &hi) && lo == NULL && hi == NULL &&
+          !RBTreeJoin(t, NULL, other) && !RBTreeUnion(other, t) && !RBTreeEnableSnapshots(empty),
+          "the nodes of a built tree were moved");
+    checkKeys(t, present, RANDOM_KEYS, "a built tree changed when its nodes were not moved");
+    freeRBTree(&empty);
+    freeRBTree(&other);
+    freeRBTree(&t);
+
+    // items out of order are rejected, and stay the caller's
+    int first = 2;
+    int second = 1;
+    void* unsorted[] = {&first, &second};
+    void* duplicates[] = {&first, &first};
+    check(RBTreeBuildFromSorted((CompareFunc) &compInt, free, unsorted, 2) == NULL &&
+          RBTreeBuildFromSorted((CompareFunc) &compInt, free, duplicates, 2) == NULL,
+          "built a tree out of unsorted items");
+    printf("\n\n*****passed the test of bulk loading*****\n\n");
+}
+
+void batchTree()
+{
+    bool present[RANDOM_KEYS];
+    RBTree* t = keyTree(present, RANDOM_KEYS);
+    for(int batch = 0; batch < BATCHES; batch++)
+    {
+        // clustered keys, with repeats inside the batch, keys of the tree and a NULL
+        void* items[BATCH_SIZE];
+        int results[BATCH_SIZE];
+        int start = rand() % RANDOM_KEYS;
+        bool added[RANDOM_KEYS] = {false};
+        int firstOf[RANDOM_KEYS];
+        for(int i = 0; i < BATCH_SIZE; i++)
+        {
+            int key = (start + rand() % (RANDOM_KEYS / 4)) % RANDOM_KEYS;
+            items[i] = (i == BATCH_SIZE / 2) ? NULL : newInt(key);
+            if(items[i] != NULL && !added[key])
+            {
+                firstOf[key] = i;
+                added[key] = true;
+            }
+        }
+        memset(added, 0, sizeof(added));
+        check(insertBatchRBTree(t, items, BATCH_SIZE, results), "a batch insert failed");
+        for(int i = 0; i < BATCH_SIZE; i++)
+        {
+            if(items[i] == NULL)
+            {
+                check(!results[i], "a NULL item was added");
+                continue;
+            }
+            int key = *((int*) items[i]);
+            if(results[i])
+            {
+                check(!present[key] && !added[key], "an item was added twice");
+                check(firstOf[key] == i, "a repeat was added instead of the first copy");
+                added[key] = true;
+            }
+            else
+            {
+                check(present[key] || added[key], "an item was not added");
+                free(items[i]);
+            }
+        }
+        for(int key = 0; key < RANDOM_KEYS; key++)
+        {
+            present[key] = present[key] || added[key];
+        }
+        checkKeys(t, present, RANDOM_KEYS, "a batch insert went wrong");
+    }
+    freeRBTree(&t);
+    printf("\n\n*****passed the test of batch inserts*****\n\n");
+}
+
+typedef struct StressScan
+{
+    int last;
+    long evens;
+    bool ascending;
+} StressScan;
+
+typedef struct StressShared
+{
+    ConcurrentRBTree* tree;
+    int done;
+    int failed;
+} StressShared;
+
+int scanStep(const void* object, void* args)
+{
+    StressScan* scan = (StressScan*) args;
+    int value = *((const int*) object);
+    if(value <= scan->last)
+    {
+        scan->ascending = false;
+    }
+    scan->last = value;
+    scan->evens += (value % 2 == 0);
+    return 1;
+}
+
+void* stressReader(void* args)
+{
+    StressShared* shared = (StressShared*) args;
+    RBReader* reader = concurrentRBTreeRegisterReader(shared->tree);
+    while(!__atomic_load_n(&shared->done, __ATOMIC_ACQUIRE))
+    {
+        // the even keys are never deleted, the odd ones come and go
+        for(int key = 0; key < STRESS_KEYS; key += 2 * 7)
+        {
+            if(!concurrentRBTreeContains(shared->tree, reader, &key))
+            {
+                __atomic_store_n(&shared->failed, 1, __ATOMIC_RELAXED);
+            }
+        }
+        StressScan scan = {-1, 0, true};
+        concurrentForEachRBTree(shared->tree, reader, scanStep, &scan);
+        if(!scan.ascending || scan.evens != STRESS_KEYS / 2)
+        {
+            __atomic_store_n(&shared->failed, 1, __ATOMIC_RELAXED);
+        }
+        // the shape is measured while the writer goes on
+        RBTreeStats stats;
+        if(!concurrentRBTreeGetStats(shared->tree, &stats) || stats.size < STRESS_KEYS / 2 ||
+           stats.size > STRESS_KEYS || stats.height <= 0)
+        {
+            __atomic_store_n(&shared->failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+    concurrentRBTreeUnregisterReader(shared->tree, reader);
+    return NULL;
+}
+
+int countItems(const void* object, void* args)
+{
+    (void) object;
+    (*((long unsigned*) args))++;
+    return 1;
+}
+
+int checkPresent(const void* object, void* args)
+{
+    bool* present = (bool*) args;
+    int value = *((const int*) object);
+    check(present[value], "the concurrent tree holds a key that was deleted");
+    present[value] = false;
+    return 1;
+}
+
+void concurrentTree()
+{
+    // one writer (this thread) and readers that check every lookup and scan while it writes
+    StressShared shared = {newConcurrentRBTree((CompareFunc) &compInt, free), 0, 0};
+    bool present[STRESS_KEYS] = {false};
+    for(int key = 0; key < STRESS_KEYS; key += 2)
+    {
+        concurrentInsertToRBTree(shared.tree, newInt(key));
+        present[key] = true;
+    }
+    pthread_t readers[STRESS_READERS];
+    for(int i = 0; i < STRESS_READERS; i++)
+    {
+        check(pthread_create(&readers[i], NULL, stressReader, &shared) == 0, "no reader thread");
+    }
+    for(int i = 0; i < STRESS_WRITES; i++)
+    {
+        int key = 2 * (rand() % (STRESS_KEYS / 2)) + 1;
+        if(present[key])
+        {
+            check(concurrentDeleteFromRBTree(shared.tree, &key), "a concurrent delete failed");
+        }
+        else
+        {
+            check(concurrentInsertToRBTree(shared.tree, newInt(key)), "a concurrent insert failed");
+        }
+        present[key] = !present[key];
+    }
+    __atomic_store_n(&shared.done, 1, __ATOMIC_RELEASE);
+    for(int i = 0; i < STRESS_READERS; i++)
+    {
+        pthread_join(readers[i], NULL);
+    }
+    check(!shared.failed, "a reader missed a key or saw the keys out of order");
+    check(isValidRBTree(shared.tree->tree), "the concurrent tree is not valid");
+    // without writers the scan walks its path through the whole tree
+    RBReader* reader = concurrentRBTreeRegisterReader(shared.tree);
+    StressScan scan = {-1, 0, true};
+    long unsigned count = 0;
+    check(concurrentForEachRBTree(shared.tree, reader, scanStep, &scan) &&
+          concurrentForEachRBTree(shared.tree, reader, countItems, &count) && scan.ascending &&
+          scan.evens == STRESS_KEYS / 2 && count == shared.tree->tree->size, "a quiet scan failed");
+    concurrentRBTreeUnregisterReader(shared.tree, reader);
+    forEachRBTree(shared.tree->tree, checkPresent, present);
+    for(int key = 0; key < STRESS_KEYS; key++)
+    {
+        check(!present[key], "the concurrent tree lost a key");
+    }
+    freeConcurrentRBTree(&shared.tree);
+    printf("\n\n*****passed the test of concurrent tree*****\n\n");
+}
+
+void snapshotTree()
+{
+    bool present[RANDOM_KEYS] = {false};
+    bool first[RANDOM_KEYS];
+    bool second[RANDOM_KEYS];
+    RBTree* t = newRBTree((CompareFunc) &compInt, free);
+    check(RBTreeEnableSnapshots(t), "could not enable snapshots");
+    randomOps(t, present, RANDOM_KEYS, RANDOM_OPS / 2, "a shareable tree went wrong");
+    memcpy(first, present, sizeof(present));
+    RBTree* older = RBTreeSnapshot(t);
+    randomOps(t, present, RANDOM_KEYS, RANDOM_OPS / 2, "a tree with a snapshot went wrong");
+    memcpy(second, present, sizeof(present));
+    RBTree* newer = RBTreeSnapshot(t);
+    randomOps(t, present, RANDOM_KEYS, RANDOM_OPS / 2, "a tree with snapshots went wrong");
+    check(older != NULL && newer != NULL, "could not take a snapshot");
+    checkKeys(older, first, RANDOM_KEYS, "an older snapshot changed");
+    checkKeys(newer, second, RANDOM_KEYS, "a newer snapshot changed");
+
+    // snapshots are read-only, and the versions can go in any order
+    int key = 0;
+    int* item = newInt(RANDOM_KEYS);
+    check(!insertToRBTree(newer, item) && !deleteFromRBTree(newer, &key), "a snapshot was changed");
+    free(item);
+    freeRBTree(&older);
+    checkKeys(t, present, RANDOM_KEYS, "freeing a snapshot changed the tree");
+    freeRBTree(&t);
+    checkKeys(newer, second, RANDOM_KEYS, "freeing the tree changed a snapshot");
+    freeRBTree(&newer);
+    printf("\n\n*****passed the test of snapshots*****\n\n");
+}
+
+int addSums(const void* object, void* args)
+{
+    *((long*) args) += *((const long*) object);
+    return 1;
+}
+
+int failOnKey(const void* object, void* args)
+{
+    return *((const int*) object) != *((const int*) args);
+}
+
+void parallelTree()
+{
+    bool present[RANDOM_KEYS] = {false};
+    RBTree* t = newRBTree((CompareFunc) &compInt, free);
+    long sums[PARALLEL_THREADS];
+    void* args[PARALLEL_THREADS];
+    for(int i = 0; i < PARALLEL_THREADS; i++)
+    {
+        args[i] = &sums[i];
+    }
+    for(int round = 0; round < 3; round++)
+    {
+        long expected = 0;
+        forEachRBTree(t, sumItems, &expected);
+        for(int threads = 1; threads <= PARALLEL_THREADS; threads++)
+        {
+            memset(sums, 0, sizeof(sums));
+            check(parallelForEachRBTree(t, sumItems, addSums, args, threads) && sums[0] == expected,
+                  "a parallel visit went wrong");
+        }
+        randomOps(t, present, RANDOM_KEYS, RANDOM_OPS / 3, "a random insert or delete went wrong");
+    }
+
+    // a failed activation fails the visit
+    int key = *((int*) RBTreePrev(t, RBTreeEnd(t))->data);
+    for(int i = 0; i < PARALLEL_THREADS; i++)
+    {
+        args[i] = &key;
+    }
+    check(!parallelForEachRBTree(t, failOnKey, NULL, args, PARALLEL_THREADS),
+          "a failed activation was not reported");
+    freeRBTree(&t);
+    printf("\n\n*****passed the test of parallel visits*****\n\n");
+}
+
+void joinSplitTree()
+{
+    bool present[SET_KEYS], other[SET_KEYS], expected[SET_KEYS];
+    RBTree* t = keyTree(present, SET_KEYS);
+    RBTree* lo;
+    RBTree* hi;
+    int key = SET_KEYS / 2;
+    check(RBTreeSplit(t, &key, &lo, &hi) && t->size == 0, "split failed");
+    for(int i = 0; i < SET_KEYS; i++)
+    {
+        expected[i] = present[i] && i < key;
+        other[i] = present[i] && i >= key;
+    }
+    checkKeys(lo, expected, SET_KEYS, "split lost the smaller items");
+    checkKeys(hi, other, SET_KEYS, "split lost the greater items");
+    check(!RBTreeJoin(hi, NULL, lo), "joined trees out of order");
+    checkKeys(lo, expected, SET_KEYS, "a rejected join changed a tree");
+    check(RBTreeJoin(lo, present[key] ? NULL : newInt(key), hi) && hi->size == 0, "join failed");
+    present[key] = true;
+    checkKeys(lo, present, SET_KEYS, "join lost items");
+    freeRBTree(&lo);
+    freeRBTree(&hi);
+    freeRBTree(&t);
+
+    // the set operations, against the same operations on the key arrays
+    for(int operation = 0; operation < 3; operation++)
+    {
+        RBTree* t1 = keyTree(present, SET_KEYS);
+        RBTree* t2 = keyTree(other, SET_KEYS);
+        int done = 0;
+        for(int i = 0; i < SET_KEYS; i++)
+        {
+            expected[i] = (operation == 0) ? present[i] || other[i] :
+                          (operation == 1) ? present[i] && other[i] : present[i] && !other[i];
+        }
+        done = (operation == 0) ? RBTreeUnion(t1, t2) :
+               (operation == 1) ? RBTreeIntersection(t1, t2) : RBTreeDifference(t1, t2);
+        check(done && t2->size == 0, "a set operation failed");
+        checkKeys(t1, expected, SET_KEYS, "a set operation is wrong");
+        freeRBTree(&t1);
+        freeRBTree(&t2);
+    }
+
+    // pooled trees cannot give their nodes away
+    t = newRBTreeWithPool((CompareFunc) &compInt, free, 0);
+    insertToRBTree(t, newInt(key));
+    lo = t;
+    hi = t;
+    check(!RBTreeSplit(t, &key, &lo, &hi) && lo == NULL && hi == NULL, "split a pooled tree");
+    freeRBTree(&t);
+    check(t == NULL, "a freed tree was not set to NULL");
+    printf("\n\n*****passed the test of joins, splits and set operations*****\n\n");
+}
+
+void deleteTree()
+{
+    bool present[RANDOM_KEYS];
+    RBTree* t = keyTree(present, RANDOM_KEYS);
+    int missing = RANDOM_KEYS;
+    check(!deleteFromRBTree(t, &missing), "deleted a missing item");
+    // by item, by node and by popping the smallest, validating after every delete
+    while(t->size > 0)
+    {
+        int way = rand() % 3;
+        int key = rand() % RANDOM_KEYS;
+        if(way == 0)
+        {
+            check(deleteFromRBTree(t, &key) == present[key], "a delete by item went wrong");
+        }
+        else if(way == 1)
+        {
+            Node* node = RBTreeLowerBound(t, &key);
+            if(node == RBTreeEnd(t))
+            {
+                continue;
+            }
+            key = *((int*) node->data);
+            check(deleteNodeFromRBTree(t, node), "a delete by node failed");
+        }
+        else
+        {
+            int* item = RBTreePopFront(t);
+            check(item != NULL, "a pop failed");
+            key = *item;
+            check(key == firstPresent(present, 0, RANDOM_KEYS), "a pop did not remove the smallest");
+            free(item);
+        }
+        present[key] = false;
+        check(isValidRBTree(t), "a delete broke the tree");
+    }
+    checkKeys(t, present, RANDOM_KEYS, "an emptied tree still has items");
+    freeRBTree(&t);
+    printf("\n\n*****passed the test of deletes*****\n\n");
+}
+
+void hintTree()
+{
+    // appending after the largest item
+    bool present[RANDOM_KEYS] = {false};
+    RBTree* t = newRBTree((CompareFunc) &countedCompInt, free);
+    comparisons = 0;
+    for(int key = 0; key < RANDOM_KEYS; key += 2)
+    {
+        check(insertToRBTreeHint(t, RBTreeEnd(t), newInt(key)), "an append failed");
+        present[key] = true;
+    }
+    check(comparisons <= 2 * RANDOM_KEYS, "appends did not use their hint");
+    checkKeys(t, present, RANDOM_KEYS, "appends went wrong");
+
+    // hints near the place, and hints far from it
+    for(int i = 0; i < RANDOM_OPS; i++)
+    {
+        int key = rand() % RANDOM_KEYS;
+        Node* hint = (rand() % 2) ? RBTreeLowerBound(t, &key) :
+                     RBTreeSelect(t, rand() % (t->size + 1));
+        if(rand() % 3 == 0)
+        {
+            check(deleteFromRBTreeHint(t, hint, &key) == present[key], "a hinted delete went wrong");
+            present[key] = false;
+            continue;
+        }
+        int* item = newInt(key);
+        bool inserted = insertToRBTreeHint(t, hint, item);
+        check(inserted == !present[key], "a hinted insert went wrong");
+        if(!inserted)
+        {
+            free(item);
+        }
+        present[key] = true;
+    }
+    checkKeys(t, present, RANDOM_KEYS, "hinted inserts and deletes went wrong");
+    check(t->size == 0 || (*((int*) RBTreeMin(t)->data) == firstPresent(present, 0, RANDOM_KEYS)),
+          "the smallest item is wrong");
+    freeRBTree(&t);
+    printf("\n\n*****passed the test of hints*****\n\n");
+}
+
+void mapTree()
+{
+    int values[RANDOM_KEYS];
+    bool present[RANDOM_KEYS] = {false};
+    RBTree* map = newRBMap((CompareFunc) &compInt, free, free);
+    check(map != NULL, "could not create a map");
+    for(int i = 0; i < RANDOM_OPS; i++)
+    {
+        int key = rand() % RANDOM_KEYS;
+        int way = rand() % 4;
+        if(way == 0)
+        {
+            check(deleteFromRBTree(map, &key) == present[key], "a map delete went wrong");
+            present[key] = false;
+        }
+        else if(way == 1)
+        {
+            // upsert
+            int* newKey = newInt(key);
+            int put = RBMapPut(map, newKey, newInt(i));
+            check(put == (present[key] ? 2 : 1), "an upsert went wrong");
+            if(put == 2)
+            {
+                free(newKey);
+            }
+            values[key] = i;
+            present[key] = true;
+        }
+        else
+        {
+            // a counter updated in place
+            int* newKey = newInt(key);
+            int inserted;
+            void** slot = RBMapGetOrInsert(map, newKey, &inserted);
+            check(slot != NULL && inserted == !present[key] && (*slot == NULL) == !present[key],
+                  "get or insert went wrong");
+            if(!inserted)
+            {
+                free(newKey);
+            }
+            if(*slot == NULL)
+            {
+                *slot = newInt(0);
+                values[key] = 0;
+            }
+            (*((int*) *slot))++;
+            values[key]++;
+            present[key] = true;
+        }
+    }
+
+    // the key the map holds, passed again, is found and not added
+    for(int key = 0; key < RANDOM_KEYS; key++)
+    {
+        Node* node = RBTreeFindNode(map, &key);
+        if(node == NULL)
+        {
+            continue;
+        }
+        int inserted;
+        long unsigned size = map->size;
+        check(RBMapGetOrInsert(map, node->data, &inserted) != NULL && !inserted &&
+              RBMapPut(map, node->data, newInt(-key)) == 2 && map->size == size,
+              "the stored key was reported as added");
+        values[key] = -key;
+    }
+    checkKeys(map, present, RANDOM_KEYS, "a map lost keys");
+    for(int key = 0; key < RANDOM_KEYS; key++)
+    {
+        int* value = RBMapGet(map, &key);
+        check(present[key] ? value != NULL && *value == values[key] : value == NULL,
+              "a map holds the wrong value");
+        Node* node = RBTreeFindNode(map, &key);
+        check(node == NULL || RBMapValue(map, node) == value, "a node holds the wrong value");
+    }
+    freeRBTree(&map);
+    printf("\n\n*****passed the test of maps*****\n\n");
+}
+
+void multisetTree()
+{
+    for(int counted = 0; counted <= 1; counted++)
+    {
+        long unsigned copies[MULTISET_KEYS] = {0};
+        RBTree* t = newRBTree((CompareFunc) &compInt, free);
+        check(RBTreeEnableMultiset(t, counted), "could not enable a multiset");
+        for(int i = 0; i < RANDOM_OPS; i++)
+        {
+            int key = rand() % MULTISET_KEYS;
+            int way = rand() % 8;
+            if(way == 0)
+            {
+                check(eraseAllRBTree(t, &key) == copies[key], "erasing all copies went wrong");
+                copies[key] = 0;
+            }
+            else if(way < 3)
+            {
+                check(deleteFromRBTree(t, &key) == (copies[key] > 0), "deleting a copy went wrong");
+                copies[key] -= (copies[key] > 0);
+            }
+            else
+            {
+                check(insertToRBTree(t, newInt(key)), "adding a copy failed");
+                copies[key]++;
+            }
+            if(i % (RANDOM_OPS / 10) == 0)
+            {
+                check(isValidRBTree(t), "a multiset is not valid");
+            }
+        }
+        check(isValidRBTree(t), "a multiset is not valid");
+        long unsigned items = 0;
+        for(int key = 0; key < MULTISET_KEYS; key++)
+        {
+            check(RBTreeCount(t, &key) == copies[key], "a count is wrong");
+            Node* node = RBTreeFindNode(t, &key);
+            check((node != NULL) == (copies[key] > 0) &&
+                  (node == NULL || RBTreeCopies(t, node) == (counted ? copies[key] : 1)),
+                  "the copies of a node are wrong");
+            items += counted ? (copies[key] > 0) : copies[key];
+        }
+        check(t->size == items, "the size of a multiset is wrong");
+        freeRBTree(&t);
+    }
+    printf("\n\n*****passed the test of multisets*****\n\n");
+}
+
+int typedBlackHeight(const TypedIntsNode* node, const TypedIntsNode* parent, long unsigned* count)
+{
+    if(node == NULL)
+    {
+        return 1;
+    }
+    (*count)++;
+    if(TypedIntsParent(node) != parent || (rbColor(node) == RED && !TypedIntsIsBlack(parent)))
+    {
+        return -1;
+    }
+    int left = typedBlackHeight(node->left, node, count);
+    int right = typedBlackHeight(node->right, node, count);
+    if(left < 0 || left != right)
+    {
+        return -1;
+    }
+    return left + (rbColor(node) == BLACK);
+}
+
+void checkTypedInts(const TypedInts* t, const bool* present, const char* what)
+{
+    long unsigned count = 0;
+    check((t->root == NULL || rbColor(t->root) == BLACK) && typedBlackHeight(t->root, NULL, &count) > 0
+          && count == t->size, what);
+    TypedIntsNode* node = TypedIntsBegin(t);
+    for(int key = 0; key < TYPED_KEYS; key++)
+    {
+        check(TypedIntsContains(t, key) == present[key], what);
+        if(present[key])
+        {
+            check(node != NULL && node->key == key, what);
+            node = TypedIntsNext(node);
+        }
+    }
+    check(node == NULL, what);
+}
+
+void typedTree()
+{
+    TypedInts t;
+    TypedIntsInit(&t);
+    bool present[TYPED_KEYS] = {false};
+    for(int i = 0; i < 4 * TYPED_KEYS; i++)
+    {
+        int key = rand() % TYPED_KEYS;
+        if(rand() % 3 == 0)
+        {
+            check(TypedIntsDelete(&t, key) == present[key], "a typed delete went wrong");
+            present[key] = false;
+        }
+        else
+        {
+            check(TypedIntsInsert(&t, key) == !present[key], "a typed insert went wrong");
+            present[key] = true;
+        }
+        if(i % (TYPED_KEYS / 10) == 0)
+        {
+            checkTypedInts(&t, present, "a typed tree is not a valid red black tree");
+        }
+    }
+    checkTypedInts(&t, present, "a typed tree is not a valid red black tree");
+    TypedIntsClear(&t);
+    check(t.root == NULL && t.size == 0, "a typed tree was not cleared");
+
+    // string keys share their first bytes, so the order is settled past the prefixes too
+    TypedStrings strings;
+    TypedStringsInit(&strings);
+    for(int i = 0; i < TYPED_STRINGS; i++)
+    {
+        char* str = malloc(TYPED_STRING_LENGTH + 1);
+        check(str != NULL, "out of memory");
+        snprintf(str, TYPED_STRING_LENGTH + 1, "%s%d", (i % 2) ? "prefixed" : "pre", rand() % 1000);
+        if(!TypedStringsInsert(&strings, rbStringKey(str)))
+        {
+            free(str);
+        }
+    }
+    long unsigned count = 0;
+    const char* last = NULL;
+    for(TypedStringsNode* node = TypedStringsBegin(&strings); node != NULL; node = TypedStringsNext(node))
+    {
+        check(last == NULL || strcmp(last, node->key.str) < 0, "typed string keys are out of order");
+        last = node->key.str;
+        count++;
+    }
+    check(count == strings.size, "a typed string tree lost keys");
+    TypedStringsClear(&strings);
+    printf("\n\n*****passed the test of typed trees*****\n\n");
+}
+
+/**
+ * @brief checks a tree that holds the even keys 0 to 2 (keys - 1): its ends, its cursors in both
+ * directions, and the lookups and bounds of every key from -1 to 2 keys, on and between the items.
+ */
+void checkEvenKeys(const RBTree* t, int keys, const char* what)
+{
+    check(t->size == (long unsigned) keys, what);
+    check(keys == 0 ? RBTreeMin(t) == NULL && RBTreeMax(t) == NULL :
+          *((int*) RBTreeMin(t)->data) == 0 && *((int*) RBTreeMax(t)->data) == 2 * (keys - 1), what);
+    Node* node = RBTreeBegin(t);
+    for(int key = 0; key < keys; key++)
+    {
+        check(node != RBTreeEnd(t) && *((int*) node->data) == 2 * key, what);
+        node = RBTreeNext(t, node);
+    }
+    check(node == RBTreeEnd(t), what);
+    node = RBTreePrev(t, RBTreeEnd(t));
+    for(int key = keys - 1; key >= 0; key--)
+    {
+        check(node != NULL && *((int*) node->data) == 2 * key, what);
+        node = RBTreePrev(t, node);
+    }
+    check(node == NULL, what);
+    for(int key = -1; key <= 2 * keys; key++)
+    {
+        int* found = RBTreeFind(t, &key);
+        bool inTree = key >= 0 && key < 2 * keys && key % 2 == 0;
+        check((found != NULL) == inTree && (found == NULL || *found == key), what);
+        int lower = (key < 0) ? 0 : key + key % 2;
+        int upper = (key < 0) ? 0 : key + 2 - key % 2;
+        node = RBTreeLowerBound(t, &key);
+        check(lower >= 2 * keys ? node == RBTreeEnd(t) : *((int*) node->data) == lower, what);
+        node = RBTreeUpperBound(t, &key);
+        check(upper >= 2 * keys ? node == RBTreeEnd(t) : *((int*) node->data) == upper, what);
+    }
+}
+
+void freezeTree()
+{
+    // the sizes up to 70 end their slot arrays on every kind of partial last level: the ends of the
+    // paths of left and right kids, and the steps up from the last slots, all move with the size
+    for(int keys = 0; keys <= MAX_FROZEN_SIZE; keys++)
+    {
+        RBTree* t = (keys % 2) ? newRBTreeWithPool((CompareFunc) &compInt, free, 0) :
+                    newRBTree((CompareFunc) &compInt, free);
+        for(int key = 0; key < keys; key++)
+        {
+            insertToRBTree(t, newInt(2 * key));
+        }
+        check(RBTreeFreeze(t), "could not freeze a tree");
+        checkEvenKeys(t, keys, "a frozen tree reads wrong");
+        int* item = newInt(1);
+        int key = 0;
+        check(!insertToRBTree(t, item) && !deleteFromRBTree(t, &key) && !RBTreeFreeze(t),
+              "a frozen tree was changed");
+        free(item);
+        freeRBTree(&t);
+    }
+
+    // the tombstones of a lazy tree are compacted away before the slots are filled
+    RBTree* t = newRBTree((CompareFunc) &compInt, free);
+    check(RBTreeEnableLazyDelete(t), "could not enable lazy deletion");
+    for(int key = 0; key < 2 * MAX_FROZEN_SIZE; key++)
+    {
+        insertToRBTree(t, newInt(key));
+    }
+    for(int key = 1; key < 2 * MAX_FROZEN_SIZE; key += 2)
+    {
+        deleteFromRBTree(t, &key);
+    }
+    check(RBTreeFreeze(t), "could not freeze a lazy tree");
+    checkEvenKeys(t, MAX_FROZEN_SIZE, "a frozen lazy tree reads wrong");
+    freeRBTree(&t);
+    printf("\n\n*****passed the test of frozen trees*****\n\n");
+}
+
+size_t encodeInt(const void* item, void* buffer, size_t size)
+{
+    if(size >= sizeof(int))
+    {
+        memcpy(buffer, item, sizeof(int));
+    }
+    return sizeof(int);
+}
+
+void* decodeInt(const void* buffer, size_t size)
+{
+    int* item = size == sizeof(int) ? malloc(sizeof(int)) : NULL;
+    if(item != NULL)
+    {
+        memcpy(item, buffer, sizeof(int));
+    }
+    return item;
+}
+
+size_t intToString(const void* item, char* buffer, size_t size)
+{
+    return (size_t) snprintf(buffer, size, "%d", *((const int*) item));
+}
+
+size_t encodeString(const void* item, void* buffer, size_t size)
+{
+    size_t length = strlen((const char*) item);
+    if(size >= length)
+    {
+        memcpy(buffer, item, length);
+    }
+    return length;
+}
+
+void* decodeString(const void* buffer, size_t size)
+{
+    char* item = (char*) malloc(size + 1);
+    if(item != NULL)
+    {
+        memcpy(item, buffer, size);
+        item[size] = '\0';
+    }
+    return item;
+}
+
+size_t copyString(const void* item, char* buffer, size_t size)
+{
+    return (size_t) snprintf(buffer, size, "%s", (const char*) item);
+}
+
+/**
+ * @brief writes a sorted stream of ints by hand, in the documented layout: "RBTS", the version and
+ * the number of items, then each item as its length and its bytes, the numbers little endian.
+ */
+FILE* intStream(const char* magic, int version, const int* items, int n)
+{
+    FILE* file = tmpfile();
+    check(file != NULL, "could not open a temporary file");
+    fwrite(magic, 1, 4, file);
+    for(int i = 0; i < 4; i++)
+    {
+        fputc((version >> (8 * i)) & 0xff, file);
+    }
+    for(int i = 0; i < 8; i++)
+    {
+        fputc(i < 4 ? (n >> (8 * i)) & 0xff : 0, file);
+    }
+    for(int i = 0; i < n; i++)
+    {
+        fputc((int) sizeof(int), file);
+        fputc(0, file);
+        fputc(0, file);
+        fputc(0, file);
+        fwrite(&items[i], sizeof(int), 1, file);
+    }
+    rewind(file);
+    return file;
+}
+
+/**
+ * @brief reads a hand-written stream of ints, and closes it.
+ * @return the tree, or NULL if the stream was refused.
+ */
+RBTree* readIntStream(FILE* file)
+{
+    RBTree* t = RBTreeReadSorted(file, (CompareFunc) &compInt, free, decodeInt);
+    fclose(file);
+    return t;
+}
+
+/**
+ * @brief writes a tree of ints as RBTreeWriteJSON should, with fprintf, node by node.
+ */
+void referenceJSON(const Node* node, FILE* file)
+{
+    if(node == NULL)
+    {
+        fputs("null", file);
+        return;
+    }
+    fprintf(file, "{\n\"data\": \"%d\",\n\"color\": \"%s\",\n\"left\": ", *((int*) node->data),
+            rbColor(node) == RED ? "r" : "b");
+    referenceJSON(node->left, file);
+    fputs(",\n\"right\": ", file);
+    referenceJSON(node->right, file);
+    fputs("}", file);
+}
+
+/**
+ * @return true if the two files hold the same bytes.
+ */
+bool sameBytes(FILE* first, FILE* second)
+{
+    rewind(first);
+    rewind(second);
+    int c;
+    do
+    {
+        c = fgetc(first);
+        if(c != fgetc(second))
+        {
+            return false;
+        }
+    } while(c != EOF);
+    return true;
+}
+
+void streamTree()
+{
+    // strings of every length up to twice the write buffer, so both sides grow their buffers
+    RBTree* t = newRBTree((CompareFunc) &stringCompare, (FreeFunc) &freeString);
+    for(int length = 0; length <= 8192; length += (length < 64) ? 1 : 1021)
+    {
+        char* item = (char*) malloc(length + 1);
+        check(item != NULL, "out of memory");
+        memset(item, 'a' + length % 26, length);
+        item[length] = '\0';
+        insertToRBTree(t, item);
+    }
+    FILE* file = tmpfile();
+    check(file != NULL && RBTreeWriteSorted(t, file, encodeString), "could not write a stream");
+
+    // the header: the magic bytes, version 1 and the number of items, little endian
+    unsigned char header[16];
+    rewind(file);
+    check(fread(header, 1, 16, file) == 16 && memcmp(header, "RBTS\1\0\0\0", 8) == 0 &&
+          header[8] == t->size && header[9] == 0, "the header of a stream is wrong");
+    rewind(file);
+    RBTree* read = RBTreeReadSorted(file, (CompareFunc) &stringCompare, (FreeFunc) &freeString,
+                                    decodeString);
+    fclose(file);
+    check(read != NULL && isValidRBTree(read) && read->size == t->size, "could not read a stream");
+    for(Node* a = RBTreeBegin(t), * b = RBTreeBegin(read); a != RBTreeEnd(t);
+        a = RBTreeNext(t, a), b = RBTreeNext(read, b))
+    {
+        check(strcmp(a->data, b->data) == 0, "a stream read back wrong");
+    }
+    freeRBTree(&read);
+    freeRBTree(&t);
+
+    // streams written by hand: a good one is read, and every broken one is refused
+    int ascending[] = {1, 3, 5};
+    int unsorted[] = {1, 5, 3};
+    int repeated[] = {1, 3, 3};
+    t = readIntStream(intStream("RBTS", 1, ascending, 3));
+    check(t != NULL && t->size == 3 && *((int*) RBTreeMax(t)->data) == 5, "a stream was misread");
+    freeRBTree(&t);
+    check(readIntStream(intStream("RBTS", 2, ascending, 3)) == NULL, "read a stream of another version");
+    check(readIntStream(intStream("RBTX", 1, ascending, 3)) == NULL, "read a stream without the magic");
+    check(readIntStream(intStream("RBTS", 1, unsorted, 3)) == NULL, "read a stream out of order");
+    check(readIntStream(intStream("RBTS", 1, repeated, 3)) == NULL, "read a stream with a repeat");
+    file = intStream("RBTS", 1, ascending, 3);
+    FILE* cut = tmpfile();
+    check(cut != NULL, "could not open a temporary file");
+    for(size_t i = 0; i + 1 < 16 + 3 * (4 + sizeof(int)); i++)
+    {
+        fputc(fgetc(file), cut);
+    }
+    fclose(file);
+    rewind(cut);
+    check(readIntStream(cut) == NULL, "read a cut stream");
+
+    // JSON, through its fixed buffer, against the same JSON written node by node
+    bool present[RANDOM_KEYS];
+    t = keyTree(present, RANDOM_KEYS);
+    file = tmpfile();
+    FILE* expected = tmpfile();
+    check(file != NULL && expected != NULL && RBTreeWriteJSON(t, file, intToString),
+          "could not write a tree as JSON");
+    referenceJSON(t->root, expected);
+    fputs("\n", expected);
+    check(sameBytes(file, expected), "the JSON of a tree is wrong");
+    fclose(file);
+    fclose(expected);
+    freeRBTree(&t);
+
+    // quotes, backslashes and control characters are escaped
+    t = newRBTree((CompareFunc) &stringCompare, (FreeFunc) &freeString);
+    char* item = (char*) malloc(16);
+    check(item != NULL, "out of memory");
+    strcpy(item, "say \"hi\"\\\n");
+    insertToRBTree(t, item);
+    file = tmpfile();
+    expected = tmpfile();
+    check(file != NULL && expected != NULL && RBTreeWriteJSON(t, file, copyString),
+          "could not write a tree as JSON");
+    fputs("{\n\"data\": \"say \\\"hi\\\"\\\\\\u000a\",\n\"color\": \"b\",\n"
+          "\"left\": null,\n\"right\": null}\n", expected);
+    check(sameBytes(file, expected), "a string was not escaped in JSON");
+    fclose(file);
+    fclose(expected);
+    freeRBTree(&t);
+    printf("\n\n*****passed the test of sorted streams*****\n\n");
+}
+
+/**
+ * @brief makes an image of the even keys 0 to 2 (keys - 1) at path
+ */
+void saveEvenKeys(const char* path, int keys)
+{
+    RBTree* t = newRBTree((CompareFunc) &compInt, free);
+    for(int key = 0; key < keys; key++)
+    {
+        insertToRBTree(t, newInt(2 * key));
+    }
+    check(RBTreeSave(t, path, encodeInt), "could not save an image");
+    freeRBTree(&t);
+}
+
+/**
+ * @brief checks that every item of a mapped tree lies in its own image
+ */
+bool itemsInImage(const RBTree* t)
+{
+    for(Node* node = RBTreeBegin(t); node != RBTreeEnd(t); node = RBTreeNext(t, node))
+    {
+        char* item = node->data;
+        if(item < (char*) t->image || item >= (char*) t->image + t->imageBytes)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void mapTreeImage()
+{
+    const char* dir = getenv("TMPDIR");
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/rbtree_image_XXXXXX",
+             (dir != NULL && *dir != '\0') ? dir : "/tmp");
+    int fd = mkstemp(path);
+    check(fd >= 0, "could not make a temporary image file");
+    close(fd);
+    for(int keys = 0; keys <= MAX_FROZEN_SIZE; keys += 5)
+    {
+        saveEvenKeys(path, keys);
+        RBTree* first = RBTreeMap(path, (CompareFunc) &compInt);
+        check(first != NULL, "could not map an image");
+        checkEvenKeys(first, keys, "a mapped image reads wrong");
+        int key = 0;
+        check(!deleteFromRBTree(first, &key) && !insertToRBTree(first, &key),
+              "a mapped image was changed");
+
+        // the first mapping holds the address the image is laid out for, so the second one is
+        // mapped elsewhere and its items are moved, and it must still read once the first is gone
+        RBTree* second = RBTreeMap(path, (CompareFunc) &compInt);
+        check(second != NULL && second->image != first->image, "could not map an image twice");
+        check(itemsInImage(first) && itemsInImage(second), "the items of an image were not moved");
+
+        // an item of the image that points outside its items is refused when it is moved
+        char* bytes = malloc(first->imageBytes);
+        check(bytes != NULL, "out of memory");
+        memcpy(bytes, first->image, first->imageBytes);
+        size_t imageBytes = first->imageBytes;
+        if(keys > 0)
+        {
+            Node* slot = (Node*) (bytes + ((char*) first->frozen - (char*) first->image) +
+                                  first->nodeBytes);
+            slot->data = (char*) first->image + first->imageBytes;
+        }
+
+        // the new file is only seen by new mappings, and first still holds the address
+        remove(path);
+        FILE* file = fopen(path, "wb");
+        check(file != NULL && fwrite(bytes, 1, imageBytes, file) == imageBytes && fclose(file) == 0,
+              "could not write an image");
+        RBTree* corrupt = RBTreeMap(path, (CompareFunc) &compInt);
+        check((corrupt == NULL) == (keys > 0), "mapped an image that points outside its items");
+        if(corrupt != NULL)
+        {
+            freeRBTree(&corrupt);
+        }
+        freeRBTree(&first);
+        checkEvenKeys(second, keys, "a moved image reads wrong");
+        freeRBTree(&second);
+
+        // an image cut short is refused
+        file = fopen(path, "wb");
+        check(file != NULL && fwrite(bytes, 1, imageBytes - 1, file) == imageBytes - 1 &&
+              fclose(file) == 0, "could not write an image");
+        check(RBTreeMap(path, (CompareFunc) &compInt) == NULL, "mapped an image cut short");
+        free(bytes);
+    }
+    remove(path);
+    check(RBTreeMap(path, (CompareFunc) &compInt) == NULL, "mapped a missing image");
+    printf("\n\n*****passed the test of mapped images*****\n\n");
+}
+
+int sign(int x)
+{
+    return (x > 0) - (x < 0);
+}
+
+int compareVectorsScalar(const Vector* a, const Vector* b)
+{
+    for(int i = 0; i < a->len && i < b->len; i++)
+    {
+        if(a->vector[i] != b->vector[i])
+        {
+            return a->vector[i] < b->vector[i] ? -1 : 1;
+        }
+    }
+    return sign(a->len - b->len);
+}
+
+void simdVectors()
+{
+    // few distinct values, so that many pairs share long prefixes.
+    Vector* vectors[SIMD_VECTORS];
+    for(int i = 0; i < SIMD_VECTORS; i++)
+    {
+        vectors[i] = randomVector(MAX_SIMD_LENGTH + 1);
+        double norm = 0;
+        for(int j = 0; j < vectors[i]->len; j++)
+        {
+            double value = rand() % 8 == 0 ? (rand() % 3) - 1.5 : 0.5;
+            vectors[i]->vector[j] = value;
+            norm += value * value;
+        }
+        double error = vectorSquaredNorm(vectors[i]) - norm;
+        check(error <= 1e-9 * (norm + 1) && -error <= 1e-9 * (norm + 1), "wrong squared norm");
+    }
+    for(int i = 0; i < SIMD_VECTORS; i++)
+    {
+        for(int j = 0; j < SIMD_VECTORS; j++)
+        {
+            check(sign(vectorCompare1By1(vectors[i], vectors[j])) ==
+                  compareVectorsScalar(vectors[i], vectors[j]), "vectors compare wrong");
+        }
+    }
+    for(int i = 0; i < SIMD_VECTORS; i++)
+    {
+        freeVector(vectors[i]);
+    }
+    printf("\n\n*****passed the test of vector kernels*****\n\n");
+}
+
+int maxSquaredNorm(const void* object, void* args)
+{
+    double norm = vectorSquaredNorm(object);
+    if(norm > *((double*) args))
+    {
+        *((double*) args) = norm;
+    }
+    return 1;
+}
+
+void checkMaxNorm(RBTree* t, const char* what)
+{
+    double expected = -1;
+    forEachRBTree(t, maxSquaredNorm, &expected);
+    Vector* found = findMaxNormVectorInTree(t);
+    check(found != NULL && vectorSquaredNorm(found) == expected, what);
+    freeVector(found);
+    found = parallelFindMaxNormVectorInTree(t, PARALLEL_THREADS);
+    check(found != NULL && vectorSquaredNorm(found) == expected, what);
+    freeVector(found);
+}
+
+void normTree()
+{
+    RBTree* plain = newRBTree((CompareFunc) &vectorCompare1By1, (FreeFunc) &freeVector);
+    RBTree* normed = newRBTree((CompareFunc) &vectorCompare1By1, (FreeFunc) &freeVector);
+    check(RBTreeEnableSubtreeMax(normed, normedVectorSquaredNorm), "could not keep subtree maxima");
+    for(int i = 0; i < NORM_VECTORS; i++)
+    {
+        int length = 1 + rand() % MAX_VECTOR_LENGTH_CHECK;
+        Vector* vector = newVector(length);
+        NormedVector* normedVector = newNormedVector(length);
+        check(vector != NULL && normedVector != NULL, "out of memory");
+        for(int j = 0; j < length; j++)
+        {
+            double value = rand() % MAX_VECTOR_DATA_VALUE - MAX_VECTOR_DATA_VALUE / 2;
+            vectorSet(vector, j, value);
+            normedVectorSet(normedVector, j, value);
+        }
+        check(normedVectorSquaredNorm(normedVector) == vectorSquaredNorm(vector),
+              "a cached norm is not the norm");
+        if(!insertToRBTree(plain, vector) || !insertToRBTree(normed, normedVector))
+        {
+            printf("ERROR - could not insert a vector\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    checkMaxNorm(plain, "the largest norm of a tree was not found");
+    checkMaxNorm(normed, "the largest norm of a tree of normed vectors was not found");
+    for(int i = 0; i < NORM_DELETES; i++)
+    {
+        check(deleteFromRBTree(normed, RBTreeMaxByMeasure(normed)), "could not delete the largest");
+        check(isValidRBTree(normed), "deleting the largest norm broke the subtree maxima");
+    }
+    checkMaxNorm(normed, "the largest norm was not found after deletions");
+    freeRBTree(&plain);
+    freeRBTree(&normed);
+
+    // vectors built by hand have nothing but their elements
+    double elements[] = {3, 4};
+    Vector hand = {2, elements};
+    Vector max = {0, NULL};
+    check(copyIfNormIsLarger(&hand, &max) && max.len == 2 && vectorSquaredNorm(&max) == 25,
+          "a vector built by hand was not copied");
+    free(max.vector);
+    printf("\n\n*****passed the test of vector norms*****\n\n");
+}
+
+/**
+ * @brief a random string over a tiny alphabet (with a char above 127), so that many strings
+ * share prefixes longer than the prefix of a StringKey.
+ */
+char* sharedPrefixString()
+{
+    static const char alphabet[] = {'a', 'b', (char) 0xe9};
+    int length = rand() % (MAX_STRING_KEY_LENGTH + 1);
+    char* s = (char*) malloc(length + 1);
+    check(s != NULL, "could not allocate a string");
+    for(int i = 0; i < length; i++)
+    {
+        s[i] = rand() % 4 == 0 ? alphabet[rand() % 3] : 'a';
+    }
+    s[length] = '\0';
+    return s;
+}
+
+void stringKeys()
+{
+    char* strings[STRING_KEYS];
+    StringKey* keys[STRING_KEYS];
+    StringKey* again[STRING_KEYS];
+    StringTable* table = newStringTable();
+    check(table != NULL, "could not allocate a string table");
+    RBTree* t = newRBTree((CompareFunc) &stringCompare, (FreeFunc) &freeString);
+    size_t joinedBytes = 1;
+    for(int i = 0; i < STRING_KEYS; i++)
+    {
+        strings[i] = sharedPrefixString();
+        keys[i] = internString(table, strings[i]);
+        check(keys[i] != NULL && strcmp(keys[i]->chars, strings[i]) == 0, "could not intern");
+        char* copy = (char*) malloc(strlen(strings[i]) + 1);
+        check(copy != NULL, "could not allocate a string");
+        strcpy(copy, strings[i]);
+        if(insertToRBTree(t, copy))
+        {
+            joinedBytes += strlen(copy) + 1;
+        }
+        else
+        {
+            free(copy);
+        }
+    }
+    for(int i = 0; i < STRING_KEYS; i++)
+    {
+        again[i] = internString(table, strings[i]);
+        check(again[i] == keys[i], "equal strings were not interned to one key");
+        for(int j = 0; j < STRING_KEYS; j++)
+        {
+            int expected = sign(strcmp(strings[i], strings[j]));
+            check(sign(stringKeyCompare(keys[i], keys[j])) == expected &&
+                  stringKeyEquals(keys[i], keys[j]) == (expected == 0) &&
+                  (expected != 0 || keys[i] == keys[j]), "string keys compare wrong");
+        }
+    }
+    for(int i = 0; i < STRING_KEYS; i++)
+    {
+        long unsigned holders = 0;
+        for(int j = 0; j < STRING_KEYS; j++)
+        {
+            holders += strcmp(strings[i], strings[j]) == 0 ? 2 : 0;
+        }
+        check(keys[i]->refs == holders, "an interned key counts its holders wrong");
+    }
+
+    char* concatenated = (char*) calloc(joinedBytes, 1);
+    StringJoin join = {(char*) calloc(joinedBytes, 1), 0};
+    check(concatenated != NULL && join.buffer != NULL &&
+          forEachRBTree(t, concatenate, concatenated) && forEachRBTree(t, joinString, &join) &&
+          strcmp(concatenated, join.buffer) == 0 && join.length == strlen(concatenated),
+          "joined strings differ from concatenated ones");
+    free(concatenated);
+    free(join.buffer);
+    freeRBTree(&t);
+
+    // the keys outlive their table, and are freed by their last holder.
+    freeStringTable(&table);
+    check(table == NULL, "a freed string table was kept");
+    for(int i = 0; i < STRING_KEYS; i++)
+    {
+        freeStringKey(keys[i]);
+        freeStringKey(again[i]);
+        free(strings[i]);
+    }
+    printf("\n\n*****passed the test of string keys*****\n\n");
+}
+
+typedef struct Interval
+{
+    double low;
+    double high;
+} Interval;
+
+typedef struct OverlapScan
+{
+    double low;
+    double high;
+    long count;
+    const Interval* last;
+    bool ordered;
+} OverlapScan;
+
+double intervalLow(const void* item)
+{
+    return ((const Interval*) item)->low;
+}
+
+double intervalHigh(const void* item)
+{
+    return ((const Interval*) item)->high;
+}
+
+int compInterval(const void* a, const void* b)
+{
+    const Interval* first = (const Interval*) a;
+    const Interval* second = (const Interval*) b;
+    if(first->low != second->low)
+    {
+        return (first->low > second->low) - (first->low < second->low);
+    }
+    return (first->high > second->high) - (first->high < second->high);
+}
+
+int countOverlap(const void* object, void* args)
+{
+    const Interval* interval = (const Interval*) object;
+    OverlapScan* scan = (OverlapScan*) args;
+    if(interval->low <= scan->high && interval->high >= scan->low)
+    {
+        scan->count++;
+    }
+    return 1;
+}
+
+int scanOverlap(const void* object, void* args)
+{
+    OverlapScan* scan = (OverlapScan*) args;
+    const Interval* interval = (const Interval*) object;
+    scan->ordered = scan->ordered && (scan->last == NULL || compInterval(scan->last, interval) < 0) &&
+                    interval->low <= scan->high && interval->high >= scan->low;
+    scan->last = interval;
+    scan->count++;
+    return 1;
+}
+
+void checkOverlaps(const RBTree* t, const char* what)
+{
+    for(int i = 0; i < INTERVAL_QUERIES; i++)
+    {
+        double low = rand() % MAX_INT_VALUE_CHECK;
+        double high = (i % 4 == 0) ? low : low + rand() % (MAX_INTERVAL_LENGTH * 4);
+        OverlapScan expected = {low, high, 0, NULL, true};
+        OverlapScan found = {low, high, 0, NULL, true};
+        forEachRBTree(t, countOverlap, &expected);
+        check(forEachOverlapRBTree(t, low, high, scanOverlap, &found) && found.ordered &&
+              found.count == expected.count, what);
+    }
+}
+
+void intervalTree()
+{
+    RBTree* t = newIntervalTree(compInterval, free, intervalLow, intervalHigh);
+    check(t != NULL, "could not create an interval tree");
+    for(int i = 0; i < INTERVALS; i++)
+    {
+        Interval* interval = malloc(sizeof(Interval));
+        check(interval != NULL, "out of memory");
+        interval->low = rand() % MAX_INT_VALUE_CHECK;
+        interval->high = interval->low + rand() % MAX_INTERVAL_LENGTH;
+        if(!insertToRBTree(t, interval))
+        {
+            free(interval);
+        }
+    }
+    check(isValidRBTree(t), "an interval tree is not valid");
+    checkOverlaps(t, "an overlap query missed intervals");
+
+    // deleted intervals are not reported
+    for(int i = 0; i < INTERVALS / 4; i++)
+    {
+        deleteFromRBTree(t, RBTreeMaxByMeasure(t));
+    }
+    check(isValidRBTree(t), "deleting intervals broke the subtree maxima");
+    checkOverlaps(t, "an overlap query missed intervals after deletions");
+    freeRBTree(&t);
+    printf("\n\n*****passed the test of interval trees*****\n\n");
+}
+
+void sumAugment(const RBTree* tree, void* summary, const void* item, const void* left,
+                const void* right)
+{
+    (void) tree;
+    long sum = *((const int*) item);
+    sum += (left == NULL) ? 0 : *((const long*) left);
+    sum += (right == NULL) ? 0 : *((const long*) right);
+    *((long*) summary) = sum;
+}
+
+/**
+ * @brief checks the summary of every node of a sumAugment tree against a sum of its subtree.
+ * @return the sum of the subtree of node.
+ */
+long checkSums(const RBTree* t, const Node* node)
+{
+    if(node == NULL)
+    {
+        return 0;
+    }
+    long sum = *((const int*) node->data) + checkSums(t, node->left) + checkSums(t, node->right);
+    check(*((const long*) RBTreeSummary(t, node)) == sum, "a summary is not the sum of its subtree");
+    return sum;
+}
+
+void augmentTree()
+{
+    bool present[RANDOM_KEYS] = {false};
+    RBTree* t = newRBTree((CompareFunc) &compInt, free);
+    check(RBTreeEnableAugment(t, sumAugment, sizeof(long)), "could not enable augmentation");
+    for(int round = 0; round < 5; round++)
+    {
+        randomOps(t, present, RANDOM_KEYS, RANDOM_OPS / 5, "an augmented tree");
+        long expected = 0;
+        for(int key = 0; key < RANDOM_KEYS; key++)
+        {
+            expected += present[key] ? key : 0;
+        }
+        check(checkSums(t, t->root) == expected, "the summary of the root is not the sum");
+
+        // splits and joins keep the summaries along the spines they rebuild
+        RBTree* lo;
+        RBTree* hi;
+        int key = rand() % RANDOM_KEYS;
+        check(RBTreeSplit(t, &key, &lo, &hi), "could not split an augmented tree");
+        check(checkSums(lo, lo->root) + checkSums(hi, hi->root) == expected,
+              "a split lost the sums");
+        check(RBTreeJoin(lo, NULL, hi) && checkSums(lo, lo->root) == expected && isValidRBTree(lo),
+              "a join lost the sums");
+        freeRBTree(&hi);
+        freeRBTree(&t);
+        t = lo;
+    }
+    checkKeys(t, present, RANDOM_KEYS, "an augmented tree after splits and joins");
+    freeRBTree(&t);
+    printf("\n\n*****passed the test of augmented trees*****\n\n");
+}
+
+void statsTree()
+{
+    bool present[RANDOM_KEYS] = {false};
+    RBTree* t = newRBTree((CompareFunc) &compInt, free);
+    long unsigned inserts = 0, deletes = 0;
+    for(int i = 0; i < RANDOM_OPS; i++)
+    {
+        int key = rand() % RANDOM_KEYS;
+        if(rand() % 3 != 0)
+        {
+            int* item = newInt(key);
+            check(insertToRBTree(t, item) == !present[key], "an insert returned wrong");
+            inserts += !present[key];
+            if(present[key])
+            {
+                free(item);
+            }
+            present[key] = true;
+        }
+        else
+        {
+            check(deleteFromRBTree(t, &key) == present[key], "a delete returned wrong");
+            deletes += present[key];
+            present[key] = false;
+        }
+    }
+    check(isValidRBTree(t), "a counted tree is not valid");
+
+    RBTreeStats stats;
+    check(RBTreeGetStats(t, &stats), "no statistics");
+    int maxHeight = 0;
+    for(long unsigned n = t->size + 1; n > 1; n /= 2)
+    {
+        maxHeight += 2;
+    }
+    check(stats.size == t->size && stats.height <= maxHeight && stats.height == treeHeight(t->root) &&
+          stats.nodeBytes >= sizeof(Node) &&
+          (t->size == 0 || (stats.averageDepth >= 1 && stats.averageDepth <= stats.height)) &&
+          stats.totalNodeBytes >= t->size * stats.nodeBytes, "the shape of a tree is wrong");
+#ifdef RB_TREE_STATS
+    check(stats.counted, "RB_TREE_STATS is defined and nothing was counted");
+#endif
+    if(stats.counted)
+    {
+        check(stats.inserts == inserts && stats.deletes == deletes &&
+              stats.nodeAllocations == inserts && stats.nodeReleases == deletes,
+              "the updates were counted wrong");
+        check(stats.rotations == stats.insertSingleRotations + 2 * stats.insertDoubleRotations +
+              stats.deleteCaseB + stats.deleteCaseD + stats.deleteCaseE,
+              "the rotations were counted wrong");
+
+        // a lookup compares once per level
+        RBTreeResetStats(t);
+        for(int key = 0; key < RANDOM_KEYS; key++)
+        {
+            check((RBTreeFind(t, &key) != NULL) == present[key], "a lookup returned wrong");
+        }
+        int height = stats.height;
+        check(RBTreeGetStats(t, &stats) && stats.lookups == RANDOM_KEYS && stats.inserts == 0 &&
+              stats.comparisons <= (long unsigned) RANDOM_KEYS * height &&
+              stats.size == t->size, "the lookups were counted wrong");
+    }
+    else
+    {
+        check(stats.inserts == 0 && stats.deletes == 0 && stats.lookups == 0 &&
+              stats.comparisons == 0, "counted without RB_TREE_STATS");
+    }
+    freeRBTree(&t);
+
+    // the memory of the nodes: whole slabs for a pooled tree, nothing for an intrusive one
+    t = newRBTreeWithPool((CompareFunc) &compInt, free, 8);
+    for(int key = 0; key < RANDOM_KEYS; key++)
+    {
+        insertToRBTree(t, newInt(key));
+    }
+    RBTreeStats full;
+    check(RBTreeGetStats(t, &full) && full.totalNodeBytes >= RANDOM_KEYS * full.nodeBytes,
+          "the slabs are too small for the tree");
+    for(int key = 0; key < RANDOM_KEYS; key++)
+    {
+        deleteFromRBTree(t, &key);
+    }
+    for(int key = 0; key < RANDOM_KEYS; key++)
+    {
+        insertToRBTree(t, newInt(key));
+    }
+    check(RBTreeGetStats(t, &stats) && stats.totalNodeBytes == full.totalNodeBytes,
+          "a refilled pooled tree took new slabs");
+    freeRBTree(&t);
+    t = newIntrusiveRBTree((CompareFunc) &compInt, free, RB_HOOK_OFFSET(Record, hook));
+    for(int key = 0; key < RANDOM_KEYS; key++)
+    {
+        Record* record = malloc(sizeof(Record));
+        check(record != NULL, "out of memory");
+        record->key = key;
+        insertToRBTree(t, record);
+    }
+    check(RBTreeGetStats(t, &stats) && stats.size == RANDOM_KEYS && stats.totalNodeBytes == 0 &&
+          stats.nodeAllocations == 0, "an intrusive tree allocated nodes");
+    freeRBTree(&t);
+    printf("\n\n*****passed the test of statistics*****\n\n");
+}
+
+RBTree* validatorSample(void)
+{
+    RBTree* t = newRBTree((CompareFunc) &compInt, free);
+    for(int i = 0; i < VALIDATOR_KEYS; i++)
+    {
+        insertToRBTree(t, newInt(i * VALIDATOR_PRIME % VALIDATOR_KEYS));
+    }
+    return t;
+}
+
+void expectViolation(RBTree* t, RBViolation violation, const char* what)
+{
+    RBValidation result;
+    check(!RBTreeValidate(t, &result) && result.violation == violation, what);
+}
+
+void validatorTree()
+{
+    RBTree* t = validatorSample();
+    RBValidation result;
+    check(RBTreeValidate(t, &result) && result.nodes == VALIDATOR_KEYS, "a valid tree was rejected");
+    rbSetColor(t->root, RED);
+    expectViolation(t, RB_RED_ROOT, "a red root was not found");
+    rbSetColor(t->root, BLACK);
+    void* data = t->root->left->data;
+    t->root->left->data = t->root->right->data;
+    expectViolation(t, RB_ORDER, "an item out of order was not found");
+    t->root->left->data = data;
+    t->size++;
+    expectViolation(t, RB_SIZE, "a wrong size was not found");
+    t->size--;
+    Node* leftmost = t->leftmost;
+    t->leftmost = t->root;
+    expectViolation(t, RB_ENDS, "a wrong cached end was not found");
+    t->leftmost = leftmost;
+    check(isValidRBTree(t), "a restored tree was rejected");
+    freeRBTree(&t);
+
+    // the extras the nodes keep
+    t = newRBTree((CompareFunc) &compInt, free);
+    check(RBTreeEnableOrderStatistics(t), "could not enable order statistics");
+    for(int i = 0; i < VALIDATOR_KEYS; i++)
+    {
+        insertToRBTree(t, newInt(i));
+    }
+    Node* leaf = t->leftmost;
+    Node* parent = rbParent(leaf);
+    parent->left = NULL;
+    expectViolation(t, RB_SUBTREE_SIZE, "a wrong subtree size was not found");
+    parent->left = leaf;
+    check(isValidRBTree(t), "a tree with order statistics was rejected");
+    freeRBTree(&t);
+    t = newRBTree((CompareFunc) &compInt, free);
+    check(RBTreeEnableAugment(t, sumAugment, sizeof(long)), "could not enable augmentation");
+    for(int i = 0; i < VALIDATOR_KEYS; i++)
+    {
+        insertToRBTree(t, newInt(i));
+    }
+    check(isValidRBTree(t), "an augmented tree was rejected");
+    *((int*) t->rightmost->data) += 1;
+    expectViolation(t, RB_SUMMARY, "a wrong summary was not found");
+    freeRBTree(&t);
+
+    // a snapshot shares the nodes of the live tree, whose parent pointers change under it
+    t = newRBTree((CompareFunc) &compInt, free);
+    check(RBTreeEnableSnapshots(t), "could not enable snapshots");
+    for(int i = 0; i < VALIDATOR_KEYS; i += 2)
+    {
+        insertToRBTree(t, newInt(i));
+    }
+    RBTree* snapshot = RBTreeSnapshot(t);
+    for(int i = 1; i < VALIDATOR_KEYS; i += 2)
+    {
+        insertToRBTree(t, newInt(i));
+    }
+    check(isValidRBTree(t) && isValidRBTree(snapshot), "a tree with a snapshot was rejected");
+    check(snapshot->size == VALIDATOR_KEYS / 2 && t->size == VALIDATOR_KEYS, "a snapshot changed");
+    freeRBTree(&snapshot);
+    freeRBTree(&t);
+    printf("\n\n*****passed the test of the validator*****\n\n");
+}
+
+void tombstoneTree()
+{
+    bool present[LAZY_KEYS];
+    RBTree* t = newRBTree((CompareFunc) &compInt, free);
+    check(RBTreeEnableLazyDelete(t), "could not enable lazy deletion");
+    for(int key = 0; key < LAZY_KEYS; key++)
+    {
+        insertToRBTree(t, newInt(key));
+        present[key] = true;
+    }
+    for(int key = 0; key < LAZY_KEYS; key += 2)
+    {
+        check(deleteFromRBTree(t, &key), "a lazy delete failed");
+        present[key] = false;
+    }
+    check(t->tombstoneCount == LAZY_KEYS / 2, "a lazy delete did not leave a tombstone");
+    checkKeys(t, present, LAZY_KEYS, "a tombstone was visited");
+    long expected = 0;
+    forEachRBTree(t, sumItems, &expected);
+    long sums[PARALLEL_THREADS] = {0};
+    void* args[PARALLEL_THREADS];
+    for(int i = 0; i < PARALLEL_THREADS; i++)
+    {
+        args[i] = &sums[i];
+    }
+    check(parallelForEachRBTree(t, sumItems, addSums, args, PARALLEL_THREADS), "parallel visit failed");
+    check(sums[0] == expected && expected == (long) LAZY_KEYS * LAZY_KEYS / 4,
+          "the parallel visit did not skip the tombstones");
+    // a tombstone is still a node in memory, deleting it again must not bury it twice
+    int key = 1;
+    Node* node = RBTreeFindNode(t, &key);
+    check(deleteNodeFromRBTree(t, node) && !deleteNodeFromRBTree(t, node), "deleted a tombstone");
+    check(t->size == LAZY_KEYS / 2 - 1 && t->tombstoneCount == LAZY_KEYS / 2 + 1,
+          "deleting a tombstone changed the counts");
+    check(RBTreeCompact(t, LAZY_KEYS) == LAZY_KEYS / 2 + 1 && isValidRBTree(t),
+          "compaction after deleting a tombstone failed");
+
+    // an operation that is refused leaves the tombstones alone
+    check(deleteFromRBTree(t, &key) == 0 && deleteNodeFromRBTree(t, RBTreeMax(t)), "no tombstone");
+    RBTree* plain = newRBTree((CompareFunc) &compInt, free);
+    check(!RBTreeUnion(t, plain) && !RBTreeJoin(t, NULL, plain) && t->tombstoneCount == 1,
+          "a refused operation compacted the tree");
+    freeRBTree(&plain);
+    freeRBTree(&t);
+    printf("\n\n*****passed the test of tombstones*****\n\n");
+}
+
+int main()
+{
+    //intTree();
+    insertTree();
+    findTree();
+    poolTree();
+    colorTree();
+    intrusiveTree();
+    cursorTree();
+    boundTree();
+    rankTree();
+    bulkTree();
+    batchTree();
+    concurrentTree();
+    snapshotTree();
+    parallelTree();
+    joinSplitTree();
+    deleteTree();
+    hintTree();
+    mapTree();
+    multisetTree();
+    typedTree();
+    freezeTree();
+    streamTree();
+    mapTreeImage();
+    simdVectors();
+    normTree();
+    stringKeys();
+    intervalTree();
+    augmentTree();
+    statsTree();
+    validatorTree();
+    tombstoneTree();
+    stringTree();
+    vectorTree();
+    printf("\nPassed All tests!!\n");
+    return EXIT_SUCCESS;
+}